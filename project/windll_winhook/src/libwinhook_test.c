@@ -1,5 +1,7 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #if defined (_MSC_VER) 
 #define WINHOOK_IMPLEMENTATION
@@ -7,6 +9,7 @@
 #define WINHOOK_USESHELLCODE
 #endif
 #include "winhook.h"
+#include <psapi.h>
 
 void test_patchpattern()
 {
@@ -129,10 +132,285 @@ void test_startexeinject()
 #endif
 }
 
+// find hello exe and dll built by Makefile (hello64) or debug (hello64d), skip test if not found
+static BOOL test_hellofind(const char *testname, char *exepath, char *dllpath)
+{
+#ifdef _WIN64
+	const char *names[] = {"hello64", "hello64d"};
+#else
+	const char *names[] = {"hello32", "hello32d"};
+#endif
+	for(int i=0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		sprintf(exepath, "%s.exe", names[i]);
+		sprintf(dllpath, "%s.dll", names[i]);
+		if(GetFileAttributesA(exepath) != INVALID_FILE_ATTRIBUTES 
+			&& GetFileAttributesA(dllpath) != INVALID_FILE_ATTRIBUTES) return TRUE;
+	}
+	printf("[%s] %s.exe not found, skip\n", testname, names[0]);
+	return FALSE;
+}
+
+void test_startexeinjectex()
+{
+	printf("[test_startexeinjectex]\n");
+	char exepath[MAX_PATH], dllpath[MAX_PATH];
+	if(!test_hellofind("test_startexeinjectex", exepath, dllpath)) return;
+	FILE *fp = fopen(dllpath, "rb");
+	assert(fp != NULL);
+	fseek(fp, 0, SEEK_END);
+	size_t modsize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	void *mod = malloc(modsize);
+	fread(mod, 1, modsize, fp);
+	fclose(fp);
+	
+	// load by path and by memory in one stub
+	LPCSTR dllpaths[] = {dllpath};
+	const void *mods[] = {mod};
+	size_t modsizes[] = {modsize};
+	DWORD pid = winhook_startexeinjectex(exepath, NULL, dllpaths, 1, mods, modsizes, 1);
+	printf("[test_startexeinjectex] pid=%lu\n", pid);
+	assert(pid != 0);
+	HANDLE hprocess = OpenProcess(PROCESS_TERMINATE | SYNCHRONIZE, FALSE, pid);
+	assert(hprocess != NULL);
+	TerminateProcess(hprocess, 0); // the child is blocked in MessageBox
+	WaitForSingleObject(hprocess, INFINITE);
+	CloseHandle(hprocess);
+
+	// the bad reloc block or type is rejected before the process runs
+	PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mod + ((PIMAGE_DOS_HEADER)mod)->e_lfanew);
+	PIMAGE_DATA_DIRECTORY pRelocEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+	PIMAGE_SECTION_HEADER pSectHeader = IMAGE_FIRST_SECTION(pNtHeader);
+	PIMAGE_BASE_RELOCATION pBaseReloc = NULL;
+	for(WORD i=0; i < pNtHeader->FileHeader.NumberOfSections; i++)
+	{
+		DWORD rva = pRelocEntry->VirtualAddress - pSectHeader[i].VirtualAddress;
+		if(pRelocEntry->VirtualAddress && rva < pSectHeader[i].SizeOfRawData)
+			pBaseReloc = (PIMAGE_BASE_RELOCATION)((uint8_t*)mod + pSectHeader[i].PointerToRawData + rva);
+	}
+	if(pBaseReloc)
+	{
+		DWORD sizeofblock = pBaseReloc->SizeOfBlock;
+		WORD item = *(WORD*)(pBaseReloc + 1);
+		pBaseReloc->SizeOfBlock = pRelocEntry->Size + sizeof(IMAGE_BASE_RELOCATION);
+		assert(winhook_startexeinjectex(exepath, NULL, NULL, 0, mods, modsizes, 1) == 0);
+		pBaseReloc->SizeOfBlock = 0;
+		assert(winhook_startexeinjectex(exepath, NULL, NULL, 0, mods, modsizes, 1) == 0);
+		pBaseReloc->SizeOfBlock = sizeofblock;
+		*(WORD*)(pBaseReloc + 1) = (WORD)((IMAGE_REL_BASED_HIGHADJ << 12) | (item & 0xfff));
+		assert(winhook_startexeinjectex(exepath, NULL, NULL, 0, mods, modsizes, 1) == 0);
+		*(WORD*)(pBaseReloc + 1) = item;
+	}
+
+	// no relocs can not be rebased to the remote buffer
+	WORD characteristics = pNtHeader->FileHeader.Characteristics;
+	pNtHeader->FileHeader.Characteristics |= IMAGE_FILE_RELOCS_STRIPPED;
+	assert(winhook_startexeinjectex(exepath, NULL, NULL, 0, mods, modsizes, 1) == 0);
+	pNtHeader->FileHeader.Characteristics = characteristics;
+	DWORD relocrva = pRelocEntry->VirtualAddress;
+	pRelocEntry->VirtualAddress = 0;
+	assert(winhook_startexeinjectex(exepath, NULL, NULL, 0, mods, modsizes, 1) == 0);
+	pRelocEntry->VirtualAddress = relocrva;
+	free(mod);
+}
+
+void test_injectdlls()
+{
+	// inject to self concurrently, a missing dll should not be loaded
+	HANDLE hprocesses[] = {GetCurrentProcess(), GetCurrentProcess()};
+	WINHOOK_INJECTRESULT results[2];
+	int loaded = winhook_injectdlls(hprocesses, 2, "version.dll", 5000, results);
+	printf("[test_injectdlls] loaded=%d, status=%lu %lu\n", loaded, results[0].status, results[1].status);
+	assert(loaded == 2 && results[0].status == WINHOOK_INJECT_LOADED && !results[0].remotebuf);
+	assert(results[0].hmod == (size_t)GetModuleHandleA("version.dll") && results[1].hmod == results[0].hmod);
+	loaded = winhook_injectdlls(hprocesses, 1, "notexist_winhook.dll", 5000, results);
+	assert(loaded == 0 && results[0].status == WINHOOK_INJECT_NOTLOADED && !results[0].hmod);
+	assert(winhook_injectdll(GetCurrentProcess(), "version.dll"));
+
+	// self and a child, then a dll blocked in DllMain (MessageBox) hits the deadline
+	char exepath[MAX_PATH], dllpath[MAX_PATH];
+	if(!test_hellofind("test_injectdlls", exepath, dllpath)) return;
+	STARTUPINFOA si = {0};
+	PROCESS_INFORMATION pi = {0};
+	si.cb = sizeof(si);
+	assert(CreateProcessA(exepath, NULL, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi));
+	WaitForInputIdle(pi.hProcess, 5000);
+	hprocesses[1] = pi.hProcess;
+	loaded = winhook_injectdlls(hprocesses, 2, "version.dll", 5000, results);
+	printf("[test_injectdlls] child pid=%lu loaded=%d, hmod=%p %p\n", 
+		pi.dwProcessId, loaded, (void*)results[0].hmod, (void*)results[1].hmod);
+	assert(loaded == 2 && results[1].status == WINHOOK_INJECT_LOADED && results[1].hmod);
+	HMODULE hmods[1024];
+	DWORD hmodsize = 0;
+	BOOL found = FALSE;
+	EnumProcessModules(pi.hProcess, hmods, sizeof(hmods), &hmodsize);
+	for(DWORD i=0; i < hmodsize / sizeof(HMODULE) && i < 1024; i++)
+	{
+		if((size_t)hmods[i] == results[1].hmod) found = TRUE;
+	}
+	assert(found);
+	DWORD start = GetTickCount();
+	loaded = winhook_injectdlls(&pi.hProcess, 1, dllpath, 200, results);
+	printf("[test_injectdlls] child loaded=%d, status=%lu, elapsed=%lu\n", 
+		loaded, results[0].status, GetTickCount() - start);
+	assert(loaded == 0 && results[0].status == WINHOOK_INJECT_TIMEOUT);
+	assert(results[0].hthread && results[0].remotebuf && GetTickCount() - start < 2000);
+	TerminateProcess(pi.hProcess, 0);
+	WaitForSingleObject(results[0].hthread, INFINITE);
+	CloseHandle(results[0].hthread);
+	CloseHandle(pi.hThread);
+	CloseHandle(pi.hProcess);
+}
+
+typedef struct _TEST_WATCHPROCESS
+{
+	char exepath[MAX_PATH];
+	char dllpath[MAX_PATH];
+	PROCESS_INFORMATION pi;
+	BOOL running; // start child not suspended
+	DWORD pid;
+	DWORD tid;
+	BOOL injected;
+	DWORD stoptick;
+} TEST_WATCHPROCESS;
+
+static DWORD WINAPI test_watchprocess_start(LPVOID arg)
+{
+	// keep main thread not started, so that hijacking it is safe
+	TEST_WATCHPROCESS *watch = (TEST_WATCHPROCESS*)arg;
+	STARTUPINFOA si = {sizeof(si)};
+	Sleep(200);
+	if(!CreateProcessA(watch->exepath, NULL, NULL, NULL, FALSE, 
+		watch->running ? 0 : CREATE_SUSPENDED, NULL, NULL, &si, &watch->pi)) return 0;
+	if(watch->running) return 0;
+	Sleep(2000);
+	ResumeThread(watch->pi.hThread);
+	return 0;
+}
+
+static BOOL test_watchprocess_callback(HANDLE hprocess, HANDLE hthread, DWORD pid, void *arg)
+{
+	TEST_WATCHPROCESS *watch = (TEST_WATCHPROCESS*)arg;
+	LPCSTR dllpaths[] = {watch->dllpath};
+	if(!watch->running) // hijacking a running thread is not safe
+	{
+		watch->injected = winhook_injectthreadex(hprocess, hthread, dllpaths, 1, NULL, NULL, 0);
+	}
+	printf("[test_watchprocess] pid=%lu hthread=%p inject=%d\n", pid, hthread, watch->injected);
+	watch->pid = pid;
+	watch->tid = hthread ? GetThreadId(hthread) : 0;
+	watch->stoptick = GetTickCount();
+	return FALSE;
+}
+
+void test_watchprocess()
+{
+	TEST_WATCHPROCESS watch = {0};
+	wchar_t exename[MAX_PATH] = {0};
+	if(!test_hellofind("test_watchprocess", watch.exepath, watch.dllpath)) return;
+	for(int i=0; watch.exepath[i]; i++) exename[i] = (wchar_t)watch.exepath[i];
+	HANDLE hthread = CreateThread(NULL, 0, test_watchprocess_start, &watch, 0, NULL);
+	int n = winhook_watchprocess(exename, 1000, 5000, test_watchprocess_callback, &watch);
+	DWORD elapse = GetTickCount() - watch.stoptick;
+	WaitForSingleObject(hthread, INFINITE);
+	CloseHandle(hthread);
+	printf("[test_watchprocess] n=%d, pid=%lu, return after %lu ms\n", n, watch.pid, elapse);
+	assert(n==1 && watch.pid && watch.injected);
+	assert(watch.pid == watch.pi.dwProcessId);
+	assert(elapse < 1000); // no sleep after callback stops
+
+	// check the dll is really loaded after main thread resumed
+	BOOL loaded = FALSE;
+	for(int i=0; i < 50 && !loaded; i++)
+	{
+		HMODULE hmods[0x400];
+		DWORD hmodsize = 0;
+		if(EnumProcessModules(watch.pi.hProcess, hmods, sizeof(hmods), &hmodsize))
+		{
+			for(DWORD j=0; j < hmodsize / sizeof(HMODULE); j++)
+			{
+				char name[MAX_PATH] = {0};
+				GetModuleBaseNameA(watch.pi.hProcess, hmods[j], name, sizeof(name));
+				if(_stricmp(name, watch.dllpath) == 0) loaded = TRUE;
+			}
+		}
+		if(!loaded) Sleep(100);
+	}
+	printf("[test_watchprocess] %s loaded=%d\n", watch.dllpath, loaded);
+	assert(loaded);
+	TerminateProcess(watch.pi.hProcess, 0);
+	CloseHandle(watch.pi.hThread);
+	CloseHandle(watch.pi.hProcess);
+}
+
+void test_watchprocess_running()
+{
+	// the child has run its loader threads, hthread should still be the main thread
+	TEST_WATCHPROCESS watch = {0};
+	wchar_t exename[MAX_PATH] = {0};
+	if(!test_hellofind("test_watchprocess_running", watch.exepath, watch.dllpath)) return;
+	for(int i=0; watch.exepath[i]; i++) exename[i] = (wchar_t)watch.exepath[i];
+	watch.running = TRUE;
+	HANDLE hthread = CreateThread(NULL, 0, test_watchprocess_start, &watch, 0, NULL);
+	int n = winhook_watchprocess(exename, 1000, 5000, test_watchprocess_callback, &watch);
+	WaitForSingleObject(hthread, INFINITE);
+	CloseHandle(hthread);
+	printf("[test_watchprocess_running] n=%d, pid=%lu, tid=%lu, main tid=%lu\n", 
+		n, watch.pid, watch.tid, watch.pi.dwThreadId);
+	assert(n==1 && watch.pid == watch.pi.dwProcessId);
+	assert(watch.tid == watch.pi.dwThreadId);
+	TerminateProcess(watch.pi.hProcess, 0);
+	WaitForSingleObject(watch.pi.hProcess, INFINITE);
+	CloseHandle(watch.pi.hThread);
+	CloseHandle(watch.pi.hProcess);
+}
+
 void test_windyn()
 {
 #ifdef WINDYN_IMPLEMENTATION
-// todo
+	const char *names[] = {"VirtualAlloc", "LoadLibraryA", "GetProcAddress", "HeapAlloc", "CloseHandle"};
+	uint32_t hashs[] = {WINDYN_HASH("VirtualAlloc"), WINDYN_HASH("LoadLibraryA"), 
+		WINDYN_HASH("GetProcAddress"), WINDYN_HASH("HeapAlloc"), WINDYN_HASH("CloseHandle")};
+	HMODULE kernel32 = NULL;
+	WINDYN_FINDKERNEL32(kernel32);
+	static INL_MODCACHE modcache;
+	for(int i=0; i<2; i++) // the second is from module cache
+	{
+		PPEB peb = NULL;
+		HMODULE kernel32_2 = NULL;
+		WINDYN_FINDMODULEEX(peb, "KERNEL32.DLL", kernel32_2, &modcache);
+		assert(kernel32_2 == kernel32);
+		assert(windyn_GetModuleHandleA("KERNEL32.DLL") == kernel32);
+	}
+	size_t indexsize = windyn_hashindex(kernel32, NULL, 0);
+	void *index = malloc(indexsize);
+	assert(windyn_hashindex(kernel32, index, indexsize) == indexsize);
+	for(int i=0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		FARPROC pfn = windyn_findapi(hashs[i]);
+		printf("[test_windyn] %s hash=%08x, pfn=%p\n", names[i], hashs[i], pfn);
+		assert(hashs[i] == inl_fnv1a32(names[i], strlen(names[i])));
+		assert(pfn && pfn == windyn_GetProcAddress(kernel32, names[i]));
+		assert(pfn == windyn_findhash(index, hashs[i]));
+	}
+	assert(windyn_findapi(WINDYN_HASH("NotExistApi")) == NULL);
+	free(index);
+
+	// shared index by findapiex, the same as findapi
+	PVOID volatile sharedindex = NULL;
+	for(int i=0; i < sizeof(names) / sizeof(names[0]); i++)
+	{
+		assert(windyn_findapiex(&sharedindex, hashs[i]) == windyn_findapi(hashs[i]));
+	}
+	assert(sharedindex);
+	VirtualFree(sharedindex, 0, MEM_RELEASE);
+
+#if defined(__GNUC__) && !defined(__cplusplus)
+	// static initializer must be constant, so it fails to compile if not folded (such as -O0)
+	static const uint32_t hashconst = WINDYN_HASH("VirtualAlloc");
+	assert(hashconst == hashs[0]);
+#endif
 #endif
 }
 
@@ -143,6 +421,10 @@ int main(int argc, char *argv[])
 	test_patchips();
 	test_searchpattern();
 	test_startexeinject();
+	test_startexeinjectex();
+	test_injectdlls();
+	test_watchprocess();
+	test_watchprocess_running();
 	test_windyn();
 	printf("%s finish!\n", argv[0]);
 	return 0;
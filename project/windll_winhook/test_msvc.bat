@@ -1,5 +1,5 @@
-msbuild %~dp0\libwinhook.sln -t:libwinhook_test:rebuild -p:configuration=debug -p:Platform=x86 
-msbuild %~dp0\libwinhook.sln -t:libwinhook_test:rebuild -p:configuration=debug -p:Platform=x64
+msbuild %~dp0\libwinhook.sln -t:libwinhook_test:rebuild;helloexe:rebuild;hellodll:rebuild -p:configuration=debug -p:Platform=x86 
+msbuild %~dp0\libwinhook.sln -t:libwinhook_test:rebuild;helloexe:rebuild;hellodll:rebuild -p:configuration=debug -p:Platform=x64
 pushd %~dp0\build
 libwinhook_test32d
 libwinhook_test64d
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #if defined (_MSC_VER) 
 #define WINPE_IMPLEMENTATION
@@ -32,9 +34,30 @@ void test_findgetprocaddress()
 void test_findmodulea(const char *modname)
 {
     void* hmod = (void*)GetModuleHandleA(modname);
-    void* hmod2 = (void*)winpe_findmodulea(modname);
+    void* hmod2 = NULL;
+    for(int i=0; i<2; i++) // the second is from module cache
+    {
+        hmod2 = (void*)winpe_findmodulea(modname);
+        assert(hmod==hmod2);
+    }
     printf("[test_findmodulea] modname=%s hmod=%p\n", modname, hmod2);
-    assert(hmod==hmod2);
+    PPEB peb = *(PPEB*)((uint8_t*)NtCurrentTeb() + (sizeof(size_t) > 4 ? 0x60 : 0x30));
+    assert(winpe_findmoduleaex(peb, modname)==hmod); // not use module cache
+}
+
+void test_findmodulecache(const char *modname)
+{
+    HMODULE hmod = LoadLibraryA(modname);
+    assert(hmod && winpe_findmodulea(modname)==hmod); // cached here
+    FreeLibrary(hmod);
+    HMODULE hmod2 = GetModuleHandleA(modname); // NULL if unloaded
+    void *hmod3 = winpe_findmodulea(modname); // stale slot is not used
+    printf("[test_findmodulecache] modname=%s hmod=%p hmod2=%p hmod3=%p\n", 
+        modname, hmod, hmod2, hmod3);
+    assert(hmod3==(void*)hmod2);
+    hmod2 = LoadLibraryA(modname);
+    assert(hmod2 && winpe_findmodulea(modname)==hmod2);
+    FreeLibrary(hmod2);
 }
 
 void test_memforwardexp(HMODULE hmod, const char *funcname)
@@ -46,11 +69,41 @@ void test_memforwardexp(HMODULE hmod, const char *funcname)
         (PFN_LoadLibraryA)winpe_findloadlibrarya(), 
         (PFN_GetProcAddress)winpe_memfindexp);
     void *func2 = winpe_memGetProcAddress(hmod, funcname);
+    static WINPE_FWDCACHE cache;
+    void *func3 = NULL;
+    for(int i=0; i<2; i++)
+    {
+        func3 = winpe_memforwardexpex(hmod, exprva, 
+            (PFN_LoadLibraryA)winpe_findloadlibrarya(), 
+            (PFN_GetProcAddress)winpe_memfindexp, &cache);
+    }
     printf("[test_memforwardexp] hmod=%p funcname=%s func=%p func2=%p\n", 
                 hmod, funcname, func, func2);
     assert(exprva!=0);
     assert((size_t)func==expva);
     assert(func2==func);
+    assert(func3==func);
+
+    // flush drops the slots of hmod, then it is resolved again
+    winpe_memforwardexpflush(&cache, hmod);
+    for(int i=0; i < WINPE_FWDCACHE_SLOTNUM; i++)
+    {
+        assert(!cache.slots[i].hash || cache.slots[i].dllbase != (size_t)hmod);
+    }
+    func3 = winpe_memforwardexpex(hmod, exprva, 
+        (PFN_LoadLibraryA)winpe_findloadlibrarya(), 
+        (PFN_GetProcAddress)winpe_memfindexp, &cache);
+    assert(func3==func);
+}
+
+void test_findapiseta(const char *apisetname)
+{
+    char hostname[MAX_PATH];
+    size_t hostlen = winpe_findapiseta(apisetname, NULL, hostname, sizeof(hostname));
+    printf("[test_findapiseta] apisetname=%s hostname=%s\n", 
+                apisetname, hostlen ? hostname : "");
+    assert(hostlen>0);
+    assert(LoadLibraryA(hostname)==LoadLibraryA(apisetname));
 }
 
 void test_memGetProcAddress(HMODULE hmod, const char *funcname)
@@ -62,17 +115,866 @@ void test_memGetProcAddress(HMODULE hmod, const char *funcname)
     assert(func==func2);
 }
 
+void test_memreloc(size_t npage)
+{
+    // make a fake pe32+ image with a fixup for each 8 bytes
+    size_t imagesize = 0x1000 + npage * 0x1000 + npage * (8 + 0x202 * 2);
+    imagesize = (imagesize + 0xfff) & ~0xfff;
+    uint8_t *mempe1 = (uint8_t*)VirtualAlloc(NULL, imagesize, MEM_COMMIT, PAGE_READWRITE);
+    uint8_t *mempe2 = (uint8_t*)VirtualAlloc(NULL, imagesize, MEM_COMMIT, PAGE_READWRITE);
+    assert(mempe1!=NULL && mempe2!=NULL);
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe1;
+    pDosHeader->e_magic = IMAGE_DOS_SIGNATURE;
+    pDosHeader->e_lfanew = sizeof(IMAGE_DOS_HEADER);
+    PIMAGE_NT_HEADERS64 pNtHeader = (PIMAGE_NT_HEADERS64)(mempe1 + pDosHeader->e_lfanew);
+    pNtHeader->Signature = IMAGE_NT_SIGNATURE;
+    pNtHeader->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER64);
+    pNtHeader->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR64_MAGIC;
+    pNtHeader->OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    pNtHeader->OptionalHeader.SizeOfImage = (DWORD)imagesize;
+    pNtHeader->OptionalHeader.ImageBase = 0x180000000;
+    DWORD relocrva = (DWORD)(0x1000 + npage * 0x1000);
+    DWORD relocsize = 0;
+    for(size_t i=0; i < npage; i++)
+    {
+        DWORD pagerva = (DWORD)(0x1000 + i * 0x1000);
+        PIMAGE_BASE_RELOCATION pBaseReloc = (PIMAGE_BASE_RELOCATION)(mempe1 + relocrva + relocsize);
+        WORD *pRelocItem = (WORD*)((uint8_t*)pBaseReloc + sizeof(IMAGE_BASE_RELOCATION));
+        pBaseReloc->VirtualAddress = pagerva;
+        for(DWORD j=0; j < 0x200; j++)
+        {
+            pRelocItem[j] = (IMAGE_REL_BASED_DIR64 << 12) | (j * 8);
+            *(uint64_t*)(mempe1 + pagerva + j * 8) = 0x180000000 + pagerva + j * 8;
+        }
+        pRelocItem[0x200] = IMAGE_REL_BASED_ABSOLUTE << 12;
+        pRelocItem[0x201] = IMAGE_REL_BASED_ABSOLUTE << 12;
+        pBaseReloc->SizeOfBlock = sizeof(IMAGE_BASE_RELOCATION) + 0x202 * sizeof(WORD);
+        relocsize += pBaseReloc->SizeOfBlock;
+    }
+    pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress = relocrva;
+    pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size = relocsize;
+    memcpy(mempe2, mempe1, imagesize);
+
+#ifdef _WIN64
+    size_t newbase = 0x7ff000000000;
+#else
+    size_t newbase = 0x70000000; // size_t base must fit in 32 bit
+#endif
+    DWORD t1 = GetTickCount();
+    size_t count1 = winpe_memreloc(mempe1, newbase);
+    DWORD t2 = GetTickCount();
+    size_t count2 = winpe_memrelocex(mempe2, newbase, 0);
+    DWORD t3 = GetTickCount();
+    printf("[test_memreloc] npage=%zu count=%zu memreloc %lums, memrelocex %lums\n", 
+                npage, count1, (unsigned long)(t2-t1), (unsigned long)(t3-t2));
+    assert(count1==npage * 0x200);
+    assert(count2==count1);
+    assert(*(uint64_t*)(mempe1 + 0x1008)==(uint64_t)newbase + 0x1008);
+    assert(memcmp(mempe1, mempe2, imagesize)==0);
+
+    // the last reloc block out of image is invalid, and no fixup is applied before it
+    PIMAGE_BASE_RELOCATION pBaseReloc = (PIMAGE_BASE_RELOCATION)(mempe1 + relocrva + relocsize 
+        - sizeof(IMAGE_BASE_RELOCATION) - 0x202 * sizeof(WORD));
+    pBaseReloc->VirtualAddress = (DWORD)imagesize - 4;
+    assert(winpe_memreloc(mempe1, 0x10000000)==(size_t)-1);
+    assert(*(uint64_t*)(mempe1 + 0x1008)==(uint64_t)newbase + 0x1008);
+    memcpy(mempe2, mempe1, imagesize);
+    assert(winpe_memrelocex(mempe2, 0x10000000, 0)==(size_t)-1);
+    assert(memcmp(mempe1, mempe2, imagesize)==0);
+
+    // highadj as the last item has no low part, it fails in check and no fixup is applied
+    pBaseReloc->VirtualAddress = (DWORD)(0x1000 + (npage - 1) * 0x1000);
+    PIMAGE_BASE_RELOCATION pFirstReloc = (PIMAGE_BASE_RELOCATION)(mempe1 + relocrva);
+    ((WORD*)(pFirstReloc + 1))[0x201] = IMAGE_REL_BASED_HIGHADJ << 12;
+    memcpy(mempe2, mempe1, imagesize);
+    assert(winpe_memreloc(mempe1, 0x10000000)==(size_t)-1);
+    assert(memcmp(mempe1, mempe2, imagesize)==0);
+    assert(winpe_memrelocex(mempe1, 0x10000000, 0)==(size_t)-1);
+    assert(memcmp(mempe1, mempe2, imagesize)==0);
+    VirtualFree(mempe1, 0, MEM_RELEASE);
+    VirtualFree(mempe2, 0, MEM_RELEASE);
+}
+
+void test_memLoadLibrarynoreloc()
+{
+    // make a fake dll without reloc directory, the DllMain returns TRUE and imports GetTickCount
+    uint8_t *mempe = (uint8_t*)VirtualAlloc(NULL, 0x2000, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    assert(mempe!=NULL);
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
+    pDosHeader->e_magic = IMAGE_DOS_SIGNATURE;
+    pDosHeader->e_lfanew = sizeof(IMAGE_DOS_HEADER);
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(mempe + pDosHeader->e_lfanew);
+    pNtHeader->Signature = IMAGE_NT_SIGNATURE;
+    pNtHeader->FileHeader.NumberOfSections = 1;
+    pNtHeader->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER);
+    pNtHeader->FileHeader.Characteristics = IMAGE_FILE_DLL | IMAGE_FILE_EXECUTABLE_IMAGE 
+        | IMAGE_FILE_RELOCS_STRIPPED;
+    pNtHeader->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR_MAGIC;
+    pNtHeader->OptionalHeader.AddressOfEntryPoint = 0x1000;
+    pNtHeader->OptionalHeader.ImageBase = (size_t)mempe;
+    pNtHeader->OptionalHeader.SectionAlignment = 0x1000;
+    pNtHeader->OptionalHeader.FileAlignment = 0x1000;
+    pNtHeader->OptionalHeader.SizeOfImage = 0x2000;
+    pNtHeader->OptionalHeader.SizeOfHeaders = 0x1000;
+    pNtHeader->OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    PIMAGE_SECTION_HEADER pSectHeader = IMAGE_FIRST_SECTION(pNtHeader);
+    memcpy(pSectHeader->Name, ".text", 5);
+    pSectHeader->Misc.VirtualSize = 0x1000;
+    pSectHeader->VirtualAddress = 0x1000;
+    pSectHeader->SizeOfRawData = 0x1000;
+    pSectHeader->PointerToRawData = 0x1000;
+    pSectHeader->Characteristics = IMAGE_SCN_CNT_CODE | IMAGE_SCN_MEM_EXECUTE 
+        | IMAGE_SCN_MEM_READ | IMAGE_SCN_MEM_WRITE;
+
+    // mov eax, 1; ret (ret 0xc for stdcall)
+#ifdef _WIN64
+    uint8_t code[] = {0xB8, 0x01, 0x00, 0x00, 0x00, 0xC3};
+#else
+    uint8_t code[] = {0xB8, 0x01, 0x00, 0x00, 0x00, 0xC2, 0x0C, 0x00};
+#endif
+    memcpy(mempe + 0x1000, code, sizeof(code));
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)(mempe + 0x1100);
+    size_t *oft = (size_t*)(mempe + 0x1180);
+    size_t *ft = (size_t*)(mempe + 0x11a0);
+    pImpDescriptor->OriginalFirstThunk = 0x1180;
+    pImpDescriptor->FirstThunk = 0x11a0;
+    pImpDescriptor->Name = 0x11c0;
+    oft[0] = ft[0] = 0x11e0;
+    strcpy((char*)mempe + 0x11c0, "kernel32.dll");
+    strcpy((char*)mempe + 0x11e0 + sizeof(WORD), "GetTickCount");
+    pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress = 0x1100;
+    pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].Size = 
+        2 * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+
+    // no reloc is not an error
+    assert(winpe_memreloc(mempe, (size_t)mempe)==0);
+    void *hmod = winpe_memLoadLibraryEx(mempe, 0, 0, 
+        (PFN_LoadLibraryA)winpe_findloadlibrarya(), 
+        (PFN_GetProcAddress)winpe_findgetprocaddress());
+    void *func = (void*)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetTickCount");
+    printf("[test_memLoadLibrarynoreloc] mempe=%p hmod=%p iat=%p\n", mempe, hmod, (void*)ft[0]);
+    assert(hmod==mempe);
+    assert((void*)ft[0]==func);
+    VirtualFree(mempe, 0, MEM_RELEASE);
+}
+
+void test_memexpindex(HMODULE hmod)
+{
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hmod;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)hmod + pDosHeader->e_lfanew);
+    PIMAGE_DATA_DIRECTORY pExpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    PIMAGE_EXPORT_DIRECTORY pExpDescriptor = (PIMAGE_EXPORT_DIRECTORY)((uint8_t*)hmod + pExpEntry->VirtualAddress);
+    DWORD *namerva = (DWORD*)((uint8_t*)hmod + pExpDescriptor->AddressOfNames);
+    
+    size_t indexsize = winpe_memexpindex(hmod, NULL, 0);
+    void *index = malloc(indexsize);
+    assert(winpe_memexpindex(hmod, index, indexsize)==indexsize);
+    DWORD t1 = GetTickCount();
+    for(DWORD i=0; i < pExpDescriptor->NumberOfNames; i++)
+    {
+        LPCSTR funcname = (LPCSTR)((uint8_t*)hmod + namerva[i]);
+        void *exp = winpe_memfindexp(hmod, funcname);
+        assert(exp!=NULL);
+        assert(winpe_memfindexphint(hmod, funcname, (WORD)i)==exp);
+        assert(winpe_memfindexphint(hmod, funcname, 0)==exp);
+        assert(winpe_memfindexpindex(index, funcname)==exp);
+    }
+    DWORD t2 = GetTickCount();
+    printf("[test_memexpindex] hmod=%p names=%lu indexsize=%zu %lums\n", 
+                hmod, (unsigned long)pExpDescriptor->NumberOfNames, indexsize, (unsigned long)(t2-t1));
+    assert(winpe_memfindexpindex(index, "NotExistFunction")==NULL);
+    free(index);
+}
+
+void test_memexpcrc32index(HMODULE hmod, DWORD flag)
+{
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hmod;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)hmod + pDosHeader->e_lfanew);
+    PIMAGE_DATA_DIRECTORY pExpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    PIMAGE_EXPORT_DIRECTORY pExpDescriptor = (PIMAGE_EXPORT_DIRECTORY)((uint8_t*)hmod + pExpEntry->VirtualAddress);
+    DWORD *namerva = (DWORD*)((uint8_t*)hmod + pExpDescriptor->AddressOfNames);
+
+    assert(inl_crc32("123456789", 9)==0xCBF43926);
+    assert(inl_crc32c("123456789", 9)==0xE3069283);
+    uint32_t crc32tab[256];
+    inl_crc32tab(crc32tab);
+    assert(inl_crc32t("123456789", 9, crc32tab)==0xCBF43926);
+    size_t indexnum = winpe_memexpcrc32index(hmod, NULL, 0, flag);
+    PWINPE_EXPCRC32 index = (PWINPE_EXPCRC32)malloc(indexnum * sizeof(WINPE_EXPCRC32));
+    assert(winpe_memexpcrc32index(hmod, index, indexnum, flag)==indexnum);
+    for(DWORD i=0; i < pExpDescriptor->NumberOfNames; i++)
+    {
+        LPCSTR funcname = (LPCSTR)((uint8_t*)hmod + namerva[i]);
+        size_t namelen = strlen(funcname);
+        uint32_t crc32 = (flag & WINPE_HASHFLAG_CRC32C) ? 
+            inl_crc32c(funcname, namelen) : inl_crc32(funcname, namelen);
+        void *exp = winpe_memfindexpcrc32index(hmod, index, indexnum, crc32);
+        if(!(flag & WINPE_HASHFLAG_CRC32C)) assert(exp==winpe_memfindexpcrc32(hmod, crc32));
+        assert(exp!=NULL);
+    }
+    printf("[test_memexpcrc32index] hmod=%p flag=%lx indexnum=%zu\n", 
+                hmod, (unsigned long)flag, indexnum);
+    free(index);
+}
+
+void test_memlz4decode()
+{
+    // "abcabcabcabcabcabc" + "xyz", a match with overlapped copy
+    uint8_t src[] = {0x3b, 'a', 'b', 'c', 0x03, 0x00, 0x30, 'x', 'y', 'z'};
+    char dst[0x20] = {0};
+    size_t dstsize = winpe_memlz4decode(src, sizeof(src), dst, sizeof(dst));
+    printf("[test_memlz4decode] dstsize=%zu dst=%s\n", dstsize, dst);
+    assert(dstsize==21 && !memcmp(dst, "abcabcabcabcabcabcxyz", 21));
+    assert(winpe_memlz4decode(src, sizeof(src), dst, 20)==0);
+    assert(winpe_memlz4decode(src, 5, dst, sizeof(dst))==0);
+}
+
+// build a mem layout image with imports for the magic, no sections
+uint8_t* test_synthpe(uint8_t *buf, WORD magic, uint64_t imagebase)
+{
+    memset(buf, 0, 0x1000);
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)buf;
+    pDosHeader->e_magic = IMAGE_DOS_SIGNATURE;
+    pDosHeader->e_lfanew = 0x40;
+    PIMAGE_NT_HEADERS32 pNtHeader32 = (PIMAGE_NT_HEADERS32)(buf + 0x40);
+    PIMAGE_NT_HEADERS64 pNtHeader64 = (PIMAGE_NT_HEADERS64)(buf + 0x40);
+    DWORD ptrsize = magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC ? 8 : 4;
+    PIMAGE_DATA_DIRECTORY pDataDir = NULL;
+    pNtHeader32->Signature = IMAGE_NT_SIGNATURE;
+    if(ptrsize == 8)
+    {
+        pNtHeader64->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER64);
+        pNtHeader64->OptionalHeader.Magic = magic;
+        pNtHeader64->OptionalHeader.ImageBase = imagebase;
+        pNtHeader64->OptionalHeader.SizeOfImage = 0x1000;
+        pNtHeader64->OptionalHeader.SizeOfHeaders = 0x200;
+        pNtHeader64->OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+        pDataDir = pNtHeader64->OptionalHeader.DataDirectory;
+    }
+    else
+    {
+        pNtHeader32->FileHeader.SizeOfOptionalHeader = sizeof(IMAGE_OPTIONAL_HEADER32);
+        pNtHeader32->OptionalHeader.Magic = magic;
+        pNtHeader32->OptionalHeader.ImageBase = (DWORD)imagebase;
+        pNtHeader32->OptionalHeader.SizeOfImage = 0x1000;
+        pNtHeader32->OptionalHeader.SizeOfHeaders = 0x200;
+        pNtHeader32->OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+        pDataDir = pNtHeader32->OptionalHeader.DataDirectory;
+    }
+    pDataDir[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress = 0x200;
+    pDataDir[IMAGE_DIRECTORY_ENTRY_IMPORT].Size = 2 * sizeof(IMAGE_IMPORT_DESCRIPTOR);
+
+    // test.dll!TestFunc, test.dll!#5
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)(buf + 0x200);
+    pImpDescriptor->OriginalFirstThunk = 0x300;
+    pImpDescriptor->Name = 0x280;
+    pImpDescriptor->FirstThunk = 0x340;
+    strcpy((char*)buf + 0x280, "test.dll");
+    strcpy((char*)buf + 0x3a2, "TestFunc");
+    for(DWORD i=0; i<2; i++)
+    {
+        uint8_t *thunk = buf + 0x300 + 0x40 * i;
+        if(ptrsize == 8)
+        {
+            ((uint64_t*)thunk)[0] = 0x3a0;
+            ((uint64_t*)thunk)[1] = IMAGE_ORDINAL_FLAG64 | 5;
+        }
+        else
+        {
+            ((uint32_t*)thunk)[0] = 0x3a0;
+            ((uint32_t*)thunk)[1] = IMAGE_ORDINAL_FLAG32 | 5;
+        }
+    }
+    return buf;
+}
+
+void test_bitness()
+{
+    // both pe32 and pe32+ should be parsed whatever the native bitness
+    static uint8_t buf[0x1000];
+    WORD magics[] = {IMAGE_NT_OPTIONAL_HDR32_MAGIC, IMAGE_NT_OPTIONAL_HDR64_MAGIC};
+    for(int i=0; i<2; i++)
+    {
+        uint8_t *pe = test_synthpe(buf, magics[i], 0x400000);
+        size_t ptrsize = magics[i] == IMAGE_NT_OPTIONAL_HDR64_MAGIC ? 8 : 4;
+        void *iat1 = winpe_memfindiat(pe, "test.dll", "TestFunc");
+        void *iat2 = winpe_memfindiat(pe, NULL, (LPCSTR)5);
+        printf("[test_bitness] magic=%x iat1=%p iat2=%p\n", magics[i], iat1, iat2);
+        assert(iat1==pe + 0x340 && iat2==pe + 0x340 + ptrsize);
+        assert(winpe_memfindiat(pe, "test.dll", (LPCSTR)6)==NULL);
+        assert(winpe_imagebaseval(pe, 0x10000000)==0x400000);
+        assert(winpe_imagebaseval(pe, 0)==0x10000000);
+        assert(winpe_imagesizeval(pe, 0)==0x1000);
+    }
+}
+
+void test_ctx(HMODULE hmod, const char *path)
+{
+    // lookups by ctx should be the same as parsing each time
+    WINPE_CTX ctx;
+    assert(winpe_ctx_init(&ctx, hmod, 0, WINPE_VIEWFLAG_MEM));
+    assert(ctx.expdir!=NULL);
+    DWORD namenum = ctx.expdir->NumberOfNames;
+    for(DWORD i=0; i < namenum; i++)
+    {
+        LPCSTR name = NULL;
+        DWORD exprva = winpe_ctx_expname(&ctx, i, &name);
+        assert(name && winpe_ctx_findexp(&ctx, name)==exprva);
+        assert(winpe_ctx_findexphint(&ctx, name, (WORD)i)==exprva);
+        assert(winpe_memfindexp(hmod, name)==(uint8_t*)hmod + exprva);
+    }
+    assert(winpe_ctx_findexp(&ctx, "not_exist_func")==0);
+
+    size_t memsize = 0;
+    uint8_t *mempe = (uint8_t*)winpe_memload_file(path, &memsize, FALSE);
+    assert(winpe_ctx_init(&ctx, mempe, memsize, WINPE_VIEWFLAG_MEM));
+    DWORD iatrva = winpe_ctx_findiat(&ctx, "kernel32.dll", "GetModuleHandleA");
+    printf("[test_ctx] namenum=%u impnum=%u iatrva=%x\n", namenum, ctx.impnum, iatrva);
+    assert(ctx.impnum > 0 && iatrva);
+    assert(mempe + iatrva==winpe_memfindiat(mempe, "kernel32.dll", "GetModuleHandleA"));
+    free(mempe);
+}
+
+void test_checksum(HMODULE hmod)
+{
+    // system dlls have valid checksum
+    char path[MAX_PATH];
+    WINPE_FILEMAP filemap;
+    GetModuleFileNameA(hmod, path, MAX_PATH);
+    uint8_t *rawpe = (uint8_t*)winpe_mapfile(path, &filemap);
+    DWORD checksum = winpe_checksum(rawpe, filemap.size);
+    DWORD headersum = winpe_checksumval(rawpe, 0);
+    printf("[test_checksum] path=%s checksum=%x headersum=%x\n", path, checksum, headersum);
+    assert(checksum==headersum);
+
+    // patch at odd offset and append, then update incrementally
+    size_t size = filemap.size;
+    uint8_t *buf = (uint8_t*)malloc(size + 0x10);
+    memcpy(buf, rawpe, size);
+    uint8_t olddata[5], newdata[5] = {0x90, 0x90, 0xcc, 0xcc, 0xc3};
+    size_t offset = size / 2 + 1;
+    memcpy(olddata, buf + offset, sizeof(olddata));
+    memcpy(buf + offset, newdata, sizeof(newdata));
+    checksum = winpe_checksum_update(checksum, size, size, offset, olddata, newdata, sizeof(newdata));
+    assert(checksum==winpe_checksum(buf, size));
+    memset(buf + size, 0x5a, 0x10);
+    checksum = winpe_checksum_update(checksum, size, size + 0x10, size, NULL, buf + size, 0x10);
+    assert(checksum==winpe_checksum(buf, size + 0x10));
+    free(buf);
+    assert(winpe_unmapfile(&filemap));
+}
+
+void test_rewrite(const char *path)
+{
+    // add a section with grown headers, then the output should be loadable
+    WINPE_FILEMAP filemap;
+    WINPE_REWRITER rw;
+    uint8_t data[0x1234];
+    for(int i=0; i<sizeof(data); i++) data[i] = (uint8_t)(i * 7 + 1);
+    uint8_t *rawpe = (uint8_t*)winpe_mapfile(path, &filemap);
+    assert(winpe_rewrite_init(&rw, rawpe, filemap.size));
+    rw.headersize = rw.sects[0].secthdr.VirtualAddress;
+    int index = winpe_rewrite_addsect(&rw, ".rwtest", data, sizeof(data), 0x2000, 
+        IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ);
+    assert(index == rw.sectnum - 1);
+    size_t filesize = winpe_rewrite_layout(&rw);
+    assert(filesize > filemap.size);
+    
+    char outpath[MAX_PATH];
+    snprintf(outpath, MAX_PATH, "%s.rw.dll", path);
+    assert(winpe_rewrite_file(&rw, outpath) == filesize);
+    DWORD rva = rw.sects[index].secthdr.VirtualAddress;
+    printf("[test_rewrite] path=%s filesize=%zx headersize=%x sectrva=%x\n", 
+        outpath, filesize, rw.sects[0].secthdr.PointerToRawData, rva);
+    winpe_rewrite_free(&rw);
+    assert(winpe_unmapfile(&filemap));
+
+    rawpe = (uint8_t*)winpe_mapfile(outpath, &filemap);
+    DWORD checksum = winpe_checksumval(rawpe, 0);
+    assert(!checksum || checksum==winpe_checksum(rawpe, filemap.size));
+    assert(winpe_unmapfile(&filemap));
+    HMODULE hmod = LoadLibraryA(outpath);
+    assert(hmod && memcmp((uint8_t*)hmod + rva, data, sizeof(data))==0);
+    assert(GetProcAddress(hmod, "winpe_rewrite_layout"));
+    FreeLibrary(hmod);
+    DeleteFileA(outpath);
+}
+
+void test_resindex(HMODULE hmod, const char *outpath)
+{
+    // the same as FindResourceW on a loaded module
+    WINPE_VIEW view;
+    assert(winpe_view_init(&view, hmod, 0, WINPE_VIEWFLAG_MEM));
+    size_t indexsize = winpe_resindex(&view, NULL, 0);
+    PWINPE_RESINDEX index = (PWINPE_RESINDEX)malloc(indexsize);
+    assert(winpe_resindex(&view, index, indexsize)==indexsize);
+    HRSRC hres = FindResourceW(hmod, MAKEINTRESOURCEW(1), (LPCWSTR)RT_VERSION);
+    PWINPE_RESENTRY entry = winpe_resfind(index, (const WORD*)RT_VERSION, (const WORD*)1, 0);
+    printf("[test_resindex] count=%u version=%p size=%x\n", index->count, entry, entry ? entry->size : 0);
+    assert(entry && winpe_resdata(index, entry)==LockResource(LoadResource(hmod, hres)));
+    assert(entry->size==SizeofResource(hmod, hres));
+    free(index);
+
+    // replace the version in file, rebuild the resource dir in a new section
+    char path[MAX_PATH];
+    WINPE_FILEMAP filemap;
+    WINPE_REWRITER rw;
+    GetModuleFileNameA(hmod, path, MAX_PATH);
+    uint8_t *rawpe = (uint8_t*)winpe_mapfile(path, &filemap);
+    assert(winpe_view_init(&view, rawpe, filemap.size, 0));
+    indexsize = winpe_resindex(&view, NULL, 0);
+    index = (PWINPE_RESINDEX)malloc(indexsize);
+    assert(winpe_resindex(&view, index, indexsize)==indexsize);
+    entry = winpe_resfind(index, (const WORD*)RT_VERSION, (const WORD*)1, 0);
+    uint8_t *version = (uint8_t*)malloc(entry->size);
+    memcpy(version, winpe_resdata(index, entry), entry->size);
+    version[entry->size - 1] ^= 0xff;
+    entry->data = version;
+    size_t rsrcsize = winpe_resbuild(index, 0, NULL, 0);
+    uint8_t *rsrc = (uint8_t*)malloc(rsrcsize);
+    assert(winpe_rewrite_init(&rw, rawpe, filemap.size));
+    int sectindex = winpe_rewrite_addsect(&rw, ".rsrc2", rsrc, (DWORD)rsrcsize, 0, 
+        IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ);
+    assert(winpe_rewrite_layout(&rw));
+    DWORD rsrcrva = rw.sects[sectindex].secthdr.VirtualAddress;
+    assert(winpe_resbuild(index, rsrcrva, rsrc, rsrcsize)==rsrcsize);
+    rw.datadir[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress = rsrcrva;
+    rw.datadir[IMAGE_DIRECTORY_ENTRY_RESOURCE].Size = (DWORD)rsrcsize;
+    assert(winpe_rewrite_layout(&rw));
+    assert(winpe_rewrite_file(&rw, outpath)==rw.filesize);
+    winpe_rewrite_free(&rw);
+    DWORD count = index->count;
+    free(index);
+    assert(winpe_unmapfile(&filemap));
+
+    rawpe = (uint8_t*)winpe_mapfile(outpath, &filemap);
+    assert(winpe_view_init(&view, rawpe, filemap.size, 0));
+    indexsize = winpe_resindex(&view, NULL, 0);
+    index = (PWINPE_RESINDEX)malloc(indexsize);
+    assert(winpe_resindex(&view, index, indexsize)==indexsize && index->count==count);
+    entry = winpe_resfind(index, (const WORD*)RT_VERSION, (const WORD*)1, 0);
+    assert(entry && memcmp(winpe_resdata(index, entry), version, entry->size)==0);
+    free(index);
+    free(rsrc);
+    free(version);
+    assert(winpe_unmapfile(&filemap));
+    DeleteFileA(outpath);
+}
+
+void test_memload_file(const char *path)
+{
+    WINPE_FILEMAP filemap;
+    uint8_t *rawpe = (uint8_t*)winpe_mapfile(path, &filemap);
+    size_t memsize = 0;
+    uint8_t *mempe = (uint8_t*)winpe_memload_file(path, &memsize, FALSE);
+    printf("[test_memload_file] path=%s rawsize=%zu memsize=%zu\n", 
+                path, filemap.size, memsize);
+    assert(rawpe!=NULL && rawpe[0]=='M' && rawpe[1]=='Z');
+    assert(mempe!=NULL && memsize==winpe_imagesizeval(mempe, 0));
+    assert(memcmp(rawpe, mempe, sizeof(IMAGE_DOS_HEADER))==0);
+    assert(winpe_unmapfile(&filemap));
+    assert(winpe_memload_file("not_exist.dll", &memsize, FALSE)==NULL);
+    free(mempe);
+}
+
+void test_view(const char *path, HMODULE hmod)
+{
+    WINPE_FILEMAP filemap;
+    uint8_t *rawpe = (uint8_t*)winpe_mapfile(path, &filemap);
+    size_t memsize = 0;
+    uint8_t *mempe = (uint8_t*)winpe_memload_file(path, &memsize, FALSE);
+    WINPE_VIEW rawview, memview;
+    assert(winpe_view_init(&rawview, rawpe, filemap.size, 0));
+    assert(winpe_view_init(&memview, mempe, memsize, WINPE_VIEWFLAG_MEM));
+    
+    // the same imports walked from raw and mem layout
+    DWORD impnum = 0;
+    PIMAGE_IMPORT_DESCRIPTOR pRawImp = NULL, pMemImp = NULL;
+    for(DWORD i=0; (pRawImp=winpe_view_impdesc(&rawview, i)); i++)
+    {
+        pMemImp = winpe_view_impdesc(&memview, i);
+        assert(pMemImp && pMemImp->Name==pRawImp->Name);
+        assert(strcmp(winpe_view_str(&rawview, pRawImp->Name), 
+            winpe_view_str(&memview, pMemImp->Name))==0);
+        DWORD thunkrva = pRawImp->OriginalFirstThunk ? 
+            pRawImp->OriginalFirstThunk : pRawImp->FirstThunk;
+        for(DWORD j=0; winpe_view_thunk(&rawview, thunkrva, j); j++, impnum++)
+        {
+            assert(winpe_view_thunk(&rawview, thunkrva, j)==winpe_view_thunk(&memview, thunkrva, j));
+        }
+    }
+    printf("[test_view] path=%s sectnum=%u impnum=%u\n", path, rawview.sectnum, impnum);
+    assert(impnum > 0);
+
+    // truncated or corrupted headers should be rejected
+    PIMAGE_SECTION_HEADER pSectHeader = winpe_view_section(&rawview, 0);
+    assert(!winpe_view_ptr(&rawview, pSectHeader->VirtualAddress, pSectHeader->SizeOfRawData + 1));
+    assert(!winpe_view_init(&rawview, rawpe, 0x40, 0));
+    uint8_t *badpe = (uint8_t*)malloc(0x400);
+    memcpy(badpe, rawpe, 0x400);
+    ((PIMAGE_DOS_HEADER)badpe)->e_lfanew = 0x7ffffff0;
+    assert(!winpe_view_init(&rawview, badpe, 0x400, 0));
+    free(badpe);
+
+    // exports by name and ordinal
+    PIMAGE_EXPORT_DIRECTORY pExpDir = NULL;
+    assert(winpe_view_init(&memview, hmod, 0, WINPE_VIEWFLAG_MEM));
+    assert((pExpDir=winpe_view_expdir(&memview))!=NULL);
+    LPCSTR name = NULL;
+    DWORD exprva = winpe_view_expname(&memview, pExpDir, 0, &name);
+    assert(name && exprva && winpe_memfindexp(hmod, name)==(uint8_t*)hmod + exprva);
+    assert(winpe_memfindexp(hmod, (LPCSTR)(size_t)pExpDir->Base)==
+        (void*)GetProcAddress(hmod, (LPCSTR)(size_t)pExpDir->Base));
+
+    assert(winpe_unmapfile(&filemap));
+    free(mempe);
+}
+
+typedef struct _TEST_ARENA
+{
+    uint8_t *base;
+    size_t size;
+    size_t cur;
+}TEST_ARENA;
+
+void* STDCALL test_arena_alloc(void *arg, void *addr, size_t size, DWORD protect)
+{
+    TEST_ARENA *arena = (TEST_ARENA*)arg;
+    size = (size + 0xfff) & ~(size_t)0xfff;
+    if(addr || arena->cur + size > arena->size) return NULL;
+    arena->cur += size;
+    return arena->base + arena->cur - size;
+}
+
+bool_t STDCALL test_arena_free(void *arg, void *addr, size_t size)
+{
+    TEST_ARENA *arena = (TEST_ARENA*)arg;
+    return (uint8_t*)addr >= arena->base && (uint8_t*)addr < arena->base + arena->size;
+}
+
+void test_memLoadLibraryAllocator(const char *path)
+{
+    TEST_ARENA arena = {NULL, 0x1000000, 0};
+    arena.base = (uint8_t*)VirtualAlloc(NULL, arena.size, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    WINPE_ALLOCATOR allocator = {&arena, test_arena_alloc, test_arena_free, NULL};
+    
+    // load file in caller buffer
+    size_t memsize = 0;
+    assert(winpe_memload_fileex(path, arena.base, &memsize, TRUE, NULL)==NULL && memsize>0);
+    void *mempe = winpe_memload_fileex(path, arena.base, &memsize, TRUE, NULL);
+    assert(mempe==arena.base);
+    mempe = winpe_memload_fileex(path, NULL, &memsize, TRUE, &allocator);
+    assert(mempe==arena.base && arena.cur>=memsize);
+
+    // load module in arena
+    void *hmod = winpe_memLoadLibraryAllocator(mempe, WINPE_LDFLAG_EXPHINT, NULL, NULL, &allocator);
+    void *func = winpe_memGetProcAddress(hmod, "winpe_memLoadLibraryAllocator");
+    printf("[test_memLoadLibraryAllocator] path=%s arena=%p hmod=%p func=%p\n", 
+                path, arena.base, hmod, func);
+    assert((uint8_t*)hmod > arena.base && (uint8_t*)hmod < arena.base + arena.size);
+    assert(func!=NULL);
+    assert(winpe_memFreeLibraryAllocator(hmod, NULL, NULL, &allocator));
+    VirtualFree(arena.base, 0, MEM_RELEASE);
+}
+
+void test_overlayopen_file(const char *path)
+{
+    WINPE_OVERLAYVIEW view;
+    assert(winpe_overlayopen_file(path, &view));
+    size_t overlaysize = 0;
+    uint8_t *overlay = (uint8_t*)winpe_overlayload_file(path, &overlaysize);
+    printf("[test_overlayopen_file] path=%s filesize=%llu offset=%llx size=%llx\n", path, 
+        (unsigned long long)view.filesize, (unsigned long long)view.offset, (unsigned long long)view.size);
+    assert(view.offset + view.size <= view.filesize && overlaysize==view.size);
+    if(view.size)
+    {
+        uint8_t buf[0x100];
+        size_t readsize = winpe_overlayread(&view, buf, sizeof(buf), 0);
+        assert(readsize > 0 && memcmp(buf, overlay, readsize)==0);
+        uint8_t *base = (uint8_t*)winpe_overlaymap(&view);
+        assert(base!=NULL && memcmp(base, overlay, overlaysize)==0);
+    }
+    assert(winpe_overlayclose(&view));
+    free(overlay);
+}
+
+void test_memLoadLibrarySection(const char *path)
+{
+    size_t memsize = 0;
+    void *mempe = winpe_memload_file(path, &memsize, TRUE);
+    HANDLE hsection = winpe_memsection_create(mempe, 0);
+    void *hmod1 = winpe_memLoadLibrarySection(hsection, WINPE_LDFLAG_EXPHINT, NULL, NULL);
+    void *hmod2 = winpe_memLoadLibrarySection(hsection, WINPE_LDFLAG_EXPHINT, NULL, NULL);
+    void *func1 = winpe_memGetProcAddress(hmod1, "winpe_memLoadLibrarySection");
+    void *func2 = winpe_memGetProcAddress(hmod2, "winpe_memLoadLibrarySection");
+    printf("[test_memLoadLibrarySection] path=%s section=%p hmod1=%p hmod2=%p\n", 
+                path, hsection, hmod1, hmod2);
+    assert(hsection!=NULL && hmod1!=NULL && hmod2!=NULL && hmod1!=hmod2);
+    assert(func1!=NULL && func2!=NULL);
+    assert(WINPE_MEMRECORD_OF(hmod1)->flag & WINPE_MEMFLAG_SECTION);
+    assert(winpe_memFreeLibrary(hmod1));
+    assert(winpe_memFreeLibrary(hmod2));
+    CloseHandle(hsection);
+    free(mempe);
+}
+
+static void* test_makertm(const char *path, size_t *prtmsize)
+{
+    // the same layout as winrtm.py at origin imagebase, so no python needed for fixture
+    size_t memsize = 0;
+    uint8_t *mempe = (uint8_t*)winpe_memload_file(path, &memsize, TRUE);
+    if(!mempe) return NULL;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(mempe + pDosHeader->e_lfanew);
+    PIMAGE_DATA_DIRECTORY pDataDirectory = pNtHeader->OptionalHeader.DataDirectory;
+    DWORD imagesize = pNtHeader->OptionalHeader.SizeOfImage;
+    DWORD pagenum = (imagesize + WINPE_RTM_PAGESIZE - 1) / WINPE_RTM_PAGESIZE;
+    DWORD pagemapsize = (pagenum + 7) / 8;
+    uint8_t *pagemap = (uint8_t*)calloc(pagemapsize, 1);
+    uint8_t *pagebits = (uint8_t*)calloc(pagenum, WINPE_RTM_PAGESIZE / 8);
+
+    // ptrsize relocs by bitmap, HIGHLOW in pe32+ by reloc32 list
+    DWORD relocrva = pDataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].VirtualAddress;
+    DWORD relocsize = relocrva ? pDataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size : 0;
+    DWORD *reloc32 = (DWORD*)malloc(relocsize * 2 + sizeof(DWORD)); // at most 2 bytes each
+    DWORD reloc32num = 0;
+    for(DWORD offset = 0; offset + sizeof(IMAGE_BASE_RELOCATION) <= relocsize; )
+    {
+        PIMAGE_BASE_RELOCATION pBlock = (PIMAGE_BASE_RELOCATION)(mempe + relocrva + offset);
+        if(!pBlock->SizeOfBlock) break;
+        WORD *items = (WORD*)(pBlock + 1);
+        for(DWORD i=0; i < (pBlock->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / 2; i++)
+        {
+            DWORD type = items[i] >> 12, rva = pBlock->VirtualAddress + (items[i] & 0xfff);
+            if(type == IMAGE_REL_BASED_HIGHLOW && sizeof(size_t) == 8) reloc32[reloc32num++] = rva;
+            else if(type == IMAGE_REL_BASED_HIGHLOW || type == IMAGE_REL_BASED_DIR64)
+            {
+                DWORD page = rva / WINPE_RTM_PAGESIZE, bit = rva % WINPE_RTM_PAGESIZE;
+                pagemap[page / 8] |= 1 << (page % 8);
+                pagebits[page * (WINPE_RTM_PAGESIZE / 8) + bit / 8] |= 1 << (bit % 8);
+            }
+        }
+        offset += pBlock->SizeOfBlock;
+    }
+    DWORD relocpagenum = 0;
+    for(DWORD i=0; i < pagenum; i++) if(pagemap[i / 8] & (1 << (i % 8))) relocpagenum++;
+
+    // flat import list in dll order, counted first
+    DWORD imprva = pDataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress;
+    PWINPE_RTMIMP imps = NULL;
+    DWORD impnum = 0;
+    for(int pass=0; pass < 2; pass++)
+    {
+        if(pass) imps = (PWINPE_RTMIMP)malloc((impnum + 1) * sizeof(WINPE_RTMIMP));
+        impnum = 0;
+        PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = imprva ? (PIMAGE_IMPORT_DESCRIPTOR)(mempe + imprva) : NULL;
+        for(; pImpDescriptor && pImpDescriptor->Name; pImpDescriptor++)
+        {
+            DWORD thunkrva = pImpDescriptor->OriginalFirstThunk ? 
+                pImpDescriptor->OriginalFirstThunk : pImpDescriptor->FirstThunk;
+            size_t *thunks = (size_t*)(mempe + thunkrva);
+            for(DWORD i=0; thunks[i]; i++, impnum++)
+            {
+                if(!pass) continue;
+                imps[impnum].iatrva = pImpDescriptor->FirstThunk + i * sizeof(size_t);
+                imps[impnum].dllnamerva = pImpDescriptor->Name;
+                if(thunks[i] & IMAGE_ORDINAL_FLAG) 
+                    imps[impnum].namerva = WINPE_RTM_ORDINALFLAG | (DWORD)(thunks[i] & 0xffff);
+                else imps[impnum].namerva = (DWORD)thunks[i] & 0x7fffffff;
+            }
+        }
+    }
+
+    // hdr | pagemap | relocmap | imps, reloc32 | image
+    WINPE_RTMHDR hdr = {0};
+    hdr.magic = WINPE_RTM_MAGIC;
+    hdr.hdrsize = sizeof(hdr);
+    hdr.imagebase = pNtHeader->OptionalHeader.ImageBase;
+    hdr.imagesize = imagesize;
+    hdr.ptrsize = sizeof(size_t);
+    hdr.pagemapoffset = sizeof(hdr);
+    hdr.pagemapsize = pagemapsize;
+    hdr.relocmapoffset = hdr.pagemapoffset + pagemapsize;
+    hdr.relocmapsize = relocpagenum * (WINPE_RTM_PAGESIZE / 8);
+    hdr.impoffset = (hdr.relocmapoffset + hdr.relocmapsize + 3) & ~3;
+    hdr.impnum = impnum;
+    hdr.reloc32num = reloc32num;
+    hdr.imageoffset = (hdr.impoffset + impnum * sizeof(WINPE_RTMIMP) + reloc32num * sizeof(DWORD) 
+        + WINPE_RTM_PAGESIZE - 1) & ~(WINPE_RTM_PAGESIZE - 1);
+    size_t rtmsize = hdr.imageoffset + imagesize;
+    uint8_t *rtm = (uint8_t*)calloc(rtmsize, 1);
+    memcpy(rtm, &hdr, sizeof(hdr));
+    memcpy(rtm + hdr.pagemapoffset, pagemap, pagemapsize);
+    uint8_t *relocmap = rtm + hdr.relocmapoffset;
+    for(DWORD i=0; i < pagenum; i++)
+    {
+        if(!(pagemap[i / 8] & (1 << (i % 8)))) continue;
+        memcpy(relocmap, pagebits + i * (WINPE_RTM_PAGESIZE / 8), WINPE_RTM_PAGESIZE / 8);
+        relocmap += WINPE_RTM_PAGESIZE / 8;
+    }
+    memcpy(rtm + hdr.impoffset, imps, impnum * sizeof(WINPE_RTMIMP));
+    memcpy(rtm + hdr.impoffset + impnum * sizeof(WINPE_RTMIMP), reloc32, reloc32num * sizeof(DWORD));
+    memcpy(rtm + hdr.imageoffset, mempe, imagesize);
+    free(imps);
+    free(reloc32);
+    free(pagebits);
+    free(pagemap);
+    free(mempe);
+    *prtmsize = rtmsize;
+    return rtm;
+}
+
+static void test_memLoadLibraryRtmbuf(const char *name, const void *rtm, size_t rtmsize)
+{
+    size_t imagesize = winpe_rtmcheck(rtm, rtmsize);
+    void *hmod = winpe_memLoadLibraryRtm(rtm, rtmsize, WINPE_LDFLAG_EXPHINT, NULL, NULL);
+    void *func = winpe_memGetProcAddress(hmod, "winpe_memLoadLibraryRtm");
+    printf("[test_memLoadLibraryRtm] %s imagesize=%zx hmod=%p func=%p\n", 
+                name, imagesize, hmod, func);
+    assert(imagesize!=0 && hmod!=NULL && func!=NULL);
+    assert(winpe_imagebaseval(hmod, 0)==(size_t)hmod);
+    assert(winpe_memFreeLibrary(hmod));
+}
+
+void test_memLoadLibraryRtm(const char *path)
+{
+    // the fixture is made from the dll here, base is in use so it is rebased
+    size_t rtmsize = 0;
+    void *rtm = test_makertm(path, &rtmsize);
+    assert(rtm!=NULL);
+    test_memLoadLibraryRtmbuf(path, rtm, rtmsize);
+    free(rtm);
+
+    // the one by winrtm.py (make libwinpe_rtm) is also tested if exists
+    char rtmpath[MAX_PATH];
+    snprintf(rtmpath, MAX_PATH, "%s.rtm", path);
+    FILE *fp = fopen(rtmpath, "rb");
+    if(!fp) return;
+    fseek(fp, 0, SEEK_END);
+    rtmsize = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    rtm = malloc(rtmsize);
+    fread(rtm, 1, rtmsize, fp);
+    fclose(fp);
+    test_memLoadLibraryRtmbuf(rtmpath, rtm, rtmsize);
+    free(rtm);
+}
+
+void test_vmmap(size_t addr, size_t size)
+{
+    WINPE_VMMAP vmmap;
+    assert(winpe_vmmap_snapshot(&vmmap, NULL));
+    void *space = winpe_vmmap_findspace(&vmmap, addr, size, 0x10000);
+    void *buf = VirtualAlloc(space, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    printf("[test_vmmap] count=%zu addr=%p size=%zx space=%p\n", 
+                vmmap.count, (void*)addr, size, space);
+    assert(space!=NULL && buf==space && (size_t)space >= addr);
+    assert(winpe_vmmap_update(&vmmap, (size_t)buf, size, MEM_COMMIT));
+    void *space2 = winpe_vmmap_findspace(&vmmap, addr, size, 0x10000);
+    assert(space2!=NULL && space2!=space);
+    VirtualFree(buf, 0, MEM_RELEASE);
+    winpe_vmmap_free(&vmmap);
+}
+
+void test_membindiatlazy(const char *path)
+{
+    size_t memsize = 0;
+    void *mempe = winpe_memload_file(path, &memsize, TRUE);
+    size_t count = winpe_membindiatex(mempe, NULL, NULL, WINPE_BINDFLAG_LAZY);
+    PWINPE_LAZYCTX ctx = WINPE_MEMRECORD_OF(mempe)->lazyctx;
+    size_t *iat = (size_t*)winpe_memfindiat(mempe, "kernel32.dll", "GetTickCount");
+    size_t stub = *iat;
+    DWORD tick = ((DWORD (WINAPI*)(void))(*iat))();
+    printf("[test_membindiatlazy] path=%s count=%zu stub=%p func=%p tick=%lu\n", 
+                path, count, (void*)stub, (void*)*iat, (unsigned long)tick);
+    assert(count>0 && ctx!=NULL && ctx->count==count);
+    assert(stub!=(size_t)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetTickCount"));
+    assert(*iat==(size_t)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetTickCount"));
+
+    // bound-only imports without OriginalFirstThunk are stubbed by FirstThunk
+    WINPE_VIEW view;
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = NULL;
+    void *mempe2 = winpe_memload_file(path, &memsize, TRUE);
+    assert(winpe_view_init(&view, mempe2, 0, WINPE_VIEWFLAG_MEM));
+    for(DWORD i=0; (pImpDescriptor = winpe_view_impdesc(&view, i)); i++)
+    {
+        pImpDescriptor->OriginalFirstThunk = 0;
+    }
+    size_t count2 = winpe_membindiatex(mempe2, NULL, NULL, WINPE_BINDFLAG_LAZY);
+    PWINPE_LAZYCTX ctx2 = WINPE_MEMRECORD_OF(mempe2)->lazyctx;
+    size_t *iat2 = (size_t*)((uint8_t*)mempe2 + ((uint8_t*)iat - (uint8_t*)mempe));
+    ((DWORD (WINAPI*)(void))(*iat2))();
+    printf("[test_membindiatlazy] bound-only count=%zu func=%p\n", count2, (void*)*iat2);
+    assert(count2==count && ctx2!=NULL);
+    assert(*iat2==*iat);
+    VirtualFree(ctx2, 0, MEM_RELEASE);
+    free(mempe2);
+    VirtualFree(ctx, 0, MEM_RELEASE);
+    free(mempe);
+}
+
+void test_memLoadLibrarySet(const char *path)
+{
+    size_t memsize = 0;
+    void *mempes[1] = {winpe_memload_file(path, &memsize, TRUE)};
+    void *hmods[1] = {NULL};
+    size_t n = winpe_memLoadLibrarySet(mempes, NULL, 1, hmods, 
+        WINPE_LDFLAG_MEMFIND | WINPE_LDFLAG_EXPHINT, NULL, NULL);
+    PWINPE_MODSET modset = WINPE_MEMRECORD_OF(hmods[0])->modset;
+    void *func = winpe_memGetProcAddress(hmods[0], "winpe_memLoadLibrarySet");
+    printf("[test_memLoadLibrarySet] path=%s n=%zu hmod=%p func=%p\n", 
+                path, n, hmods[0], func);
+    assert(n==1 && modset!=NULL && modset->count==1 && modset->hmods[0]==hmods[0]);
+    assert(func!=NULL);
+    assert(winpe_memFreeLibrary(hmods[0]));
+    free(mempes[0]);
+}
+
 int main(int argc, char *argv[])
 {
     test_findkernel32();
     test_findloadlibrarya();
     test_findgetprocaddress();
     test_findmodulea("kernel32.dll");
+    test_findmodulea("NTDLL.DLL");
+    LoadLibraryA("version.dll"); // ldr list changed, not cached before
+    test_findmodulea("version.dll");
+    test_findmodulecache("msimg32.dll");
     HMODULE hkernel32 = LoadLibraryA("kernel32.dll");
     test_memforwardexp(hkernel32, "LoadLibraryA");
     test_memforwardexp(hkernel32, "InitializeSListHead");
     test_memforwardexp(hkernel32, "GetSystemTimeAsFileTime");
     test_memGetProcAddress(hkernel32, "GetProcessMitigationPolicy");
+    test_findapiseta("api-ms-win-core-processthreads-l1-1-1.dll");
+    test_memexpindex(hkernel32);
+    test_memexpindex(GetModuleHandleA("ntdll.dll"));
+    test_memexpcrc32index(hkernel32, 0);
+    test_memexpcrc32index(hkernel32, WINPE_HASHFLAG_CRC32C);
+    char exepath[MAX_PATH];
+    GetModuleFileNameA(NULL, exepath, MAX_PATH);
+    test_memload_file(exepath);
+    test_view(exepath, hkernel32);
+    test_ctx(hkernel32, exepath);
+    test_checksum(hkernel32);
+    char outpath[MAX_PATH];
+    snprintf(outpath, MAX_PATH, "%s.rsrc.dll", exepath);
+    test_resindex(hkernel32, outpath);
+    test_overlayopen_file(exepath);
+    test_membindiatlazy(exepath);
+    test_memreloc(0x400); // about 5MB, large enough for threads
+    test_memLoadLibrarynoreloc();
+    test_memlz4decode();
+    test_bitness();
+    test_vmmap(0x10000000, 0x100000);
+    MEMORY_BASIC_INFORMATION mbi;
+    char dllpath[MAX_PATH];
+    VirtualQuery((void*)winpe_memLoadLibrarySet, &mbi, sizeof(mbi));
+    GetModuleFileNameA((HMODULE)mbi.AllocationBase, dllpath, MAX_PATH);
+    test_memLoadLibrarySet(dllpath);
+    test_memLoadLibraryAllocator(dllpath);
+    test_memLoadLibrarySection(dllpath);
+    test_rewrite(dllpath);
+    test_memLoadLibraryRtm(dllpath);
     printf("%s finish!\n", argv[0]);
     return 0;
 }
\ No newline at end of file
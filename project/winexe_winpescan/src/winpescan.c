@@ -0,0 +1,517 @@
+/**
+ * scan pe files in directory trees by a worker pool,
+ * one json or csv record for each pe, build on windows and linux
+ *    v0.1.1, developed by devseed
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#define WINPE_IMPLEMENTATION
+#include "winpe.h"
+
+#define WINPESCAN_VERSION "0.1.1"
+#define WINPESCAN_MAXTHUNK 0x10000 // thunks of each file, against the crafted loops
+#define WINPESCAN_MAXDLL 0x1000
+#define WINPESCAN_MAXEXP 0x10000
+#define WINPESCAN_MAXTLS 0x100
+
+#define WINPESCAN_FORMAT_JSON 0
+#define WINPESCAN_FORMAT_CSV 1
+
+// thread and lock for both platforms
+#ifdef _WIN32
+typedef HANDLE scan_thread_t;
+typedef CRITICAL_SECTION scan_mutex_t;
+#define scan_mutex_init(m) InitializeCriticalSection(m)
+#define scan_mutex_lock(m) EnterCriticalSection(m)
+#define scan_mutex_unlock(m) LeaveCriticalSection(m)
+#define scan_mutex_free(m) DeleteCriticalSection(m)
+#define scan_fetchadd(p) ((size_t)InterlockedExchangeAdd((volatile LONG*)(p), 1))
+#else
+typedef pthread_t scan_thread_t;
+typedef pthread_mutex_t scan_mutex_t;
+#define scan_mutex_init(m) pthread_mutex_init(m, NULL)
+#define scan_mutex_lock(m) pthread_mutex_lock(m)
+#define scan_mutex_unlock(m) pthread_mutex_unlock(m)
+#define scan_mutex_free(m) pthread_mutex_destroy(m)
+#define scan_fetchadd(p) __sync_fetch_and_add(p, 1)
+#endif
+
+typedef struct _SCAN_BUF
+{
+    char *data;
+    size_t size;
+    size_t cap;
+}SCAN_BUF, *PSCAN_BUF;
+
+typedef struct _SCAN_LIST
+{
+    char **paths;
+    size_t count;
+    size_t cap;
+}SCAN_LIST, *PSCAN_LIST;
+
+typedef struct _SCAN_CTX
+{
+    SCAN_LIST list;
+    volatile LONG next; // the next path index to take by workers
+    volatile LONG pecount;
+    int format;
+    FILE *fp;
+    scan_mutex_t lock; // for writing records to fp
+}SCAN_CTX, *PSCAN_CTX;
+
+// string buffer
+static void scan_bufgrow(PSCAN_BUF buf, size_t size)
+{
+    if(buf->size + size + 1 <= buf->cap) return;
+    size_t cap = buf->cap ? buf->cap : 0x1000;
+    while(cap < buf->size + size + 1) cap *= 2;
+    buf->data = (char*)realloc(buf->data, cap);
+    if(!buf->data)
+    {
+        fprintf(stderr, "error no memory\n");
+        exit(-1);
+    }
+    buf->cap = cap;
+}
+
+static void scan_printf(PSCAN_BUF buf, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if(n <= 0) return;
+    scan_bufgrow(buf, (size_t)n);
+    va_start(ap, fmt);
+    vsnprintf(buf->data + buf->size, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    buf->size += (size_t)n;
+}
+
+static size_t scan_utf8len(const unsigned char *str, size_t n)
+{
+    // length of the valid utf-8 sequence at str, 0 if invalid, overlong or surrogate
+    unsigned char c = str[0];
+    size_t len = c >= 0xf0 ? 4 : (c >= 0xe0 ? 3 : 2);
+    if(c < 0xc2 || c > 0xf4 || n < len) return 0;
+    for(size_t i=1; i < len; i++)
+    {
+        if((str[i] & 0xc0) != 0x80) return 0;
+    }
+    if(c == 0xe0 && str[1] < 0xa0) return 0;
+    if(c == 0xed && str[1] >= 0xa0) return 0;
+    if(c == 0xf0 && str[1] < 0x90) return 0;
+    if(c == 0xf4 && str[1] >= 0x90) return 0;
+    return len;
+}
+
+static void scan_putstr(PSCAN_BUF buf, const char *str, size_t len, int format)
+{
+    // strings in pe are not trusted, escape quotes and control chars, 
+    // valid utf-8 is kept, other bytes are escaped as \u00xx in json
+    size_t n = 0;
+    while(n < len && str[n]) n++;
+    scan_bufgrow(buf, n * 6 + 2);
+    char *p = buf->data + buf->size;
+    *p++ = '"';
+    for(size_t i=0; i < n; i++)
+    {
+        unsigned char c = (unsigned char)str[i];
+        if(format == WINPESCAN_FORMAT_CSV)
+        {
+            if(c == '"') *p++ = '"';
+            *p++ = c < 0x20 ? '?' : c;
+        }
+        else if(c == '"' || c == '\\')
+        {
+            *p++ = '\\';
+            *p++ = c;
+        }
+        else if(c < 0x20 || c == 0x7f)
+        {
+            p += sprintf(p, "\\u%04x", c);
+        }
+        else if(c > 0x7f)
+        {
+            size_t seqlen = scan_utf8len((const unsigned char*)str + i, n - i);
+            if(!seqlen) 
+            {
+                p += sprintf(p, "\\u%04x", c);
+                continue;
+            }
+            memcpy(p, str + i, seqlen);
+            p += seqlen;
+            i += seqlen - 1;
+        }
+        else *p++ = c;
+    }
+    *p++ = '"';
+    buf->size = p - buf->data;
+    buf->data[buf->size] = '\0';
+}
+
+// file list
+static void scan_listadd(PSCAN_LIST list, const char *path)
+{
+    if(list->count >= list->cap)
+    {
+        list->cap = list->cap ? list->cap * 2 : 0x400;
+        list->paths = (char**)realloc(list->paths, list->cap * sizeof(char*));
+        if(!list->paths)
+        {
+            fprintf(stderr, "error no memory\n");
+            exit(-1);
+        }
+    }
+    size_t len = strlen(path);
+    list->paths[list->count] = (char*)malloc(len + 1);
+    memcpy(list->paths[list->count], path, len + 1);
+    list->count++;
+}
+
+static void scan_listwalk(PSCAN_LIST list, const char *path)
+{
+    // symbolic links and reparse points are not followed, against the loops
+    char subpath[0x1000];
+#ifdef _WIN32
+    DWORD attr = GetFileAttributesA(path);
+    if(attr == INVALID_FILE_ATTRIBUTES) return;
+    if(!(attr & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        scan_listadd(list, path);
+        return;
+    }
+    WIN32_FIND_DATAA finddata;
+    snprintf(subpath, sizeof(subpath), "%s\\*", path);
+    HANDLE hfind = FindFirstFileA(subpath, &finddata);
+    if(hfind == INVALID_HANDLE_VALUE) return;
+    do
+    {
+        if(!strcmp(finddata.cFileName, ".") || !strcmp(finddata.cFileName, "..")) continue;
+        if(finddata.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) continue;
+        if(snprintf(subpath, sizeof(subpath), "%s\\%s",
+            path, finddata.cFileName) >= (int)sizeof(subpath)) continue;
+        if(finddata.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) scan_listwalk(list, subpath);
+        else if(finddata.nFileSizeHigh || finddata.nFileSizeLow >= sizeof(IMAGE_DOS_HEADER))
+        {
+            scan_listadd(list, subpath);
+        }
+    } while(FindNextFileA(hfind, &finddata));
+    FindClose(hfind);
+#else
+    struct stat st;
+    if(lstat(path, &st) != 0) return;
+    if(S_ISREG(st.st_mode))
+    {
+        scan_listadd(list, path);
+        return;
+    }
+    if(!S_ISDIR(st.st_mode)) return;
+    DIR *dir = opendir(path);
+    if(!dir) return;
+    struct dirent *ent = NULL;
+    while((ent = readdir(dir)))
+    {
+        if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+        if(snprintf(subpath, sizeof(subpath), "%s/%s",
+            path, ent->d_name) >= (int)sizeof(subpath)) continue;
+        if(lstat(subpath, &st) != 0) continue;
+        if(S_ISDIR(st.st_mode)) scan_listwalk(list, subpath);
+        else if(S_ISREG(st.st_mode) && st.st_size >= (off_t)sizeof(IMAGE_DOS_HEADER))
+        {
+            scan_listadd(list, subpath);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+// pe record
+static size_t scan_relocnum(const WINPE_VIEW *view)
+{
+    size_t count = 0;
+    DWORD offset = 0;
+    PIMAGE_BASE_RELOCATION pBaseReloc = NULL;
+    while((pBaseReloc = winpe_view_relocblock(view, &offset)))
+    {
+        const WORD *pRelocItem = (const WORD*)(pBaseReloc + 1);
+        DWORD itemnum = (pBaseReloc->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+        for(DWORD i=0; i < itemnum; i++)
+        {
+            if(pRelocItem[i] >> 12 != IMAGE_REL_BASED_ABSOLUTE) count++;
+        }
+    }
+    return count;
+}
+
+static void scan_imports(const WINPE_VIEW *view, PSCAN_BUF buf,
+    int format, size_t *pdllnum, size_t *pfuncnum)
+{
+    size_t dllnum = 0, funcnum = 0;
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = NULL;
+    if(format == WINPESCAN_FORMAT_JSON) scan_printf(buf, "\"imports\":[");
+    for(DWORD i=0; i < WINPESCAN_MAXDLL && (pImpDescriptor = winpe_view_impdesc(view, i)); i++)
+    {
+        LPCSTR dllname = winpe_view_str(view, pImpDescriptor->Name);
+        if(format == WINPESCAN_FORMAT_JSON)
+        {
+            scan_printf(buf, "%s{\"dll\":", dllnum ? "," : "");
+            scan_putstr(buf, dllname ? dllname : "", (size_t)-1, format);
+            scan_printf(buf, ",\"funcs\":[");
+        }
+        DWORD thunkrva = pImpDescriptor->OriginalFirstThunk ?
+            pImpDescriptor->OriginalFirstThunk : pImpDescriptor->FirstThunk;
+        for(DWORD j=0; funcnum < WINPESCAN_MAXTHUNK; j++, funcnum++)
+        {
+            uint64_t thunk = winpe_view_thunk(view, thunkrva, j);
+            if(!thunk) break;
+            if(format != WINPESCAN_FORMAT_JSON) continue;
+            if(j) scan_printf(buf, ",");
+            if(thunk & IMAGE_ORDINAL_FLAG64) scan_printf(buf, "\"#%u\"", (unsigned)(thunk & 0xffff));
+            else
+            {
+                LPCSTR funcname = winpe_view_str(view, (size_t)thunk + sizeof(WORD));
+                scan_putstr(buf, funcname ? funcname : "", (size_t)-1, format);
+            }
+        }
+        if(format == WINPESCAN_FORMAT_JSON) scan_printf(buf, "]}");
+        dllnum++;
+        if(funcnum >= WINPESCAN_MAXTHUNK) break;
+    }
+    if(format == WINPESCAN_FORMAT_JSON) scan_printf(buf, "],");
+    *pdllnum = dllnum;
+    *pfuncnum = funcnum;
+}
+
+static bool_t scan_file(const char *path, PSCAN_BUF buf, int format)
+{
+    WINPE_FILEMAP filemap;
+    WINPE_VIEW view;
+    void *rawpe = winpe_mapfile(path, &filemap);
+    if(!rawpe) return FALSE;
+    if(!winpe_view_init(&view, rawpe, filemap.size, 0))
+    {
+        winpe_unmapfile(&filemap);
+        return FALSE;
+    }
+
+    // the header fields, the same offset in pe32 and pe32+
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = (PIMAGE_OPTIONAL_HEADER32)view.opthdr;
+    uint64_t imagebase = winpe_view_imagebase(&view);
+    uint64_t overlaysize = 0;
+    uint64_t overlayoffset = winpe_overlayrange(rawpe, filemap.size, &overlaysize);
+    size_t relocnum = scan_relocnum(&view);
+    if(format == WINPESCAN_FORMAT_JSON)
+    {
+        scan_printf(buf, "{\"path\":");
+        scan_putstr(buf, path, (size_t)-1, format);
+        scan_printf(buf, ",\"size\":%zu,\"machine\":%u,\"magic\":%u,"
+            "\"imagebase\":%llu,\"imagesize\":%u,\"entry\":%u,\"sections\":[",
+            filemap.size, view.filehdr->Machine, view.magic,
+            (unsigned long long)imagebase, view.imagesize, pOptHeader->AddressOfEntryPoint);
+        for(WORD i=0; i < view.sectnum; i++)
+        {
+            PIMAGE_SECTION_HEADER pSectHeader = winpe_view_section(&view, i);
+            scan_printf(buf, "%s{\"name\":", i ? "," : "");
+            scan_putstr(buf, (const char*)pSectHeader->Name, IMAGE_SIZEOF_SHORT_NAME, format);
+            scan_printf(buf, ",\"va\":%u,\"vsize\":%u,\"rawoffset\":%u,\"rawsize\":%u,"
+                "\"characteristics\":%u}", pSectHeader->VirtualAddress,
+                pSectHeader->Misc.VirtualSize, pSectHeader->PointerToRawData,
+                pSectHeader->SizeOfRawData, pSectHeader->Characteristics);
+        }
+        scan_printf(buf, "],");
+    }
+    else
+    {
+        scan_putstr(buf, path, (size_t)-1, format);
+        scan_printf(buf, ",%zu,%u,%u,%llu,%u,%u,%u,",
+            filemap.size, view.filehdr->Machine, view.magic,
+            (unsigned long long)imagebase, view.imagesize,
+            pOptHeader->AddressOfEntryPoint, view.sectnum);
+    }
+
+    // imports and exports
+    size_t dllnum = 0, funcnum = 0, expnum = 0;
+    scan_imports(&view, buf, format, &dllnum, &funcnum);
+    PIMAGE_EXPORT_DIRECTORY pExpDir = winpe_view_expdir(&view);
+    if(pExpDir) expnum = pExpDir->NumberOfNames;
+    if(expnum > WINPESCAN_MAXEXP) expnum = WINPESCAN_MAXEXP;
+    if(format == WINPESCAN_FORMAT_JSON)
+    {
+        scan_printf(buf, "\"exports\":[");
+        for(DWORD i=0; i < expnum; i++)
+        {
+            LPCSTR expname = NULL;
+            winpe_view_expname(&view, pExpDir, i, &expname);
+            if(i) scan_printf(buf, ",");
+            scan_putstr(buf, expname ? expname : "", (size_t)-1, format);
+        }
+        scan_printf(buf, "],\"overlay\":{\"offset\":%llu,\"size\":%llu},\"tls\":[",
+            (unsigned long long)overlayoffset, (unsigned long long)overlaysize);
+    }
+    else
+    {
+        scan_printf(buf, "%zu,%zu,%zu,%llu,%llu,", dllnum, funcnum, expnum,
+            (unsigned long long)overlayoffset, (unsigned long long)overlaysize);
+    }
+
+    // tls callbacks as rva
+    DWORD tlsnum = 0;
+    uint64_t cbva = 0;
+    while(tlsnum < WINPESCAN_MAXTLS && (cbva = winpe_view_tlscallback(&view, tlsnum)))
+    {
+        if(format == WINPESCAN_FORMAT_JSON)
+        {
+            scan_printf(buf, "%s%llu", tlsnum ? "," : "", (unsigned long long)(cbva - imagebase));
+        }
+        tlsnum++;
+    }
+    if(format == WINPESCAN_FORMAT_JSON) scan_printf(buf, "],\"relocs\":%zu}\n", relocnum);
+    else scan_printf(buf, "%u,%zu\n", tlsnum, relocnum);
+
+    winpe_unmapfile(&filemap);
+    return TRUE;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI scan_worker(LPVOID param)
+#else
+static void* scan_worker(void *param)
+#endif
+{
+    // each worker takes the next file, so the slow disk reads are overlapped
+    PSCAN_CTX ctx = (PSCAN_CTX)param;
+    SCAN_BUF buf = {NULL, 0, 0};
+    size_t i = 0;
+    while((i = scan_fetchadd(&ctx->next)) < ctx->list.count)
+    {
+        buf.size = 0;
+        if(!scan_file(ctx->list.paths[i], &buf, ctx->format)) continue;
+        scan_fetchadd(&ctx->pecount);
+        scan_mutex_lock(&ctx->lock);
+        fwrite(buf.data, 1, buf.size, ctx->fp);
+        scan_mutex_unlock(&ctx->lock);
+    }
+    free(buf.data);
+    return 0;
+}
+
+static double scan_walltime()
+{
+#ifdef _WIN32
+    return GetTickCount() / 1000.0;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int scan_cpunum()
+{
+#ifdef _WIN32
+    SYSTEM_INFO sysinfo;
+    GetSystemInfo(&sysinfo);
+    return (int)sysinfo.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    SCAN_CTX ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.fp = stdout;
+    int nthread = 0;
+    int argi = 1;
+    const char *outpath = NULL;
+    for(; argi < argc && argv[argi][0] == '-'; argi++)
+    {
+        if(!strcmp(argv[argi], "-j") && argi + 1 < argc) nthread = atoi(argv[++argi]);
+        else if(!strcmp(argv[argi], "-o") && argi + 1 < argc) outpath = argv[++argi];
+        else if(!strcmp(argv[argi], "-f") && argi + 1 < argc)
+        {
+            argi++;
+            if(!strcmp(argv[argi], "csv")) ctx.format = WINPESCAN_FORMAT_CSV;
+            else if(!strcmp(argv[argi], "json")) ctx.format = WINPESCAN_FORMAT_JSON;
+            else argi = argc;
+        }
+        else argi = argc;
+    }
+    if(argi >= argc)
+    {
+        fprintf(stderr, "winpescan v%s, developed by devseed\n"
+            "usage:\n"
+            "winpescan [-j threads] [-f json|csv] [-o outpath] path1 [path2 ...]\n"
+            "  scan pe files in the paths recursively, one record each line\n"
+            "  records are not in order when threads > 1\n", WINPESCAN_VERSION);
+        return -1;
+    }
+    if(outpath && !(ctx.fp = fopen(outpath, "wb")))
+    {
+        fprintf(stderr, "error open %s\n", outpath);
+        return -1;
+    }
+
+    // list all files first, then the workers only read and parse
+    double start = scan_walltime();
+    for(; argi < argc; argi++) scan_listwalk(&ctx.list, argv[argi]);
+    if(nthread <= 0) nthread = scan_cpunum() * 2; // more than cores to wait for io
+    if((size_t)nthread > ctx.list.count) nthread = ctx.list.count ? (int)ctx.list.count : 1;
+    if(ctx.format == WINPESCAN_FORMAT_CSV)
+    {
+        fprintf(ctx.fp, "path,size,machine,magic,imagebase,imagesize,entry,sectnum,"
+            "impdllnum,impfuncnum,expnum,overlayoffset,overlaysize,tlsnum,relocnum\n");
+    }
+
+    scan_mutex_init(&ctx.lock);
+    scan_thread_t *threads = (scan_thread_t*)malloc(nthread * sizeof(scan_thread_t));
+    for(int i=0; i < nthread; i++)
+    {
+#ifdef _WIN32
+        threads[i] = CreateThread(NULL, 0, scan_worker, &ctx, 0, NULL);
+#else
+        pthread_create(&threads[i], NULL, scan_worker, &ctx);
+#endif
+    }
+    for(int i=0; i < nthread; i++)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+#else
+        pthread_join(threads[i], NULL);
+#endif
+    }
+    scan_mutex_free(&ctx.lock);
+    free(threads);
+
+    fprintf(stderr, "scan %zu files, %d pe, %d threads, %.3fs\n",
+        ctx.list.count, (int)ctx.pecount, nthread, scan_walltime() - start);
+    for(size_t i=0; i < ctx.list.count; i++) free(ctx.list.paths[i]);
+    free(ctx.list.paths);
+    if(ctx.fp != stdout) fclose(ctx.fp);
+    return 0;
+}
+
+/**
+ * history:
+ * v0.1, initial version, scan pe files by worker threads, output json or csv
+ * v0.1.1, keep valid utf-8 in json strings, escape only control chars, quotes and invalid bytes
+*/
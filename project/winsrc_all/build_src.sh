@@ -22,6 +22,7 @@ build_csrc()
 
 mkdir -p $(dirname $0)/build
 build_pysrc src $(dirname $0)/build windllin
+build_pysrc src $(dirname $0)/build winrtm
 build_csrc src $(dirname $0)/build commdef
 build_csrc src $(dirname $0)/build winhook
 build_csrc src $(dirname $0)/build windyn
@@ -1,16 +1,23 @@
 /**
  * common macro define
- *   v0.1.1, developed by devseed
+ *   v0.1.6, developed by devseed
 */
 
 #ifndef _COMMDEF_H
 #define _COMMDEF_H
-#define COMMDEF_VERSION "0.1.1"
+#define COMMDEF_VERSION "0.1.6"
 #ifdef __cplusplus
 extern "C" {
 #endif
 #include <stdio.h>
+#include <stddef.h>
 #include <stdint.h>
+#if defined(__SSE4_2__) || defined(__AVX__)
+#include <nmmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 // function declear macro
 #if defined(_MSC_VER) || defined(__TINYC__)
@@ -31,7 +38,11 @@ extern "C" {
 #endif
 #else
 #ifndef STDCALL
+#if defined(_WIN32) || defined(__i386__)
 #define STDCALL __attribute__((stdcall))
+#else
+#define STDCALL // no stdcall on posix x64, avoid the warning
+#endif
 #endif
 #ifndef NAKED
 #define NAKED __attribute__((naked))
@@ -132,6 +143,13 @@ static INLINE size_t inl_strlen(const char *str1)
     return p - str1;
 }
 
+static INLINE int inl_strcmp(const char *str1, const char *str2)
+{
+    int i=0;
+    while(str1[i]!=0 && str1[i]==str2[i]) i++;
+    return (int)(uint8_t)str1[i] - (int)(uint8_t)str2[i];
+}
+
 static INLINE int inl_stricmp(const char *str1, const char *str2)
 {
     int i=0;
@@ -205,6 +223,80 @@ static INLINE uint32_t inl_crc32(const void *buf, size_t n)
     return ~crc32;
 }
 
+// fill crc32 table with 256 items (1KB), for inl_crc32t
+static INLINE void inl_crc32tab(uint32_t *table)
+{
+    for(uint32_t i=0; i < 256; i++)
+    {
+        uint32_t crc32 = i;
+        for(int j = 0; j < 8; j++)
+        {
+            uint32_t t = ~((crc32&1) - 1); 
+            crc32 = (crc32>>1) ^ (0xEDB88320 & t);
+        }
+        table[i] = crc32;
+    }
+}
+
+// crc32 by table from inl_crc32tab, one byte each step for short names
+static INLINE uint32_t inl_crc32t(const void *buf, size_t n, const uint32_t *table)
+{
+    const uint8_t *p = (const uint8_t*)buf;
+    uint32_t crc32 = ~0;
+    for(; n > 0; n--, p++)
+    {
+        crc32 = (crc32 >> 8) ^ table[(crc32 ^ *p) & 0xff];
+    }
+    return ~crc32;
+}
+
+// crc32c (castagnoli), use sse4.2 crc32 instruction if enabled
+static INLINE uint32_t inl_crc32c(const void *buf, size_t n)
+{
+    const uint8_t *p = (const uint8_t*)buf;
+    uint32_t crc32 = ~0;
+#if defined(__SSE4_2__) || defined(__AVX__)
+#if defined(_WIN64) || defined(__x86_64__)
+    uint64_t crc64 = crc32;
+    for(; n >= 8; n -= 8, p += 8)
+    {
+        crc64 = _mm_crc32_u64(crc64, *(const uint64_t*)p);
+    }
+    crc32 = (uint32_t)crc64;
+#endif
+    for(; n >= 4; n -= 4, p += 4)
+    {
+        crc32 = _mm_crc32_u32(crc32, *(const uint32_t*)p);
+    }
+    for(; n > 0; n--, p++)
+    {
+        crc32 = _mm_crc32_u8(crc32, *p);
+    }
+#else
+    for(; n > 0; n--, p++)
+    {
+        crc32 ^= *p;
+        for(int i = 0; i < 8; i++)
+        {
+            uint32_t t = ~((crc32&1) - 1); 
+            crc32 = (crc32>>1) ^ (0x82F63B78 & t);
+        }
+    }
+#endif
+    return ~crc32;
+}
+
+static INLINE uint32_t inl_fnv1a32(const void *buf, size_t n)
+{
+    uint32_t hash = 0x811c9dc5;
+    for(size_t i=0; i < n; i++)
+    {
+        hash ^= *((const uint8_t*)buf+i);
+        hash *= 0x01000193;
+    }
+    return hash;
+}
+
 static INLINE void* inl_memset(void *buf, int ch, size_t n)
 {
     char *p = (char *)buf;
@@ -364,6 +456,186 @@ inl_search_next:
     return matchaddr;
 }
 
+// atomic helpers for lock-free caches
+static INLINE int32_t inl_cas32(volatile int32_t *dst, int32_t xchg, int32_t cmp)
+{
+#if defined(_MSC_VER)
+    return (int32_t)_InterlockedCompareExchange((volatile long*)dst, (long)xchg, (long)cmp);
+#elif defined(__TINYC__)
+    int32_t ret;
+    __asm__ __volatile__("lock; cmpxchgl %2, %1" 
+        : "=a"(ret), "+m"(*dst) : "r"(xchg), "0"(cmp) : "memory");
+    return ret;
+#else
+    return __sync_val_compare_and_swap(dst, cmp, xchg);
+#endif
+}
+
+static INLINE void inl_fence()
+{
+#if defined(_MSC_VER) && (defined(_M_ARM) || defined(_M_ARM64))
+    __dmb(0xB); // ish
+#elif defined(_MSC_VER)
+    _ReadWriteBarrier(); // x86 loads are not reordered with other loads
+#elif defined(__TINYC__)
+    __asm__ __volatile__("" ::: "memory");
+#else
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+#endif
+}
+
+// loader module cache, shared by winpe and windyn
+#define INL_MODCACHE_SLOTNUM 0x100
+#define INL_MODCACHE_MAXPROBE 8 // slots probed from the hash, the first is replaced if all used
+
+typedef struct _INL_LISTLINK
+{
+    struct _INL_LISTLINK *flink;
+    struct _INL_LISTLINK *blink;
+}INL_LISTLINK, *PINL_LISTLINK;
+
+typedef struct _INL_MODSLOT
+{
+    volatile int32_t seq; // odd while writing, slot is read again if changed
+    volatile uint32_t hash; // fnv1a32 of lower module name, 0 for empty slot
+    volatile int32_t epoch; // cache epoch when filled, older slots are not used
+    void* volatile link; // InMemoryOrderLinks of the ldr entry, compared before read
+    void* volatile dllbase;
+}INL_MODSLOT, *PINL_MODSLOT;
+
+typedef struct _INL_MODCACHE
+{
+    volatile int32_t epoch; // increased when the ldr list stamp changed
+    void* volatile head; // ldr list stamp, first, last link and count
+    void* volatile tail;
+    volatile int32_t count;
+    INL_MODSLOT slots[INL_MODCACHE_SLOTNUM];
+}INL_MODCACHE, *PINL_MODCACHE;
+
+/**
+ * compare the base name in FullDllName of ldr entry, case-insensitive
+*/
+static INLINE int inl_ldrmatch(const void *link, const char *modulename)
+{
+    const uint8_t *ustr = (const uint8_t*)link + 7*sizeof(void*); // FullDllName
+    const wchar_t *buf = *(const wchar_t* const*)(ustr + sizeof(void*));
+    int i = *(const uint16_t*)ustr / 2 - 1;
+    if(!buf || i < 0) return 0;
+    for(; i > 0 && buf[i] != '\\'; i--);
+    if(buf[i] == '\\') i++;
+    return inl_stricmp2(modulename, buf + i) == 0;
+}
+
+/**
+ * check the ldr list stamp (first, last link and count), 
+ * increase the epoch if changed, so that all filled slots are dropped
+ * @return the current epoch
+*/
+static INLINE int32_t inl_modcache_epoch(INL_MODCACHE *cache, const INL_LISTLINK *list, int32_t count)
+{
+    int32_t epoch = cache->epoch;
+    if(cache->head == list->flink && cache->tail == list->blink && cache->count == count) return epoch;
+    if(inl_cas32(&cache->epoch, epoch + 1, epoch) != epoch) return cache->epoch; // by other thread
+    cache->head = list->flink;
+    cache->tail = list->blink;
+    cache->count = count;
+    return epoch + 1;
+}
+
+static INLINE void inl_modcache_put(INL_MODCACHE *cache, uint32_t hash, int32_t epoch, 
+    void *link, void *dllbase)
+{
+    // use the empty, same name or older epoch slot in probe range, or replace the first slot
+    INL_MODSLOT *target = &cache->slots[hash & (INL_MODCACHE_SLOTNUM - 1)];
+    for(uint32_t k=0; k < INL_MODCACHE_MAXPROBE; k++)
+    {
+        INL_MODSLOT *slot = &cache->slots[(hash + k) & (INL_MODCACHE_SLOTNUM - 1)];
+        if(!slot->hash || slot->hash == hash || slot->epoch != epoch)
+        {
+            target = slot;
+            break;
+        }
+    }
+    int32_t seq = target->seq;
+    if((seq & 1) || inl_cas32(&target->seq, seq + 1, seq) != seq) return; // other thread writing
+    target->hash = hash;
+    target->epoch = epoch;
+    target->link = link;
+    target->dllbase = dllbase;
+    inl_cas32(&target->seq, seq + 2, seq + 1);
+}
+
+/**
+ * find module in ldr InMemoryOrderModuleList, similar as GetModuleHandleA
+ * @param head &ldr->InMemoryOrderModuleList
+ * @param cache if not NULL, probe and fill slots by lower name hash and ldr list stamp, 
+ *        a cached link is read only after found by pointer on the live list, 
+ *        so a freed ldr entry is never touched
+ * @return dllbase, the first module if modulename is NULL
+*/
+static INLINE void* inl_findmodule(void *head, const char *modulename, INL_MODCACHE *cache)
+{
+    INL_LISTLINK *list = (INL_LISTLINK*)head;
+    if(!modulename) return *(void**)((uint8_t*)list->flink + 4*sizeof(void*));
+
+    uint32_t hash = 0x811c9dc5;
+    for(const char *p = modulename; *p; p++)
+    {
+        uint8_t c = (uint8_t)*p;
+        if(c >= 'A' && c <= 'Z') c += 0x20;
+        hash = (hash ^ c) * 0x01000193;
+    }
+    if(!hash) hash = 1;
+
+    // take the slots of current epoch, count the list and match the links without string compare
+    int32_t epoch = 0;
+    if(cache)
+    {
+        int32_t epoch0 = cache->epoch;
+        void *links[INL_MODCACHE_MAXPROBE];
+        void *bases[INL_MODCACHE_MAXPROBE];
+        uint32_t n = 0;
+        for(uint32_t k=0; k < INL_MODCACHE_MAXPROBE; k++)
+        {
+            INL_MODSLOT *slot = &cache->slots[(hash + k) & (INL_MODCACHE_SLOTNUM - 1)];
+            int32_t seq = slot->seq;
+            inl_fence();
+            uint32_t curhash = slot->hash;
+            int32_t curepoch = slot->epoch;
+            void *curlink = slot->link;
+            void *curbase = slot->dllbase;
+            inl_fence();
+            if((seq & 1) || seq != slot->seq) continue; // writing by other thread
+            if(curhash != hash || curepoch != epoch0) continue;
+            links[n] = curlink;
+            bases[n] = curbase;
+            n++;
+        }
+        int32_t count = 0;
+        void *found = NULL;
+        for(INL_LISTLINK *link = list->flink; link != list; link = link->flink, count++)
+        {
+            for(uint32_t i=0; !found && i < n; i++)
+            {
+                if(link != links[i]) continue; // live entry, safe to read
+                void *dllbase = *(void**)((uint8_t*)link + 4*sizeof(void*));
+                if(dllbase == bases[i] && inl_ldrmatch(link, modulename)) found = dllbase;
+            }
+        }
+        epoch = inl_modcache_epoch(cache, list, count);
+        if(found && epoch == epoch0) return found;
+    }
+
+    for(INL_LISTLINK *link = list->flink; link != list; link = link->flink)
+    {
+        if(!inl_ldrmatch(link, modulename)) continue;
+        void *dllbase = *(void**)((uint8_t*)link + 4*sizeof(void*));
+        if(cache) inl_modcache_put(cache, hash, epoch, link, dllbase);
+        return dllbase;
+    }
+    return NULL;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -373,4 +645,9 @@ inl_search_next:
  * history
  * v0.1, initial version
  * v0.1.1, add hexifya, hexifyw, search
+ * v0.1.2, add strcmp, fnv1a32
+ * v0.1.3, add crc32tab, crc32t, crc32c
+ * v0.1.4, add cas32, fence, findmodule with module cache
+ * v0.1.5, module cache dropped by ldr list stamp, cached links compared on list before read
+ * v0.1.6, inl_crc32t by one 1KB table only, slice-by-8 removed
 */
\ No newline at end of file
@@ -1,5 +1,5 @@
 # -*- coding: utf-8 -*-
-__version__ = "0.3.2.1"
+__version__ = "0.3.3"
 __description__ = f"""
 modify windows pe with dll injected for hooking
 only support for x86 and x64 architecture, no arm support now
@@ -12,6 +12,59 @@ import argparse
 import lief
 from keystone import Ks, KS_ARCH_X86, KS_MODE_32, KS_MODE_64
 
+def lz4_compress(data, acceleration=1) -> bytes:
+    """
+    compress data to lz4 block format (without frame and size), 
+    for winpe_memlz4decode in winpe.h
+    """
+
+    def matchlen(ref, cur, limit):
+        n, k = 0, 0x1000
+        while k and cur + n < limit:
+            k = min(k, limit - cur - n)
+            if data[ref+n: ref+n+k] == data[cur+n: cur+n+k]: n += k
+            else: k //= 2
+        return n
+
+    def extlen(out, n):
+        while n >= 255:
+            out.append(255)
+            n -= 255
+        out.append(n)
+
+    try:
+        import lz4.block
+        return lz4.block.compress(bytes(data), 
+            mode='high_compression', store_size=False)
+    except ImportError: pass
+
+    data = bytes(data)
+    size = len(data)
+    out = bytearray()
+    table = dict()
+    anchor, cur = 0, 0
+    while cur < size - 12: # the last match should start 12 bytes before end
+        key = data[cur: cur+4]
+        ref = table.get(key)
+        table[key] = cur
+        if ref is None or cur - ref > 0xffff: # skip faster in uncompressible data
+            cur += acceleration + ((cur - anchor) >> 6)
+            continue
+        mlen = 4 + matchlen(ref + 4, cur + 4, size - 5) # last 5 bytes are literals
+        litlen = cur - anchor
+        out.append((min(litlen, 15) << 4) | min(mlen - 4, 15))
+        if litlen >= 15: extlen(out, litlen - 15)
+        out += data[anchor: cur]
+        out += int.to_bytes(cur - ref, 2, 'little')
+        if mlen - 4 >= 15: extlen(out, mlen - 4 - 15)
+        cur += mlen
+        anchor = cur
+    litlen = size - anchor
+    out.append(min(litlen, 15) << 4)
+    if litlen >= 15: extlen(out, litlen - 15)
+    out += data[anchor:]
+    return bytes(out)
+
 def injectdll_iat(exepath, dllpath, outpath="out.exe"): 
     """
     This might be regared as virus by windows defender, 
@@ -237,7 +290,7 @@ def injectdll_codecave2(exepath, dllpath, outpath="out.exe", aslr=False):
     builder.build()
     builder.write(outpath)
 
-def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
+def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False, compress=False):
     # parsing exepe
     exepe = lief.parse(exepath)
     exepe_oph = exepe.optional_header
@@ -255,6 +308,9 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         dllpe_content.extend(sect.content)
     padding_size = dllpe_oph.sizeof_image - len(dllpe_content)
     if padding_size>0: dllpe_content.extend([0x00]*(padding_size))
+    if compress: # decoded to the image memory by shellcode, zero padding is not stored
+        dllpe_lz4 = list(lz4_compress(dllpe_content))
+        print(f"compress module 0x{len(dllpe_content):x} -> 0x{len(dllpe_lz4):x}")
     
     # make shellocde for loading memory module
     if exepe_oph.magic == lief.PE.PE_TYPE.PE32_PLUS:
@@ -262,6 +318,7 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         vasize = 0x8
         memreloc_code = [0x41, 0x57, 0x41, 0x56, 0x41, 0x55, 0x41, 0x54, 0x56, 0x57, 0x55, 0x53, 0x48, 0x83, 0xEC, 0x10, 0x48, 0x63, 0x69, 0x3C, 0x44, 0x8B, 0x8C, 0x29, 0xB4, 0x00, 0x00, 0x00, 0x31, 0xC0, 0x45, 0x85, 0xC9, 0x0F, 0x84, 0x8D, 0x00, 0x00, 0x00, 0x48, 0x89, 0x54, 0x24, 0x08, 0x49, 0x89, 0xD2, 0x4C, 0x2B, 0x54, 0x29, 0x30, 0x48, 0x89, 0x2C, 0x24, 0x44, 0x8B, 0x9C, 0x29, 0xB0, 0x00, 0x00, 0x00, 0x49, 0x01, 0xCB, 0x49, 0xBE, 0xF8, 0xFF, 0xFF, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x41, 0xBF, 0xFF, 0xFF, 0xFF, 0xFF, 0x45, 0x31, 0xE4, 0x44, 0x89, 0xE3, 0x41, 0x8B, 0x74, 0x1B, 0x04, 0x4C, 0x01, 0xF6, 0x49, 0x89, 0xF5, 0x49, 0xD1, 0xED, 0x4C, 0x89, 0xEF, 0x4C, 0x21, 0xFF, 0x74, 0x26, 0x4C, 0x01, 0xDB, 0x31, 0xED, 0x44, 0x0F, 0xB7, 0x44, 0x6B, 0x08, 0x45, 0x85, 0xC0, 0x74, 0x0E, 0x41, 0x81, 0xE0, 0xFF, 0x0F, 0x00, 0x00, 0x44, 0x03, 0x03, 0x4E, 0x01, 0x14, 0x01, 0x48, 0xFF, 0xC5, 0x48, 0x39, 0xEF, 0x75, 0xDF, 0x83, 0xC6, 0x08, 0x83, 0xE6, 0xFE, 0x44, 0x01, 0xE6, 0x44, 0x01, 0xE8, 0x41, 0x89, 0xF4, 0x44, 0x39, 0xCE, 0x72, 0xAD, 0x89, 0xC0, 0x48, 0x8B, 0x54, 0x24, 0x08, 0x48, 0x8B, 0x2C, 0x24, 0x48, 0x89, 0x54, 0x29, 0x30, 0x48, 0x83, 0xC4, 0x10, 0x5B, 0x5D, 0x5F, 0x5E, 0x41, 0x5C, 0x41, 0x5D, 0x41, 0x5E, 0x41, 0x5F, 0xC3]
         membindiat_code = [0x41, 0x57, 0x41, 0x56, 0x41, 0x55, 0x41, 0x54, 0x56, 0x57, 0x55, 0x53, 0x48, 0x83, 0xEC, 0x38, 0x4D, 0x89, 0xC5, 0x49, 0x89, 0xCF, 0x48, 0x63, 0x41, 0x3C, 0x44, 0x8B, 0xA4, 0x01, 0x90, 0x00, 0x00, 0x00, 0x48, 0x89, 0xD0, 0x48, 0x89, 0x54, 0x24, 0x20, 0x48, 0x85, 0xD2, 0x0F, 0x85, 0x28, 0x01, 0x00, 0x00, 0x48, 0x8D, 0x4C, 0x24, 0x28, 0x48, 0xC7, 0x01, 0x00, 0x00, 0x00, 0x00, 0x65, 0x48, 0x8B, 0x04, 0x25, 0x60, 0x00, 0x00, 0x00, 0x48, 0x8B, 0x40, 0x18, 0x48, 0x8B, 0x40, 0x20, 0x48, 0x8B, 0x00, 0x48, 0x8B, 0x00, 0x48, 0x8B, 0x40, 0x20, 0x48, 0x89, 0x44, 0x24, 0x28, 0x48, 0x8B, 0x29, 0x48, 0xB8, 0x69, 0x62, 0x72, 0x61, 0x72, 0x79, 0x41, 0x00, 0x48, 0x89, 0x41, 0x05, 0x48, 0xB8, 0x4C, 0x6F, 0x61, 0x64, 0x4C, 0x69, 0x62, 0x72, 0x48, 0x89, 0x01, 0x48, 0x63, 0x45, 0x3C, 0x8B, 0x84, 0x05, 0x88, 0x00, 0x00, 0x00, 0x44, 0x8B, 0x44, 0x05, 0x24, 0x49, 0x01, 0xE8, 0x44, 0x8B, 0x4C, 0x05, 0x1C, 0x49, 0x01, 0xE9, 0x48, 0x81, 0xF9, 0x00, 0x00, 0x01, 0x00, 0x73, 0x27, 0x8B, 0x44, 0x05, 0x10, 0xFF, 0xC8, 0x48, 0x8D, 0x4C, 0x24, 0x28, 0xBA, 0xFF, 0xFF, 0x00, 0x00, 0x21, 0xD1, 0x21, 0xD0, 0x29, 0xC1, 0x48, 0x63, 0xC1, 0x41, 0x0F, 0xB7, 0x04, 0x40, 0x41, 0x8B, 0x04, 0x81, 0x48, 0x01, 0xE8, 0xEB, 0x79, 0x44, 0x8B, 0x5C, 0x05, 0x18, 0x4D, 0x85, 0xDB, 0x74, 0x6D, 0x44, 0x8B, 0x74, 0x05, 0x20, 0x49, 0x01, 0xEE, 0x4C, 0x8D, 0x55, 0x01, 0x31, 0xC0, 0x48, 0x89, 0x44, 0x24, 0x20, 0x31, 0xD2, 0x41, 0x8B, 0x0C, 0x96, 0x8A, 0x44, 0x0D, 0x00, 0x84, 0xC0, 0x74, 0x33, 0x4C, 0x01, 0xD1, 0x31, 0xFF, 0x0F, 0xBE, 0xF0, 0x0F, 0xBE, 0x5C, 0x3C, 0x28, 0x85, 0xDB, 0x74, 0x26, 0x38, 0xD8, 0x74, 0x10, 0x8D, 0x46, 0x20, 0x39, 0xD8, 0x74, 0x09, 0x89, 0xD8, 0x83, 0xC0, 0x20, 0x39, 0xF0, 0x75, 0x16, 0x8A, 0x04, 0x39, 0x48, 0xFF, 0xC7, 0x84, 0xC0, 0x75, 0xD6, 0x89, 0xFF, 0xEB, 0x02, 0x31, 0xFF, 0x31, 0xF6, 0x8A, 0x5C, 0x3C, 0x28, 0x0F, 0xBE, 0xC3, 0x39, 0xC6, 0x74, 0x13, 0x48, 0xFF, 0xC2, 0x4C, 0x39, 0xDA, 0x75, 0xAA, 0xEB, 0x1C, 0x31, 0xC0, 0x48, 0x89, 0x44, 0x24, 0x20, 0xEB, 0x13, 0x89, 0xD0, 0x41, 0x0F, 0xB7, 0x04, 0x40, 0x41, 0x8B, 0x04, 0x81, 0x48, 0x01, 0xC5, 0x48, 0x89, 0x6C, 0x24, 0x20, 0x4D, 0x01, 0xFC, 0x4D, 0x85, 0xED, 0x0F, 0x85, 0x21, 0x01, 0x00, 0x00, 0x48, 0x8D, 0x4C, 0x24, 0x28, 0x48, 0xC7, 0x01, 0x00, 0x00, 0x00, 0x00, 0x65, 0x48, 0x8B, 0x04, 0x25, 0x60, 0x00, 0x00, 0x00, 0x48, 0x8B, 0x40, 0x18, 0x48, 0x8B, 0x40, 0x20, 0x48, 0x8B, 0x00, 0x48, 0x8B, 0x00, 0x48, 0x8B, 0x40, 0x20, 0x48, 0x89, 0x44, 0x24, 0x28, 0x48, 0x8B, 0x29, 0x48, 0xB8, 0x41, 0x64, 0x64, 0x72, 0x65, 0x73, 0x73, 0x00, 0x48, 0x89, 0x41, 0x07, 0x48, 0xB8, 0x47, 0x65, 0x74, 0x50, 0x72, 0x6F, 0x63, 0x41, 0x48, 0x89, 0x01, 0x48, 0x63, 0x45, 0x3C, 0x8B, 0x84, 0x05, 0x88, 0x00, 0x00, 0x00, 0x44, 0x8B, 0x44, 0x05, 0x24, 0x49, 0x01, 0xE8, 0x44, 0x8B, 0x4C, 0x05, 0x1C, 0x49, 0x01, 0xE9, 0x48, 0x81, 0xF9, 0x00, 0x00, 0x01, 0x00, 0x73, 0x2A, 0x8B, 0x44, 0x05, 0x10, 0xFF, 0xC8, 0x48, 0x8D, 0x4C, 0x24, 0x28, 0xBA, 0xFF, 0xFF, 0x00, 0x00, 0x21, 0xD1, 0x21, 0xD0, 0x29, 0xC1, 0x48, 0x63, 0xC1, 0x41, 0x0F, 0xB7, 0x04, 0x40, 0x45, 0x8B, 0x2C, 0x81, 0x49, 0x01, 0xED, 0xE9, 0x89, 0x00, 0x00, 0x00, 0x44, 0x8B, 0x5C, 0x05, 0x18, 0x4D, 0x85, 0xDB, 0x74, 0x69, 0x44, 0x8B, 0x74, 0x05, 0x20, 0x49, 0x01, 0xEE, 0x4C, 0x8D, 0x55, 0x01, 0x45, 0x31, 0xED, 0x31, 0xD2, 0x41, 0x8B, 0x0C, 0x96, 0x8A, 0x44, 0x0D, 0x00, 0x84, 0xC0, 0x74, 0x33, 0x4C, 0x01, 0xD1, 0x31, 0xFF, 0x0F, 0xBE, 0xF0, 0x0F, 0xBE, 0x5C, 0x3C, 0x28, 0x85, 0xDB, 0x74, 0x26, 0x38, 0xD8, 0x74, 0x10, 0x8D, 0x46, 0x20, 0x39, 0xD8, 0x74, 0x09, 0x89, 0xD8, 0x83, 0xC0, 0x20, 0x39, 0xF0, 0x75, 0x16, 0x8A, 0x04, 0x39, 0x48, 0xFF, 0xC7, 0x84, 0xC0, 0x75, 0xD6, 0x89, 0xFF, 0xEB, 0x02, 0x31, 0xFF, 0x31, 0xF6, 0x8A, 0x5C, 0x3C, 0x28, 0x0F, 0xBE, 0xC3, 0x39, 0xC6, 0x74, 0x0F, 0x48, 0xFF, 0xC2, 0x4C, 0x39, 0xDA, 0x75, 0xAA, 0xEB, 0x16, 0x45, 0x31, 0xED, 0xEB, 0x11, 0x89, 0xD0, 0x41, 0x0F, 0xB7, 0x04, 0x40, 0x41, 0x8B, 0x04, 0x81, 0x48, 0x01, 0xC5, 0x49, 0x89, 0xED, 0x41, 0x8B, 0x44, 0x24, 0x0C, 0x31, 0xED, 0x85, 0xC0, 0x74, 0x67, 0x89, 0xC1, 0x4C, 0x01, 0xF9, 0x41, 0x8B, 0x3C, 0x24, 0x45, 0x8B, 0x74, 0x24, 0x10, 0xFF, 0x54, 0x24, 0x20, 0x48, 0x85, 0xC0, 0x74, 0x54, 0x4B, 0x83, 0x3C, 0x37, 0x00, 0x74, 0x3E, 0x48, 0x89, 0xC3, 0x4C, 0x89, 0xFE, 0x48, 0x8B, 0x04, 0x3E, 0x48, 0x85, 0xC0, 0x74, 0x2F, 0x4C, 0x89, 0xF9, 0x48, 0x01, 0xC1, 0x0F, 0xB7, 0xC9, 0x49, 0x8D, 0x54, 0x07, 0x02, 0x48, 0x0F, 0x48, 0xD1, 0x48, 0x89, 0xD9, 0x41, 0xFF, 0xD5, 0x48, 0x85, 0xC0, 0x74, 0x06, 0x4A, 0x89, 0x04, 0x36, 0xFF, 0xC5, 0x4A, 0x83, 0x7C, 0x36, 0x08, 0x00, 0x48, 0x8D, 0x76, 0x08, 0x75, 0xC8, 0x41, 0x8B, 0x44, 0x24, 0x20, 0x49, 0x83, 0xC4, 0x14, 0xEB, 0x95, 0x89, 0xE8, 0xEB, 0x02, 0x31, 0xC0, 0x48, 0x83, 0xC4, 0x38, 0x5B, 0x5D, 0x5F, 0x5E, 0x41, 0x5C, 0x41, 0x5D, 0x41, 0x5E, 0x41, 0x5F, 0xC3]
+        lz4decode_code = [0x55, 0x57, 0x56, 0x4B, 0x8D, 0x34, 0x08, 0x53, 0x48, 0x8D, 0x1C, 0x11, 0x48, 0x39, 0xD9, 0x0F, 0x83, 0x4F, 0x01, 0x00, 0x00, 0x49, 0x89, 0xCA, 0x4C, 0x89, 0xC0, 0x49, 0x8D, 0x4A, 0x01, 0x45, 0x0F, 0xB6, 0x12, 0x4D, 0x89, 0xD1, 0x49, 0xC1, 0xEA, 0x04, 0x49, 0x83, 0xFA, 0x0F, 0x0F, 0x84, 0x2B, 0x01, 0x00, 0x00, 0x48, 0x89, 0xDA, 0x48, 0x29, 0xCA, 0x4C, 0x39, 0xD2, 0x0F, 0x82, 0x21, 0x01, 0x00, 0x00, 0x48, 0x89, 0xF2, 0x48, 0x29, 0xC2, 0x4C, 0x39, 0xD2, 0x0F, 0x82, 0x12, 0x01, 0x00, 0x00, 0x49, 0x83, 0xFA, 0x07, 0x76, 0x33, 0x49, 0x8D, 0x52, 0xF8, 0x48, 0xC1, 0xEA, 0x03, 0x48, 0x8D, 0x3C, 0xD5, 0x08, 0x00, 0x00, 0x00, 0x31, 0xD2, 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x4C, 0x8B, 0x1C, 0x11, 0x4C, 0x89, 0x1C, 0x10, 0x48, 0x83, 0xC2, 0x08, 0x48, 0x39, 0xFA, 0x75, 0xEF, 0x48, 0x01, 0xD0, 0x48, 0x01, 0xD1, 0x41, 0x83, 0xE2, 0x07, 0x4D, 0x85, 0xD2, 0x74, 0x20, 0x31, 0xD2, 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x44, 0x0F, 0xB6, 0x1C, 0x11, 0x44, 0x88, 0x1C, 0x10, 0x48, 0x83, 0xC2, 0x01, 0x49, 0x39, 0xD2, 0x75, 0xEE, 0x4C, 0x01, 0xD1, 0x4C, 0x01, 0xD0, 0x48, 0x39, 0xD9, 0x0F, 0x83, 0x84, 0x00, 0x00, 0x00, 0x48, 0x89, 0xDA, 0x48, 0x29, 0xCA, 0x48, 0x83, 0xFA, 0x01, 0x0F, 0x84, 0x9B, 0x00, 0x00, 0x00, 0x0F, 0xB7, 0x29, 0x4C, 0x8D, 0x51, 0x02, 0x0F, 0xB7, 0xFD, 0x85, 0xED, 0x0F, 0x84, 0x89, 0x00, 0x00, 0x00, 0x48, 0x89, 0xC2, 0x4C, 0x29, 0xC2, 0x48, 0x39, 0xFA, 0x72, 0x7E, 0x44, 0x89, 0xC9, 0x4C, 0x89, 0xCA, 0x83, 0xE1, 0x0F, 0x83, 0xE2, 0x0F, 0x80, 0xF9, 0x0F, 0x0F, 0x84, 0xBD, 0x00, 0x00, 0x00, 0x48, 0x89, 0xF1, 0x4C, 0x8D, 0x5A, 0x04, 0x48, 0x29, 0xC1, 0x4C, 0x39, 0xD9, 0x72, 0x5A, 0x49, 0x89, 0xC1, 0x49, 0x29, 0xF9, 0x83, 0xFD, 0x07, 0x7F, 0x5B, 0x31, 0xD2, 0x4D, 0x85, 0xDB, 0x74, 0x18, 0x0F, 0x1F, 0x40, 0x00, 0x41, 0x0F, 0xB6, 0x0C, 0x11, 0x88, 0x0C, 0x10, 0x48, 0x83, 0xC2, 0x01, 0x49, 0x39, 0xD3, 0x75, 0xEF, 0x4C, 0x01, 0xD8, 0x49, 0x39, 0xDA, 0x0F, 0x82, 0xDE, 0xFE, 0xFF, 0xFF, 0x5B, 0x4C, 0x29, 0xC0, 0x5E, 0x5F, 0x5D, 0xC3, 0x0F, 0x1F, 0x00, 0x0F, 0xB6, 0x11, 0x48, 0x83, 0xC1, 0x01, 0x49, 0x01, 0xD2, 0x48, 0x81, 0xFA, 0xFF, 0x00, 0x00, 0x00, 0x0F, 0x85, 0xD5, 0xFE, 0xFF, 0xFF, 0x48, 0x39, 0xD9, 0x72, 0xE4, 0x5B, 0x31, 0xC0, 0x5E, 0x5F, 0x5D, 0xC3, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x49, 0x83, 0xFB, 0x07, 0x76, 0x9F, 0x48, 0x8D, 0x4A, 0xFC, 0x31, 0xD2, 0x48, 0x89, 0xCD, 0x48, 0xC1, 0xED, 0x03, 0x48, 0x8D, 0x3C, 0xED, 0x08, 0x00, 0x00, 0x00, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0x4D, 0x8B, 0x1C, 0x11, 0x4C, 0x89, 0x1C, 0x10, 0x48, 0x83, 0xC2, 0x08, 0x48, 0x39, 0xFA, 0x75, 0xEF, 0x48, 0xF7, 0xDD, 0x48, 0x01, 0xD0, 0x49, 0x01, 0xD1, 0x4C, 0x8D, 0x1C, 0xE9, 0xE9, 0x62, 0xFF, 0xFF, 0xFF, 0x0F, 0x1F, 0x44, 0x00, 0x00, 0xBA, 0x0F, 0x00, 0x00, 0x00, 0xEB, 0x19, 0x90, 0x41, 0x0F, 0xB6, 0x0A, 0x49, 0x83, 0xC2, 0x01, 0x48, 0x01, 0xCA, 0x48, 0x81, 0xF9, 0xFF, 0x00, 0x00, 0x00, 0x0F, 0x85, 0x23, 0xFF, 0xFF, 0xFF, 0x49, 0x39, 0xDA, 0x72, 0xE3, 0xEB, 0x85]
         membindtls_code = [0x56, 0x57, 0x55, 0x53, 0x48, 0x83, 0xEC, 0x28, 0x48, 0x63, 0x41, 0x3C, 0x8B, 0x84, 0x01, 0xD0, 0x00, 0x00, 0x00, 0x48, 0x85, 0xC0, 0x74, 0x32, 0x48, 0x89, 0xCF, 0x48, 0x8B, 0x74, 0x01, 0x18, 0x48, 0x85, 0xF6, 0x74, 0x25, 0x48, 0x8B, 0x06, 0x48, 0x85, 0xC0, 0x74, 0x1D, 0x89, 0xD5, 0x31, 0xDB, 0x48, 0x89, 0xF9, 0x89, 0xEA, 0x45, 0x31, 0xC0, 0xFF, 0xD0, 0x48, 0x8B, 0x44, 0xDE, 0x08, 0x48, 0xFF, 0xC3, 0x48, 0x85, 0xC0, 0x75, 0xE9, 0xEB, 0x02, 0x31, 0xDB, 0x48, 0x89, 0xD8, 0x48, 0x83, 0xC4, 0x28, 0x5B, 0x5D, 0x5F, 0x5E, 0xC3]
 
         ks = Ks(KS_ARCH_X86, KS_MODE_64)
@@ -283,6 +340,20 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         mov rdi, [rdi + 20h]; //InMemoryOrderLoadList, this
         mov rdi, [rdi -10h + 30h]; //this.DllBase
 
+        // decode the compressed module
+        mov rdx, [rbx + lz4size]; // arg2, srcsize
+        test rdx, rdx;
+        jz lz4skip;
+        mov rcx, [rbx + lz4rva];
+        add rcx, rdi; // arg1, src
+        mov r8, [rbx + dllrva];
+        add r8, rdi; // arg3, dst
+        mov r9, [rbx + dllsize]; // arg4, dstsize
+        mov rax, [rbx + lz4decoderva];
+        add rax, rdi;
+        call rax;
+        lz4skip:
+
         // reloc
         mov rcx, [rbx + dllrva];
         add rcx, rdi;
@@ -339,6 +410,10 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         memrelocrva: nop;nop;nop;nop;nop;nop;nop;nop;
         membindiatrva: nop;nop;nop;nop;nop;nop;nop;nop;
         membindtlsrva: nop;nop;nop;nop;nop;nop;nop;nop;
+        lz4decoderva: nop;nop;nop;nop;nop;nop;nop;nop;
+        lz4rva: nop;nop;nop;nop;nop;nop;nop;nop;
+        lz4size: nop;nop;nop;nop;nop;nop;nop;nop;
+        dllsize: nop;nop;nop;nop;nop;nop;nop;nop;
         """
         print(infostr, code_str)
         payload, _ = ks.asm(code_str) # > 32bit error
@@ -347,6 +422,7 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         vasize = 0x4
         memreloc_code = [0x55, 0x53, 0x57, 0x56, 0x83, 0xEC, 0x14, 0x8B, 0x5C, 0x24, 0x2C, 0x8B, 0x44, 0x24, 0x28, 0x8B, 0x48, 0x3C, 0x8B, 0x94, 0x08, 0xA4, 0x00, 0x00, 0x00, 0x89, 0x54, 0x24, 0x08, 0x85, 0xD2, 0x89, 0x4C, 0x24, 0x04, 0x74, 0x67, 0x2B, 0x5C, 0x08, 0x34, 0x8B, 0x94, 0x08, 0xA0, 0x00, 0x00, 0x00, 0x89, 0xC1, 0x01, 0xC2, 0x89, 0x14, 0x24, 0x31, 0xF6, 0x31, 0xC0, 0x89, 0x74, 0x24, 0x10, 0x8B, 0x14, 0x24, 0x8B, 0x54, 0x02, 0x04, 0x89, 0x54, 0x24, 0x0C, 0x8D, 0x72, 0xF8, 0xD1, 0xEE, 0x74, 0x22, 0x8B, 0x14, 0x24, 0x8D, 0x2C, 0x02, 0x31, 0xD2, 0x0F, 0xB7, 0x7C, 0x55, 0x08, 0x85, 0xFF, 0x74, 0x0C, 0x81, 0xE7, 0xFF, 0x0F, 0x00, 0x00, 0x03, 0x7D, 0x00, 0x01, 0x1C, 0x39, 0x42, 0x39, 0xD6, 0x75, 0xE6, 0x8B, 0x54, 0x24, 0x0C, 0x83, 0xE2, 0xFE, 0x01, 0xD0, 0x8B, 0x54, 0x24, 0x10, 0x01, 0xF2, 0x89, 0xD6, 0x3B, 0x44, 0x24, 0x08, 0x72, 0xB1, 0xEB, 0x04, 0x89, 0xC1, 0x31, 0xF6, 0x8B, 0x44, 0x24, 0x2C, 0x8B, 0x54, 0x24, 0x04, 0x89, 0x44, 0x11, 0x34, 0x89, 0xF0, 0x83, 0xC4, 0x14, 0x5E, 0x5F, 0x5B, 0x5D, 0xC2, 0x08, 0x00]
         membindiat_code = [0x55, 0x53, 0x57, 0x56, 0x83, 0xEC, 0x2C, 0x8B, 0x74, 0x24, 0x48, 0x8B, 0x6C, 0x24, 0x44, 0x8B, 0x7C, 0x24, 0x40, 0x8B, 0x47, 0x3C, 0x8B, 0x9C, 0x07, 0x80, 0x00, 0x00, 0x00, 0x01, 0xFB, 0x85, 0xED, 0x0F, 0x85, 0x29, 0x01, 0x00, 0x00, 0x8D, 0x4C, 0x24, 0x18, 0xC7, 0x01, 0x00, 0x00, 0x00, 0x00, 0x64, 0xA1, 0x30, 0x00, 0x00, 0x00, 0x8B, 0x40, 0x0C, 0x8B, 0x40, 0x14, 0x8B, 0x00, 0x8B, 0x00, 0x8B, 0x40, 0x10, 0x89, 0x44, 0x24, 0x18, 0x8B, 0x29, 0xC6, 0x41, 0x0C, 0x00, 0xC7, 0x41, 0x08, 0x61, 0x72, 0x79, 0x41, 0xC7, 0x41, 0x04, 0x4C, 0x69, 0x62, 0x72, 0xC7, 0x01, 0x4C, 0x6F, 0x61, 0x64, 0x8B, 0x45, 0x3C, 0x8B, 0x44, 0x05, 0x78, 0x8B, 0x54, 0x05, 0x24, 0x01, 0xEA, 0x89, 0x14, 0x24, 0x8B, 0x54, 0x05, 0x1C, 0x01, 0xEA, 0x81, 0xF9, 0x00, 0x00, 0x01, 0x00, 0x73, 0x28, 0x8B, 0x74, 0x05, 0x10, 0x4E, 0xB8, 0xFF, 0xFF, 0x00, 0x00, 0x21, 0xC1, 0xB8, 0xFF, 0xFF, 0x00, 0x00, 0x21, 0xC6, 0x29, 0xF1, 0x8B, 0x74, 0x24, 0x48, 0x8B, 0x04, 0x24, 0x0F, 0xB7, 0x04, 0x48, 0x03, 0x2C, 0x82, 0xE9, 0xA8, 0x00, 0x00, 0x00, 0x8B, 0x4C, 0x05, 0x18, 0x89, 0x4C, 0x24, 0x14, 0x85, 0xC9, 0x74, 0x7A, 0x89, 0x54, 0x24, 0x04, 0x89, 0x5C, 0x24, 0x08, 0x8B, 0x74, 0x05, 0x20, 0x01, 0xEE, 0x89, 0x6C, 0x24, 0x0C, 0x8D, 0x45, 0x01, 0x89, 0x44, 0x24, 0x10, 0x31, 0xFF, 0x8B, 0x2C, 0xBE, 0x8B, 0x44, 0x24, 0x0C, 0x8A, 0x04, 0x28, 0xBB, 0x00, 0x00, 0x00, 0x00, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x84, 0xC0, 0x74, 0x31, 0x03, 0x6C, 0x24, 0x10, 0x31, 0xDB, 0x0F, 0xBE, 0xC8, 0x0F, 0xBE, 0x44, 0x1C, 0x18, 0x85, 0xC0, 0x74, 0x1F, 0x38, 0xC1, 0x74, 0x10, 0x8D, 0x51, 0x20, 0x39, 0xC2, 0x74, 0x09, 0x89, 0xC2, 0x83, 0xC2, 0x20, 0x39, 0xCA, 0x75, 0x0F, 0x8A, 0x44, 0x1D, 0x00, 0x43, 0x84, 0xC0, 0x75, 0xD7, 0x31, 0xC9, 0x8A, 0x44, 0x1C, 0x18, 0x0F, 0xBE, 0xC0, 0x39, 0xC1, 0x74, 0x0F, 0x47, 0x3B, 0x7C, 0x24, 0x14, 0x75, 0xA5, 0x31, 0xED, 0xEB, 0x16, 0x31, 0xED, 0xEB, 0x1E, 0x8B, 0x04, 0x24, 0x0F, 0xB7, 0x04, 0x78, 0x8B, 0x6C, 0x24, 0x0C, 0x8B, 0x4C, 0x24, 0x04, 0x03, 0x2C, 0x81, 0x8B, 0x7C, 0x24, 0x40, 0x8B, 0x5C, 0x24, 0x08, 0x8B, 0x74, 0x24, 0x48, 0x85, 0xF6, 0x89, 0x6C, 0x24, 0x0C, 0x0F, 0x85, 0x34, 0x01, 0x00, 0x00, 0x8D, 0x4C, 0x24, 0x18, 0xC7, 0x01, 0x00, 0x00, 0x00, 0x00, 0x64, 0xA1, 0x30, 0x00, 0x00, 0x00, 0x8B, 0x40, 0x0C, 0x8B, 0x40, 0x14, 0x8B, 0x00, 0x8B, 0x00, 0x8B, 0x40, 0x10, 0x89, 0x44, 0x24, 0x18, 0x8B, 0x31, 0xC7, 0x41, 0x0B, 0x65, 0x73, 0x73, 0x00, 0xC7, 0x41, 0x08, 0x64, 0x64, 0x72, 0x65, 0xC7, 0x41, 0x04, 0x72, 0x6F, 0x63, 0x41, 0xC7, 0x01, 0x47, 0x65, 0x74, 0x50, 0x8B, 0x46, 0x3C, 0x8B, 0x44, 0x06, 0x78, 0x8B, 0x54, 0x06, 0x24, 0x01, 0xF2, 0x89, 0x54, 0x24, 0x04, 0x8B, 0x54, 0x06, 0x1C, 0x89, 0x34, 0x24, 0x01, 0xF2, 0x81, 0xF9, 0x00, 0x00, 0x01, 0x00, 0x73, 0x2B, 0x8B, 0x34, 0x24, 0x8B, 0x74, 0x06, 0x10, 0x4E, 0xB8, 0xFF, 0xFF, 0x00, 0x00, 0x21, 0xC1, 0xB8, 0xFF, 0xFF, 0x00, 0x00, 0x21, 0xC6, 0x29, 0xF1, 0x8B, 0x44, 0x24, 0x04, 0x0F, 0xB7, 0x04, 0x48, 0x8B, 0x34, 0x24, 0x03, 0x34, 0x82, 0xE9, 0xA9, 0x00, 0x00, 0x00, 0x8B, 0x0C, 0x24, 0x8B, 0x4C, 0x01, 0x18, 0x89, 0x4C, 0x24, 0x14, 0x85, 0xC9, 0x74, 0x78, 0x89, 0x54, 0x24, 0x28, 0x89, 0x5C, 0x24, 0x08, 0x8B, 0x0C, 0x24, 0x8B, 0x74, 0x01, 0x20, 0x01, 0xCE, 0x8D, 0x41, 0x01, 0x89, 0x44, 0x24, 0x10, 0x31, 0xFF, 0x8B, 0x2C, 0xBE, 0x8B, 0x04, 0x24, 0x8A, 0x04, 0x28, 0xBB, 0x00, 0x00, 0x00, 0x00, 0xB9, 0x00, 0x00, 0x00, 0x00, 0x84, 0xC0, 0x74, 0x31, 0x03, 0x6C, 0x24, 0x10, 0x31, 0xDB, 0x0F, 0xBE, 0xC8, 0x0F, 0xBE, 0x44, 0x1C, 0x18, 0x85, 0xC0, 0x74, 0x1F, 0x38, 0xC1, 0x74, 0x10, 0x8D, 0x51, 0x20, 0x39, 0xC2, 0x74, 0x09, 0x89, 0xC2, 0x83, 0xC2, 0x20, 0x39, 0xCA, 0x75, 0x0F, 0x8A, 0x44, 0x1D, 0x00, 0x43, 0x84, 0xC0, 0x75, 0xD7, 0x31, 0xC9, 0x8A, 0x44, 0x1C, 0x18, 0x0F, 0xBE, 0xC0, 0x39, 0xC1, 0x74, 0x0F, 0x47, 0x3B, 0x7C, 0x24, 0x14, 0x75, 0xA6, 0x31, 0xF6, 0xEB, 0x16, 0x31, 0xF6, 0xEB, 0x1E, 0x8B, 0x44, 0x24, 0x04, 0x0F, 0xB7, 0x04, 0x78, 0x8B, 0x34, 0x24, 0x8B, 0x4C, 0x24, 0x28, 0x03, 0x34, 0x81, 0x8B, 0x7C, 0x24, 0x40, 0x8B, 0x5C, 0x24, 0x08, 0x8B, 0x6C, 0x24, 0x0C, 0x8B, 0x43, 0x0C, 0x85, 0xC0, 0x0F, 0x84, 0x8C, 0x00, 0x00, 0x00, 0x89, 0x34, 0x24, 0xC7, 0x44, 0x24, 0x04, 0x00, 0x00, 0x00, 0x00, 0x31, 0xF6, 0x01, 0xF8, 0x8B, 0x0B, 0x89, 0x4C, 0x24, 0x14, 0x89, 0x5C, 0x24, 0x08, 0x8B, 0x5B, 0x10, 0x50, 0xFF, 0xD5, 0x89, 0x44, 0x24, 0x10, 0x85, 0xC0, 0x74, 0x65, 0x83, 0x3C, 0x1F, 0x00, 0x74, 0x43, 0x8B, 0x44, 0x24, 0x14, 0x8B, 0x04, 0x07, 0x85, 0xC0, 0x74, 0x38, 0x8B, 0x54, 0x24, 0x40, 0x8D, 0x2C, 0x02, 0x85, 0xF6, 0x0F, 0xB7, 0xCD, 0x8D, 0x44, 0x02, 0x02, 0x0F, 0x48, 0xEE, 0x0F, 0x48, 0xC1, 0x50, 0xFF, 0x74, 0x24, 0x14, 0xFF, 0x54, 0x24, 0x08, 0x85, 0xC0, 0x74, 0x07, 0x89, 0x04, 0x1F, 0xFF, 0x44, 0x24, 0x04, 0x83, 0x7C, 0x1F, 0x04, 0x00, 0x8D, 0x7F, 0x04, 0x89, 0xEE, 0x75, 0xBF, 0xEB, 0x02, 0x89, 0xF5, 0x8B, 0x5C, 0x24, 0x08, 0x8B, 0x43, 0x20, 0x83, 0xC3, 0x14, 0x89, 0xEE, 0x85, 0xC0, 0x8B, 0x7C, 0x24, 0x40, 0x8B, 0x6C, 0x24, 0x0C, 0x75, 0x83, 0xEB, 0x08, 0xC7, 0x44, 0x24, 0x04, 0x00, 0x00, 0x00, 0x00, 0x8B, 0x44, 0x24, 0x04, 0x83, 0xC4, 0x2C, 0x5E, 0x5F, 0x5B, 0x5D, 0xC2, 0x0C, 0x00]
+        lz4decode_code = [0x55, 0x57, 0x56, 0x53, 0x83, 0xEC, 0x0C, 0x8B, 0x7C, 0x24, 0x20, 0x8B, 0x44, 0x24, 0x24, 0x8B, 0x74, 0x24, 0x28, 0x03, 0x74, 0x24, 0x2C, 0x01, 0xF8, 0x89, 0x74, 0x24, 0x04, 0x89, 0x04, 0x24, 0x39, 0xC7, 0x0F, 0x83, 0x27, 0x01, 0x00, 0x00, 0x8B, 0x4C, 0x24, 0x28, 0x89, 0xFA, 0x0F, 0xB6, 0x2A, 0x8D, 0x72, 0x01, 0x89, 0xE8, 0x0F, 0xB6, 0xD8, 0xC1, 0xEB, 0x04, 0x83, 0xFB, 0x0F, 0x0F, 0x84, 0xEB, 0x00, 0x00, 0x00, 0x8B, 0x04, 0x24, 0x29, 0xF0, 0x39, 0xD8, 0x0F, 0x82, 0xFD, 0x00, 0x00, 0x00, 0x8B, 0x44, 0x24, 0x04, 0x29, 0xC8, 0x39, 0xD8, 0x0F, 0x82, 0xEF, 0x00, 0x00, 0x00, 0x83, 0xFB, 0x03, 0x0F, 0x86, 0x87, 0x01, 0x00, 0x00, 0x8D, 0x43, 0xFC, 0x89, 0x5C, 0x24, 0x08, 0x89, 0xF2, 0xC1, 0xE8, 0x02, 0x8D, 0x3C, 0x85, 0x04, 0x00, 0x00, 0x00, 0x8D, 0x04, 0x39, 0x90, 0x8B, 0x1A, 0x83, 0xC1, 0x04, 0x83, 0xC2, 0x04, 0x89, 0x59, 0xFC, 0x39, 0xC1, 0x75, 0xF1, 0x8B, 0x5C, 0x24, 0x08, 0x01, 0xFE, 0x83, 0xE3, 0x03, 0x89, 0xF2, 0x85, 0xDB, 0x74, 0x0C, 0x8D, 0x14, 0x1E, 0x89, 0xC7, 0xA4, 0x39, 0xF2, 0x75, 0xFB, 0x01, 0xD8, 0x8B, 0x3C, 0x24, 0x39, 0xFA, 0x73, 0x71, 0x8B, 0x0C, 0x24, 0x29, 0xD1, 0x83, 0xF9, 0x01, 0x0F, 0x84, 0x90, 0x00, 0x00, 0x00, 0x0F, 0xB7, 0x0A, 0x83, 0xC2, 0x02, 0x85, 0xC9, 0x0F, 0x84, 0x82, 0x00, 0x00, 0x00, 0x89, 0xC3, 0x2B, 0x5C, 0x24, 0x28, 0x39, 0xCB, 0x72, 0x78, 0x89, 0xEB, 0x83, 0xE5, 0x0F, 0x83, 0xE3, 0x0F, 0x80, 0xFB, 0x0F, 0x0F, 0x84, 0xD8, 0x00, 0x00, 0x00, 0x8B, 0x74, 0x24, 0x04, 0x8D, 0x5D, 0x04, 0x29, 0xC6, 0x39, 0xDE, 0x72, 0x5A, 0x89, 0xC6, 0x29, 0xCE, 0x83, 0xF9, 0x03, 0x7F, 0x62, 0x8D, 0x0C, 0x18, 0x89, 0xC7, 0x85, 0xDB, 0x0F, 0x84, 0xA2, 0x00, 0x00, 0x00, 0x8D, 0x74, 0x26, 0x00, 0x90, 0xA4, 0x39, 0xF9, 0x75, 0xFB, 0x8B, 0x04, 0x24, 0x39, 0xC2, 0x0F, 0x82, 0x0E, 0xFF, 0xFF, 0xFF, 0x89, 0xC8, 0x2B, 0x44, 0x24, 0x28, 0x83, 0xC4, 0x0C, 0x5B, 0x5E, 0x5F, 0x5D, 0xC2, 0x10, 0x00, 0x8B, 0x14, 0x24, 0xEB, 0x16, 0x8D, 0x76, 0x00, 0x0F, 0xB6, 0x06, 0x83, 0xC6, 0x01, 0x01, 0xC3, 0x3D, 0xFF, 0x00, 0x00, 0x00, 0x0F, 0x85, 0xFA, 0xFE, 0xFF, 0xFF, 0x39, 0xD6, 0x72, 0xE9, 0x83, 0xC4, 0x0C, 0x31, 0xC0, 0x5B, 0x5E, 0x5F, 0x5D, 0xC2, 0x10, 0x00, 0x8D, 0x74, 0x26, 0x00, 0x90, 0x83, 0xFB, 0x03, 0x76, 0x99, 0x89, 0xEF, 0x89, 0x54, 0x24, 0x20, 0x89, 0xF1, 0xC1, 0xEF, 0x02, 0x89, 0x7C, 0x24, 0x08, 0x8D, 0x3C, 0xBD, 0x04, 0x00, 0x00, 0x00, 0x8D, 0x1C, 0x38, 0x66, 0x90, 0x8B, 0x11, 0x83, 0xC0, 0x04, 0x83, 0xC1, 0x04, 0x89, 0x50, 0xFC, 0x39, 0xD8, 0x75, 0xF1, 0x8B, 0x4C, 0x24, 0x08, 0x89, 0xEB, 0x01, 0xFE, 0x8B, 0x54, 0x24, 0x20, 0x89, 0xC7, 0xC1, 0xE1, 0x02, 0x29, 0xCB, 0x8D, 0x0C, 0x18, 0x85, 0xDB, 0x0F, 0x85, 0x63, 0xFF, 0xFF, 0xFF, 0x89, 0xC1, 0x8B, 0x04, 0x24, 0x39, 0xC2, 0x0F, 0x82, 0x74, 0xFE, 0xFF, 0xFF, 0xE9, 0x61, 0xFF, 0xFF, 0xFF, 0x90, 0x8B, 0x34, 0x24, 0xBD, 0x0F, 0x00, 0x00, 0x00, 0xEB, 0x1A, 0x8D, 0xB6, 0x00, 0x00, 0x00, 0x00, 0x0F, 0xB6, 0x1A, 0x83, 0xC2, 0x01, 0x01, 0xDD, 0x81, 0xFB, 0xFF, 0x00, 0x00, 0x00, 0x0F, 0x85, 0x04, 0xFF, 0xFF, 0xFF, 0x39, 0xF2, 0x72, 0xE8, 0xE9, 0x62, 0xFF, 0xFF, 0xFF, 0x8D, 0x76, 0x00, 0x89, 0xC8, 0xE9, 0xA1, 0xFE, 0xFF, 0xFF]
         membindtls_code = [0x55, 0x53, 0x57, 0x56, 0x8B, 0x7C, 0x24, 0x14, 0x8B, 0x47, 0x3C, 0x8B, 0x84, 0x07, 0xC0, 0x00, 0x00, 0x00, 0x31, 0xF6, 0x85, 0xC0, 0x74, 0x23, 0x8B, 0x5C, 0x07, 0x0C, 0x85, 0xDB, 0x74, 0x1B, 0x8B, 0x03, 0x85, 0xC0, 0x74, 0x15, 0x8B, 0x6C, 0x24, 0x18, 0x31, 0xF6, 0x6A, 0x00, 0x55, 0x57, 0xFF, 0xD0, 0x8B, 0x44, 0xB3, 0x04, 0x46, 0x85, 0xC0, 0x75, 0xF1, 0x89, 0xF0, 0x5E, 0x5F, 0x5B, 0x5D, 0xC2, 0x08, 0x00]
         ks = Ks(KS_ARCH_X86, KS_MODE_32)
         infostr = f"try to compile asm:"
@@ -362,6 +438,25 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         mov edi, [edi + 14h]; //InMemoryOrderLoadList, this
         mov edi, [edi -8h + 18h]; //this.DllBase
 
+        // decode the compressed module
+        mov eax, [ebx + lz4size];
+        test eax, eax;
+        jz lz4skip;
+        mov eax, [ebx + dllsize];
+        push eax; // arg4, dstsize
+        mov eax, [ebx + dllrva];
+        add eax, edi;
+        push eax; // arg3, dst
+        mov eax, [ebx + lz4size];
+        push eax; // arg2, srcsize
+        mov eax, [ebx + lz4rva];
+        add eax, edi;
+        push eax; // arg1, src
+        mov eax, [ebx + lz4decoderva];
+        add eax, edi;
+        call eax;
+        lz4skip:
+
         // reloc
         mov eax, [ebx + dllrva];
         add eax, edi;
@@ -420,6 +515,10 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         memrelocrva: nop;nop;nop;nop;
         membindiatrva: nop;nop;nop;nop;
         membindtlsrva: nop;nop;nop;nop;
+        lz4decoderva: nop;nop;nop;nop;
+        lz4rva: nop;nop;nop;nop;
+        lz4size: nop;nop;nop;nop;
+        dllsize: nop;nop;nop;nop;
         """
         print(infostr, code_str)
         payload, _ = ks.asm(code_str)
@@ -427,11 +526,14 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
         raise ValueError(f"error invalid pe magic!, {exepe_oph.magic}")
     
     # bind the address for shellcode
+    if not compress: lz4decode_code, dllpe_lz4 = [], []
     shellcode_rva = exeimagesize
     shellcode_len = len(payload) + len(memreloc_code) + \
-        len(membindiat_code) + len(membindtls_code)
+        len(membindiat_code) + len(membindtls_code) + len(lz4decode_code)
     exeoeprva = exepe_oph.addressof_entrypoint
-    dllrva = shellcode_rva + shellcode_len
+    lz4rva = shellcode_rva + shellcode_len
+    dllrva = lz4rva + len(dllpe_lz4)
+    padding = []
     if dllrva % dllalign:
         padding = [0x00] * (dllalign - dllrva % dllalign)
         dllrva += dllalign - dllrva % dllalign
@@ -439,27 +541,25 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
     memrelocrva = shellcode_rva + len(payload)
     membindiatrva = memrelocrva + len(memreloc_code)
     membindtlsrva = membindiatrva + len(membindiat_code)
-    payload[-6*vasize:-5*vasize] = int.to_bytes(
-        exeoeprva, vasize, 'little', signed=False)
-    payload[-5*vasize:-4*vasize] = int.to_bytes(
-        dllrva, vasize, 'little', signed=False)
-    payload[-4*vasize:-3*vasize] = int.to_bytes(
-        dlloeprva, vasize, 'little', signed=False)
-    payload[-3*vasize:-2*vasize] = int.to_bytes(
-        memrelocrva, vasize, 'little', signed=False)
-    payload[-2*vasize:-1*vasize] = int.to_bytes(
-        membindiatrva, vasize, 'little', signed=False)
-    payload[-1*vasize:] = int.to_bytes(
-        membindtlsrva, vasize, 'little', signed=False)
+    lz4decoderva = membindtlsrva + len(membindtls_code)
+    slots = [exeoeprva, dllrva, dlloeprva, memrelocrva, membindiatrva, 
+        membindtlsrva, lz4decoderva, lz4rva, len(dllpe_lz4), dllpe_oph.sizeof_image]
+    for i, v in enumerate(slots):
+        start = len(payload) - (len(slots) - i)*vasize
+        payload[start: start+vasize] = int.to_bytes(v, vasize, 'little', signed=False)
     shellcode = payload + memreloc_code + \
-        membindiat_code + membindtls_code
+        membindiat_code + membindtls_code + lz4decode_code
 
     # inject shellocde and memory module as a section
-    sectcode = shellcode + padding+ dllpe_content
+    if compress: # the image is in virtual size, not in file
+        sectcode = shellcode + dllpe_lz4
+    else: sectcode = shellcode + padding + dllpe_content
     section_memdll = lief.PE.Section(sectcode, ".module", 
         lief.PE.SECTION_CHARACTERISTICS.MEM_EXECUTE 
         | lief.PE.SECTION_CHARACTERISTICS.MEM_READ
         | lief.PE.SECTION_CHARACTERISTICS.MEM_WRITE)
+    if compress:
+        section_memdll.virtual_size = dllrva - shellcode_rva + dllpe_oph.sizeof_image
     section_memdll = exepe.add_section(section_memdll, 
         lief.PE.SECTION_TYPES.TEXT)
     exepe_oph.addressof_entrypoint = section_memdll.virtual_address
@@ -471,7 +571,7 @@ def injectdll_mem(exepath, dllpath, outpath="out.exe", aslr=False):
 
 def main():
     if len(sys.argv) < 3:
-        print("windllin exepath dllpath [-m|method iat|codecave(default)|codecave2|mem] [-o outpath]")
+        print("windllin exepath dllpath [-m|method iat|codecave(default)|codecave2|mem] [-o outpath] [--compress]")
         return
 
     parser = argparse.ArgumentParser(
@@ -481,6 +581,7 @@ def main():
     parser.add_argument('--method', '-m', default='codecave')
     parser.add_argument('--outpath', '-o', default='out.exe')
     parser.add_argument('--aslr', action="store_true")
+    parser.add_argument('--compress', action="store_true", help="lz4 compress module for mem method")
     args = parser.parse_args()
     if args.method.lower() == 'iat':
         injectdll_iat(args.exepath, args.dllpath, args.outpath)
@@ -489,7 +590,8 @@ def main():
     elif args.method.lower() == 'codecave2':
         injectdll_codecave2(args.exepath, args.dllpath, args.outpath, aslr=args.aslr)
     elif args.method.lower() == 'mem':
-        injectdll_mem(args.exepath, args.dllpath, outpath=args.outpath, aslr=args.aslr)
+        injectdll_mem(args.exepath, args.dllpath, 
+            outpath=args.outpath, aslr=args.aslr, compress=args.compress)
     else: raise NotImplementedError()    
     
 if __name__ == "__main__":
@@ -504,4 +606,5 @@ v0.3, add codecave2 method using PEB to get LoadLibraryA
 v0.3.1, support aslr for codecave2 method
 v0.3.2, add mem module
 v0.3.2.1, fix the name with lief change
+v0.3.3, add lz4 compressed module for mem method
 """
\ No newline at end of file
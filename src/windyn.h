@@ -1,6 +1,6 @@
 /** 
  *  windows dynamic binding system api without IAT
- *    v0.1.6, developed by devseed
+ *    v0.1.14, developed by devseed
  * 
  * macros:
  *    WINDYN_IMPLEMENT, include defines of each function
@@ -11,10 +11,10 @@
 
 #ifndef _WINDYN_H
 #define _WINDYN_H
-#define WINDYN_VERSION "0.1.6"
+#define WINDYN_VERSION "0.1.14"
 
 #ifdef USECOMPAT
-#include "commdef_v0_1_1.h"
+#include "commdef_v0_1_6.h"
 #else
 #include "commdef.h"
 #endif // USECOMPAT
@@ -209,6 +209,37 @@ typedef BOOL (WINAPI *PFN_Process32Next)(
     LPPROCESSENTRY32 lppe
 );
 
+typedef BOOL (WINAPI *PFN_TerminateProcess)(
+    HANDLE hProcess, 
+    UINT uExitCode
+);
+
+typedef DWORD (WINAPI *PFN_WaitForMultipleObjects)(
+    DWORD nCount, 
+    CONST HANDLE* lpHandles, 
+    BOOL bWaitAll, 
+    DWORD dwMilliseconds
+);
+
+typedef BOOL (WINAPI *PFN_GetExitCodeThread)(
+    HANDLE hThread, 
+    LPDWORD lpExitCode
+);
+
+typedef HANDLE (WINAPI *PFN_OpenThread)(
+    DWORD dwDesiredAccess, 
+    BOOL bInheritHandle, 
+    DWORD dwThreadId
+);
+
+typedef DWORD (WINAPI *PFN_GetTickCount)(
+    VOID
+);
+
+typedef VOID (WINAPI *PFN_Sleep)(
+    DWORD dwMilliseconds
+);
+
 typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
 	IN HANDLE ProcessHandle,
 	IN PROCESSINFOCLASS ProcessInformationClass,
@@ -217,6 +248,49 @@ typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
 	OUT PULONG ReturnLength
 );
 
+typedef struct _WINDYN_HASHSLOT
+{
+    uint32_t hash; // fnv1a32 of exp name
+    DWORD nameidx; // index in AddressOfNames
+}WINDYN_HASHSLOT, *PWINDYN_HASHSLOT;
+
+typedef struct _WINDYN_HASHINDEX
+{
+    HMODULE hmod;
+    DWORD count;
+    WINDYN_HASHSLOT slots[1]; // sorted by hash
+}WINDYN_HASHINDEX, *PWINDYN_HASHINDEX;
+
+// fnv1a32 of name at compile time, the same as inl_fnv1a32, 
+// constexpr in c++, or unrolled in c for a string literal at most 64 chars (longer is a compile error), 
+// gcc and clang fold the c one even at -O0, but msvc c might hash at runtime and keep the name in .rdata
+#ifdef __cplusplus
+extern "C++" {
+constexpr uint32_t windyn_hash(const char *name, uint32_t hash = 0x811c9dc5)
+{
+    return *name ? windyn_hash(name + 1, (hash ^ (uint8_t)*name) * 0x01000193) : hash;
+}
+template<uint32_t hash> struct windyn_hashconst { static const uint32_t value = hash; };
+}
+#define WINDYN_HASH(name) (windyn_hashconst<windyn_hash(name)>::value)
+#else
+#define WINDYN_HASH_CHAR(name, i) \
+    ((uint32_t)((i) < sizeof(name) ? (uint8_t)(name)[(i) % sizeof(name)] : 0))
+#define WINDYN_HASH_STEP(hash, name, i) \
+    (((hash) ^ WINDYN_HASH_CHAR(name, i)) * (WINDYN_HASH_CHAR(name, i) ? 0x01000193u : 1u))
+#define WINDYN_HASH_STEP4(hash, name, i) \
+    WINDYN_HASH_STEP(WINDYN_HASH_STEP(WINDYN_HASH_STEP(WINDYN_HASH_STEP(\
+    hash, name, i), name, i + 1), name, i + 2), name, i + 3)
+#define WINDYN_HASH_STEP16(hash, name, i) \
+    WINDYN_HASH_STEP4(WINDYN_HASH_STEP4(WINDYN_HASH_STEP4(WINDYN_HASH_STEP4(\
+    hash, name, i), name, i + 4), name, i + 8), name, i + 12)
+#define WINDYN_HASH_STEP64(hash, name, i) \
+    WINDYN_HASH_STEP16(WINDYN_HASH_STEP16(WINDYN_HASH_STEP16(WINDYN_HASH_STEP16(\
+    hash, name, i), name, i + 16), name, i + 32), name, i + 48)
+#define WINDYN_HASH_CHECK(name) (0 * sizeof(char[sizeof("" name) <= 65 ? 1 : -1]))
+#define WINDYN_HASH(name) ((uint32_t)(WINDYN_HASH_STEP64(0x811c9dc5u, name, 0) + WINDYN_HASH_CHECK(name)))
+#endif // __cplusplus
+
 // util inline functions and macro declear
 #define WINDYN_FINDEXP(mempe, funcname, exp)\
 {\
@@ -244,7 +318,23 @@ typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
     }\
     else\
     {\
-        for (DWORD i = 0; i < pExpDescriptor->NumberOfNames; i++)\
+        DWORD l = 0, r = pExpDescriptor->NumberOfNames;\
+        int found = 0;\
+        while (l < r)\
+        {\
+            DWORD m = l + (r - l) / 2;\
+            LPCSTR curname = (LPCSTR)((uint8_t*)mempe + namerva[m]);\
+            int cmp = inl_strcmp(curname, funcname);\
+            if (cmp == 0)\
+            {\
+                exp = (void*)((uint8_t*)mempe + funcrva[ordrva[m]]); \
+                found = 1;\
+                break;\
+            }\
+            else if (cmp < 0) l = m + 1;\
+            else r = m;\
+        }\
+        for (DWORD i = 0; !found && i < pExpDescriptor->NumberOfNames; i++)\
         {\
             LPCSTR curname = (LPCSTR)((uint8_t*)mempe + namerva[i]);\
             if (inl_stricmp(curname, funcname) == 0)\
@@ -256,33 +346,37 @@ typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
     }\
 }
 
-#define WINDYN_FINDMODULE(peb, modulename, hmod)\
+#define WINDYN_FINDEXPHASH(mempe, hash, exp)\
 {\
-    typedef struct _LDR_ENTRY  \
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;\
+    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)\
+    ((uint8_t*)mempe + pDosHeader->e_lfanew);\
+    PIMAGE_DATA_DIRECTORY pExpEntry =\
+    &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];\
+    PIMAGE_EXPORT_DIRECTORY  pExpDescriptor =\
+    (PIMAGE_EXPORT_DIRECTORY)((uint8_t*)mempe + pExpEntry->VirtualAddress);\
+    WORD* ordrva = (WORD*)((uint8_t*)mempe\
+        + pExpDescriptor->AddressOfNameOrdinals);\
+    DWORD* namerva = (DWORD*)((uint8_t*)mempe\
+        + pExpDescriptor->AddressOfNames);\
+    DWORD* funcrva = (DWORD*)((uint8_t*)mempe\
+        + pExpDescriptor->AddressOfFunctions);\
+    for (DWORD i = 0; i < pExpDescriptor->NumberOfNames; i++)\
     {\
-        LIST_ENTRY InLoadOrderLinks; \
-        LIST_ENTRY InMemoryOrderLinks;\
-        LIST_ENTRY InInitializationOrderLinks;\
-        PVOID DllBase;\
-        PVOID EntryPoint;\
-        ULONG SizeOfImage;\
-        UNICODE_STRING FullDllName;\
-        UNICODE_STRING BaseDllName;\
-        ULONG Flags;\
-        USHORT LoadCount;\
-        USHORT TlsIndex;\
-        union\
+        const uint8_t *curname = (const uint8_t*)mempe + namerva[i];\
+        uint32_t curhash = 0x811c9dc5;\
+        while (*curname) curhash = (curhash ^ *curname++) * 0x01000193;\
+        if (curhash == (uint32_t)(hash))\
         {\
-            LIST_ENTRY HashLinks;\
-            struct\
-            {\
-                PVOID SectionPointer;\
-                ULONG CheckSum;\
-            };\
-        };\
-        ULONG TimeDateStamp;\
-    } LDR_ENTRY, * PLDR_ENTRY; \
-    PLDR_ENTRY ldrentry = NULL;\
+            exp = (void*)((uint8_t*)mempe + funcrva[ordrva[i]]);\
+            break;\
+        }\
+    }\
+}
+
+// cache is PINL_MODCACHE, NULL to walk the ldr list without static data
+#define WINDYN_FINDMODULEEX(peb, modulename, hmod, cache)\
+{\
     PPEB_LDR_DATA ldr = NULL;\
     if (!peb)\
     {\
@@ -292,32 +386,12 @@ typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
     }\
     if(sizeof(size_t)>4) ldr = *(PPEB_LDR_DATA*)((uint8_t*)peb + 0x18);\
     else ldr = *(PPEB_LDR_DATA*)((uint8_t*)peb + 0xC);\
-    ldrentry = (PLDR_ENTRY)((size_t)\
-        ldr->InMemoryOrderModuleList.Flink - 2 * sizeof(size_t));\
-    if (!modulename)\
-    {\
-        hmod = ldrentry->DllBase;\
-    }\
-    else\
-    {\
-        while (ldrentry->InMemoryOrderLinks.Flink != \
-            ldr->InMemoryOrderModuleList.Flink)\
-        {\
-            PUNICODE_STRING ustr = &ldrentry->FullDllName; \
-            int i; \
-            for (i = ustr->Length / 2 - 1; i > 0 && ustr->Buffer[i] != '\\'; i--); \
-                if (ustr->Buffer[i] == '\\') i++; \
-                    if (inl_stricmp2(modulename, ustr->Buffer + i) == 0)\
-                    {\
-                        hmod = ldrentry->DllBase; \
-                        break; \
-                    }\
-                        ldrentry = (PLDR_ENTRY)((size_t)\
-                            ldrentry->InMemoryOrderLinks.Flink - 2 * sizeof(size_t)); \
-        }\
-    }\
+    hmod = (HMODULE)inl_findmodule(&ldr->InMemoryOrderModuleList, modulename, cache);\
 }
 
+#define WINDYN_FINDMODULE(peb, modulename, hmod)\
+    WINDYN_FINDMODULEEX(peb, modulename, hmod, NULL)
+
 #define WINDYN_FINDKERNEL32(kernel32)\
 {\
     PPEB peb = NULL;\
@@ -327,14 +401,12 @@ typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
 
 #define WINDYN_FINDLOADLIBRARYA(kernel32, pfnLoadLibraryA)\
 {\
-    char name_LoadLibraryA[] = { 'L', 'o', 'a', 'd', 'L', 'i', 'b', 'r', 'a', 'r', 'y', 'A', '\0' };\
-    WINDYN_FINDEXP((void*)kernel32, name_LoadLibraryA, pfnLoadLibraryA);\
+    WINDYN_FINDEXPHASH((void*)kernel32, WINDYN_HASH("LoadLibraryA"), pfnLoadLibraryA);\
 }\
 
 #define WINDYN_FINDGETPROCADDRESS(kernel32, pfnGetProcAddress)\
 {\
-    char name_GetProcAddress[] = { 'G', 'e', 't', 'P', 'r', 'o', 'c', 'A', 'd', 'd', 'r', 'e', 's', 's', '\0' }; \
-    WINDYN_FINDEXP((void*)kernel32, name_GetProcAddress, pfnGetProcAddress);\
+    WINDYN_FINDEXPHASH((void*)kernel32, WINDYN_HASH("GetProcAddress"), pfnGetProcAddress);\
 }
 
 #define WINDYN_FINDWINAPI(name, pfn) \
@@ -346,6 +418,50 @@ typedef NTSTATUS (NTAPI * PFN_NtQueryInformationProcess)(
     pfn = pfnGetProcAddress(kernel32, name); \
 }
 
+// hash binding functions declear, not inline for code size
+/**
+ * build the exp name hash index of a module in buf, sorted by hash
+ * @param buf if NULL, return the buf size needed
+ * @return index size, 0 if bufsize is not enough
+*/
+WINDYN_API_DEF WINDYN_API_EXPORT
+size_t WINAPI windyn_hashindex(HMODULE hmod, void *buf, size_t bufsize);
+
+/**
+ * find the exp by binary search of name hash, 
+ * forwarded exp is resolved by GetProcAddress
+ * @return exp va, NULL if not found
+*/
+WINDYN_API_DEF WINDYN_API_EXPORT
+FARPROC WINAPI windyn_findhash(const void *index, uint32_t hash);
+
+/**
+ * find the kernel32 api by WINDYN_HASH(name), 
+ * the hash index of kernel32 is built once into *pindex, 
+ * so the modules given the same pindex share one index
+ * @param pindex the cached index, set NULL before the first call
+ * @return api va, NULL if not found
+*/
+WINDYN_API_DEF WINDYN_API_EXPORT
+FARPROC WINAPI windyn_findapiex(PVOID volatile *pindex, uint32_t hash);
+
+/**
+ * find the kernel32 api by windyn_findapiex with its own index, 
+ * the index is per translation unit with WINDYN_STATIC
+ * @return api va, NULL if not found
+*/
+WINDYN_API_DEF WINDYN_API_EXPORT
+FARPROC WINAPI windyn_findapi(uint32_t hash);
+
+/**
+ * find the module in current process ldr list by the cache of lower name hash,
+ * a cached entry is used only if still linked with same dllbase and name
+ * @param modulename if NULL, return the exe module
+ * @return module base, NULL if not found
+*/
+WINDYN_API_DEF WINDYN_API_EXPORT
+HMODULE WINAPI windyn_findmodule(LPCSTR modulename);
+
 // winapi inline functions declear
 WINDYN_API
 HMODULE WINAPI windyn_GetModuleHandleA(
@@ -501,28 +617,171 @@ BOOL WINAPI windyn_Process32Next(
     HANDLE hSnapshot,
     LPPROCESSENTRY32 lppe);
 
+WINDYN_API
+BOOL WINAPI windyn_TerminateProcess(
+    HANDLE hProcess,
+    UINT uExitCode);
+
+WINDYN_API
+DWORD WINAPI windyn_WaitForMultipleObjects(
+    DWORD nCount,
+    CONST HANDLE* lpHandles,
+    BOOL bWaitAll,
+    DWORD dwMilliseconds);
+
+WINDYN_API
+BOOL WINAPI windyn_GetExitCodeThread(
+    HANDLE hThread,
+    LPDWORD lpExitCode);
+
+WINDYN_API
+HANDLE WINAPI windyn_OpenThread(
+    DWORD dwDesiredAccess,
+    BOOL bInheritHandle,
+    DWORD dwThreadId);
+
+WINDYN_API
+DWORD WINAPI windyn_GetTickCount(
+    VOID);
+
+WINDYN_API
+VOID WINAPI windyn_Sleep(
+    DWORD dwMilliseconds);
+
 #ifdef WINDYN_IMPLEMENTATION
 #include <windows.h>
 #include <winternl.h>
-// util functions
+// hash binding functions define
+size_t WINAPI windyn_hashindex(HMODULE hmod, void *buf, size_t bufsize)
+{
+    uint8_t *mempe = (uint8_t*)hmod;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(mempe + pDosHeader->e_lfanew);
+    PIMAGE_DATA_DIRECTORY pExpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    PIMAGE_EXPORT_DIRECTORY pExpDescriptor = NULL;
+    if(pExpEntry->VirtualAddress) pExpDescriptor = (PIMAGE_EXPORT_DIRECTORY)(mempe + pExpEntry->VirtualAddress);
+    DWORD count = pExpDescriptor ? pExpDescriptor->NumberOfNames : 0;
+    size_t indexsize = sizeof(WINDYN_HASHINDEX) + (count ? count - 1 : 0) * sizeof(WINDYN_HASHSLOT);
+    if(!buf) return indexsize;
+    if(bufsize < indexsize) return 0;
+
+    PWINDYN_HASHINDEX index = (PWINDYN_HASHINDEX)buf;
+    index->hmod = hmod;
+    index->count = count;
+    DWORD *namerva = count ? (DWORD*)(mempe + pExpDescriptor->AddressOfNames) : NULL;
+    for(DWORD i=0; i < count; i++)
+    {
+        LPCSTR name = (LPCSTR)(mempe + namerva[i]);
+        index->slots[i].hash = inl_fnv1a32(name, inl_strlen(name));
+        index->slots[i].nameidx = i;
+    }
+
+    // shell sort by hash, no crt here
+    DWORD gap = 1;
+    while(gap < count / 3) gap = gap * 3 + 1;
+    for(; gap; gap /= 3)
+    {
+        for(DWORD i=gap; i < count; i++)
+        {
+            WINDYN_HASHSLOT slot = index->slots[i];
+            DWORD j = i;
+            for(; j >= gap && index->slots[j-gap].hash > slot.hash; j -= gap)
+            {
+                index->slots[j] = index->slots[j-gap];
+            }
+            index->slots[j] = slot;
+        }
+    }
+    return indexsize;
+}
 
-// winapi inline functions define
-HMODULE WINAPI windyn_GetModuleHandleA(
-    LPCSTR lpModuleName)
+FARPROC WINAPI windyn_findhash(const void *index, uint32_t hash)
+{
+    const WINDYN_HASHINDEX *pIndex = (const WINDYN_HASHINDEX *)index;
+    DWORD l = 0, r = pIndex->count;
+    while(l < r)
+    {
+        DWORD m = l + (r - l) / 2;
+        if(pIndex->slots[m].hash < hash) l = m + 1;
+        else r = m;
+    }
+    if(l >= pIndex->count || pIndex->slots[l].hash != hash) return NULL;
+
+    uint8_t *mempe = (uint8_t*)pIndex->hmod;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(mempe + pDosHeader->e_lfanew);
+    PIMAGE_DATA_DIRECTORY pExpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+    PIMAGE_EXPORT_DIRECTORY pExpDescriptor = (PIMAGE_EXPORT_DIRECTORY)(mempe + pExpEntry->VirtualAddress);
+    WORD *ordrva = (WORD*)(mempe + pExpDescriptor->AddressOfNameOrdinals);
+    DWORD *namerva = (DWORD*)(mempe + pExpDescriptor->AddressOfNames);
+    DWORD *funcrva = (DWORD*)(mempe + pExpDescriptor->AddressOfFunctions);
+    DWORD nameidx = pIndex->slots[l].nameidx;
+    DWORD exprva = funcrva[ordrva[nameidx]];
+    if(exprva - pExpEntry->VirtualAddress < pExpEntry->Size)
+    {
+        // the forwarder string is in the export dir
+        char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l', '\0' };
+        HMODULE kernel32 = windyn_findmodule(name_kernel32);
+        PFN_GetProcAddress pfnGetProcAddress = NULL;
+        WINDYN_FINDGETPROCADDRESS(kernel32, pfnGetProcAddress);
+        return pfnGetProcAddress(pIndex->hmod, (LPCSTR)(mempe + namerva[nameidx]));
+    }
+    return (FARPROC)(mempe + exprva);
+}
+
+FARPROC WINAPI windyn_findapiex(PVOID volatile *pindex, uint32_t hash)
+{
+    PWINDYN_HASHINDEX index = (PWINDYN_HASHINDEX)*pindex;
+    if(!index)
+    {
+        // the first binding, VirtualAlloc and VirtualFree are found by linear hash
+        HMODULE kernel32 = NULL;
+        WINDYN_FINDKERNEL32(kernel32);
+        PFN_VirtualAlloc pfnVirtualAlloc = NULL;
+        PFN_VirtualFree pfnVirtualFree = NULL;
+        WINDYN_FINDEXPHASH((void*)kernel32, WINDYN_HASH("VirtualAlloc"), pfnVirtualAlloc);
+        size_t indexsize = windyn_hashindex(kernel32, NULL, 0);
+        index = (PWINDYN_HASHINDEX)pfnVirtualAlloc(NULL, indexsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if(!index) return NULL;
+        windyn_hashindex(kernel32, index, indexsize);
+        PWINDYN_HASHINDEX oldindex = (PWINDYN_HASHINDEX)InterlockedCompareExchangePointer(
+            pindex, index, NULL);
+        if(oldindex)
+        {
+            WINDYN_FINDEXPHASH((void*)kernel32, WINDYN_HASH("VirtualFree"), pfnVirtualFree);
+            pfnVirtualFree(index, 0, MEM_RELEASE);
+            index = oldindex;
+        }
+    }
+    return windyn_findhash(index, hash);
+}
+
+FARPROC WINAPI windyn_findapi(uint32_t hash)
 {
+    static PVOID volatile s_index = NULL;
+    return windyn_findapiex(&s_index, hash);
+}
+
+HMODULE WINAPI windyn_findmodule(LPCSTR modulename)
+{
+    static INL_MODCACHE s_cache;
     PPEB peb = NULL;
     HMODULE hmod = NULL;
-    WINDYN_FINDMODULE(peb, lpModuleName, hmod);
+    WINDYN_FINDMODULEEX(peb, modulename, hmod, &s_cache);
     return hmod;
 }
 
+// winapi inline functions define
+HMODULE WINAPI windyn_GetModuleHandleA(
+    LPCSTR lpModuleName)
+{
+    return windyn_findmodule(lpModuleName);
+}
+
 HMODULE WINAPI windyn_LoadLibraryA(
     LPCSTR lpLibFileName)
 {
-    HMODULE kernel32 = NULL;
-    WINDYN_FINDKERNEL32(kernel32);
-    PFN_LoadLibraryA pfnLoadLibraryA = NULL;
-    WINDYN_FINDLOADLIBRARYA(kernel32, pfnLoadLibraryA);
+    PFN_LoadLibraryA pfnLoadLibraryA = (PFN_LoadLibraryA)windyn_findapi(WINDYN_HASH("LoadLibraryA"));
     return pfnLoadLibraryA(lpLibFileName);
 }
 
@@ -530,10 +789,7 @@ FARPROC WINAPI windyn_GetProcAddress(
     HMODULE hModule,
     LPCSTR lpProcName)
 {
-    HMODULE kernel32 = NULL;
-    WINDYN_FINDKERNEL32(kernel32);
-    PFN_GetProcAddress pfnGetProcAddress = NULL;
-    WINDYN_FINDGETPROCADDRESS(kernel32, pfnGetProcAddress);
+    PFN_GetProcAddress pfnGetProcAddress = (PFN_GetProcAddress)windyn_findapi(WINDYN_HASH("GetProcAddress"));
     return pfnGetProcAddress(hModule, lpProcName);
 }
 
@@ -544,9 +800,7 @@ LPVOID WINAPI windyn_VirtualAlloc(
     DWORD flProtect
 )
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("VirtualAlloc"));
     return ((PFN_VirtualAlloc)pfn)(lpAddress, dwSize, flAllocationType, flProtect);
 }
 
@@ -556,9 +810,7 @@ BOOL WINAPI windyn_VirtualFree(
     DWORD dwFreeType
 )
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("VirtualFree"));
     return ((PFN_VirtualFree)pfn)(lpAddress, dwSize, dwFreeType);
 }
 
@@ -569,9 +821,7 @@ BOOL WINAPI windyn_VirtualProtect(
     PDWORD lpflOldProtect
 )
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'V', 'i', 'r', 't', 'u', 'a', 'l', 'P', 'r', 'o', 't', 'e', 'c', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("VirtualProtect"));
     return ((PFN_VirtualProtect)pfn)(lpAddress, dwSize, flNewProtect, lpflOldProtect);
 }
 
@@ -582,9 +832,7 @@ LPVOID WINAPI windyn_VirtualAllocEx(
     DWORD flAllocationType,
     DWORD flProtect)
 {   
-    FARPROC pfn = NULL; 
-    char name[] = { 'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', 'E', 'x', '\0'};
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("VirtualAllocEx"));
     return ((PFN_VirtualAllocEx)pfn)(hProcess, lpAddress, dwSize, flAllocationType, flProtect);
 }
 
@@ -594,9 +842,7 @@ BOOL WINAPI windyn_VirtualFreeEx(
     SIZE_T dwSize,
     DWORD dwFreeType)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', 'E', 'x', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("VirtualFreeEx"));
     return ((PFN_VirtualFreeEx)pfn)(hProcess, lpAddress, dwSize, dwFreeType);
 }
 
@@ -607,9 +853,7 @@ BOOL WINAPI windyn_VirtualProtectEx(
     DWORD flNewProtect,
     PDWORD lpflOldProtect)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'V', 'i', 'r', 't', 'u', 'a', 'l', 'P', 'r', 'o', 't', 'e', 'c', 't', 'E', 'x', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("VirtualProtectEx"));
     return ((PFN_VirtualProtectEx)pfn)(hProcess, lpAddress, dwSize, flNewProtect, lpflOldProtect);
 }
 
@@ -625,9 +869,7 @@ BOOL WINAPI windyn_CreateProcessA(
     LPSTARTUPINFOA lpStartupInfo,
     LPPROCESS_INFORMATION lpProcessInformation)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'C', 'r', 'e', 'a', 't', 'e', 'P', 'r', 'o', 'c', 'e', 's', 's', 'A', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("CreateProcessA"));
     return ((PFN_CreateProcessA)pfn)(lpApplicationName, lpCommandLine, 
         lpProcessAttributes, lpThreadAttributes, bInheritHandles, 
         dwCreationFlags, lpEnvironment, lpCurrentDirectory, 
@@ -639,18 +881,14 @@ HANDLE WINAPI windyn_OpenProcess(
     BOOL bInheritHandle,
     DWORD dwProcessId)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'O', 'p', 'e', 'n', 'P', 'r', 'o', 'c', 'e', 's', 's', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("OpenProcess"));
     return ((PFN_OpenProcess)pfn)(dwDesiredAccess, bInheritHandle, dwProcessId);
 }
 
 HANDLE WINAPI windyn_GetCurrentProcess(
     VOID)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'G', 'e', 't', 'C', 'u', 'r', 'r', 'e', 'n', 't', 'P', 'r', 'o', 'c', 'e', 's', 's', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("GetCurrentProcess"));
     return ((PFN_GetCurrentProcess)pfn)();
 }
 
@@ -661,9 +899,7 @@ BOOL WINAPI windyn_ReadProcessMemory(
     SIZE_T nSize,
     SIZE_T* lpNumberOfBytesRead)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'R', 'e', 'a', 'd', 'P', 'r', 'o', 'c', 'e', 's', 's', 'M', 'e', 'm', 'o', 'r', 'y', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("ReadProcessMemory"));
     return ((PFN_ReadProcessMemory)pfn)(hProcess, lpBaseAddress, lpBuffer, nSize, lpNumberOfBytesRead);
 }
 
@@ -674,9 +910,7 @@ BOOL WINAPI windyn_WriteProcessMemory(
     SIZE_T nSize,
     SIZE_T* lpNumberOfBytesWritten)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'W', 'r', 'i', 't', 'e', 'P', 'r', 'o', 'c', 'e', 's', 's', 'M', 'e', 'm', 'o', 'r', 'y', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("WriteProcessMemory"));
     return ((PFN_WriteProcessMemory)pfn)(hProcess, lpBaseAddress, lpBuffer, nSize, lpNumberOfBytesWritten);
 }
 
@@ -689,9 +923,7 @@ HANDLE WINAPI windyn_CreateRemoteThread(
     DWORD dwCreationFlags,
     LPDWORD lpThreadId)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'C', 'r', 'e', 'a', 't', 'e', 'R', 'e', 'm', 'o', 't', 'e', 'T', 'h', 'r', 'e', 'a', 'd', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("CreateRemoteThread"));
     return ((PFN_CreateRemoteThread)pfn)(hProcess, lpThreadAttributes, 
         dwStackSize, lpStartAddress, lpParameter, 
         dwCreationFlags, lpThreadId);
@@ -700,27 +932,21 @@ HANDLE WINAPI windyn_CreateRemoteThread(
 HANDLE WINAPI windyn_GetCurrentThread(
     VOID)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'G', 'e', 't', 'C', 'u', 'r', 'r', 'e', 'n', 't', 'T', 'h', 'r', 'e', 'a', 'd', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("GetCurrentThread"));
     return ((PFN_GetCurrentThread)pfn)();
 }
 
 DWORD WINAPI windyn_SuspendThread(
     HANDLE hThread)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'S', 'u', 's', 'p', 'e', 'n', 'd', 'T', 'h', 'r', 'e', 'a', 'd', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("SuspendThread"));
     return ((PFN_SuspendThread)pfn)(hThread);
 }
 
 DWORD WINAPI windyn_ResumeThread(
     HANDLE hThread)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'R', 'e', 's', 'u', 'm', 'e', 'T', 'h', 'r', 'e', 'a', 'd', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("ResumeThread"));
     return ((PFN_ResumeThread)pfn)(hThread);
 }
 
@@ -728,9 +954,7 @@ BOOL WINAPI windyn_GetThreadContext(
     HANDLE hThread,
     LPCONTEXT lpContext)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'G', 'e', 't', 'T', 'h', 'r', 'e', 'a', 'd', 'C', 'o', 'n', 't', 'e', 'x', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("GetThreadContext"));
     return ((PFN_GetThreadContext)pfn)(hThread, lpContext);
 }
 
@@ -738,9 +962,7 @@ BOOL WINAPI windyn_SetThreadContext(
     HANDLE hThread,
     CONST CONTEXT* lpContext)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'S', 'e', 't', 'T', 'h', 'r', 'e', 'a', 'd', 'C', 'o', 'n', 't', 'e', 'x', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("SetThreadContext"));
     return ((PFN_SetThreadContext)pfn)(hThread, lpContext);
 }
 
@@ -748,18 +970,14 @@ DWORD WINAPI windyn_WaitForSingleObject(
     HANDLE hHandle,
     DWORD dwMilliseconds)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'W', 'a', 'i', 't', 'F', 'o', 'r', 'S', 'i', 'n', 'g', 'l', 'e', 'O', 'b', 'j', 'e', 'c', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("WaitForSingleObject"));
     return ((PFN_WaitForSingleObject)pfn)(hHandle, dwMilliseconds);
 }
 
 BOOL WINAPI windyn_CloseHandle(
     HANDLE hObject)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'C', 'l', 'o', 's', 'e', 'H', 'a', 'n', 'd', 'l', 'e', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("CloseHandle"));
     return ((PFN_CloseHandle)pfn)(hObject);
 }
 
@@ -767,9 +985,7 @@ HANDLE WINAPI windyn_CreateToolhelp32Snapshot(
     DWORD dwFlags,
     DWORD th32ProcessID)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'C', 'r', 'e', 'a', 't', 'e', 'T', 'o', 'o', 'l', 'h', 'e', 'l', 'p', '3', '2', 'S', 'n', 'a', 'p', 's', 'h', 'o', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("CreateToolhelp32Snapshot"));
     return ((PFN_CreateToolhelp32Snapshot)pfn)(dwFlags, th32ProcessID);
 }
 
@@ -777,9 +993,7 @@ BOOL WINAPI windyn_Process32First(
     HANDLE hSnapshot,
     LPPROCESSENTRY32 lppe)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'P', 'r', 'o', 'c', 'e', 's', 's', '3', '2', 'F', 'i', 'r', 's', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("Process32First"));
     return ((PFN_Process32First)pfn)(hSnapshot, lppe);
 }
 
@@ -787,12 +1001,59 @@ BOOL WINAPI windyn_Process32Next(
     HANDLE hSnapshot,
     LPPROCESSENTRY32 lppe)
 {
-    FARPROC pfn = NULL;
-    char name[] = { 'P', 'r', 'o', 'c', 'e', 's', 's', '3', '2', 'N', 'e', 'x', 't', '\0' };
-    WINDYN_FINDWINAPI(name, pfn);
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("Process32Next"));
     return ((PFN_Process32Next)pfn)(hSnapshot, lppe);
 }
 
+BOOL WINAPI windyn_TerminateProcess(
+    HANDLE hProcess,
+    UINT uExitCode)
+{
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("TerminateProcess"));
+    return ((PFN_TerminateProcess)pfn)(hProcess, uExitCode);
+}
+
+DWORD WINAPI windyn_WaitForMultipleObjects(
+    DWORD nCount,
+    CONST HANDLE* lpHandles,
+    BOOL bWaitAll,
+    DWORD dwMilliseconds)
+{
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("WaitForMultipleObjects"));
+    return ((PFN_WaitForMultipleObjects)pfn)(nCount, lpHandles, bWaitAll, dwMilliseconds);
+}
+
+BOOL WINAPI windyn_GetExitCodeThread(
+    HANDLE hThread,
+    LPDWORD lpExitCode)
+{
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("GetExitCodeThread"));
+    return ((PFN_GetExitCodeThread)pfn)(hThread, lpExitCode);
+}
+
+HANDLE WINAPI windyn_OpenThread(
+    DWORD dwDesiredAccess,
+    BOOL bInheritHandle,
+    DWORD dwThreadId)
+{
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("OpenThread"));
+    return ((PFN_OpenThread)pfn)(dwDesiredAccess, bInheritHandle, dwThreadId);
+}
+
+DWORD WINAPI windyn_GetTickCount(
+    VOID)
+{
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("GetTickCount"));
+    return ((PFN_GetTickCount)pfn)();
+}
+
+VOID WINAPI windyn_Sleep(
+    DWORD dwMilliseconds)
+{
+    FARPROC pfn = windyn_findapi(WINDYN_HASH("Sleep"));
+    ((PFN_Sleep)pfn)(dwMilliseconds);
+}
+
 #endif // WINDYN_IMPLEMENTATION
 
 #ifdef __cplusplus
@@ -810,4 +1071,12 @@ BOOL WINAPI windyn_Process32Next(
  * v0.1.4, improve macro style
  * v0.1.5, seperate some macro to commdef
  * v0.1.6, add more functions
+ * v0.1.7, WINDYN_FINDEXP by binary search
+ * v0.1.8, bind api by compile-time fnv1a32 name hash with the cached hash index of kernel32
+ * v0.1.9, windyn_GetModuleHandleA by module cache, flushed when ldr list changed
+ * v0.1.10, windyn_findmodule by shared inl_findmodule, add WINDYN_FINDMODULEEX with module cache
+ * v0.1.11, use commdef v0.1.5 module cache with ldr list stamp
+ * v0.1.12, add TerminateProcess, WaitForMultipleObjects, GetExitCodeThread, OpenThread, GetTickCount, Sleep
+ * v0.1.13, WINDYN_HASH rejects names over 64 chars at compile time, add windyn_findapiex to share the hash index
+ * v0.1.14, use commdef v0.1.6
 */
\ No newline at end of file
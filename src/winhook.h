@@ -1,6 +1,6 @@
 /**
  * windows dynamic hook and memory util functions
- *    v0.3.6, developed by devseed
+ *    v0.3.15, developed by devseed
  * 
  * macros:
  *    WINHOOK_IMPLEMENT, include defines of each function
@@ -12,7 +12,7 @@
 
 #ifndef _WINHOOK_H
 #define _WINHOOK_H
-#define WINHOOK_VERSION "0.3.6"
+#define WINHOOK_VERSION "0.3.15"
 
 #ifdef USECOMPAT
 #include "commdef_v0_1_1.h"
@@ -56,6 +56,46 @@ extern "C" {
 #endif
 #include <windows.h>
 
+#define WINHOOK_INJECTOP_END 0
+#define WINHOOK_INJECTOP_LOADLIBRARY 1
+#define WINHOOK_INJECTOP_GETPROCADDRESS 2
+#define WINHOOK_INJECTOP_CALL 3
+#define WINHOOK_INJECTOP_CALLCHECK 4 // CALL, then stop if returned 0
+#define WINHOOK_INJECT_FAILED 0 // remote alloc, write or thread failed
+#define WINHOOK_INJECT_LOADED 1 // remote LoadLibraryA returned module
+#define WINHOOK_INJECT_NOTLOADED 2 // remote LoadLibraryA returned NULL
+#define WINHOOK_INJECT_TIMEOUT 3 // remote thread still running
+
+typedef struct _WINHOOK_INJECTOP
+{
+    size_t type; // WINHOOK_INJECTOP_xxx
+    // LOADLIBRARY: name, the module is used by next GETPROCADDRESS
+    // GETPROCADDRESS: name or ordinal, the slot va to store func
+    // CALL, CALLCHECK: func, arg1, arg2, arg3
+    // the stub stops at the first LOADLIBRARY, GETPROCADDRESS or CALLCHECK returned 0
+    size_t args[4];
+}WINHOOK_INJECTOP, *PWINHOOK_INJECTOP;
+
+typedef struct _WINHOOK_INJECTRESULT
+{
+    HANDLE hprocess;
+    DWORD status; // WINHOOK_INJECT_xxx
+    DWORD exitcode; // 1 if remote LoadLibraryA returned module, else 0
+    size_t hmod; // remote module base, full width read back from remotebuf
+    // only kept if WINHOOK_INJECT_TIMEOUT, then wait hthread, read hmod at 
+    // remotebuf + sizeof(size_t), VirtualFreeEx(hprocess, remotebuf, 0, MEM_RELEASE) 
+    // and CloseHandle(hthread)
+    HANDLE hthread;
+    LPVOID remotebuf;
+}WINHOOK_INJECTRESULT, *PWINHOOK_INJECTRESULT;
+
+/**
+ * @param hprocess, hthread suspended new process and its main thread, 
+ *        hthread can be NULL if not opened
+ * @return FALSE to stop watch
+*/
+typedef BOOL (*PFN_WINHOOK_WATCH)(HANDLE hprocess, HANDLE hthread, DWORD pid, void *arg);
+
 /**
  * start a exe and inject dll into exe
  * @return pid
@@ -63,6 +103,54 @@ extern "C" {
 WINHOOK_API 
 DWORD winhook_startexeinject(LPCSTR exepath, LPSTR cmdstr, LPCSTR dllpath);
 
+/**
+ * start a exe and load dlls then memory modules in order before exe entry, 
+ * by one stub with one alloc, SetThreadContext and WriteProcessMemory,
+ * the memory module is mapped and relocated here, imports, tls callbacks, 
+ * (x64 function table) and entry are done by the stub in target,
+ * the stub skips the rest ops if a dll, import or entry failed, then returns to exe
+ * @param dllpaths dll path list, can be NULL
+ * @param mods raw dll file list for memory module, can be NULL, 
+ *        static tls (__declspec(thread)) is not supported 
+ * @return pid, 0 if failed or a module has invalid or unsupported relocs, 
+ *         or no relocs (stripped) and can not be at its ImageBase, 
+ *         the modules are checked before the process created
+*/
+WINHOOK_API 
+DWORD winhook_startexeinjectex(LPCSTR exepath, LPSTR cmdstr, 
+    LPCSTR dllpaths[], int dllnum, const void* mods[], const size_t modsizes[], int modnum);
+
+/**
+ * the same as winhook_startexeinjectex, but on a suspended thread of a process,
+ * the stub runs when the thread resumed, best for the thread not started yet
+ * @return TRUE if the stub is written and thread context is set
+*/
+WINHOOK_API 
+BOOL winhook_injectthreadex(HANDLE hprocess, HANDLE hthread, 
+    LPCSTR dllpaths[], int dllnum, const void* mods[], const size_t modsizes[], int modnum);
+
+/**
+ * watch new processes of exename by NtQuerySystemInformation, only name of 
+ * new pid is compared, the matched process is suspended before callback, 
+ * then resumed after callback, so winhook_injectthreadex can be used in callback.
+ * the process is found by polling, so it may have run up to interval ms, 
+ * and hthread is then hijacked wherever it stopped, 
+ * such as in a wait (the stub runs after the wait returns) or holding loader lock 
+ * (LoadLibraryA in stub may deadlock), only the not started thread is safe. 
+ * hthread is the earliest created thread at the query, as the main thread in most cases, 
+ * but it might have exited or a thread created in the same tick might be chosen, 
+ * so this function is best-effort, and hthread is NULL if the thread can not be opened. 
+ * for the process started by yourself, use winhook_startexeinjectex (CREATE_SUSPENDED)
+ * @param exename image name, such as game.exe, not matched if exists before watch
+ * @param interval ms to sleep between each query, 0 to yield
+ * @param timeout ms to watch, INFINITE to watch until callback returns FALSE
+ * @return the num of matched processes, -1 if query failed, 
+ *         returns at once after callback returned FALSE
+*/
+WINHOOK_API
+int winhook_watchprocess(LPCWSTR exename, DWORD interval, DWORD timeout, 
+    PFN_WINHOOK_WATCH callback, void *arg);
+
 /**
  * start a exe by CreateProcess
  * @return pid
@@ -97,6 +185,19 @@ size_t winhook_getimagesize(HANDLE hprocess, HMODULE hmod);
 WINHOOK_API
 BOOL winhook_injectdll(HANDLE hprocess, LPCSTR dllname);
 
+/**
+ * dynamic inject a dll into processes concurrently, 
+ * remote threads are created at first, then waited together,
+ * each thread runs a small stub storing LoadLibraryA result in remotebuf 
+ * and exits with 0 or 1, as the exit code only has low 32 bit of module
+ * @param timeout ms for all processes, INFINITE to wait all finished
+ * @param results n results for each process
+ * @return the num of processes loaded the dll
+*/ 
+WINHOOK_API
+int winhook_injectdlls(HANDLE hprocesses[], int n, LPCSTR dllname, 
+    DWORD timeout, WINHOOK_INJECTRESULT results[]);
+
 /**
  * alloc a console for the program
 */
@@ -242,67 +343,342 @@ BOOL winhook_iathook(LPCSTR targetDllName, PROC pfnOrg, PROC pfgNew);
 #define CreateToolhelp32Snapshot windyn_CreateToolhelp32Snapshot
 #define Process32First windyn_Process32First
 #define Process32Next windyn_Process32Next
+#define TerminateProcess windyn_TerminateProcess
+#define WaitForMultipleObjects windyn_WaitForMultipleObjects
+#define GetExitCodeThread windyn_GetExitCodeThread
+#define OpenThread windyn_OpenThread
+#define GetTickCount windyn_GetTickCount
+#define Sleep windyn_Sleep
 #endif // WINHOOK_USEDYNBIND
 
 // loader functions
+static size_t winhook_mapmodule(const void *mod, size_t modsize, uint8_t *image)
+{
+    // map raw dll to image by sections, return imagesize, 0 if invalid
+    const uint8_t *raw = (const uint8_t *)mod;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)raw;
+    if(modsize < sizeof(IMAGE_DOS_HEADER) || pDosHeader->e_magic != IMAGE_DOS_SIGNATURE) return 0;
+    if(pDosHeader->e_lfanew < 0 || (size_t)pDosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS) > modsize) return 0;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(raw + pDosHeader->e_lfanew);
+    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
+    if(pNtHeader->Signature != IMAGE_NT_SIGNATURE) return 0;
+    if(pOptHeader->Magic != IMAGE_NT_OPTIONAL_HDR_MAGIC) return 0; // the same arch
+    size_t imagesize = pOptHeader->SizeOfImage;
+    size_t headersize = pOptHeader->SizeOfHeaders;
+    if(headersize > modsize || headersize > imagesize) return 0;
+    PIMAGE_SECTION_HEADER pSectHeader = (PIMAGE_SECTION_HEADER)
+        ((uint8_t*)pOptHeader + pNtHeader->FileHeader.SizeOfOptionalHeader);
+    WORD sectnum = pNtHeader->FileHeader.NumberOfSections;
+    if((uint8_t*)(pSectHeader + sectnum) > raw + headersize) return 0;
+    for(WORD i=0; i < sectnum; i++)
+    {
+        size_t rawsize = pSectHeader[i].SizeOfRawData;
+        if(pSectHeader[i].Misc.VirtualSize && pSectHeader[i].Misc.VirtualSize < rawsize)
+            rawsize = pSectHeader[i].Misc.VirtualSize;
+        if((size_t)pSectHeader[i].PointerToRawData + rawsize > modsize) return 0;
+        if((size_t)pSectHeader[i].VirtualAddress + rawsize > imagesize) return 0;
+        if(image && rawsize) memcpy(image + pSectHeader[i].VirtualAddress, 
+            raw + pSectHeader[i].PointerToRawData, rawsize);
+    }
+    if(image) memcpy(image, raw, headersize);
+    return imagesize;
+}
+
+static size_t winhook_bindmodule(uint8_t *image, size_t imagesize, 
+    size_t imageva, PWINHOOK_INJECTOP ops, size_t pfnRtlAddFunctionTable)
+{
+    // relocate image to imageva, return the op num to bind and init in target,
+    // if ops NULL, only check relocs and count the op num, (size_t)-1 if invalid
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)image;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(image + pDosHeader->e_lfanew);
+    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
+    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
+    size_t opnum = 0;
+
+    // every block and item must be in image, zero header only as the end padding
+    PIMAGE_DATA_DIRECTORY pRelocEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
+    size_t delta = imageva - (size_t)pOptHeader->ImageBase;
+    size_t relocsize = pRelocEntry->VirtualAddress ? pRelocEntry->Size : 0;
+    if((size_t)pRelocEntry->VirtualAddress + relocsize > imagesize) return (size_t)-1;
+    if(delta && (!relocsize || (pNtHeader->FileHeader.Characteristics 
+        & IMAGE_FILE_RELOCS_STRIPPED))) return (size_t)-1; // can not rebase
+    for(size_t offset = 0; offset + sizeof(IMAGE_BASE_RELOCATION) <= relocsize; )
+    {
+        PIMAGE_BASE_RELOCATION pBaseReloc = (PIMAGE_BASE_RELOCATION)
+            (image + pRelocEntry->VirtualAddress + offset);
+        if(!pBaseReloc->VirtualAddress && !pBaseReloc->SizeOfBlock) break;
+        if(pBaseReloc->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION) 
+            || pBaseReloc->SizeOfBlock > relocsize - offset) return (size_t)-1;
+        WORD *items = (WORD*)(pBaseReloc + 1);
+        DWORD itemnum = (pBaseReloc->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+        for(DWORD i=0; i < itemnum; i++)
+        {
+            size_t rva = (size_t)pBaseReloc->VirtualAddress + (items[i] & 0xfff);
+            switch(items[i] >> 12)
+            {
+            case IMAGE_REL_BASED_ABSOLUTE: // padding
+                break;
+            case IMAGE_REL_BASED_HIGHLOW:
+                if(rva + sizeof(DWORD) > imagesize) return (size_t)-1;
+                if(ops) *(DWORD*)(image + rva) += (DWORD)delta;
+                break;
+#ifdef _WIN64
+            case IMAGE_REL_BASED_DIR64:
+                if(rva + sizeof(ULONGLONG) > imagesize) return (size_t)-1;
+                if(ops) *(ULONGLONG*)(image + rva) += (ULONGLONG)delta;
+                break;
+#endif
+            default: // can not rebase
+                return (size_t)-1;
+            }
+        }
+        offset += pBaseReloc->SizeOfBlock;
+    }
+    if(ops) pOptHeader->ImageBase = imageva;
+
+    // LoadLibraryA each import dll, then GetProcAddress to fill iat
+    PIMAGE_DATA_DIRECTORY pImpEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)(image + pImpEntry->VirtualAddress);
+    for(; pImpEntry->VirtualAddress && (uint8_t*)(pImpDescriptor + 1) <= image + imagesize 
+        && pImpDescriptor->Name; pImpDescriptor++)
+    {
+        DWORD thunkrva = pImpDescriptor->OriginalFirstThunk ? 
+            pImpDescriptor->OriginalFirstThunk : pImpDescriptor->FirstThunk;
+        if(pImpDescriptor->Name >= imagesize || thunkrva >= imagesize) break;
+        if(ops)
+        {
+            ops[opnum].type = WINHOOK_INJECTOP_LOADLIBRARY;
+            ops[opnum].args[0] = imageva + pImpDescriptor->Name;
+        }
+        opnum++;
+        PIMAGE_THUNK_DATA pThunk = (PIMAGE_THUNK_DATA)(image + thunkrva);
+        for(size_t i=0; (uint8_t*)(pThunk + 1) <= image + imagesize && pThunk->u1.AddressOfData; i++, pThunk++)
+        {
+            if(ops)
+            {
+                ops[opnum].type = WINHOOK_INJECTOP_GETPROCADDRESS;
+                if(IMAGE_SNAP_BY_ORDINAL(pThunk->u1.Ordinal))
+                    ops[opnum].args[0] = (size_t)IMAGE_ORDINAL(pThunk->u1.Ordinal);
+                else ops[opnum].args[0] = imageva + (size_t)pThunk->u1.AddressOfData 
+                    + sizeof(WORD); // IMAGE_IMPORT_BY_NAME.Name
+                ops[opnum].args[1] = imageva + pImpDescriptor->FirstThunk + i * sizeof(size_t);
+            }
+            opnum++;
+        }
+    }
+
+#ifdef _WIN64
+    PIMAGE_DATA_DIRECTORY pExceptEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_EXCEPTION];
+    if(pExceptEntry->VirtualAddress && pExceptEntry->Size && pfnRtlAddFunctionTable)
+    {
+        if(ops)
+        {
+            ops[opnum].type = WINHOOK_INJECTOP_CALL;
+            ops[opnum].args[0] = pfnRtlAddFunctionTable;
+            ops[opnum].args[1] = imageva + pExceptEntry->VirtualAddress;
+            ops[opnum].args[2] = pExceptEntry->Size / sizeof(IMAGE_RUNTIME_FUNCTION_ENTRY);
+            ops[opnum].args[3] = imageva;
+        }
+        opnum++;
+    }
+#endif
+
+    // tls callbacks and entry, with (hinst, DLL_PROCESS_ATTACH, NULL)
+    PIMAGE_DATA_DIRECTORY pTlsEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_TLS];
+    if(pTlsEntry->VirtualAddress && pTlsEntry->VirtualAddress + sizeof(IMAGE_TLS_DIRECTORY) <= imagesize)
+    {
+        PIMAGE_TLS_DIRECTORY pTls = (PIMAGE_TLS_DIRECTORY)(image + pTlsEntry->VirtualAddress);
+        size_t cbrva = (size_t)pTls->AddressOfCallBacks - (size_t)pOptHeader->ImageBase;
+        for(; pTls->AddressOfCallBacks && cbrva + sizeof(size_t) <= imagesize 
+            && *(size_t*)(image + cbrva); cbrva += sizeof(size_t))
+        {
+            if(ops)
+            {
+                ops[opnum].type = WINHOOK_INJECTOP_CALL;
+                ops[opnum].args[0] = *(size_t*)(image + cbrva);
+                ops[opnum].args[1] = imageva;
+                ops[opnum].args[2] = DLL_PROCESS_ATTACH;
+                ops[opnum].args[3] = 0;
+            }
+            opnum++;
+        }
+    }
+    if(pOptHeader->AddressOfEntryPoint)
+    {
+        if(ops)
+        {
+            ops[opnum].type = WINHOOK_INJECTOP_CALLCHECK;
+            ops[opnum].args[0] = imageva + pOptHeader->AddressOfEntryPoint;
+            ops[opnum].args[1] = imageva;
+            ops[opnum].args[2] = DLL_PROCESS_ATTACH;
+            ops[opnum].args[3] = 0;
+        }
+        opnum++;
+    }
+    return opnum;
+}
+
+static size_t winhook_checkmodules(const void* mods[], const size_t modsizes[], int modnum, 
+    size_t pfnRtlAddFunctionTable, size_t *pimagesize)
+{
+    // map and check relocs of each module, return the op num and page aligned image size, 
+    // (size_t)-1 if a module is invalid
+    size_t opnum = 0;
+    size_t imagesize = 0;
+    for(int i=0; i < modnum; i++)
+    {
+        size_t modimagesize = winhook_mapmodule(mods[i], modsizes[i], NULL);
+        if(!modimagesize) return (size_t)-1;
+        uint8_t *image = (uint8_t*)VirtualAlloc(NULL, modimagesize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if(!image) return (size_t)-1;
+        winhook_mapmodule(mods[i], modsizes[i], image);
+        size_t modopnum = winhook_bindmodule(image, modimagesize, 0, NULL, pfnRtlAddFunctionTable);
+        VirtualFree(image, 0, MEM_RELEASE);
+        if(modopnum == (size_t)-1) return (size_t)-1;
+        opnum += modopnum;
+        imagesize += (modimagesize + 0xfff) & ~(size_t)0xfff;
+    }
+    if(pimagesize) *pimagesize = imagesize;
+    return opnum;
+}
+
 DWORD winhook_startexeinject(LPCSTR exepath, LPSTR cmdstr, LPCSTR dllpath)
+{
+    return winhook_startexeinjectex(exepath, cmdstr, 
+        dllpath ? &dllpath : NULL, dllpath ? 1 : 0, NULL, NULL, 0);
+}
+
+DWORD winhook_startexeinjectex(LPCSTR exepath, LPSTR cmdstr, 
+    LPCSTR dllpaths[], int dllnum, const void* mods[], const size_t modsizes[], int modnum)
 {
     STARTUPINFOA si = {0};
     PROCESS_INFORMATION pi = {0};
     si.cb = sizeof(STARTUPINFOA);
+    if(modnum && winhook_checkmodules(mods, modsizes, modnum, 0, NULL) == (size_t)-1) 
+        return 0; // reject before the process created
     if (!CreateProcessA(exepath, cmdstr,NULL, NULL, FALSE, CREATE_SUSPENDED, NULL, NULL, &si, &pi))
         return 0;
 
-    if (dllpath) // inject dll to process
+    if (dllnum || modnum) // inject dlls and mods to process
     {
-        size_t n = 0;
-        HANDLE hprocess = pi.hProcess;
-        HANDLE hthread = pi.hThread;
-        LPVOID injectaddr = VirtualAllocEx(hprocess,
-            0, 0x1000, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-        size_t oepva = 0;
-
-        // prepare shellcode 
-        CONTEXT context = { 0 };
-        context.ContextFlags = CONTEXT_ALL;
-        GetThreadContext(hthread, &context);
+        if(!winhook_injectthreadex(pi.hProcess, pi.hThread, 
+            dllpaths, dllnum, mods, modsizes, modnum))
+        {
+            TerminateProcess(pi.hProcess, 0);
+            CloseHandle(pi.hThread);
+            CloseHandle(pi.hProcess);
+            return 0;
+        }
+    }
+
+    ResumeThread(pi.hThread);
+    CloseHandle(pi.hThread);
+    return pi.dwProcessId;
+}
+
+BOOL winhook_injectthreadex(HANDLE hprocess, HANDLE hthread, 
+    LPCSTR dllpaths[], int dllnum, const void* mods[], const size_t modsizes[], int modnum)
+{
+    // the stub saves context, runs ops in table and returns to origin ip, 
+    // gprs and flags are pushed, fpu, sse and avx states by xsave (fxsave if no osxsave),
+    // table is {oepva, LoadLibraryA, GetProcAddress, WINHOOK_INJECTOP[]}
+#ifdef _WIN64
+    uint8_t injectcode[] = {0x50,0x9c,0x50,0x51,0x52,0x53,0x55,0x56,0x57,0x41,0x50,0x41,0x51,0x41,0x52,0x41,0x53,0x41,0x54,0x41,0x55,0xfc,0x48,0x89,0xe5,0xb8,0x01,0x00,0x00,0x00,0x0f,0xa2,0x45,0x31,0xe4,0xbb,0x00,0x02,0x00,0x00,0x0f,0xba,0xe1,0x1b,0x73,0x0f,0xb8,0x0d,0x00,0x00,0x00,0x31,0xc9,0x0f,0xa2,0x41,0xbc,0x01,0x00,0x00,0x00,0x48,0x29,0xdc,0x48,0x83,0xe4,0xc0,0x49,0x89,0xe5,0x45,0x85,0xe4,0x74,0x22,0x49,0x8d,0xbd,0x00,0x02,0x00,0x00,0xb9,0x08,0x00,0x00,0x00,0x31,0xc0,0xf3,0x48,0xab,0xb8,0xff,0xff,0xff,0xff,0xba,0xff,0xff,0xff,0xff,0x49,0x0f,0xae,0x65,0x00,0xeb,0x05,0x49,0x0f,0xae,0x45,0x00,0x48,0x83,0xec,0x20,0x48,0x8d,0x1d,0xa2,0x00,0x00,0x00,0x48,0x8b,0x03,0x48,0x89,0x45,0x70,0x48,0x8d,0x7b,0x18,0x31,0xf6,0x48,0x8b,0x07,0x48,0x85,0xc0,0x74,0x4d,0x48,0x83,0xf8,0x01,0x75,0x0c,0x48,0x8b,0x4f,0x08,0xff,0x53,0x08,0x48,0x89,0xc6,0xeb,0x30,0x48,0x83,0xf8,0x02,0x75,0x13,0x48,0x89,0xf1,0x48,0x8b,0x57,0x08,0xff,0x53,0x10,0x48,0x8b,0x4f,0x10,0x48,0x89,0x01,0xeb,0x17,0x48,0x8b,0x4f,0x10,0x48,0x8b,0x57,0x18,0x4c,0x8b,0x47,0x20,0xff,0x57,0x08,0x48,0x83,0x3f,0x04,0x75,0x07,0x89,0xc0,0x48,0x85,0xc0,0x74,0x06,0x48,0x83,0xc7,0x28,0xeb,0xab,0x45,0x85,0xe4,0x74,0x11,0xb8,0xff,0xff,0xff,0xff,0xba,0xff,0xff,0xff,0xff,0x49,0x0f,0xae,0x6d,0x00,0xeb,0x05,0x49,0x0f,0xae,0x4d,0x00,0x48,0x89,0xec,0x41,0x5d,0x41,0x5c,0x41,0x5b,0x41,0x5a,0x41,0x59,0x41,0x58,0x5f,0x5e,0x5d,0x5b,0x5a,0x59,0x58,0x9d,0xc3,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90};
+#else
+    uint8_t injectcode[] = {0x50,0x9c,0x60,0xfc,0x89,0xe5,0x83,0xec,0x08,0xb8,0x01,0x00,0x00,0x00,0x0f,0xa2,0x31,0xf6,0xbb,0x00,0x02,0x00,0x00,0x0f,0xba,0xe1,0x1b,0x73,0x0a,0xb8,0x0d,0x00,0x00,0x00,0x31,0xc9,0x0f,0xa2,0x46,0x89,0x75,0xfc,0x29,0xdc,0x83,0xe4,0xc0,0x89,0x65,0xf8,0x85,0xf6,0x74,0x20,0x8d,0xbc,0x24,0x00,0x02,0x00,0x00,0xb9,0x10,0x00,0x00,0x00,0x31,0xc0,0xf3,0xab,0xb8,0xff,0xff,0xff,0xff,0xba,0xff,0xff,0xff,0xff,0x0f,0xae,0x24,0x24,0xeb,0x04,0x0f,0xae,0x04,0x24,0xe8,0x00,0x00,0x00,0x00,0x5b,0x81,0xc3,0x81,0x00,0x00,0x00,0x8b,0x03,0x89,0x45,0x24,0x8d,0x7b,0x0c,0x31,0xf6,0x8b,0x07,0x85,0xc0,0x74,0x3c,0x83,0xf8,0x01,0x75,0x0a,0xff,0x77,0x04,0xff,0x53,0x04,0x89,0xc6,0xeb,0x24,0x83,0xf8,0x02,0x75,0x0e,0xff,0x77,0x04,0x56,0xff,0x53,0x08,0x8b,0x4f,0x08,0x89,0x01,0xeb,0x11,0xff,0x77,0x10,0xff,0x77,0x0c,0xff,0x77,0x08,0xff,0x57,0x04,0x83,0x3f,0x04,0x75,0x04,0x85,0xc0,0x74,0x05,0x83,0xc7,0x14,0xeb,0xbe,0x8b,0x4d,0xf8,0x83,0x7d,0xfc,0x00,0x74,0x0f,0xb8,0xff,0xff,0xff,0xff,0xba,0xff,0xff,0xff,0xff,0x0f,0xae,0x29,0xeb,0x03,0x0f,0xae,0x09,0x89,0xec,0x61,0x9d,0xc3,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90};
+#endif
+    if(dllnum < 0 || modnum < 0) return FALSE;
+
+    // kernel32 has the same base in target
+    char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l', '\0'};
+    HMODULE kernel32 = GetModuleHandleA(name_kernel32);
+    char name_LoadLibraryA[] = { 'L', 'o', 'a', 'd', 'L', 'i', 'b', 'r', 'a', 'r', 'y', 'A', '\0' };
+    FARPROC pfnLoadlibraryA = GetProcAddress(kernel32, name_LoadLibraryA);
+    char name_GetProcAddress[] = { 'G', 'e', 't', 'P', 'r', 'o', 'c', 'A', 'd', 'd', 'r', 'e', 's', 's', '\0' };
+    FARPROC pfnGetProcAddress = GetProcAddress(kernel32, name_GetProcAddress);
+    FARPROC pfnRtlAddFunctionTable = NULL;
 #ifdef _WIN64
-        uint8_t injectcode[] = {0x50,0x53,0x51,0x52,0xe8,0x2d,0x00,0x00,0x00,0x48,0x8d,0x58,0xf7,0x48,0x83,0xec,0x28,0x48,0x8b,0x8b,0x43,0x00,0x00,0x00,0x48,0x8b,0x83,0x4b,0x00,0x00,0x00,0xff,0xd0,0x48,0x83,0xc4,0x28,0x48,0x8b,0x83,0x3b,0x00,0x00,0x00,0x49,0x89,0xc7,0x5a,0x59,0x5b,0x58,0x41,0xff,0xe7,0x48,0x8b,0x04,0x24,0xc3,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90 };
-        oepva = context.Rip; 
-        context.Rip = (ULONGLONG)injectaddr;
+    char name_RtlAddFunctionTable[] = { 'R', 't', 'l', 'A', 'd', 'd', 'F', 'u', 'n', 'c', 't', 'i', 'o', 'n', 'T', 'a', 'b', 'l', 'e', '\0' };
+    pfnRtlAddFunctionTable = GetProcAddress(kernel32, name_RtlAddFunctionTable);
+#endif
+
+    // payload is [stub, table, ops, dll names, page aligned images]
+    size_t namesize = 0;
+    size_t imagesize = 0;
+    for(int i=0; i < dllnum; i++) namesize += strlen(dllpaths[i]) + 1;
+    size_t modopnum = winhook_checkmodules(mods, modsizes, modnum, 
+        (size_t)pfnRtlAddFunctionTable, &imagesize);
+    if(modopnum == (size_t)-1) return FALSE;
+    size_t opnum = dllnum + modopnum + 1; // the last is WINHOOK_INJECTOP_END
+    size_t tableoffset = sizeof(injectcode);
+    size_t opoffset = tableoffset + 3 * sizeof(size_t);
+    size_t nameoffset = opoffset + opnum * sizeof(WINHOOK_INJECTOP);
+    size_t imageoffset = (nameoffset + namesize + 0xfff) & ~(size_t)0xfff;
+    size_t payloadsize = imageoffset + imagesize;
+
+    size_t n = 0;
+    uint8_t *payload = (uint8_t*)VirtualAlloc(NULL, 
+        payloadsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    LPVOID injectaddr = VirtualAllocEx(hprocess,
+        0, payloadsize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    if(!payload || !injectaddr)
+    {
+        if(payload) VirtualFree(payload, 0, MEM_RELEASE);
+        if(injectaddr) VirtualFreeEx(hprocess, injectaddr, 0, MEM_RELEASE);
+        return FALSE;
+    }
 
+    // prepare shellcode 
+    size_t oepva = 0;
+    CONTEXT context = { 0 };
+    context.ContextFlags = CONTEXT_ALL;
+    if(!GetThreadContext(hthread, &context))
+    {
+        VirtualFree(payload, 0, MEM_RELEASE);
+        VirtualFreeEx(hprocess, injectaddr, 0, MEM_RELEASE);
+        return FALSE;
+    }
+#ifdef _WIN64
+    oepva = context.Rip; 
+    context.Rip = (ULONGLONG)injectaddr;
 #else
-        uint8_t injectcode[] = {0x50,0x53,0xe8,0x1e,0x00,0x00,0x00,0x8d,0x58,0xf9,0x8b,0x83,0x2d,0x00,0x00,0x00,0x50,0x8b,0x83,0x31,0x00,0x00,0x00,0xff,0xd0,0x8b,0x83,0x29,0x00,0x00,0x00,0x89,0xc7,0x5b,0x58,0xff,0xe7,0x8b,0x04,0x24,0xc3,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90,0x90 };
-        oepva = context.Eip; // origin eip at RtlUserThreadStart
-        context.Eip = (DWORD)injectaddr; 
+    oepva = context.Eip; // origin eip at RtlUserThreadStart
+    context.Eip = (DWORD)injectaddr; 
 #endif
-        SetThreadContext(hthread, &context);
-
-        char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l', '\0'};
-        HMODULE kernel32 = GetModuleHandleA(name_kernel32);
-        char name_LoadLibraryA[] = { 'L', 'o', 'a', 'd', 'L', 'i', 'b', 'r', 'a', 'r', 'y', 'A', '\0' };
-        FARPROC pfnLoadlibraryA = GetProcAddress(kernel32, name_LoadLibraryA);
-        size_t* pretva = (size_t*)(injectcode 
-            + sizeof(injectcode) - 3 * sizeof(size_t));
-        size_t *pdllnameva = (size_t*)(injectcode 
-            + sizeof(injectcode) - 2 * sizeof(size_t));
-        size_t* ploadlibraryva = (size_t*)(injectcode 
-            + sizeof(injectcode) - 1 * sizeof(size_t));
-        *pretva = (size_t)oepva;
-        *pdllnameva = (size_t)((size_t)injectaddr + sizeof(injectcode));
-        *ploadlibraryva = (size_t)pfnLoadlibraryA;
-
-        uint8_t* addr = (uint8_t*)injectaddr;
-        WriteProcessMemory(hprocess, addr,
-            injectcode, sizeof(injectcode), (SIZE_T*)&n); // copy shellcode
-        addr += sizeof(injectcode);
-        WriteProcessMemory(hprocess, addr,
-            dllpath, strlen(dllpath) + 1, (SIZE_T*)&n); // copy dll name
+    memcpy(payload, injectcode, sizeof(injectcode));
+    size_t *table = (size_t*)(payload + tableoffset);
+    table[0] = oepva;
+    table[1] = (size_t)pfnLoadlibraryA;
+    table[2] = (size_t)pfnGetProcAddress;
+
+    // prepare ops of dlls and mods
+    PWINHOOK_INJECTOP ops = (PWINHOOK_INJECTOP)(payload + opoffset);
+    size_t opcur = 0;
+    size_t namecur = nameoffset;
+    for(int i=0; i < dllnum; i++)
+    {
+        size_t namelen = strlen(dllpaths[i]) + 1;
+        memcpy(payload + namecur, dllpaths[i], namelen);
+        ops[opcur].type = WINHOOK_INJECTOP_LOADLIBRARY;
+        ops[opcur].args[0] = (size_t)injectaddr + namecur;
+        opcur++;
+        namecur += namelen;
+    }
+    size_t imagecur = imageoffset;
+    for(int i=0; i < modnum; i++)
+    {
+        uint8_t *image = payload + imagecur;
+        size_t modimagesize = winhook_mapmodule(mods[i], modsizes[i], image);
+        opcur += winhook_bindmodule(image, modimagesize, (size_t)injectaddr + imagecur, 
+            ops + opcur, (size_t)pfnRtlAddFunctionTable);
+        imagecur += (modimagesize + 0xfff) & ~(size_t)0xfff;
     }
 
-    ResumeThread(pi.hThread);
-    CloseHandle(pi.hThread);
-    return pi.dwProcessId;
+    BOOL ret = WriteProcessMemory(hprocess, injectaddr, payload, payloadsize, (SIZE_T*)&n);
+    if(ret) ret = SetThreadContext(hthread, &context);
+    VirtualFree(payload, 0, MEM_RELEASE);
+    if(!ret) VirtualFreeEx(hprocess, injectaddr, 0, MEM_RELEASE);
+    return ret;
 }
 
 HANDLE winhook_getprocess(LPCWSTR exename)
@@ -331,6 +707,189 @@ HANDLE winhook_getprocess(LPCWSTR exename)
     return NULL; // Not found
 }
 
+int winhook_watchprocess(LPCWSTR exename, DWORD interval, DWORD timeout, 
+    PFN_WINHOOK_WATCH callback, void *arg)
+{
+    typedef NTSTATUS (NTAPI *PFN_NtQuerySystemInformation)(ULONG, PVOID, ULONG, PULONG);
+    typedef NTSTATUS (NTAPI *PFN_NtSuspendProcess)(HANDLE);
+    typedef NTSTATUS (NTAPI *PFN_NtResumeProcess)(HANDLE);
+    typedef struct _SYSTEM_THREAD // the layout after SYSTEM_PROCESS_INFORMATION
+    {
+        LARGE_INTEGER Reserved1[3];
+        ULONG Reserved2;
+        PVOID StartAddress;
+        HANDLE UniqueProcess;
+        HANDLE UniqueThread;
+        LONG Priority;
+        LONG BasePriority;
+        ULONG Reserved3[3];
+    } SYSTEM_THREAD, *PSYSTEM_THREAD; // use this because of mingw and msvc differ
+    typedef struct _WATCH_PROCESS
+    {
+        DWORD pid;
+        LONGLONG createtime; // distinguish the reused pid
+    } WATCH_PROCESS, *PWATCH_PROCESS;
+
+    char name_ntdll[] = { 'n', 't', 'd', 'l', 'l', '.', 'd', 'l', 'l', '\0' };
+    HMODULE ntdll = GetModuleHandleA(name_ntdll);
+    char name_NtQuerySystemInformation[] = { 'N', 't', 'Q', 'u', 'e', 'r', 'y', 'S', 'y', 's', 't', 'e', 'm', 
+        'I', 'n', 'f', 'o', 'r', 'm', 'a', 't', 'i', 'o', 'n', '\0' };
+    PFN_NtQuerySystemInformation pfnNtQuerySystemInformation = (PFN_NtQuerySystemInformation)
+        GetProcAddress(ntdll, name_NtQuerySystemInformation);
+    char name_NtSuspendProcess[] = { 'N', 't', 'S', 'u', 's', 'p', 'e', 'n', 'd', 'P', 'r', 'o', 'c', 'e', 's', 's', '\0' };
+    PFN_NtSuspendProcess pfnNtSuspendProcess = (PFN_NtSuspendProcess)GetProcAddress(ntdll, name_NtSuspendProcess);
+    char name_NtResumeProcess[] = { 'N', 't', 'R', 'e', 's', 'u', 'm', 'e', 'P', 'r', 'o', 'c', 'e', 's', 's', '\0' };
+    PFN_NtResumeProcess pfnNtResumeProcess = (PFN_NtResumeProcess)GetProcAddress(ntdll, name_NtResumeProcess);
+    if(!pfnNtQuerySystemInformation || !pfnNtSuspendProcess || !pfnNtResumeProcess) return -1;
+
+    size_t namelen = 0;
+    while(exename[namelen]) namelen++;
+    ULONG bufsize = 0x40000;
+    uint8_t *buf = NULL;
+    PWATCH_PROCESS procs = NULL, newprocs = NULL; // sorted by pid
+    size_t proccap = 0, procnum = 0;
+    int matchnum = 0;
+    BOOL watching = TRUE;
+    BOOL first = TRUE;
+    DWORD start = GetTickCount();
+    while(watching)
+    {
+        // all processes by one query, without snapshot handle
+        NTSTATUS status = 0;
+        ULONG retsize = 0;
+        while(1)
+        {
+            if(!buf) buf = (uint8_t*)VirtualAlloc(NULL, bufsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if(!buf) break;
+            status = pfnNtQuerySystemInformation(5, buf, bufsize, &retsize); // SystemProcessInformation
+            if(status != (NTSTATUS)0xC0000004) break; // STATUS_INFO_LENGTH_MISMATCH
+            VirtualFree(buf, 0, MEM_RELEASE);
+            buf = NULL;
+            bufsize = retsize + 0x10000 > bufsize * 2 ? retsize + 0x10000 : bufsize * 2;
+        }
+        if(!buf || status < 0)
+        {
+            matchnum = -1;
+            break;
+        }
+
+        size_t num = 0;
+        PSYSTEM_PROCESS_INFORMATION pinfo = (PSYSTEM_PROCESS_INFORMATION)buf;
+        for(num = 1; pinfo->NextEntryOffset; num++)
+        {
+            pinfo = (PSYSTEM_PROCESS_INFORMATION)((uint8_t*)pinfo + pinfo->NextEntryOffset);
+        }
+        if(num > proccap)
+        {
+            size_t cap = num * 2;
+            PWATCH_PROCESS procs2 = (PWATCH_PROCESS)VirtualAlloc(NULL, 
+                cap * sizeof(WATCH_PROCESS), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            PWATCH_PROCESS newprocs2 = (PWATCH_PROCESS)VirtualAlloc(NULL, 
+                cap * sizeof(WATCH_PROCESS), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+            if(!procs2 || !newprocs2)
+            {
+                if(procs2) VirtualFree(procs2, 0, MEM_RELEASE);
+                if(newprocs2) VirtualFree(newprocs2, 0, MEM_RELEASE);
+                matchnum = -1;
+                break;
+            }
+            if(procnum) memcpy(procs2, procs, procnum * sizeof(WATCH_PROCESS));
+            if(procs) VirtualFree(procs, 0, MEM_RELEASE);
+            if(newprocs) VirtualFree(newprocs, 0, MEM_RELEASE);
+            procs = procs2;
+            newprocs = newprocs2;
+            proccap = cap;
+        }
+
+        // only compare the name of new process, then suspend it at once
+        size_t newnum = 0;
+        pinfo = (PSYSTEM_PROCESS_INFORMATION)buf;
+        for(size_t i=0; i < num; i++)
+        {
+            DWORD pid = (DWORD)(size_t)pinfo->UniqueProcessId;
+            LONGLONG createtime = *(LONGLONG*)(pinfo->Reserved1 + 0x18); // CreateTime
+            newprocs[newnum].pid = pid;
+            newprocs[newnum].createtime = createtime;
+            newnum++;
+
+            size_t l = 0, r = procnum;
+            while(l < r)
+            {
+                size_t m = l + (r - l) / 2;
+                if(procs[m].pid < pid) l = m + 1;
+                else r = m;
+            }
+            BOOL isnew = !(l < procnum && procs[l].pid == pid && procs[l].createtime == createtime);
+            BOOL ismatch = FALSE;
+            if(!first && watching && isnew && pid && pinfo->ImageName.Length / 2 == namelen)
+            {
+                ismatch = TRUE;
+                for(size_t j=0; j < namelen; j++)
+                {
+                    wchar_t c1 = pinfo->ImageName.Buffer[j], c2 = exename[j];
+                    if(c1 >= 'A' && c1 <= 'Z') c1 += 0x20;
+                    if(c2 >= 'A' && c2 <= 'Z') c2 += 0x20;
+                    if(c1 != c2) {ismatch = FALSE; break;}
+                }
+            }
+            if(ismatch)
+            {
+                HANDLE hprocess = OpenProcess(PROCESS_ALL_ACCESS, FALSE, pid);
+                if(hprocess)
+                {
+                    pfnNtSuspendProcess(hprocess);
+                    HANDLE hthread = NULL;
+                    PSYSTEM_THREAD pthread = (PSYSTEM_THREAD)(pinfo + 1);
+                    PSYSTEM_THREAD pmain = NULL; // the earliest created one, list order is not creation order
+                    for(ULONG j=0; j < pinfo->NumberOfThreads; j++)
+                    {
+                        if(!pmain || pthread[j].Reserved1[2].QuadPart < pmain->Reserved1[2].QuadPart) // CreateTime
+                        {
+                            pmain = pthread + j;
+                        }
+                    }
+                    if(pmain) hthread = OpenThread(THREAD_ALL_ACCESS, FALSE, (DWORD)(size_t)pmain->UniqueThread);
+                    matchnum++;
+                    watching = callback(hprocess, hthread, pid, arg);
+                    pfnNtResumeProcess(hprocess);
+                    if(hthread) CloseHandle(hthread);
+                    CloseHandle(hprocess);
+                    if(!watching) break;
+                }
+            }
+            pinfo = (PSYSTEM_PROCESS_INFORMATION)((uint8_t*)pinfo + pinfo->NextEntryOffset);
+        }
+        if(!watching) break; // no more query or sleep
+
+        // sort by pid for next query
+        size_t gap = 1;
+        while(gap < newnum / 3) gap = gap * 3 + 1;
+        for(; gap; gap /= 3)
+        {
+            for(size_t i=gap; i < newnum; i++)
+            {
+                WATCH_PROCESS proc = newprocs[i];
+                size_t j = i;
+                for(; j >= gap && newprocs[j-gap].pid > proc.pid; j -= gap) newprocs[j] = newprocs[j-gap];
+                newprocs[j] = proc;
+            }
+        }
+        PWATCH_PROCESS tmp = procs;
+        procs = newprocs;
+        newprocs = tmp;
+        procnum = newnum;
+        first = FALSE;
+
+        if(timeout != INFINITE && GetTickCount() - start >= timeout) break;
+        Sleep(interval);
+    }
+
+    if(buf) VirtualFree(buf, 0, MEM_RELEASE);
+    if(procs) VirtualFree(procs, 0, MEM_RELEASE);
+    if(newprocs) VirtualFree(newprocs, 0, MEM_RELEASE);
+    return matchnum;
+}
+
 size_t winhook_getimagebase(HANDLE hprocess)
 {
     //if (hprocess == GetCurrentProcess()) return (size_t)GetModuleHandleA(NULL);
@@ -353,25 +912,109 @@ size_t winhook_getimagesize(HANDLE hprocess, HMODULE hmod)
 
 BOOL winhook_injectdll(HANDLE hprocess, LPCSTR dllname)
 {
-    LPVOID addr = VirtualAllocEx(hprocess, 
-        0, 0x100, MEM_COMMIT, PAGE_READWRITE);
-    SIZE_T count;
-    if (addr == NULL) return FALSE;
-    WriteProcessMemory(hprocess, 
-        addr, dllname, strlen(dllname)+1, (SIZE_T*)&count);
+    WINHOOK_INJECTRESULT result;
+    winhook_injectdlls(&hprocess, 1, dllname, INFINITE, &result);
+    return result.status == WINHOOK_INJECT_LOADED 
+        || result.status == WINHOOK_INJECT_NOTLOADED;
+}
 
+int winhook_injectdlls(HANDLE hprocesses[], int n, LPCSTR dllname, 
+    DWORD timeout, WINHOOK_INJECTRESULT results[])
+{
+    // remotebuf is {LoadLibraryA, hmod, stub at 0x10, dllname at 0x40}, 
+    // stub(remotebuf) stores hmod and returns hmod != NULL
+#ifdef _WIN64
+    uint8_t loadcode[] = {0x53,0x48,0x83,0xec,0x20,0x48,0x89,0xcb,0x48,0x8d,0x4b,0x40,0xff,0x13,0x48,0x89,0x43,0x08,0x31,0xc9,0x48,0x85,0xc0,0x0f,0x95,0xc1,0x89,0xc8,0x48,0x83,0xc4,0x20,0x5b,0xc3};
+#else
+    uint8_t loadcode[] = {0x53,0x8b,0x5c,0x24,0x08,0x8d,0x43,0x40,0x50,0xff,0x13,0x89,0x43,0x04,0xf7,0xd8,0x19,0xc0,0xf7,0xd8,0x5b,0xc2,0x04,0x00};
+#endif
     char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l', '\0' };
     HMODULE kernel32 = GetModuleHandleA(name_kernel32);
     char name_LoadLibraryA[] = { 'L', 'o', 'a', 'd', 'L', 'i', 'b', 'r', 'a', 'r', 'y', 'A', '\0' };
     FARPROC pfnLoadlibraryA = GetProcAddress(kernel32, name_LoadLibraryA);
-    HANDLE hthread = CreateRemoteThread(hprocess, NULL, 0, 
-        (LPTHREAD_START_ROUTINE)pfnLoadlibraryA, addr, 0, NULL); 
-   
-    if (hthread == NULL) return FALSE;
-    WaitForSingleObject(hthread, -1);
-    VirtualFreeEx(hprocess, addr, 0x100, MEM_COMMIT);
+    size_t namesize = strlen(dllname) + 1;
+    size_t bufsize = 0x40 + namesize;
+    uint8_t *buf = (uint8_t*)VirtualAlloc(NULL, bufsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if(buf)
+    {
+        *(size_t*)buf = (size_t)pfnLoadlibraryA;
+        memcpy(buf + 0x10, loadcode, sizeof(loadcode));
+        memcpy(buf + 0x40, dllname, namesize);
+    }
+
+    // start all remote stubs without wait
+    for(int i=0; i < n; i++)
+    {
+        HANDLE hprocess = hprocesses[i];
+        SIZE_T count = 0;
+        results[i].hprocess = hprocess;
+        results[i].status = WINHOOK_INJECT_FAILED;
+        results[i].exitcode = 0;
+        results[i].hmod = 0;
+        results[i].hthread = NULL;
+        results[i].remotebuf = !buf ? NULL : VirtualAllocEx(hprocess, 
+            0, bufsize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+        if(!results[i].remotebuf) continue;
+        if(WriteProcessMemory(hprocess, results[i].remotebuf, buf, bufsize, &count))
+        {
+            results[i].hthread = CreateRemoteThread(hprocess, NULL, 0, 
+                (LPTHREAD_START_ROUTINE)((uint8_t*)results[i].remotebuf + 0x10), 
+                results[i].remotebuf, 0, NULL);
+        }
+        if(!results[i].hthread)
+        {
+            VirtualFreeEx(hprocess, results[i].remotebuf, 0, MEM_RELEASE);
+            results[i].remotebuf = NULL;
+        }
+    }
+    if(buf) VirtualFree(buf, 0, MEM_RELEASE);
+
+    // wait all threads by MAXIMUM_WAIT_OBJECTS in the same deadline
+    DWORD start = GetTickCount();
+    for(int i=0; i < n; )
+    {
+        HANDLE hthreads[MAXIMUM_WAIT_OBJECTS];
+        DWORD hthreadnum = 0;
+        for(; i < n && hthreadnum < MAXIMUM_WAIT_OBJECTS; i++)
+        {
+            if(results[i].hthread) hthreads[hthreadnum++] = results[i].hthread;
+        }
+        if(!hthreadnum) continue;
+        DWORD remain = INFINITE;
+        if(timeout != INFINITE)
+        {
+            DWORD elapsed = GetTickCount() - start;
+            remain = elapsed < timeout ? timeout - elapsed : 0;
+        }
+        WaitForMultipleObjects(hthreadnum, hthreads, TRUE, remain);
+    }
 
-    return TRUE;
+    // collect results, remote buffer is released only if thread finished
+    int loaded = 0;
+    for(int i=0; i < n; i++)
+    {
+        if(!results[i].hthread) continue;
+        if(WaitForSingleObject(results[i].hthread, 0) != WAIT_OBJECT_0)
+        {
+            results[i].status = WINHOOK_INJECT_TIMEOUT;
+            continue;
+        }
+        DWORD exitcode = 0;
+        SIZE_T count = 0;
+        size_t hmod = 0;
+        GetExitCodeThread(results[i].hthread, &exitcode);
+        ReadProcessMemory(results[i].hprocess, (uint8_t*)results[i].remotebuf + sizeof(size_t), 
+            &hmod, sizeof(hmod), &count);
+        results[i].exitcode = exitcode;
+        results[i].hmod = hmod;
+        results[i].status = exitcode == 1 ? WINHOOK_INJECT_LOADED : WINHOOK_INJECT_NOTLOADED;
+        if(exitcode == 1) loaded++;
+        VirtualFreeEx(results[i].hprocess, results[i].remotebuf, 0, MEM_RELEASE);
+        CloseHandle(results[i].hthread);
+        results[i].remotebuf = NULL;
+        results[i].hthread = NULL;
+    }
+    return loaded;
 }
 
 void winhook_installconsole()
@@ -724,4 +1367,13 @@ BOOL winhook_iathookpe(LPCSTR targetDllName, void* mempe, PROC pfnOrg, PROC pfnN
  * v0.3.4, change winhook_searchmemory pattern to xx ? xx xx, or xx ?? xx xx, 
  * v0.3.5, add winhook_getimagesize, winhook_searchmemory to inl_search
  * v0.3.6, add more windyn functions
+ * v0.3.7, add winhook_startexeinjectex to load dlls and memory modules by one stub
+ * v0.3.8, add winhook_injectdlls to inject processes concurrently with timeout, fix remote buffer leak
+ * v0.3.9, add winhook_watchprocess to catch new process suspended, winhook_injectthreadex for its thread
+ * v0.3.10, winhook_bindmodule rejects bad reloc blocks and types, the inject stub stops at the first failed op
+ * v0.3.11, winhook_injectdlls checks load by a remote stub flag, full remote module base in result hmod
+ * v0.3.12, inject stub saves full fpu/sse/avx state, winhook_watchprocess returns at once when callback stops
+ * v0.3.13, winhook_bindmodule rejects a module without relocs off its ImageBase, winhook_startexeinjectex checks mods before process created
+ * v0.3.14, winhook uses windyn for TerminateProcess, WaitForMultipleObjects, GetExitCodeThread, OpenThread, GetTickCount, Sleep in WINHOOK_USEDYNBIND
+ * v0.3.15, winhook_watchprocess picks the earliest created thread as hthread, documented as best-effort
 */
\ No newline at end of file
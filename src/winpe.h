@@ -1,6 +1,6 @@
 /**
  *  windows pe structure, adjusting realoc addrs, or iat
- *    v0.3.7, developed by devseed
+ *    v0.3.36, developed by devseed
  * 
  * macros:
  *    WINPE_IMPLEMENT, include defines of each function
@@ -12,10 +12,10 @@
 
 #ifndef _WINPE_H
 #define _WINPE_H
-#define WINPE_VERSION "0.3.7"
+#define WINPE_VERSION "0.3.36"
 
 #ifdef USECOMPAT
-#include "commdef_v0_1_1.h"
+#include "commdef_v0_1_6.h"
 #else
 #include "commdef.h"
 #endif // USECOMPAT
@@ -57,8 +57,297 @@
 extern "C" {
 #endif //  __cplusplus
 #include <stdint.h>
+#ifdef _WIN32
 #include <windows.h>
 #include <winternl.h>
+#else
+#include <stddef.h>
+// portable pe structures without windows.h, for parsing pe on posix
+#ifndef WINAPI
+#define WINAPI
+#endif
+#ifndef TRUE
+#define TRUE 1
+#define FALSE 0
+#endif
+#define MAXWORD 0xffff
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define LOWORD(l) ((WORD)(((size_t)(l)) & 0xffff))
+#define HIWORD(l) ((WORD)((((size_t)(l)) >> 16) & 0xffff))
+#define DLL_PROCESS_DETACH 0
+#define DLL_PROCESS_ATTACH 1
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define PAGE_EXECUTE_READ 0x20
+#define PAGE_EXECUTE_READWRITE 0x40
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_RELEASE 0x8000
+#define MEM_FREE 0x10000
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD, *PDWORD, *LPDWORD;
+typedef int32_t LONG;
+typedef uint64_t ULONGLONG;
+typedef int BOOL;
+typedef char CHAR;
+typedef const char *LPCSTR;
+typedef char *LPSTR;
+typedef void *LPVOID, *HANDLE, *HMODULE, *HINSTANCE;
+typedef const void *LPCVOID;
+typedef size_t SIZE_T, ULONG_PTR;
+typedef intptr_t (*FARPROC)();
+typedef intptr_t (*PROC)();
+typedef struct _MEMORY_BASIC_INFORMATION MEMORY_BASIC_INFORMATION, *PMEMORY_BASIC_INFORMATION;
+
+#define IMAGE_DOS_SIGNATURE 0x5A4D // MZ
+#define IMAGE_NT_SIGNATURE 0x00004550 // PE00
+#define IMAGE_NT_OPTIONAL_HDR32_MAGIC 0x10b
+#define IMAGE_NT_OPTIONAL_HDR64_MAGIC 0x20b
+#define IMAGE_NUMBEROF_DIRECTORY_ENTRIES 16
+#define IMAGE_SIZEOF_SHORT_NAME 8
+#define IMAGE_DIRECTORY_ENTRY_EXPORT 0
+#define IMAGE_DIRECTORY_ENTRY_IMPORT 1
+#define IMAGE_DIRECTORY_ENTRY_RESOURCE 2
+#define IMAGE_DIRECTORY_ENTRY_EXCEPTION 3
+#define IMAGE_DIRECTORY_ENTRY_SECURITY 4
+#define IMAGE_DIRECTORY_ENTRY_BASERELOC 5
+#define IMAGE_DIRECTORY_ENTRY_DEBUG 6
+#define IMAGE_DIRECTORY_ENTRY_TLS 9
+#define IMAGE_DIRECTORY_ENTRY_LOAD_CONFIG 10
+#define IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT 11
+#define IMAGE_DIRECTORY_ENTRY_IAT 12
+#define IMAGE_DIRECTORY_ENTRY_DELAY_IMPORT 13
+#define IMAGE_REL_BASED_ABSOLUTE 0
+#define IMAGE_REL_BASED_HIGH 1
+#define IMAGE_REL_BASED_LOW 2
+#define IMAGE_REL_BASED_HIGHLOW 3
+#define IMAGE_REL_BASED_HIGHADJ 4
+#define IMAGE_REL_BASED_DIR64 10
+#define IMAGE_ORDINAL_FLAG32 0x80000000
+#define IMAGE_ORDINAL_FLAG64 0x8000000000000000ULL
+#define IMAGE_FILE_DLL 0x2000
+#define IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE 0x0040
+
+#pragma pack(push, 2)
+typedef struct _IMAGE_DOS_HEADER 
+{
+    WORD e_magic, e_cblp, e_cp, e_crlc, e_cparhdr, e_minalloc, e_maxalloc, e_ss;
+    WORD e_sp, e_csum, e_ip, e_cs, e_lfarlc, e_ovno, e_res[4], e_oemid, e_oeminfo, e_res2[10];
+    LONG e_lfanew;
+}IMAGE_DOS_HEADER, *PIMAGE_DOS_HEADER;
+#pragma pack(pop)
+
+#pragma pack(push, 4)
+typedef struct _IMAGE_FILE_HEADER 
+{
+    WORD Machine;
+    WORD NumberOfSections;
+    DWORD TimeDateStamp;
+    DWORD PointerToSymbolTable;
+    DWORD NumberOfSymbols;
+    WORD SizeOfOptionalHeader;
+    WORD Characteristics;
+}IMAGE_FILE_HEADER, *PIMAGE_FILE_HEADER;
+
+typedef struct _IMAGE_DATA_DIRECTORY 
+{
+    DWORD VirtualAddress;
+    DWORD Size;
+}IMAGE_DATA_DIRECTORY, *PIMAGE_DATA_DIRECTORY;
+
+typedef struct _IMAGE_OPTIONAL_HEADER32 
+{
+    WORD Magic;
+    BYTE MajorLinkerVersion, MinorLinkerVersion;
+    DWORD SizeOfCode, SizeOfInitializedData, SizeOfUninitializedData;
+    DWORD AddressOfEntryPoint, BaseOfCode, BaseOfData;
+    DWORD ImageBase;
+    DWORD SectionAlignment, FileAlignment;
+    WORD MajorOperatingSystemVersion, MinorOperatingSystemVersion;
+    WORD MajorImageVersion, MinorImageVersion;
+    WORD MajorSubsystemVersion, MinorSubsystemVersion;
+    DWORD Win32VersionValue, SizeOfImage, SizeOfHeaders, CheckSum;
+    WORD Subsystem, DllCharacteristics;
+    DWORD SizeOfStackReserve, SizeOfStackCommit, SizeOfHeapReserve, SizeOfHeapCommit;
+    DWORD LoaderFlags, NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+}IMAGE_OPTIONAL_HEADER32, *PIMAGE_OPTIONAL_HEADER32;
+
+typedef struct _IMAGE_OPTIONAL_HEADER64 
+{
+    WORD Magic;
+    BYTE MajorLinkerVersion, MinorLinkerVersion;
+    DWORD SizeOfCode, SizeOfInitializedData, SizeOfUninitializedData;
+    DWORD AddressOfEntryPoint, BaseOfCode;
+    ULONGLONG ImageBase;
+    DWORD SectionAlignment, FileAlignment;
+    WORD MajorOperatingSystemVersion, MinorOperatingSystemVersion;
+    WORD MajorImageVersion, MinorImageVersion;
+    WORD MajorSubsystemVersion, MinorSubsystemVersion;
+    DWORD Win32VersionValue, SizeOfImage, SizeOfHeaders, CheckSum;
+    WORD Subsystem, DllCharacteristics;
+    ULONGLONG SizeOfStackReserve, SizeOfStackCommit, SizeOfHeapReserve, SizeOfHeapCommit;
+    DWORD LoaderFlags, NumberOfRvaAndSizes;
+    IMAGE_DATA_DIRECTORY DataDirectory[IMAGE_NUMBEROF_DIRECTORY_ENTRIES];
+}IMAGE_OPTIONAL_HEADER64, *PIMAGE_OPTIONAL_HEADER64;
+
+typedef struct _IMAGE_NT_HEADERS32
+{
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER32 OptionalHeader;
+}IMAGE_NT_HEADERS32, *PIMAGE_NT_HEADERS32;
+
+typedef struct _IMAGE_NT_HEADERS64
+{
+    DWORD Signature;
+    IMAGE_FILE_HEADER FileHeader;
+    IMAGE_OPTIONAL_HEADER64 OptionalHeader;
+}IMAGE_NT_HEADERS64, *PIMAGE_NT_HEADERS64;
+
+typedef struct _IMAGE_SECTION_HEADER 
+{
+    BYTE Name[IMAGE_SIZEOF_SHORT_NAME];
+    union 
+    {
+        DWORD PhysicalAddress;
+        DWORD VirtualSize;
+    }Misc;
+    DWORD VirtualAddress;
+    DWORD SizeOfRawData;
+    DWORD PointerToRawData;
+    DWORD PointerToRelocations;
+    DWORD PointerToLinenumbers;
+    WORD NumberOfRelocations;
+    WORD NumberOfLinenumbers;
+    DWORD Characteristics;
+}IMAGE_SECTION_HEADER, *PIMAGE_SECTION_HEADER;
+
+typedef struct _IMAGE_IMPORT_DESCRIPTOR 
+{
+    union 
+    {
+        DWORD Characteristics;
+        DWORD OriginalFirstThunk;
+    };
+    DWORD TimeDateStamp;
+    DWORD ForwarderChain;
+    DWORD Name;
+    DWORD FirstThunk;
+}IMAGE_IMPORT_DESCRIPTOR, *PIMAGE_IMPORT_DESCRIPTOR;
+
+typedef struct _IMAGE_IMPORT_BY_NAME 
+{
+    WORD Hint;
+    CHAR Name[1];
+}IMAGE_IMPORT_BY_NAME, *PIMAGE_IMPORT_BY_NAME;
+
+typedef struct _IMAGE_THUNK_DATA32 
+{
+    union 
+    {
+        DWORD ForwarderString, Function, Ordinal, AddressOfData;
+    }u1;
+}IMAGE_THUNK_DATA32, *PIMAGE_THUNK_DATA32;
+
+typedef struct _IMAGE_THUNK_DATA64 
+{
+    union 
+    {
+        ULONGLONG ForwarderString, Function, Ordinal, AddressOfData;
+    }u1;
+}IMAGE_THUNK_DATA64, *PIMAGE_THUNK_DATA64;
+
+typedef struct _IMAGE_EXPORT_DIRECTORY 
+{
+    DWORD Characteristics;
+    DWORD TimeDateStamp;
+    WORD MajorVersion;
+    WORD MinorVersion;
+    DWORD Name;
+    DWORD Base;
+    DWORD NumberOfFunctions;
+    DWORD NumberOfNames;
+    DWORD AddressOfFunctions;
+    DWORD AddressOfNames;
+    DWORD AddressOfNameOrdinals;
+}IMAGE_EXPORT_DIRECTORY, *PIMAGE_EXPORT_DIRECTORY;
+
+typedef struct _IMAGE_BASE_RELOCATION 
+{
+    DWORD VirtualAddress;
+    DWORD SizeOfBlock;
+}IMAGE_BASE_RELOCATION, *PIMAGE_BASE_RELOCATION;
+
+typedef struct _IMAGE_TLS_DIRECTORY32 
+{
+    DWORD StartAddressOfRawData, EndAddressOfRawData;
+    DWORD AddressOfIndex, AddressOfCallBacks;
+    DWORD SizeOfZeroFill, Characteristics;
+}IMAGE_TLS_DIRECTORY32, *PIMAGE_TLS_DIRECTORY32;
+
+typedef struct _IMAGE_TLS_DIRECTORY64 
+{
+    ULONGLONG StartAddressOfRawData, EndAddressOfRawData;
+    ULONGLONG AddressOfIndex, AddressOfCallBacks;
+    DWORD SizeOfZeroFill, Characteristics;
+}IMAGE_TLS_DIRECTORY64, *PIMAGE_TLS_DIRECTORY64;
+
+typedef struct _IMAGE_DEBUG_DIRECTORY 
+{
+    DWORD Characteristics;
+    DWORD TimeDateStamp;
+    WORD MajorVersion;
+    WORD MinorVersion;
+    DWORD Type;
+    DWORD SizeOfData;
+    DWORD AddressOfRawData;
+    DWORD PointerToRawData;
+}IMAGE_DEBUG_DIRECTORY, *PIMAGE_DEBUG_DIRECTORY;
+
+typedef struct _IMAGE_RESOURCE_DIRECTORY 
+{
+    DWORD Characteristics;
+    DWORD TimeDateStamp;
+    WORD MajorVersion;
+    WORD MinorVersion;
+    WORD NumberOfNamedEntries;
+    WORD NumberOfIdEntries;
+}IMAGE_RESOURCE_DIRECTORY, *PIMAGE_RESOURCE_DIRECTORY;
+
+typedef struct _IMAGE_RESOURCE_DIRECTORY_ENTRY 
+{
+    DWORD Name; // id, or 0x80000000 | string offset
+    DWORD OffsetToData; // data entry offset, or 0x80000000 | subdirectory offset
+}IMAGE_RESOURCE_DIRECTORY_ENTRY, *PIMAGE_RESOURCE_DIRECTORY_ENTRY;
+
+typedef struct _IMAGE_RESOURCE_DATA_ENTRY 
+{
+    DWORD OffsetToData; // rva
+    DWORD Size;
+    DWORD CodePage;
+    DWORD Reserved;
+}IMAGE_RESOURCE_DATA_ENTRY, *PIMAGE_RESOURCE_DATA_ENTRY;
+#pragma pack(pop)
+
+typedef void (WINAPI *PIMAGE_TLS_CALLBACK)(void *DllHandle, DWORD Reason, void *Reserved);
+
+#if UINTPTR_MAX > 0xffffffff
+typedef IMAGE_NT_HEADERS64 IMAGE_NT_HEADERS, *PIMAGE_NT_HEADERS;
+typedef IMAGE_OPTIONAL_HEADER64 IMAGE_OPTIONAL_HEADER, *PIMAGE_OPTIONAL_HEADER;
+typedef IMAGE_THUNK_DATA64 IMAGE_THUNK_DATA, *PIMAGE_THUNK_DATA;
+typedef IMAGE_TLS_DIRECTORY64 IMAGE_TLS_DIRECTORY, *PIMAGE_TLS_DIRECTORY;
+#define IMAGE_ORDINAL_FLAG IMAGE_ORDINAL_FLAG64
+#else
+typedef IMAGE_NT_HEADERS32 IMAGE_NT_HEADERS, *PIMAGE_NT_HEADERS;
+typedef IMAGE_OPTIONAL_HEADER32 IMAGE_OPTIONAL_HEADER, *PIMAGE_OPTIONAL_HEADER;
+typedef IMAGE_THUNK_DATA32 IMAGE_THUNK_DATA, *PIMAGE_THUNK_DATA;
+typedef IMAGE_TLS_DIRECTORY32 IMAGE_TLS_DIRECTORY, *PIMAGE_TLS_DIRECTORY;
+#define IMAGE_ORDINAL_FLAG IMAGE_ORDINAL_FLAG32
+#endif
+#endif // _WIN32
 
 typedef struct _RELOCOFFSET
 {
@@ -96,14 +385,429 @@ typedef SIZE_T (WINAPI *PFN_VirtualQuery)(
 typedef BOOL (WINAPI *PFN_DllMain)(HINSTANCE hinstDLL,
     DWORD fdwReason, LPVOID lpReserved );
 
+typedef BOOL (WINAPI *PFN_UnmapViewOfFile)(
+    LPCVOID lpBaseAddress);
+
 #define WINPE_LDFLAG_MEMALLOC 0x1
 #define WINPE_LDFLAG_MEMFIND 0x2
+#define WINPE_LDFLAG_EXPHINT 0x4
+#define WINPE_LDFLAG_FWDCACHE 0x8
+#define WINPE_LDFLAG_LAZY 0x10
+#define WINPE_BINDFLAG_EXPHINT 0x1
+#define WINPE_BINDFLAG_FWDCACHE 0x2
+#define WINPE_BINDFLAG_LAZY 0x4
+#define WINPE_LAZYSTATUS_DLLNOTFOUND 0xC0000135 // STATUS_DLL_NOT_FOUND
+#define WINPE_LAZYSTATUS_FUNCNOTFOUND 0xC0000139 // STATUS_ENTRYPOINT_NOT_FOUND
+#define WINPE_FWDCACHE_SLOTNUM 0x400
+#define WINPE_FWDCACHE_MAXPROBE 8 // slots probed from the hash, the first is replaced if all used
+#define WINPE_FWDMAXHOP 16
+#define WINPE_HASHFLAG_CRC32C 0x1
+#define WINPE_MEMFLAG_SECTION 0x1
+#define WINPE_VIEWFLAG_MEM 0x1
+#define WINPE_REWRITE_MAXSECT 96 // the section limit of old loaders
+#define WINPE_REWRITE_MAXPATCH 32
+#define WINPE_RES_STRINGFLAG 0x80000000
+#define WINPE_RES_MAXENTRY 0x10000
+#define WINPE_RTM_MAGIC 0x304D5452 // "RTM0"
+#define WINPE_RTM_PAGESIZE 0x1000
+#define WINPE_RTM_ORDINALFLAG 0x80000000
+
+typedef struct _WINPE_EXPSLOT
+{
+    uint32_t hash; // fnv1a32 of exp name
+    DWORD nameidx; // index in AddressOfNames + 1, 0 for empty slot
+}WINPE_EXPSLOT, *PWINPE_EXPSLOT;
+
+typedef struct _WINPE_EXPINDEX
+{
+    void *mempe;
+    DWORD slotnum; // power of 2
+    DWORD namenum;
+    WINPE_EXPSLOT slots[1];
+}WINPE_EXPINDEX, *PWINPE_EXPINDEX;
+
+typedef struct _WINPE_FWDSLOT
+{
+    volatile int32_t seq; // odd while writing, slot is read again if changed
+    volatile uint32_t hash; // fnv1a32 of forward name "dll.func" and exp dir name, 0 for empty slot
+    volatile size_t dllbase; // the module of forward exp, key with exprva
+    volatile size_t exprva;
+    void* volatile va; // final exp va
+}WINPE_FWDSLOT, *PWINPE_FWDSLOT;
+
+typedef struct _WINPE_FWDCACHE
+{
+    WINPE_FWDSLOT slots[WINPE_FWDCACHE_SLOTNUM];
+}WINPE_FWDCACHE, *PWINPE_FWDCACHE;
+
+typedef struct _WINPE_LAZYENTRY
+{
+    struct _WINPE_LAZYCTX *ctx;
+    PIMAGE_THUNK_DATA iat; // the iat slot to patch
+    PIMAGE_IMPORT_BY_NAME impbyname; // NULL if by ordinal
+    LPCSTR dllname;
+    LPCSTR funcname; // name or ordinal
+}WINPE_LAZYENTRY, *PWINPE_LAZYENTRY;
+
+typedef struct _WINPE_LAZYCTX
+{
+    PFN_LoadLibraryA pfnLoadLibraryA;
+    PFN_GetProcAddress pfnGetProcAddress;
+    DWORD flag; // bind flag for resolving
+    DWORD count;
+    size_t size; // alloc size, ctx|entries|common code|stubs
+    PWINPE_LAZYENTRY entries;
+    uint8_t *stubs;
+}WINPE_LAZYCTX, *PWINPE_LAZYCTX;
+
+typedef struct _WINPE_MODSET
+{
+    volatile LONG refcount; // shared by all modules in the set
+    DWORD count;
+    void *hmods[1]; // topological order, dependency first
+}WINPE_MODSET, *PWINPE_MODSET;
+
+// the records of memory module, in IMAGE_DOS_HEADER e_res2 (20 bytes)
+#pragma pack(push, 4)
+typedef struct _WINPE_MEMRECORD
+{
+    PWINPE_LAZYCTX lazyctx;
+    PWINPE_MODSET modset;
+    DWORD flag; // WINPE_MEMFLAG_SECTION, mapped view of section
+}WINPE_MEMRECORD, *PWINPE_MEMRECORD;
+#pragma pack(pop)
+#define WINPE_MEMRECORD_OF(mempe) ((PWINPE_MEMRECORD)((PIMAGE_DOS_HEADER)(mempe))->e_res2)
+
+typedef struct _WINPE_EXPCRC32
+{
+    uint32_t crc32;
+    DWORD exprva;
+}WINPE_EXPCRC32, *PWINPE_EXPCRC32;
+
+// ready-to-map image made by winrtm.py, 
+// hdr | pagemap | relocmap | imps | image (aligned by 0x1000)
+typedef struct _WINPE_RTMHDR
+{
+    DWORD magic; // WINPE_RTM_MAGIC
+    DWORD hdrsize;
+    uint64_t imagebase; // relocs in image are applied for this base
+    DWORD imagesize;
+    DWORD ptrsize; // 4 or 8
+    DWORD imageoffset; // image in section alignment
+    DWORD pagemapoffset; // one bit for each 4KB page with relocs
+    DWORD pagemapsize;
+    DWORD relocmapoffset; // 512 bytes for each page in pagemap, one bit for each reloc addr
+    DWORD relocmapsize;
+    DWORD impoffset; // WINPE_RTMIMP array, ordered by dll
+    DWORD impnum;
+    DWORD reloc32num; // HIGHLOW rvas in pe32+ (DWORD array after imps), rebased by 4 bytes
+}WINPE_RTMHDR, *PWINPE_RTMHDR;
+
+typedef struct _WINPE_RTMIMP
+{
+    DWORD iatrva;
+    DWORD dllnamerva;
+    DWORD namerva; // IMAGE_IMPORT_BY_NAME rva, or WINPE_RTM_ORDINALFLAG | ordinal
+}WINPE_RTMIMP, *PWINPE_RTMIMP;
+
+typedef struct _WINPE_FILEMAP
+{
+    void *base; // readonly view of the whole file
+    size_t size;
+    void *hfile; // file handle, or fd on posix
+    void *hmap; // file mapping handle, NULL on posix
+}WINPE_FILEMAP, *PWINPE_FILEMAP;
+
+typedef struct _WINPE_OVERLAYVIEW
+{
+    uint64_t offset; // overlay offset in file
+    uint64_t size; // overlay size, without the certificate table
+    uint64_t filesize;
+    void *hfile; // file handle, or fd on posix
+    void *hmap; // file mapping handle, NULL on posix
+    void *mapbase; // mapped view aligned by 0x10000, NULL if not mapped
+    size_t mapsize;
+    void *base; // overlay start in the mapped view
+}WINPE_OVERLAYVIEW, *PWINPE_OVERLAYVIEW;
+
+typedef struct _WINPE_VMREGION
+{
+    size_t base;
+    size_t size;
+    DWORD state; // MEM_FREE, MEM_RESERVE, MEM_COMMIT
+}WINPE_VMREGION, *PWINPE_VMREGION;
+
+// snapshot of the address space, sorted and coalesced regions, 
+// with a segment tree of the max free region size for searching
+typedef struct _WINPE_VMMAP
+{
+    HANDLE hprocess; // NULL for current process
+    size_t count;
+    size_t capacity;
+    PWINPE_VMREGION regions;
+    size_t leafnum; // power of 2
+    size_t *tree; // 2*leafnum, max free size of each node
+}WINPE_VMMAP, *PWINPE_VMMAP;
+
+// allocator hooks for placing images and file buffers in caller arenas
+typedef struct _WINPE_ALLOCATOR
+{
+    void *arg; // user data, such as the arena
+    void* (STDCALL *alloc)(void *arg, void *addr, size_t size, DWORD protect); // addr is prefered or NULL
+    bool_t (STDCALL *free)(void *arg, void *addr, size_t size);
+    bool_t (STDCALL *protect)(void *arg, void *addr, size_t size, DWORD protect, DWORD *oldprotect); // optional
+}WINPE_ALLOCATOR, *PWINPE_ALLOCATOR;
+
+// bounds-checked view of a pe in raw (file) or mem (image) layout, zero copy,
+// the fields are from the headers, so the same code works for pe32 and pe32+
+typedef struct _WINPE_VIEW
+{
+    const uint8_t *base;
+    size_t size; // accessible bytes from base
+    DWORD flag; // WINPE_VIEWFLAG_MEM for image layout
+    WORD magic; // IMAGE_NT_OPTIONAL_HDR32_MAGIC or IMAGE_NT_OPTIONAL_HDR64_MAGIC
+    WORD ptrsize; // 4 or 8 by magic, not the native
+    PIMAGE_FILE_HEADER filehdr;
+    void *opthdr; // PIMAGE_OPTIONAL_HEADER32 or PIMAGE_OPTIONAL_HEADER64 by magic
+    PIMAGE_DATA_DIRECTORY datadir;
+    DWORD dirnum; // clamped by SizeOfOptionalHeader
+    PIMAGE_SECTION_HEADER secthdr;
+    WORD sectnum;
+    DWORD headersize;
+    DWORD imagesize;
+}WINPE_VIEW, *PWINPE_VIEW;
+
+// the view with resolved directories, parsed once for many lookups
+typedef struct _WINPE_CTX
+{
+    WINPE_VIEW view;
+    PIMAGE_EXPORT_DIRECTORY expdir; // NULL if no exports or out of bounds
+    const DWORD *expfuncs; // AddressOfFunctions, NumberOfFunctions in bounds
+    const DWORD *expnames; // AddressOfNames, NumberOfNames in bounds
+    const WORD *expords; // AddressOfNameOrdinals, NumberOfNames in bounds
+    PIMAGE_IMPORT_DESCRIPTOR impdesc; // the first import descriptor
+    DWORD impnum; // the contiguous descriptors in bounds before the null one
+}WINPE_CTX, *PWINPE_CTX;
+
+typedef size_t (STDCALL *PFN_WINPE_WRITE)(void *arg, const void *buf, size_t size);
+
+typedef struct _WINPE_REWRITESECT
+{
+    IMAGE_SECTION_HEADER secthdr; // the output header, rva and raw offset are filled by layout
+    DWORD orgoffset; // raw range in the source pe, 0 for added sections
+    DWORD orgsize;
+    const void *data; // replaced contents, NULL to copy the source range
+    DWORD datasize;
+}WINPE_REWRITESECT, *PWINPE_REWRITESECT;
+
+typedef struct _WINPE_REWRITEPATCH
+{
+    DWORD offset; // output file offset, ascending
+    DWORD value;
+}WINPE_REWRITEPATCH, *PWINPE_REWRITEPATCH;
+
+// edits collected on a raw pe, the layout is computed once, 
+// then the output is streamed sequentially from the source and edit buffers
+typedef struct _WINPE_REWRITER
+{
+    WINPE_VIEW view; // source pe in raw layout, must be alive until written
+    DWORD entry; // AddressOfEntryPoint, initialized from source
+    WORD filechar; // FileHeader.Characteristics
+    WORD dllchar; // OptionalHeader.DllCharacteristics
+    DWORD headersize; // min SizeOfHeaders, grown by layout for the section table
+    IMAGE_DATA_DIRECTORY datadir[IMAGE_NUMBEROF_DIRECTORY_ENTRIES]; // source dirnum entries are written
+    DWORD checksum; // recomputed by layout if not 0
+    DWORD overlayoffset; // data after the sections in source, such as certificate
+    DWORD overlaysize;
+    DWORD newoverlayoffset;
+    DWORD filesize; // output size after layout
+    WORD sectnum;
+    WORD rawnum; // sections with raw data, raworder in file offset
+    WORD raworder[WINPE_REWRITE_MAXSECT];
+    WINPE_REWRITESECT sects[WINPE_REWRITE_MAXSECT];
+    DWORD patchnum; // dwords changed inside the copied ranges, such as debug dir
+    WINPE_REWRITEPATCH patches[WINPE_REWRITE_MAXPATCH];
+    uint8_t *header; // output headers in SizeOfHeaders, made by layout
+}WINPE_REWRITER, *PWINPE_REWRITER;
+
+typedef struct _WINPE_RESENTRY
+{
+    DWORD type; // id, or WINPE_RES_STRINGFLAG | string offset in resource dir
+    DWORD name; // the same as type
+    DWORD lang;
+    DWORD rva; // data rva in view
+    DWORD size; // data size, can be changed with data
+    DWORD codepage;
+    const void *data; // replaced data for winpe_resbuild, NULL to keep the origin
+}WINPE_RESENTRY, *PWINPE_RESENTRY;
+
+// flat index of the resource directory, zero copy of the view
+typedef struct _WINPE_RESINDEX
+{
+    WINPE_VIEW view;
+    DWORD rsrcrva; // resource dir rva, the string offsets are from here
+    DWORD count;
+    WINPE_RESENTRY entries[1]; // sorted by type, name, lang, strings before ids
+}WINPE_RESINDEX, *PWINPE_RESINDEX;
+
+/**
+ * make a view over the pe bytes, check the headers and section table
+ * @param size bytes of pe, 0 for a trusted pe (such as a loaded module), 
+ *        bounded by SizeOfImage in mem layout, unbounded in raw layout
+ * @param flag WINPE_VIEWFLAG_MEM if pe is in image layout, else file layout
+ * @return True if the headers are valid
+*/
+WINPE_API
+bool_t STDCALL winpe_view_init(PWINPE_VIEW view, const void *pe, size_t size, DWORD flag);
+
+/**
+ * get the pointer of rva with size bytes in view, 
+ * in raw layout, the rva is translated by the section table
+ * @return pointer, NULL if out of bounds
+*/
+WINPE_API
+void* STDCALL winpe_view_ptr(const WINPE_VIEW *view, size_t rva, size_t size);
+
+/**
+ * @return the zero terminated string at rva, NULL if not terminated in bounds
+*/
+WINPE_API
+LPCSTR STDCALL winpe_view_str(const WINPE_VIEW *view, size_t rva);
+
+/**
+ * @return section header, NULL if index out of section number
+*/
+WINPE_API
+PIMAGE_SECTION_HEADER STDCALL winpe_view_section(const WINPE_VIEW *view, DWORD index);
+
+/**
+ * get the whole data of a directory, such as IMAGE_DIRECTORY_ENTRY_BASERELOC
+ * @param psize directory size, can be NULL
+ * @return directory data, NULL if empty or out of bounds
+*/
+WINPE_API
+void* STDCALL winpe_view_dir(const WINPE_VIEW *view, DWORD index, DWORD *psize);
+
+/**
+ * @return ImageBase in optional header, by magic
+*/
+WINPE_API
+uint64_t STDCALL winpe_view_imagebase(const WINPE_VIEW *view);
+
+/**
+ * @return import descriptor at index, NULL at the end or out of bounds
+*/
+WINPE_API
+PIMAGE_IMPORT_DESCRIPTOR STDCALL winpe_view_impdesc(const WINPE_VIEW *view, DWORD index);
+
+/**
+ * get the thunk value of pe32 or pe32+ at thunkrva[index], 
+ * the ordinal flag is always moved to IMAGE_ORDINAL_FLAG64
+ * @return thunk value, 0 at the end or out of bounds
+*/
+WINPE_API
+uint64_t STDCALL winpe_view_thunk(const WINPE_VIEW *view, DWORD thunkrva, DWORD index);
+
+/**
+ * @return export directory with the 3 address arrays in bounds, NULL if no exports
+*/
+WINPE_API
+PIMAGE_EXPORT_DIRECTORY STDCALL winpe_view_expdir(const WINPE_VIEW *view);
+
+/**
+ * get the exp by name index in AddressOfNames
+ * @param pname the exp name, can be NULL
+ * @return exp rva, 0 if out of bounds
+*/
+WINPE_API
+DWORD STDCALL winpe_view_expname(const WINPE_VIEW *view, 
+    const IMAGE_EXPORT_DIRECTORY *pExpDir, DWORD nameindex, LPCSTR *pname);
+
+/**
+ * get the exp by ordinal (with Base)
+ * @return exp rva, 0 if out of bounds
+*/
+WINPE_API
+DWORD STDCALL winpe_view_expord(const WINPE_VIEW *view, 
+    const IMAGE_EXPORT_DIRECTORY *pExpDir, DWORD ordinal);
+
+/**
+ * iterate the reloc blocks
+ * @param poffset in the block offset in reloc directory, out the next block offset
+ * @return reloc block with items in bounds, NULL at the end or invalid
+*/
+WINPE_API
+PIMAGE_BASE_RELOCATION STDCALL winpe_view_relocblock(const WINPE_VIEW *view, DWORD *poffset);
+
+/**
+ * @return tls callback va at index, 0 at the end or out of bounds
+*/
+WINPE_API
+uint64_t STDCALL winpe_view_tlscallback(const WINPE_VIEW *view, DWORD index);
+
+/**
+ * parse the headers once and resolve the export and import directories,
+ * then the winpe_ctx_ lookups skip re-deriving the headers
+ * @param size, flag the same as winpe_view_init
+ * @return FALSE if headers invalid
+*/
+WINPE_API
+bool_t STDCALL winpe_ctx_init(PWINPE_CTX ctx, const void *pe, size_t size, DWORD flag);
+
+/**
+ * @param pname optional, the export name at nameindex
+ * @return export rva by name index, 0 if out of bounds
+*/
+WINPE_API
+DWORD STDCALL winpe_ctx_expname(const WINPE_CTX *ctx, DWORD nameindex, LPCSTR *pname);
+
+/**
+ * find the export by name (binary search first, then ignore case) or by ordinal
+ * @return export rva, 0 if not found
+*/
+WINPE_API
+DWORD STDCALL winpe_ctx_findexp(const WINPE_CTX *ctx, LPCSTR funcname);
+
+/**
+ * try the name index of hint first, then winpe_ctx_findexp
+ * @return export rva, 0 if not found
+*/
+WINPE_API
+DWORD STDCALL winpe_ctx_findexphint(const WINPE_CTX *ctx, LPCSTR funcname, WORD hint);
+
+/**
+ * @return export rva with crc32 of name, 0 if not found
+*/
+WINPE_API
+DWORD STDCALL winpe_ctx_findexpcrc32(const WINPE_CTX *ctx, uint32_t crc32);
+
+/**
+ * find the iat slot by name or ordinal (hint for names), dllname NULL for all dlls
+ * @return iat rva, 0 if not found
+*/
+WINPE_API
+DWORD STDCALL winpe_ctx_findiat(const WINPE_CTX *ctx, LPCSTR dllname, LPCSTR funcname);
+
+/**
+ * map the whole file as a readonly view, 
+ * MapViewOfFile on windows, mmap on posix
+ * @return view base, NULL if failed or empty file
+*/
+WINPE_API
+void* STDCALL winpe_mapfile(const char *path, PWINPE_FILEMAP filemap);
+
+/**
+ * unmap the view and close the handles from winpe_mapfile
+*/
+WINPE_API
+bool_t STDCALL winpe_unmapfile(PWINPE_FILEMAP filemap);
 
 /**
  * load the origin rawpe file in memory buffer by mem align
- * mempe means the pe in memory alignment
+ * mempe means the pe in memory alignment, 
+ * the sections are copied from the mapped file view directly
  * @param pmemsize mempe buffer size
- * @return mempe buf
+ * @return mempe buf, NULL if failed
 */
 WINPE_API
 void* STDCALL winpe_memload_file(const char *path, size_t *pmemsize, bool_t same_align);
@@ -116,6 +820,56 @@ void* STDCALL winpe_memload_file(const char *path, size_t *pmemsize, bool_t same
 WINPE_API 
 void* STDCALL winpe_overlayload_file(const char *path, size_t *poverlaysize);
 
+/**
+ * open the overlay of a pe file, only the headers are read to locate it
+ * @return True on successful, view->size can be 0 if no overlay
+*/
+WINPE_API
+bool_t STDCALL winpe_overlayopen_file(const char *path, PWINPE_OVERLAYVIEW view);
+
+/**
+ * read the overlay data like pread, without mapping
+ * @param offset the offset from the overlay start
+ * @return read size, clamped by the overlay size
+*/
+WINPE_API
+size_t STDCALL winpe_overlayread(PWINPE_OVERLAYVIEW view, void *buf, size_t size, uint64_t offset);
+
+/**
+ * map the whole overlay as a readonly view
+ * @return overlay start va, NULL if failed (such as multi-GB overlay in x86)
+*/
+WINPE_API
+void* STDCALL winpe_overlaymap(PWINPE_OVERLAYVIEW view);
+
+/**
+ * unmap the overlay and close the file
+*/
+WINPE_API
+bool_t STDCALL winpe_overlayclose(PWINPE_OVERLAYVIEW view);
+
+/**
+ * load the rawpe file into caller buffer or allocator memory by mem align
+ * @param mempe caller buffer, if NULL, alloc by allocator or malloc
+ * @param pmemsize in the caller buffer size, out the mempe size (required size if too small)
+ * @param allocator alloc mempe if mempe is NULL, malloc if allocator is NULL
+ * @return mempe buf, NULL if failed or the buffer is too small
+*/
+WINPE_API
+void* STDCALL winpe_memload_fileex(const char *path, void *mempe, size_t *pmemsize, 
+    bool_t same_align, PWINPE_ALLOCATOR allocator);
+
+/**
+ * load the overlay data into caller buffer or allocator memory
+ * @param overlay caller buffer, if NULL, alloc by allocator or malloc
+ * @param poverlaysize in the caller buffer size, out the overlay size (required size if too small)
+ * @return overlay buf, NULL if failed, no overlay or the buffer is too small
+*/
+WINPE_API
+void* STDCALL winpe_overlayload_fileex(const char *path, void *overlay, size_t *poverlaysize, 
+    PWINPE_ALLOCATOR allocator);
+
+#ifdef _WIN32
 /**
  * similar to LoadlibrayA, 
  * will load the mempe in a valid imagebase
@@ -129,12 +883,71 @@ void* STDCALL winpe_memLoadLibrary(void *mempe);
  * @param imagebase if 0, will load on mempe, else in imagebase
  * @param flag WINPE_LDFLAG_MEMALLOC 0x1, will alloc memory to imagebase
  *             WINPE_LDFLAG_MEMFIND 0x2, will find a valid space, 
+ *             WINPE_LDFLAG_EXPHINT 0x4, bind iat by import hint and binary search
+ *             WINPE_LDFLAG_FWDCACHE 0x8, cache forwarded exps in process
+ *             WINPE_LDFLAG_LAZY 0x10, bind iat on the first call of each import
  * @return hmodule base
 */
 WINPE_API
 void* STDCALL winpe_memLoadLibraryEx(void *mempe, size_t imagebase, DWORD flag,
     PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
 
+/**
+ * load the mempe in the memory from allocator (at prefered imagebase first), 
+ * such as a pre-reserved arena, will call dll entry
+ * @param flag the same as winpe_memLoadLibraryEx, except MEMALLOC and MEMFIND
+ * @return hmodule base, free by winpe_memFreeLibraryAllocator
+*/
+WINPE_API
+void* STDCALL winpe_memLoadLibraryAllocator(void *mempe, DWORD flag, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, 
+    PWINPE_ALLOCATOR allocator);
+
+/**
+ * create a pagefile backed section with the mempe relocated to imagebase, 
+ * the section handle can be duplicated to other processes for loading
+ * @param imagebase the prefered base for all instances, 0 for the imagebase in mempe
+ * @return section handle, NULL if failed
+*/
+WINPE_API
+HANDLE STDCALL winpe_memsection_create(void *mempe, size_t imagebase);
+
+/**
+ * load the module by mapping the section as copy on write, 
+ * read-only and execute pages are shared among instances, 
+ * only written pages (such as iat, data, reloc if not at prefered base) are private
+ * @param flag WINPE_LDFLAG_EXPHINT, WINPE_LDFLAG_FWDCACHE, WINPE_LDFLAG_LAZY
+ * @return hmodule base, free by winpe_memFreeLibrary
+*/
+WINPE_API
+void* STDCALL winpe_memLoadLibrarySection(HANDLE hsection, DWORD flag, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
+
+/**
+ * load the ready-to-map image by one copy, 
+ * if not at the prefered imagebase, rebase by reloc bitmap, 
+ * then bind iat by the flat import list, will call dll entry
+ * @param flag WINPE_LDFLAG_EXPHINT, WINPE_LDFLAG_FWDCACHE
+ * @return hmodule base, free by winpe_memFreeLibrary
+*/
+WINPE_API
+void* STDCALL winpe_memLoadLibraryRtm(const void *rtm, size_t rtmsize, DWORD flag, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
+
+/**
+ * load the mempe modules as a set, the imports among them are bound in memory
+ * without LoadLibraryA, then call the dll entries in topological order
+ * @param names the dll names matched with import directory, such as "b.dll", 
+ *        if NULL, use the name in export directory
+ * @param hmods output hmodule base for each mempe, 
+ *        all modules are unloaded when the refcount (n) dropped to 0 by winpe_memFreeLibrary
+ * @param flag WINPE_LDFLAG_MEMFIND, WINPE_LDFLAG_EXPHINT, WINPE_LDFLAG_FWDCACHE
+ * @return loaded module count, 0 if failed
+*/
+WINPE_API
+size_t STDCALL winpe_memLoadLibrarySet(void **mempes, LPCSTR *names, size_t n, 
+    void **hmods, DWORD flag, PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
+
 /**
  * similar to FreeLibrary, will call dll entry
  * @return True on successful
@@ -146,6 +959,16 @@ WINPE_API
 BOOL STDCALL winpe_memFreeLibraryEx(void *mempe, 
     PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
 
+/**
+ * free the module from winpe_memLoadLibraryAllocator, will call dll entry
+ * @param allocator the same allocator for loading
+ * @return True on successful
+*/
+WINPE_API
+BOOL STDCALL winpe_memFreeLibraryAllocator(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, 
+    PWINPE_ALLOCATOR allocator);
+
 
 /**
  * similar to GetProcAddress
@@ -163,6 +986,9 @@ void* winpe_findkernel32();
 
 /**
  * use peb and ldr list, similar as GetModuleHandleA
+ * @param peb if NULL, use current process peb and find in module cache, 
+ *        the cache is dropped when ldr list stamp changed, a cached entry is used
+ *        only if found on the live list with same dllbase and name
  * @return ldr module address
 */
 WINPE_API
@@ -196,35 +1022,127 @@ void* STDCALL winpe_findspace(
     PFN_VirtualQuery pfnVirtualQuery);
 
 /**
- * @return the overlay offset
+ * snapshot the free and used regions of process address space
+ * @param hprocess NULL for current process, else by VirtualQueryEx
+ * @return True on successful
 */
 WINPE_API
-size_t STDCALL winpe_overlayoffset(const void *rawpe);
+bool_t STDCALL winpe_vmmap_snapshot(PWINPE_VMMAP vmmap, HANDLE hprocess);
 
 /**
- * load the origin rawpe in memory buffer by mem align
- * @return memsize
+ * update the vmmap after our own allocation or free, without query
+ * @param state MEM_FREE, MEM_RESERVE or MEM_COMMIT
+ * @return True on successful
 */
 WINPE_API
-size_t STDCALL winpe_memload(const void *rawpe, size_t rawsize, 
-    void *mempe, size_t memsize, bool_t same_align);
+bool_t STDCALL winpe_vmmap_update(PWINPE_VMMAP vmmap, size_t base, size_t size, DWORD state);
 
 /**
- * realoc the addrs for the mempe addr as image base
- * origin image base usually at 0x00400000, 0x0000000180000000
- * new image base mush be divided by 0x10000, if use loadlibrary
- * @return reloc count
+ * find the first free aligned space at or after addr, in O(log n)
+ * @return va, NULL if not found
 */
 WINPE_API
-size_t STDCALL winpe_memreloc(void *mempe, size_t newimagebase);
+void* STDCALL winpe_vmmap_findspace(PWINPE_VMMAP vmmap, 
+    size_t addr, size_t size, size_t alignsize);
+
+WINPE_API
+void STDCALL winpe_vmmap_free(PWINPE_VMMAP vmmap);
+#endif // _WIN32
 
 /**
- * load the iat for the mempe, use rvafunc for winpe_memfindexp
- * @return iat count
+ * @return the overlay offset
 */
 WINPE_API
-size_t STDCALL winpe_membindiat(void *mempe, 
-    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
+size_t STDCALL winpe_overlayoffset(const void *rawpe);
+
+/**
+ * locate the overlay by the headers, after the end of last section raw data, 
+ * the certificate table (file offset in security directory) is not in overlay
+ * @param rawpe at least the headers with section table
+ * @param filesize whole file size, 0 for unknown
+ * @param poverlaysize overlay size without certificate table, 0 if unknown
+ * @return the overlay offset
+*/
+WINPE_API
+uint64_t STDCALL winpe_overlayrange(const void *rawpe, uint64_t filesize, uint64_t *poverlaysize);
+
+/**
+ * check the ready-to-map image from winrtm.py, bounds of each part
+ * @return imagesize, 0 if invalid or not the native ptrsize
+*/
+WINPE_API
+size_t STDCALL winpe_rtmcheck(const void *rtm, size_t rtmsize);
+
+/**
+ * load the origin rawpe in memory buffer by mem align
+ * @return memsize
+*/
+WINPE_API
+size_t STDCALL winpe_memload(const void *rawpe, size_t rawsize, 
+    void *mempe, size_t memsize, bool_t same_align);
+
+/**
+ * realoc the addrs for the mempe addr as image base
+ * origin image base usually at 0x00400000, 0x0000000180000000
+ * new image base mush be divided by 0x10000, if use loadlibrary
+ * @return reloc count, 0 if no reloc directory, 
+ *         (size_t)-1 if the reloc table is invalid and the image is unchanged
+*/
+WINPE_API
+size_t STDCALL winpe_memreloc(void *mempe, size_t newimagebase);
+
+#ifdef _WIN32
+/**
+ * the same as winpe_memreloc, but split the reloc blocks into threads
+ * @param nthread 0 for the processor number, 1 for no threads
+ * @return reloc count, (size_t)-1 if the reloc table is invalid
+*/
+WINPE_API
+size_t STDCALL winpe_memrelocex(void *mempe, size_t newimagebase, DWORD nthread);
+#endif // _WIN32
+
+/**
+ * realoc the addrs in one IMAGE_BASE_RELOCATION block (a 4KB page),
+ * dispatch by type ABSOLUTE, HIGH, LOW, HIGHLOW, HIGHADJ, DIR64
+ * @param imagesize the target addr out of imagesize is invalid
+ * @param delta newimagebase - oldimagebase
+ * @return reloc count, (size_t)-1 if the block is invalid
+*/
+WINPE_API
+size_t STDCALL winpe_memrelocblock(void *mempe, size_t imagesize,
+    const void *basereloc, int64_t delta);
+
+#ifdef _WIN32
+/**
+ * load the iat for the mempe, use rvafunc for winpe_memfindexp
+ * @return iat count
+*/
+WINPE_API
+size_t STDCALL winpe_membindiat(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
+
+/**
+ * load the iat for the mempe, 
+ * @param flag WINPE_BINDFLAG_EXPHINT 0x1, find exp by import hint, 
+ *             then binary search, instead of pfnGetProcAddress
+ *             WINPE_BINDFLAG_FWDCACHE 0x2, cache forwarded exps in process
+ *             WINPE_BINDFLAG_LAZY 0x4, point iat to resolver stubs, 
+ *             bind on first call like delay load, the WINPE_LAZYCTX is in WINPE_MEMRECORD
+ * @return iat count
+*/
+WINPE_API
+size_t STDCALL winpe_membindiatex(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, DWORD flag);
+
+/**
+ * resolve a WINPE_LAZYENTRY and patch the iat slot atomically,
+ * called by the lazy stub on the first call
+ * if failed, raise WINPE_LAZYSTATUS_DLLNOTFOUND or WINPE_LAZYSTATUS_FUNCNOTFOUND (noncontinuable),
+ * with the entry in ExceptionInformation[0], instead of jumping to NULL
+ * @return the func va
+*/
+WINPE_API
+void* STDCALL winpe_memlazybind(void *entry);
 
 /**
  * exec the tls callbacks for the mempe, before dll oep load
@@ -233,6 +1151,16 @@ size_t STDCALL winpe_membindiat(void *mempe,
 */
 WINPE_API
 size_t STDCALL winpe_membindtls(void *mempe, DWORD reason);
+#endif // _WIN32
+
+/**
+ * decode lz4 block format into dst, position independent without crt, 
+ * so it can be used as shellcode to decode the compressed module (windllin)
+ * @param dst should not overlap with src
+ * @return decoded size, 0 if src is invalid or dst is too small
+*/
+WINPE_API
+size_t STDCALL winpe_memlz4decode(const void *src, size_t srcsize, void *dst, size_t dstsize);
 
 /**
  * find the iat addres, for call [iat]
@@ -253,13 +1181,88 @@ WINPE_API
 void* STDCALL winpe_memfindexpcrc32(void* mempe, uint32_t crc32);
 
 /**
- * forward the exp to the final expva
- * @return the final exp va
+ * build the (crc32, exprva) array sorted by crc32, for resolving by hash
+ * @param index if NULL, return the item count needed
+ * @param flag WINPE_HASHFLAG_CRC32C 0x1, use crc32c (sse4.2) instead of crc32
+ * @return item count, 0 if indexnum is not enough
+*/
+WINPE_API
+size_t STDCALL winpe_memexpcrc32index(void *mempe, 
+    PWINPE_EXPCRC32 index, size_t indexnum, DWORD flag);
+
+/**
+ * binary search the crc32 in the index from winpe_memexpcrc32index
+ * @return target exp va
+*/
+WINPE_API
+void* STDCALL winpe_memfindexpcrc32index(void *mempe, 
+    const WINPE_EXPCRC32 *index, size_t indexnum, uint32_t crc32);
+
+/**
+ * find the exp by the hint (index in AddressOfNames) first, 
+ * if not match, use winpe_memfindexp
+ * @return target exp va
+*/
+WINPE_API
+void* STDCALL winpe_memfindexphint(void *mempe, LPCSTR funcname, WORD hint);
+
+/**
+ * build the hashed exp name index in buf, for many lookups in one module
+ * @param buf if NULL, return the buf size needed
+ * @return index size, 0 if bufsize is not enough
+*/
+WINPE_API
+size_t STDCALL winpe_memexpindex(void *mempe, void *buf, size_t bufsize);
+
+/**
+ * find the exp by the index from winpe_memexpindex, 
+ * the name is case sensitive as GetProcAddress
+ * @return target exp va
+*/
+WINPE_API
+void* STDCALL winpe_memfindexpindex(const void *index, LPCSTR funcname);
+
+#ifdef _WIN32
+/**
+ * forward the exp to the final expva, at most WINPE_FWDMAXHOP times, 
+ * api set dll names are resolved by peb ApiSetMap
+ * @return the final exp va, NULL if failed or forward loop
 */
 WINPE_API
 void* STDCALL winpe_memforwardexp(void *mempe, size_t exprva, 
     PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress);
 
+/**
+ * the same as winpe_memforwardexp, 
+ * but find and insert the forward exp by (mempe, exprva) in cache, 
+ * a hit is used only if the hash of forward name and exp dir name also matches
+ * @param cache zero initialized at first, if NULL, not use cache
+ * @return the final exp va, NULL if failed or forward loop
+*/
+WINPE_API
+void* STDCALL winpe_memforwardexpex(void *mempe, size_t exprva, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, 
+    PWINPE_FWDCACHE cache);
+
+/**
+ * drop the cached forward exps from or into mempe, call it before mempe freed, 
+ * winpe_memFreeLibrary does this for the process forward cache
+ * @param cache if NULL, use the process forward cache
+*/
+WINPE_API
+void STDCALL winpe_memforwardexpflush(PWINPE_FWDCACHE cache, void *mempe);
+
+/**
+ * resolve the api set name by peb ApiSetMap (schema v6, win10+),
+ * such as api-ms-win-core-processthreads-l1-1-1.dll -> kernelbase.dll
+ * @param importer the dll which import the api set, can be NULL
+ * @return the host name length, 0 if not found
+*/
+WINPE_API
+size_t STDCALL winpe_findapiseta(const char *apisetname, const char *importer, 
+    char *hostname, size_t hostsize);
+#endif // _WIN32
+
 /**
  * change the oep of the pe if newoeprva!=0
  * @return the old oep rva
@@ -268,7 +1271,7 @@ WINPE_API
 DWORD STDCALL winpe_oepval(void *mempe, DWORD newoeprva);
 
 /**
- * change the imagebase of the pe if newimagebase!=0
+ * change the imagebase of the pe32 or pe32+ by magic if newimagebase!=0
  * @return the old imagebase va
 */
 WINPE_API
@@ -295,6 +1298,137 @@ void STDCALL winpe_noaslr(void *pe);
 WINPE_API
 size_t STDCALL winpe_appendsecth(void *mempe, PIMAGE_SECTION_HEADER psecth);
 
+/**
+ * change the CheckSum in optional header if newchecksum!=0
+ * @return the old checksum
+*/
+WINPE_API
+DWORD STDCALL winpe_checksumval(void *pe, DWORD newchecksum);
+
+/**
+ * compute the pe checksum the same as CheckSumMappedFile,
+ * 16 bits ones' complement sum of the file by sse2 if enabled, 
+ * with the current CheckSum field subtracted, then add filesize
+ * @param rawpe the whole file in raw layout
+ * @return checksum, 0 if invalid headers
+*/
+WINPE_API
+DWORD STDCALL winpe_checksum(const void *rawpe, size_t filesize);
+
+/**
+ * update the checksum incrementally after a range changed or appended,
+ * the same as winpe_checksum on the new file if the CheckSum field 
+ * still keeps the old checksum, so only the changed bytes are summed
+ * @param checksum the old valid checksum, also in the CheckSum field
+ * @param oldfilesize, newfilesize the file size before and after changing
+ * @param offset file offset of the range, should not cover the CheckSum field
+ * @param olddata bytes of the range before changing, NULL for zeros or appended
+ * @param newdata bytes of the range after changing
+ * @return new checksum
+*/
+WINPE_API
+DWORD STDCALL winpe_checksum_update(DWORD checksum, size_t oldfilesize, size_t newfilesize,
+    size_t offset, const void *olddata, const void *newdata, size_t size);
+
+/**
+ * start the edits of a raw pe, the entry, characteristics and headersize 
+ * in rewriter can be changed directly before layout
+ * @param rawpe the whole source file, such as winpe_mapfile, not copied
+ * @return FALSE if headers invalid or too many sections
+*/
+WINPE_API
+bool_t STDCALL winpe_rewrite_init(PWINPE_REWRITER rw, const void *rawpe, size_t size);
+
+/**
+ * add a section after the last one, rva and raw offset are filled by layout
+ * @param data section contents, not copied, NULL for uninitialized data
+ * @param virtualsize at least datasize
+ * @return section index, -1 if too many sections
+*/
+WINPE_API
+int STDCALL winpe_rewrite_addsect(PWINPE_REWRITER rw, LPCSTR name, 
+    const void *data, DWORD datasize, DWORD virtualsize, DWORD characteristics);
+
+/**
+ * replace the contents of a section, not copied, 
+ * the VirtualSize is extended if datasize is larger
+ * @return FALSE if index out of sections or data NULL
+*/
+WINPE_API
+bool_t STDCALL winpe_rewrite_setsect(PWINPE_REWRITER rw, WORD index, const void *data, DWORD datasize);
+
+/**
+ * compute the final layout once, grow the headers by shifting raw data, 
+ * place the sections and overlay, fix the file offsets in headers and debug dir, 
+ * then build the output headers (with CheckSum if the source has)
+ * @return output file size, 0 if the headers can not grow or sections overlap
+*/
+WINPE_API
+size_t STDCALL winpe_rewrite_layout(PWINPE_REWRITER rw);
+
+/**
+ * stream the output in a single sequential pass, layout first if not done
+ * @param pfnwrite return bytes written, stop if less than size
+ * @return bytes written, 0 if failed
+*/
+WINPE_API
+size_t STDCALL winpe_rewrite_write(PWINPE_REWRITER rw, PFN_WINPE_WRITE pfnwrite, void *arg);
+
+/**
+ * winpe_rewrite_write to a file, path should not be the source file
+ * @return bytes written, 0 if failed
+*/
+WINPE_API
+size_t STDCALL winpe_rewrite_file(PWINPE_REWRITER rw, const char *path);
+
+/**
+ * free the output headers made by layout
+*/
+WINPE_API
+void STDCALL winpe_rewrite_free(PWINPE_REWRITER rw);
+
+/**
+ * walk the resource directory of the view into a flat index in buf, 
+ * at most WINPE_RES_MAXENTRY entries, the view should be alive while using the index
+ * @param buf if NULL, return the buf size needed
+ * @return index size, 0 if bufsize is not enough or resource dir invalid
+*/
+WINPE_API
+size_t STDCALL winpe_resindex(const WINPE_VIEW *view, void *buf, size_t bufsize);
+
+/**
+ * find the resource by binary search, the same as FindResourceExW
+ * @param type, name id (<= MAXWORD) or utf-16 string, ignore ascii case
+ * @param lang 0 for the first language
+ * @return resource entry, NULL if not found
+*/
+WINPE_API
+PWINPE_RESENTRY STDCALL winpe_resfind(const void *index, const WORD *type, const WORD *name, WORD lang);
+
+/**
+ * @return resource data in view (or the replaced data) with entry->size, NULL if out of bounds
+*/
+WINPE_API
+const void* STDCALL winpe_resdata(const void *index, const WINPE_RESENTRY *entry);
+
+/**
+ * @param key type or name in the entry
+ * @param plen utf-16 length of the name
+ * @return the name string without zero terminated, NULL if key is id or out of bounds
+*/
+WINPE_API
+const WORD* STDCALL winpe_resname(const void *index, DWORD key, WORD *plen);
+
+/**
+ * rebuild the resource dir with the replaced entries in one pass, 
+ * dirs | data entries | strings | data (8 bytes aligned)
+ * @param rva where the built resource dir is placed, for the data rva
+ * @param buf if NULL, return the buf size needed
+ * @return resource dir size, 0 if bufsize is not enough or data out of bounds
+*/
+WINPE_API
+size_t STDCALL winpe_resbuild(const void *index, DWORD rva, void *buf, size_t bufsize);
+
 
 #ifdef __cplusplus
 }
@@ -313,154 +1447,1296 @@ size_t STDCALL winpe_appendsecth(void *mempe, PIMAGE_SECTION_HEADER psecth);
 
 #include <stdio.h>
 #include <assert.h>
+#ifdef _WIN32
 #include <windows.h>
 #include <winternl.h>
+#else
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WINPE_USE_SSE2
+#endif
 
-// PE high order fnctions
-void* STDCALL winpe_memload_file(const char *path, size_t *pmemsize, bool_t same_align)
+#ifdef _WIN32
+static WINPE_FWDCACHE s_winpe_fwdcache; // process forward cache, flushed by winpe_memFreeLibrary
+static INL_MODCACHE s_winpe_modcache; // process module cache, dropped by ldr list stamp
+static INLINE size_t winpe_memfindimp(size_t dllbase, LPCSTR funcname, 
+    PIMAGE_IMPORT_BY_NAME pImpByName, PFN_LoadLibraryA pfnLoadLibraryA, 
+    PFN_GetProcAddress pfnGetProcAddress, DWORD flag);
+#endif
+static uint32_t s_winpe_crc32tab[256]; // process crc32 table, built once by winpe_crc32tab
+static volatile int32_t s_winpe_crc32tabok;
+
+// PE view functions
+bool_t STDCALL winpe_view_init(PWINPE_VIEW view, const void *pe, size_t size, DWORD flag)
 {
-    FILE *fp = fopen(path, "rb");
-    fseek(fp, 0, SEEK_END);
-    size_t rawsize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    void *rawpe = malloc(rawsize);
-    fread(rawpe, 1, rawsize, fp);
-    fclose(fp);
+    const uint8_t *base = (const uint8_t*)pe;
+    inl_memset(view, 0, sizeof(WINPE_VIEW));
+    if(!pe) return FALSE;
+    if(size && size < sizeof(IMAGE_DOS_HEADER)) return FALSE;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)base;
+    if(pDosHeader->e_magic != IMAGE_DOS_SIGNATURE || pDosHeader->e_lfanew <= 0) return FALSE;
+    size_t ntoffset = (size_t)pDosHeader->e_lfanew;
+    size_t optoffset = ntoffset + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER);
+    size_t diroffset = FIELD_OFFSET(IMAGE_OPTIONAL_HEADER32, DataDirectory);
+    if(size && (ntoffset > size || size - ntoffset < optoffset - ntoffset + diroffset)) return FALSE;
+    if(*(const DWORD*)(base + ntoffset) != IMAGE_NT_SIGNATURE) return FALSE;
 
-    void *mempe = NULL;
-    if(pmemsize)
+    // optional header by magic, the data directory number is clamped by the header size
+    PIMAGE_FILE_HEADER pFileHeader = (PIMAGE_FILE_HEADER)(base + ntoffset + sizeof(DWORD));
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader32 = (PIMAGE_OPTIONAL_HEADER32)(base + optoffset);
+    PIMAGE_OPTIONAL_HEADER64 pOptHeader64 = (PIMAGE_OPTIONAL_HEADER64)(base + optoffset);
+    DWORD dirnum = 0;
+    if(pOptHeader32->Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        diroffset = FIELD_OFFSET(IMAGE_OPTIONAL_HEADER64, DataDirectory);
+        if(size && size - optoffset < diroffset) return FALSE;
+        view->ptrsize = 8;
+        view->datadir = pOptHeader64->DataDirectory;
+        dirnum = pOptHeader64->NumberOfRvaAndSizes;
+    }
+    else if(pOptHeader32->Magic == IMAGE_NT_OPTIONAL_HDR32_MAGIC)
+    {
+        view->ptrsize = 4;
+        view->datadir = pOptHeader32->DataDirectory;
+        dirnum = pOptHeader32->NumberOfRvaAndSizes;
+    }
+    else return FALSE;
+    if(pFileHeader->SizeOfOptionalHeader < diroffset) return FALSE;
+    if(dirnum > (pFileHeader->SizeOfOptionalHeader - diroffset) / sizeof(IMAGE_DATA_DIRECTORY))
     {
-        *pmemsize = winpe_memload(rawpe, 0, NULL, 0, FALSE);
-        mempe = malloc(*pmemsize);
-        winpe_memload(rawpe, rawsize, mempe, *pmemsize, same_align);
+        dirnum = (DWORD)((pFileHeader->SizeOfOptionalHeader - diroffset) / sizeof(IMAGE_DATA_DIRECTORY));
     }
-    free(rawpe);
-    return mempe;
+    if(dirnum > IMAGE_NUMBEROF_DIRECTORY_ENTRIES) dirnum = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+
+    // section table should be in bounds
+    size_t sectoffset = optoffset + pFileHeader->SizeOfOptionalHeader;
+    size_t sectsize = (size_t)pFileHeader->NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+    if(size && (sectoffset > size || size - sectoffset < sectsize)) return FALSE;
+
+    view->base = base;
+    view->flag = flag;
+    view->magic = pOptHeader32->Magic;
+    view->filehdr = pFileHeader;
+    view->opthdr = pOptHeader32;
+    view->dirnum = dirnum;
+    view->secthdr = (PIMAGE_SECTION_HEADER)(base + sectoffset);
+    view->sectnum = pFileHeader->NumberOfSections;
+    view->headersize = pOptHeader32->SizeOfHeaders; // the same offset in pe32 and pe32+
+    view->imagesize = pOptHeader32->SizeOfImage;
+    if(size) view->size = size;
+    else if(flag & WINPE_VIEWFLAG_MEM) view->size = view->imagesize;
+    else view->size = (size_t)-1 - (size_t)base;
+    return TRUE;
 }
- 
-void* STDCALL winpe_overlayload_file(const char *path, size_t *poverlaysize)
+
+void* STDCALL winpe_view_ptr(const WINPE_VIEW *view, size_t rva, size_t size)
 {
-    FILE *fp = fopen(path, "rb");
-    fseek(fp, 0, SEEK_END);
-    size_t rawsize = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
-    void *rawpe = malloc(rawsize);
-    fread(rawpe, 1, rawsize, fp);
-    fclose(fp);
-    void *overlay = NULL;
-    size_t overlayoffset = winpe_overlayoffset(rawpe);
-    
-    if(poverlaysize)
+    size_t offset = rva;
+    if(!(view->flag & WINPE_VIEWFLAG_MEM) && rva >= view->headersize)
     {
-        *poverlaysize = rawsize - overlayoffset;
-        if(*poverlaysize>0)
+        // find the section with rva, then check the raw data size
+        WORD i = 0;
+        for(; i < view->sectnum; i++)
         {
-            overlay = malloc(*poverlaysize);
-            memcpy(overlay, (uint8_t*)rawpe+overlayoffset, *poverlaysize);
+            PIMAGE_SECTION_HEADER pSectHeader = &view->secthdr[i];
+            size_t sectva = pSectHeader->VirtualAddress;
+            size_t sectrawsize = pSectHeader->SizeOfRawData;
+            if(rva < sectva || rva - sectva >= sectrawsize) continue;
+            if(size > sectrawsize - (rva - sectva)) return NULL;
+            offset = (size_t)pSectHeader->PointerToRawData + (rva - sectva);
+            break;
         }
+        if(i >= view->sectnum) return NULL;
     }
-    free(rawpe);
-    return overlay;
+    if(offset > view->size || size > view->size - offset) return NULL;
+    return (void*)(view->base + offset);
 }
 
-void* STDCALL winpe_memLoadLibrary(void *mempe)
+LPCSTR STDCALL winpe_view_str(const WINPE_VIEW *view, size_t rva)
 {
-    PFN_LoadLibraryA pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
-    PFN_GetProcAddress pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
-    return winpe_memLoadLibraryEx(mempe, 0, 
-                WINPE_LDFLAG_MEMFIND | WINPE_LDFLAG_MEMALLOC, 
-                pfnLoadLibraryA, pfnGetProcAddress);
+    LPCSTR str = (LPCSTR)winpe_view_ptr(view, rva, 1);
+    if(!str) return NULL;
+
+    // the string might cross the section raw data, so check each part
+    size_t i = 0;
+    while(1)
+    {
+        if(!str[i]) return str;
+        i++;
+        if(!(view->flag & WINPE_VIEWFLAG_MEM) && !winpe_view_ptr(view, rva + i, 1)) return NULL;
+        if((size_t)(str - (LPCSTR)view->base) + i >= view->size) return NULL;
+    }
 }
 
-void* STDCALL winpe_memLoadLibraryEx(void *mempe, size_t imagebase, DWORD flag,
-    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+PIMAGE_SECTION_HEADER STDCALL winpe_view_section(const WINPE_VIEW *view, DWORD index)
 {
-    // bind windows api
-    char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l' , '\0'};
-    char name_VirtualQuery[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'Q', 'u', 'e', 'r', 'y', '\0'};
-    char name_VirtualAlloc[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', '\0'};
-    char name_VirtualProtect[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'P', 'r', 'o', 't', 'e', 'c', 't', '\0'};
-    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
-    PFN_VirtualQuery pfnVirtualQuery = (PFN_VirtualQuery)pfnGetProcAddress(hmod_kernel32, name_VirtualQuery);
-    PFN_VirtualAlloc pfnVirtualAlloc = (PFN_VirtualAlloc)pfnGetProcAddress(hmod_kernel32, name_VirtualAlloc);
-    PFN_VirtualProtect pfnVirtualProtect =(PFN_VirtualProtect)pfnGetProcAddress(hmod_kernel32, name_VirtualProtect);
-#ifdef _DEBUG
-    assert(pfnVirtualQuery!=0 && pfnVirtualAlloc!=0 && pfnVirtualProtect!=0);
-#endif
+    if(index >= view->sectnum) return NULL;
+    return &view->secthdr[index];
+}
 
-    // find proper imagebase
-    size_t imagesize = winpe_imagesizeval(mempe, 0);
-    if(flag & WINPE_LDFLAG_MEMFIND)
+void* STDCALL winpe_view_dir(const WINPE_VIEW *view, DWORD index, DWORD *psize)
+{
+    if(psize) *psize = 0;
+    if(index >= view->dirnum) return NULL;
+    PIMAGE_DATA_DIRECTORY pDirEntry = &view->datadir[index];
+    if(!pDirEntry->VirtualAddress || !pDirEntry->Size) return NULL;
+    void *dir = winpe_view_ptr(view, pDirEntry->VirtualAddress, pDirEntry->Size);
+    if(dir && psize) *psize = pDirEntry->Size;
+    return dir;
+}
+
+uint64_t STDCALL winpe_view_imagebase(const WINPE_VIEW *view)
+{
+    if(view->magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC) 
     {
-        imagebase = winpe_imagebaseval(mempe, 0);
-        imagebase = (size_t)winpe_findspace(imagebase, imagesize, 0x10000, pfnVirtualQuery);
+        return ((PIMAGE_OPTIONAL_HEADER64)view->opthdr)->ImageBase;
     }
-    if(flag & WINPE_LDFLAG_MEMALLOC) // find proper memory to reloc
-    {
+    return ((PIMAGE_OPTIONAL_HEADER32)view->opthdr)->ImageBase;
+}
 
-        imagebase = (size_t)pfnVirtualAlloc((void*)imagebase, imagesize, 
-                            MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
-        if(!imagebase) // try alloc in arbitary place
-        {
-            imagebase = (size_t)pfnVirtualAlloc(NULL, imagesize, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-            if(!imagebase) return NULL;
-        }
-        else
-        {
-            imagebase = (size_t)pfnVirtualAlloc((void*)imagebase, imagesize, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-            if(!imagebase) return NULL;            
-        }
-    }
+PIMAGE_IMPORT_DESCRIPTOR STDCALL winpe_view_impdesc(const WINPE_VIEW *view, DWORD index)
+{
+    // the size in import directory is not reliable, so only check each descriptor
+    if(IMAGE_DIRECTORY_ENTRY_IMPORT >= view->dirnum) return NULL;
+    size_t imprva = view->datadir[IMAGE_DIRECTORY_ENTRY_IMPORT].VirtualAddress;
+    if(!imprva) return NULL;
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)winpe_view_ptr(view, 
+        imprva + (size_t)index * sizeof(IMAGE_IMPORT_DESCRIPTOR), sizeof(IMAGE_IMPORT_DESCRIPTOR));
+    if(!pImpDescriptor || !pImpDescriptor->Name) return NULL;
+    return pImpDescriptor;
+}
 
-    // copy to imagebase
-    if(!imagebase) 
-    {
-        imagebase = (size_t)mempe;
-    }
-    else
-    {
-        DWORD oldprotect;
-        pfnVirtualProtect((void*)imagebase, imagesize, PAGE_EXECUTE_READWRITE, &oldprotect);
-        inl_memcpy((void*)imagebase, mempe, imagesize);
-        pfnVirtualProtect((void*)imagebase, imagesize, oldprotect, &oldprotect);
-    }
+// ptrsize should be constant 4 or 8, so the loops calling this are specialized by bitness
+static INLINE uint64_t winpe_view_thunkt(const WINPE_VIEW *view, 
+    DWORD thunkrva, DWORD index, const DWORD ptrsize)
+{
+    if(!thunkrva) return 0;
+    const void *thunk = winpe_view_ptr(view, thunkrva + (size_t)index * ptrsize, ptrsize);
+    if(!thunk) return 0;
+    if(ptrsize == 8) return *(const uint64_t*)thunk;
+    uint32_t thunk32 = *(const uint32_t*)thunk;
+    if(thunk32 & IMAGE_ORDINAL_FLAG32) return IMAGE_ORDINAL_FLAG64 | (thunk32 & 0xffff);
+    return thunk32;
+}
 
-    // initial memory module
-    if(!winpe_memreloc((void*)imagebase, imagebase)) return NULL;
-    if(!winpe_membindiat((void*)imagebase, pfnLoadLibraryA, pfnGetProcAddress)) return NULL;
-    winpe_membindtls(mempe, DLL_PROCESS_ATTACH);
-    PFN_DllMain pfnDllMain = (PFN_DllMain)(imagebase + winpe_oepval((void*)imagebase, 0));
-    pfnDllMain((HINSTANCE)imagebase, DLL_PROCESS_ATTACH, NULL);
-    return (void*)imagebase;
+uint64_t STDCALL winpe_view_thunk(const WINPE_VIEW *view, DWORD thunkrva, DWORD index)
+{
+    if(view->ptrsize == 8) return winpe_view_thunkt(view, thunkrva, index, 8);
+    return winpe_view_thunkt(view, thunkrva, index, 4);
 }
 
-BOOL STDCALL winpe_memFreeLibrary(void *mempe)
+PIMAGE_EXPORT_DIRECTORY STDCALL winpe_view_expdir(const WINPE_VIEW *view)
 {
-    PFN_LoadLibraryA pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
-    PFN_GetProcAddress pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
-    return winpe_memFreeLibraryEx(mempe, pfnLoadLibraryA, pfnGetProcAddress);
+    if(IMAGE_DIRECTORY_ENTRY_EXPORT >= view->dirnum) return NULL;
+    size_t exprva = view->datadir[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress;
+    if(!exprva) return NULL;
+    PIMAGE_EXPORT_DIRECTORY pExpDir = (PIMAGE_EXPORT_DIRECTORY)winpe_view_ptr(view, 
+        exprva, sizeof(IMAGE_EXPORT_DIRECTORY));
+    if(!pExpDir) return NULL;
+    if(pExpDir->NumberOfFunctions && !winpe_view_ptr(view, pExpDir->AddressOfFunctions, 
+        (size_t)pExpDir->NumberOfFunctions * sizeof(DWORD))) return NULL;
+    if(pExpDir->NumberOfNames && (!winpe_view_ptr(view, pExpDir->AddressOfNames, 
+        (size_t)pExpDir->NumberOfNames * sizeof(DWORD)) || !winpe_view_ptr(view, 
+        pExpDir->AddressOfNameOrdinals, (size_t)pExpDir->NumberOfNames * sizeof(WORD)))) return NULL;
+    return pExpDir;
 }
 
-BOOL STDCALL winpe_memFreeLibraryEx(void *mempe, 
-    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+DWORD STDCALL winpe_view_expname(const WINPE_VIEW *view, 
+    const IMAGE_EXPORT_DIRECTORY *pExpDir, DWORD nameindex, LPCSTR *pname)
 {
-    char name_kernel32[] = {'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '\0'};
-    char name_VirtualFree[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', '\0'};
-    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
-    PFN_VirtualFree pfnVirtualFree = (PFN_VirtualFree)pfnGetProcAddress(hmod_kernel32, name_VirtualFree);
-    PFN_DllMain pfnDllMain = (PFN_DllMain)((uint8_t*)mempe + winpe_oepval(mempe, 0));
-    winpe_membindtls(mempe, DLL_PROCESS_DETACH);
-    pfnDllMain((HINSTANCE)mempe, DLL_PROCESS_DETACH, NULL);
-    return pfnVirtualFree(mempe, 0, MEM_FREE);
+    if(pname) *pname = NULL;
+    if(nameindex >= pExpDir->NumberOfNames) return 0;
+    const DWORD *namerva = (const DWORD*)winpe_view_ptr(view, pExpDir->AddressOfNames, 
+        (size_t)pExpDir->NumberOfNames * sizeof(DWORD));
+    const WORD *ordrva = (const WORD*)winpe_view_ptr(view, pExpDir->AddressOfNameOrdinals, 
+        (size_t)pExpDir->NumberOfNames * sizeof(WORD));
+    const DWORD *funcrva = (const DWORD*)winpe_view_ptr(view, pExpDir->AddressOfFunctions, 
+        (size_t)pExpDir->NumberOfFunctions * sizeof(DWORD));
+    if(!namerva || !ordrva || !funcrva || ordrva[nameindex] >= pExpDir->NumberOfFunctions) return 0;
+    if(pname) *pname = winpe_view_str(view, namerva[nameindex]);
+    return funcrva[ordrva[nameindex]];
 }
 
-PROC STDCALL winpe_memGetProcAddress(void *mempe, const char *funcname)
+DWORD STDCALL winpe_view_expord(const WINPE_VIEW *view, 
+    const IMAGE_EXPORT_DIRECTORY *pExpDir, DWORD ordinal)
 {
-    // this function might failed if inline and -Os, -O3, if in dll function, use printf might help
-    void* expva = winpe_memfindexp(mempe, funcname);
-    size_t exprva = (size_t)expva - (size_t)mempe;
-    // printf("[winpe_memGetProcAddress] expva=%p\n", expva);
-    
+    if(ordinal < pExpDir->Base || ordinal - pExpDir->Base >= pExpDir->NumberOfFunctions) return 0;
+    const DWORD *funcrva = (const DWORD*)winpe_view_ptr(view, pExpDir->AddressOfFunctions, 
+        (size_t)pExpDir->NumberOfFunctions * sizeof(DWORD));
+    if(!funcrva) return 0;
+    return funcrva[ordinal - pExpDir->Base];
+}
+
+PIMAGE_BASE_RELOCATION STDCALL winpe_view_relocblock(const WINPE_VIEW *view, DWORD *poffset)
+{
+    DWORD relocsize = 0;
+    uint8_t *reloc = (uint8_t*)winpe_view_dir(view, IMAGE_DIRECTORY_ENTRY_BASERELOC, &relocsize);
+    DWORD offset = *poffset;
+    if(!reloc || offset > relocsize || relocsize - offset < sizeof(IMAGE_BASE_RELOCATION)) return NULL;
+    PIMAGE_BASE_RELOCATION pBaseReloc = (PIMAGE_BASE_RELOCATION)(reloc + offset);
+    if(pBaseReloc->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION)) return NULL; // zero padding at the end
+    if(pBaseReloc->SizeOfBlock > relocsize - offset) return NULL;
+    *poffset = offset + pBaseReloc->SizeOfBlock;
+    return pBaseReloc;
+}
+
+uint64_t STDCALL winpe_view_tlscallback(const WINPE_VIEW *view, DWORD index)
+{
+    if(IMAGE_DIRECTORY_ENTRY_TLS >= view->dirnum) return 0;
+    size_t tlsrva = view->datadir[IMAGE_DIRECTORY_ENTRY_TLS].VirtualAddress;
+    if(!tlsrva) return 0;
+    uint64_t cbva = 0;
+    if(view->ptrsize == 8)
+    {
+        PIMAGE_TLS_DIRECTORY64 pTls = (PIMAGE_TLS_DIRECTORY64)winpe_view_ptr(
+            view, tlsrva, sizeof(IMAGE_TLS_DIRECTORY64));
+        if(!pTls) return 0;
+        cbva = pTls->AddressOfCallBacks;
+    }
+    else
+    {
+        PIMAGE_TLS_DIRECTORY32 pTls = (PIMAGE_TLS_DIRECTORY32)winpe_view_ptr(
+            view, tlsrva, sizeof(IMAGE_TLS_DIRECTORY32));
+        if(!pTls) return 0;
+        cbva = pTls->AddressOfCallBacks;
+    }
+
+    // AddressOfCallBacks is va, relocated with ImageBase
+    uint64_t imagebase = winpe_view_imagebase(view);
+    if(!cbva || cbva < imagebase || cbva - imagebase >= view->imagesize) return 0;
+    const void *cb = winpe_view_ptr(view, 
+        (size_t)(cbva - imagebase) + (size_t)index * view->ptrsize, view->ptrsize);
+    if(!cb) return 0;
+    return view->ptrsize == 8 ? *(const uint64_t*)cb : *(const uint32_t*)cb;
+}
+
+// PE context functions
+bool_t STDCALL winpe_ctx_init(PWINPE_CTX ctx, const void *pe, size_t size, DWORD flag)
+{
+    inl_memset(ctx, 0, sizeof(WINPE_CTX));
+    PWINPE_VIEW view = &ctx->view;
+    if(!winpe_view_init(view, pe, size, flag)) return FALSE;
+
+    // the 3 export arrays are checked in bounds by winpe_view_expdir
+    PIMAGE_EXPORT_DIRECTORY pExpDir = winpe_view_expdir(view);
+    if(pExpDir)
+    {
+        ctx->expdir = pExpDir;
+        ctx->expfuncs = (const DWORD*)winpe_view_ptr(view, pExpDir->AddressOfFunctions, 
+            (size_t)pExpDir->NumberOfFunctions * sizeof(DWORD));
+        ctx->expnames = (const DWORD*)winpe_view_ptr(view, pExpDir->AddressOfNames, 
+            (size_t)pExpDir->NumberOfNames * sizeof(DWORD));
+        ctx->expords = (const WORD*)winpe_view_ptr(view, pExpDir->AddressOfNameOrdinals, 
+            (size_t)pExpDir->NumberOfNames * sizeof(WORD));
+        if(!ctx->expfuncs || !ctx->expnames || !ctx->expords) ctx->expdir = NULL;
+    }
+
+    // descriptors might cross the sections in raw layout, only keep the contiguous ones
+    ctx->impdesc = winpe_view_impdesc(view, 0);
+    if(ctx->impdesc)
+    {
+        PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = NULL;
+        while((pImpDescriptor = winpe_view_impdesc(view, ctx->impnum)) 
+            && pImpDescriptor == ctx->impdesc + ctx->impnum) ctx->impnum++;
+    }
+    return TRUE;
+}
+
+DWORD STDCALL winpe_ctx_expname(const WINPE_CTX *ctx, DWORD nameindex, LPCSTR *pname)
+{
+    if(pname) *pname = NULL;
+    if(!ctx->expdir || nameindex >= ctx->expdir->NumberOfNames) return 0;
+    WORD ord = ctx->expords[nameindex];
+    if(ord >= ctx->expdir->NumberOfFunctions) return 0;
+    if(pname) *pname = winpe_view_str(&ctx->view, ctx->expnames[nameindex]);
+    return ctx->expfuncs[ord];
+}
+
+DWORD STDCALL winpe_ctx_findexp(const WINPE_CTX *ctx, LPCSTR funcname)
+{
+    PIMAGE_EXPORT_DIRECTORY pExpDir = ctx->expdir;
+    if(!pExpDir) return 0;
+    if((size_t)funcname <= MAXWORD) // find by ordnial
+    {
+        DWORD ord = LOWORD(funcname);
+        if(ord < pExpDir->Base || ord - pExpDir->Base >= pExpDir->NumberOfFunctions) return 0;
+        return ctx->expfuncs[ord - pExpDir->Base];
+    }
+
+    // exp names are sorted by ascii, binary search first
+    DWORD exprva = 0;
+    LPCSTR curname = NULL;
+    DWORD l = 0, r = pExpDir->NumberOfNames;
+    while(l < r)
+    {
+        DWORD m = l + (r - l) / 2;
+        exprva = winpe_ctx_expname(ctx, m, &curname);
+        if(!curname) return 0;
+        int cmp = inl_strcmp(curname, funcname);
+        if(cmp==0) return exprva;
+        else if(cmp < 0) l = m + 1;
+        else r = m;
+    }
+
+    // then ignore case, compatible with the previous version
+    for(DWORD i=0; i < pExpDir->NumberOfNames; i++)
+    {
+        exprva = winpe_ctx_expname(ctx, i, &curname);
+        if(exprva && curname && inl_stricmp(curname, funcname)==0) return exprva;
+    }
+    return 0;
+}
+
+DWORD STDCALL winpe_ctx_findexphint(const WINPE_CTX *ctx, LPCSTR funcname, WORD hint)
+{
+    if((size_t)funcname > MAXWORD && ctx->expdir && hint < ctx->expdir->NumberOfNames)
+    {
+        LPCSTR curname = NULL;
+        DWORD exprva = winpe_ctx_expname(ctx, hint, &curname);
+        if(exprva && curname && inl_strcmp(curname, funcname)==0) return exprva;
+    }
+    return winpe_ctx_findexp(ctx, funcname);
+}
+
+static DWORD winpe_ctx_findexpcrc32t(const WINPE_CTX *ctx, uint32_t crc32, const uint32_t *crc32tab)
+{
+    if(!ctx->expdir) return 0;
+    for (DWORD i = 0; i < ctx->expdir->NumberOfNames; i++)
+    {
+        LPCSTR curname = NULL;
+        DWORD exprva = winpe_ctx_expname(ctx, i, &curname);
+        if (curname && crc32==inl_crc32t(curname, inl_strlen(curname), crc32tab)) return exprva;
+    }
+    return 0;
+}
+
+static const uint32_t* winpe_crc32tab()
+{
+    // built once, the racing builders write the same values
+    if(!s_winpe_crc32tabok)
+    {
+        inl_crc32tab(s_winpe_crc32tab);
+        inl_fence();
+        s_winpe_crc32tabok = 1;
+    }
+    inl_fence();
+    return s_winpe_crc32tab;
+}
+
+DWORD STDCALL winpe_ctx_findexpcrc32(const WINPE_CTX *ctx, uint32_t crc32)
+{
+    if(!ctx->expdir) return 0;
+    uint32_t crc32tab[256]; // on stack for shellcode
+    inl_crc32tab(crc32tab);
+    return winpe_ctx_findexpcrc32t(ctx, crc32, crc32tab);
+}
+
+// ptrsize should be constant 4 or 8, specialized by bitness
+static INLINE DWORD winpe_ctx_findiatt(const WINPE_CTX *ctx, 
+    LPCSTR dllname, LPCSTR funcname, const DWORD ptrsize)
+{
+    const WINPE_VIEW *view = &ctx->view;
+    PIMAGE_IMPORT_BY_NAME pImpByName = NULL;
+    for (DWORD i=0; i < ctx->impnum; i++) 
+    {
+        PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = &ctx->impdesc[i];
+        LPCSTR pDllName = winpe_view_str(view, pImpDescriptor->Name);
+        if(!pDllName || (dllname && inl_stricmp(pDllName, dllname)!=0)) continue;
+        DWORD oft = pImpDescriptor->OriginalFirstThunk;
+        DWORD ft = pImpDescriptor->FirstThunk;
+        for (DWORD j=0; winpe_view_thunkt(view, ft, j, ptrsize); j++) 
+        {
+            uint64_t thunk = winpe_view_thunkt(view, oft ? oft : ft, j, ptrsize);
+            if(!thunk) break;
+            DWORD iatrva = ft + j * ptrsize;
+            if((size_t)funcname <= MAXWORD) // ordinary
+            {
+                WORD funcord = LOWORD(funcname);
+                if(thunk & IMAGE_ORDINAL_FLAG64)
+                {
+                    if((WORD)thunk == funcord) return iatrva;
+                    continue;
+                }
+                pImpByName = (PIMAGE_IMPORT_BY_NAME)winpe_view_ptr(view, 
+                    (size_t)thunk, sizeof(IMAGE_IMPORT_BY_NAME));
+                if(pImpByName && pImpByName->Hint == funcord) return iatrva;
+            }
+            else
+            {
+                if(thunk & IMAGE_ORDINAL_FLAG64) continue;
+                LPCSTR name = winpe_view_str(view, (size_t)thunk + sizeof(WORD));
+                if(name && inl_stricmp(name, funcname)==0) return iatrva;
+            }
+        }
+    }
+    return 0;
+}
+
+DWORD STDCALL winpe_ctx_findiat(const WINPE_CTX *ctx, LPCSTR dllname, LPCSTR funcname)
+{
+    if(ctx->view.ptrsize == 8) return winpe_ctx_findiatt(ctx, dllname, funcname, 8);
+    return winpe_ctx_findiatt(ctx, dllname, funcname, 4);
+}
+
+// PE high order fnctions
+void* STDCALL winpe_mapfile(const char *path, PWINPE_FILEMAP filemap)
+{
+    inl_memset(filemap, 0, sizeof(WINPE_FILEMAP));
+#ifdef _WIN32
+    LARGE_INTEGER filesize;
+    HANDLE hfile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hfile == INVALID_HANDLE_VALUE) return NULL;
+    if(!GetFileSizeEx(hfile, &filesize) || !filesize.QuadPart 
+        || (uint64_t)filesize.QuadPart > (size_t)-1) goto winpe_mapfile_fail;
+    HANDLE hmap = CreateFileMappingA(hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!hmap) goto winpe_mapfile_fail;
+    void *base = MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+    if(!base)
+    {
+        CloseHandle(hmap);
+        goto winpe_mapfile_fail;
+    }
+    filemap->base = base;
+    filemap->size = (size_t)filesize.QuadPart;
+    filemap->hfile = hfile;
+    filemap->hmap = hmap;
+    return base;
+
+winpe_mapfile_fail:
+    CloseHandle(hfile);
+    return NULL;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return NULL;
+    if(fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return NULL;
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(base == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    filemap->base = base;
+    filemap->size = (size_t)st.st_size;
+    filemap->hfile = (void*)(size_t)fd;
+    return base;
+#endif
+}
+
+bool_t STDCALL winpe_unmapfile(PWINPE_FILEMAP filemap)
+{
+    if(!filemap->base) return FALSE;
+#ifdef _WIN32
+    bool_t ret = UnmapViewOfFile(filemap->base);
+    CloseHandle((HANDLE)filemap->hmap);
+    CloseHandle((HANDLE)filemap->hfile);
+#else
+    bool_t ret = munmap(filemap->base, filemap->size) == 0;
+    close((int)(size_t)filemap->hfile);
+#endif
+    inl_memset(filemap, 0, sizeof(WINPE_FILEMAP));
+    return ret;
+}
+
+static size_t winpe_fileread(void *hfile, void *buf, size_t size, uint64_t offset)
+{
+    size_t total = 0;
+    while(total < size)
+    {
+#ifdef _WIN32
+        OVERLAPPED ov;
+        DWORD nread = 0;
+        DWORD chunk = size - total > 0x40000000 ? 0x40000000 : (DWORD)(size - total);
+        inl_memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)(offset + total);
+        ov.OffsetHigh = (DWORD)((offset + total) >> 32);
+        if(!ReadFile((HANDLE)hfile, (uint8_t*)buf + total, chunk, &nread, &ov) || !nread) break;
+#else
+        ssize_t nread = pread((int)(size_t)hfile, (uint8_t*)buf + total, size - total, (off_t)(offset + total));
+        if(nread <= 0) break;
+#endif
+        total += (size_t)nread;
+    }
+    return total;
+}
+
+bool_t STDCALL winpe_overlayopen_file(const char *path, PWINPE_OVERLAYVIEW view)
+{
+    inl_memset(view, 0, sizeof(WINPE_OVERLAYVIEW));
+#ifdef _WIN32
+    LARGE_INTEGER filesize;
+    HANDLE hfile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(hfile == INVALID_HANDLE_VALUE) return FALSE;
+    if(!GetFileSizeEx(hfile, &filesize))
+    {
+        CloseHandle(hfile);
+        return FALSE;
+    }
+    view->hfile = hfile;
+    view->filesize = (uint64_t)filesize.QuadPart;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return FALSE;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return FALSE;
+    }
+    view->hfile = (void*)(size_t)fd;
+    view->filesize = (uint64_t)st.st_size;
+#endif
+
+    // read dos header, nt header and section table only
+    IMAGE_DOS_HEADER doshdr;
+    uint8_t *hdr = NULL;
+    size_t hdrsize = 0;
+    if(winpe_fileread(view->hfile, &doshdr, sizeof(doshdr), 0) != sizeof(doshdr)
+        || doshdr.e_magic != IMAGE_DOS_SIGNATURE || doshdr.e_lfanew <= 0) goto winpe_overlayopen_file_fail;
+    hdrsize = (size_t)doshdr.e_lfanew + sizeof(IMAGE_NT_HEADERS64);
+    for(int i=0; i<2; i++) // nt header, then with section table
+    {
+        free(hdr);
+        hdr = (uint8_t*)malloc(hdrsize);
+        if(!hdr || winpe_fileread(view->hfile, hdr, hdrsize, 0) != hdrsize) goto winpe_overlayopen_file_fail;
+        PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(hdr + doshdr.e_lfanew);
+        hdrsize = (size_t)doshdr.e_lfanew + FIELD_OFFSET(IMAGE_NT_HEADERS, OptionalHeader)
+            + pNtHeader->FileHeader.SizeOfOptionalHeader 
+            + pNtHeader->FileHeader.NumberOfSections * sizeof(IMAGE_SECTION_HEADER);
+    }
+    view->offset = winpe_overlayrange(hdr, view->filesize, &view->size);
+    free(hdr);
+    return TRUE;
+
+winpe_overlayopen_file_fail:
+    free(hdr);
+    winpe_overlayclose(view);
+    return FALSE;
+}
+
+size_t STDCALL winpe_overlayread(PWINPE_OVERLAYVIEW view, void *buf, size_t size, uint64_t offset)
+{
+    if(offset >= view->size) return 0;
+    if(size > view->size - offset) size = (size_t)(view->size - offset);
+    if(view->base) 
+    {
+        inl_memcpy(buf, (uint8_t*)view->base + offset, size);
+        return size;
+    }
+    return winpe_fileread(view->hfile, buf, size, view->offset + offset);
+}
+
+void* STDCALL winpe_overlaymap(PWINPE_OVERLAYVIEW view)
+{
+    if(view->base) return view->base;
+    if(!view->size) return NULL;
+    uint64_t mapoffset = view->offset & ~(uint64_t)0xffff;
+    uint64_t mapsize = view->offset + view->size - mapoffset;
+    if(mapsize > (size_t)-1) return NULL;
+#ifdef _WIN32
+    HANDLE hmap = CreateFileMappingA((HANDLE)view->hfile, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!hmap) return NULL;
+    void *mapbase = MapViewOfFile(hmap, FILE_MAP_READ, 
+        (DWORD)(mapoffset >> 32), (DWORD)mapoffset, (SIZE_T)mapsize);
+    if(!mapbase)
+    {
+        CloseHandle(hmap);
+        return NULL;
+    }
+    view->hmap = hmap;
+#else
+    void *mapbase = mmap(NULL, (size_t)mapsize, PROT_READ, MAP_PRIVATE, 
+        (int)(size_t)view->hfile, (off_t)mapoffset);
+    if(mapbase == MAP_FAILED) return NULL;
+#endif
+    view->mapbase = mapbase;
+    view->mapsize = (size_t)mapsize;
+    view->base = (uint8_t*)mapbase + (view->offset - mapoffset);
+    return view->base;
+}
+
+bool_t STDCALL winpe_overlayclose(PWINPE_OVERLAYVIEW view)
+{
+    bool_t ret = view->hfile != NULL;
+#ifdef _WIN32
+    if(view->mapbase) UnmapViewOfFile(view->mapbase);
+    if(view->hmap) CloseHandle((HANDLE)view->hmap);
+    if(view->hfile) CloseHandle((HANDLE)view->hfile);
+#else
+    if(view->mapbase) munmap(view->mapbase, view->mapsize);
+    if(view->hfile) close((int)(size_t)view->hfile);
+#endif
+    inl_memset(view, 0, sizeof(WINPE_OVERLAYVIEW));
+    return ret;
+}
+
+void* STDCALL winpe_memload_file(const char *path, size_t *pmemsize, bool_t same_align)
+{
+    if(!pmemsize) return NULL;
+    return winpe_memload_fileex(path, NULL, pmemsize, same_align, NULL);
+}
+
+void* STDCALL winpe_memload_fileex(const char *path, void *mempe, size_t *pmemsize, 
+    bool_t same_align, PWINPE_ALLOCATOR allocator)
+{
+    WINPE_FILEMAP filemap;
+    void *rawpe = winpe_mapfile(path, &filemap);
+    if(!rawpe) return NULL;
+
+    // only headers in file are valid for winpe_memload
+    void *buf = NULL;
+    size_t bufsize = mempe && pmemsize ? *pmemsize : 0;
+    size_t rawsize = filemap.size;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)rawpe;
+    if(pmemsize && rawsize >= sizeof(IMAGE_DOS_HEADER) && pDosHeader->e_magic == IMAGE_DOS_SIGNATURE
+        && pDosHeader->e_lfanew > 0 && (size_t)pDosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS) <= rawsize)
+    {
+        *pmemsize = winpe_memload(rawpe, rawsize, NULL, 0, FALSE);
+        if(!*pmemsize) buf = NULL;
+        else if(mempe) buf = bufsize >= *pmemsize ? mempe : NULL;
+        else if(allocator) buf = allocator->alloc(allocator->arg, NULL, *pmemsize, PAGE_READWRITE);
+        else buf = malloc(*pmemsize);
+        if(buf && !winpe_memload(rawpe, rawsize, buf, *pmemsize, same_align))
+        {
+            if(!mempe && allocator) allocator->free(allocator->arg, buf, *pmemsize);
+            else if(!mempe) free(buf);
+            buf = NULL;
+        }
+    }
+    winpe_unmapfile(&filemap);
+    return buf;
+}
+ 
+void* STDCALL winpe_overlayload_file(const char *path, size_t *poverlaysize)
+{
+    if(!poverlaysize) return NULL;
+    return winpe_overlayload_fileex(path, NULL, poverlaysize, NULL);
+}
+
+void* STDCALL winpe_overlayload_fileex(const char *path, void *overlay, size_t *poverlaysize, 
+    PWINPE_ALLOCATOR allocator)
+{
+    WINPE_OVERLAYVIEW view;
+    if(!poverlaysize || !winpe_overlayopen_file(path, &view)) return NULL;
+
+    void *buf = NULL;
+    size_t bufsize = overlay ? *poverlaysize : 0;
+    *poverlaysize = view.size <= (size_t)-1 ? (size_t)view.size : 0;
+    if(*poverlaysize>0)
+    {
+        if(overlay) buf = bufsize >= *poverlaysize ? overlay : NULL;
+        else if(allocator) buf = allocator->alloc(allocator->arg, NULL, *poverlaysize, PAGE_READWRITE);
+        else buf = malloc(*poverlaysize);
+        if(buf && winpe_overlayread(&view, buf, *poverlaysize, 0) != *poverlaysize)
+        {
+            if(!overlay && allocator) allocator->free(allocator->arg, buf, *poverlaysize);
+            else if(!overlay) free(buf);
+            buf = NULL;
+        }
+    }
+    winpe_overlayclose(&view);
+    return buf;
+}
+
+#ifdef _WIN32
+void* STDCALL winpe_memLoadLibrary(void *mempe)
+{
+    PFN_LoadLibraryA pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    PFN_GetProcAddress pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    return winpe_memLoadLibraryEx(mempe, 0, 
+                WINPE_LDFLAG_MEMFIND | WINPE_LDFLAG_MEMALLOC 
+                | WINPE_LDFLAG_EXPHINT | WINPE_LDFLAG_FWDCACHE, 
+                pfnLoadLibraryA, pfnGetProcAddress);
+}
+
+void* STDCALL winpe_memLoadLibraryEx(void *mempe, size_t imagebase, DWORD flag,
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+{
+    // bind windows api
+    char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l' , '\0'};
+    char name_VirtualQuery[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'Q', 'u', 'e', 'r', 'y', '\0'};
+    char name_VirtualAlloc[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', '\0'};
+    char name_VirtualProtect[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'P', 'r', 'o', 't', 'e', 'c', 't', '\0'};
+    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
+    PFN_VirtualQuery pfnVirtualQuery = (PFN_VirtualQuery)pfnGetProcAddress(hmod_kernel32, name_VirtualQuery);
+    PFN_VirtualAlloc pfnVirtualAlloc = (PFN_VirtualAlloc)pfnGetProcAddress(hmod_kernel32, name_VirtualAlloc);
+    PFN_VirtualProtect pfnVirtualProtect =(PFN_VirtualProtect)pfnGetProcAddress(hmod_kernel32, name_VirtualProtect);
+#ifdef _DEBUG
+    assert(pfnVirtualQuery!=0 && pfnVirtualAlloc!=0 && pfnVirtualProtect!=0);
+#endif
+
+    // find proper imagebase
+    size_t imagesize = winpe_imagesizeval(mempe, 0);
+    if(flag & WINPE_LDFLAG_MEMFIND)
+    {
+        imagebase = winpe_imagebaseval(mempe, 0);
+        imagebase = (size_t)winpe_findspace(imagebase, imagesize, 0x10000, pfnVirtualQuery);
+    }
+    if(flag & WINPE_LDFLAG_MEMALLOC) // find proper memory to reloc
+    {
+
+        imagebase = (size_t)pfnVirtualAlloc((void*)imagebase, imagesize, 
+                            MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+        if(!imagebase) // try alloc in arbitary place
+        {
+            imagebase = (size_t)pfnVirtualAlloc(NULL, imagesize, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+            if(!imagebase) return NULL;
+        }
+        else
+        {
+            imagebase = (size_t)pfnVirtualAlloc((void*)imagebase, imagesize, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
+            if(!imagebase) return NULL;            
+        }
+    }
+
+    // copy to imagebase
+    if(!imagebase) 
+    {
+        imagebase = (size_t)mempe;
+    }
+    else
+    {
+        DWORD oldprotect;
+        pfnVirtualProtect((void*)imagebase, imagesize, PAGE_EXECUTE_READWRITE, &oldprotect);
+        inl_memcpy((void*)imagebase, mempe, imagesize);
+        pfnVirtualProtect((void*)imagebase, imagesize, oldprotect, &oldprotect);
+    }
+
+    // initial memory module
+    if(winpe_memreloc((void*)imagebase, imagebase) == (size_t)-1) return NULL;
+    inl_memset(WINPE_MEMRECORD_OF(imagebase), 0, sizeof(WINPE_MEMRECORD));
+    DWORD bindflag = 0;
+    if(flag & WINPE_LDFLAG_EXPHINT) bindflag |= WINPE_BINDFLAG_EXPHINT;
+    if(flag & WINPE_LDFLAG_FWDCACHE) bindflag |= WINPE_BINDFLAG_FWDCACHE;
+    if(flag & WINPE_LDFLAG_LAZY) bindflag |= WINPE_BINDFLAG_LAZY;
+    if(!winpe_membindiatex((void*)imagebase, pfnLoadLibraryA, pfnGetProcAddress, bindflag)) return NULL;
+    winpe_membindtls(mempe, DLL_PROCESS_ATTACH);
+    PFN_DllMain pfnDllMain = (PFN_DllMain)(imagebase + winpe_oepval((void*)imagebase, 0));
+    pfnDllMain((HINSTANCE)imagebase, DLL_PROCESS_ATTACH, NULL);
+    return (void*)imagebase;
+}
+
+void* STDCALL winpe_memLoadLibraryAllocator(void *mempe, DWORD flag, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, 
+    PWINPE_ALLOCATOR allocator)
+{
+    if(!pfnLoadLibraryA) pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    if(!pfnGetProcAddress) pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    size_t imagesize = winpe_imagesizeval(mempe, 0);
+    void *prefer = (void*)winpe_imagebaseval(mempe, 0);
+    void *imagebase = allocator->alloc(allocator->arg, prefer, imagesize, PAGE_EXECUTE_READWRITE);
+    if(!imagebase) imagebase = allocator->alloc(allocator->arg, NULL, imagesize, PAGE_EXECUTE_READWRITE);
+    if(!imagebase) return NULL;
+    if(allocator->protect)
+    {
+        DWORD oldprotect;
+        allocator->protect(allocator->arg, imagebase, imagesize, PAGE_EXECUTE_READWRITE, &oldprotect);
+    }
+
+    flag &= ~(WINPE_LDFLAG_MEMALLOC | WINPE_LDFLAG_MEMFIND);
+    void *hmod = winpe_memLoadLibraryEx(mempe, (size_t)imagebase, flag, 
+        pfnLoadLibraryA, pfnGetProcAddress);
+    if(!hmod) allocator->free(allocator->arg, imagebase, imagesize);
+    return hmod;
+}
+
+HANDLE STDCALL winpe_memsection_create(void *mempe, size_t imagebase)
+{
+    size_t imagesize = winpe_imagesizeval(mempe, 0);
+    if(!imagebase) imagebase = winpe_imagebaseval(mempe, 0);
+    HANDLE hsection = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, 
+        PAGE_EXECUTE_READWRITE | SEC_COMMIT, (DWORD)((uint64_t)imagesize >> 32), (DWORD)imagesize, NULL);
+    if(!hsection) return NULL;
+    void *view = MapViewOfFile(hsection, FILE_MAP_WRITE, 0, 0, imagesize);
+    if(!view)
+    {
+        CloseHandle(hsection);
+        return NULL;
+    }
+
+    // relocate once in section, so instances at imagebase have no private reloc pages
+    inl_memcpy(view, mempe, imagesize);
+    if(winpe_memreloc(view, imagebase) == (size_t)-1)
+    {
+        UnmapViewOfFile(view);
+        CloseHandle(hsection);
+        return NULL;
+    }
+    inl_memset(WINPE_MEMRECORD_OF(view), 0, sizeof(WINPE_MEMRECORD));
+    UnmapViewOfFile(view);
+    return hsection;
+}
+
+void* STDCALL winpe_memLoadLibrarySection(HANDLE hsection, DWORD flag, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+{
+    if(!pfnLoadLibraryA) pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    if(!pfnGetProcAddress) pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    
+    // the prefered base is in the relocated headers
+    void *header = MapViewOfFile(hsection, FILE_MAP_READ, 0, 0, 0x1000);
+    if(!header) return NULL;
+    size_t imagebase = winpe_imagebaseval(header, 0);
+    UnmapViewOfFile(header);
+
+    void *hmod = MapViewOfFileEx(hsection, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0, (void*)imagebase);
+    if(!hmod) 
+    {
+        hmod = MapViewOfFileEx(hsection, FILE_MAP_COPY | FILE_MAP_EXECUTE, 0, 0, 0, NULL);
+        if(!hmod) return NULL;
+        if(winpe_memreloc(hmod, (size_t)hmod) == (size_t)-1) goto winpe_memLoadLibrarySection_fail;
+    }
+
+    inl_memset(WINPE_MEMRECORD_OF(hmod), 0, sizeof(WINPE_MEMRECORD));
+    WINPE_MEMRECORD_OF(hmod)->flag = WINPE_MEMFLAG_SECTION;
+    DWORD bindflag = 0;
+    if(flag & WINPE_LDFLAG_EXPHINT) bindflag |= WINPE_BINDFLAG_EXPHINT;
+    if(flag & WINPE_LDFLAG_FWDCACHE) bindflag |= WINPE_BINDFLAG_FWDCACHE;
+    if(flag & WINPE_LDFLAG_LAZY) bindflag |= WINPE_BINDFLAG_LAZY;
+    if(!winpe_membindiatex(hmod, pfnLoadLibraryA, pfnGetProcAddress, bindflag)) 
+    {
+        goto winpe_memLoadLibrarySection_fail;
+    }
+    winpe_membindtls(hmod, DLL_PROCESS_ATTACH);
+    PFN_DllMain pfnDllMain = (PFN_DllMain)((uint8_t*)hmod + winpe_oepval(hmod, 0));
+    pfnDllMain((HINSTANCE)hmod, DLL_PROCESS_ATTACH, NULL);
+    return hmod;
+
+winpe_memLoadLibrarySection_fail:
+    UnmapViewOfFile(hmod);
+    return NULL;
+}
+
+void* STDCALL winpe_memLoadLibraryRtm(const void *rtm, size_t rtmsize, DWORD flag, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+{
+    if(!pfnLoadLibraryA) pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    if(!pfnGetProcAddress) pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l' , '\0'};
+    char name_VirtualAlloc[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', '\0'};
+    char name_VirtualFree[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', '\0'};
+    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
+    PFN_VirtualAlloc pfnVirtualAlloc = (PFN_VirtualAlloc)pfnGetProcAddress(hmod_kernel32, name_VirtualAlloc);
+    PFN_VirtualFree pfnVirtualFree = (PFN_VirtualFree)pfnGetProcAddress(hmod_kernel32, name_VirtualFree);
+    PWINPE_RTMHDR hdr = (PWINPE_RTMHDR)rtm;
+    size_t imagesize = winpe_rtmcheck(rtm, rtmsize);
+    if(!imagesize || !pfnVirtualAlloc || !pfnVirtualFree) return NULL;
+
+    // one bulk copy, at prefered imagebase first
+    uint8_t *imagebase = (uint8_t*)pfnVirtualAlloc((void*)(size_t)hdr->imagebase, imagesize, 
+        MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    if(!imagebase) imagebase = (uint8_t*)pfnVirtualAlloc(NULL, imagesize, 
+        MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+    if(!imagebase) return NULL;
+    inl_memcpy(imagebase, (uint8_t*)rtm + hdr->imageoffset, imagesize);
+
+    // rebase by the reloc bitmap
+    size_t delta = (size_t)imagebase - (size_t)hdr->imagebase;
+    if(delta)
+    {
+        const uint8_t *pagemap = (const uint8_t*)rtm + hdr->pagemapoffset;
+        const uint8_t *relocmap = (const uint8_t*)rtm + hdr->relocmapoffset;
+        for(DWORD i=0; i < hdr->pagemapsize * 8; i++)
+        {
+            if(!(pagemap[i/8] & (1 << (i%8)))) continue;
+            uint8_t *page = imagebase + (size_t)i * WINPE_RTM_PAGESIZE;
+            for(DWORD j=0; j < WINPE_RTM_PAGESIZE / 8; j++)
+            {
+                uint8_t bits = relocmap[j];
+                for(DWORD k=0; bits; k++, bits >>= 1)
+                {
+                    if(!(bits & 1)) continue;
+                    size_t *addr = (size_t*)(page + j*8 + k);
+                    *addr += delta;
+                }
+            }
+            relocmap += WINPE_RTM_PAGESIZE / 8;
+        }
+        const DWORD *reloc32 = (const DWORD*)((uint8_t*)rtm + hdr->impoffset 
+            + (size_t)hdr->impnum * sizeof(WINPE_RTMIMP));
+        for(DWORD i=0; i < hdr->reloc32num; i++)
+        {
+            *(uint32_t*)(imagebase + reloc32[i]) += (uint32_t)delta;
+        }
+    }
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)imagebase;
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)(imagebase + pDosHeader->e_lfanew);
+    pNtHeader->OptionalHeader.ImageBase = (size_t)imagebase;
+    inl_memset(WINPE_MEMRECORD_OF(imagebase), 0, sizeof(WINPE_MEMRECORD));
+
+    // bind iat by the flat list, load each dll once
+    DWORD bindflag = 0;
+    if(flag & WINPE_LDFLAG_EXPHINT) bindflag |= WINPE_BINDFLAG_EXPHINT;
+    if(flag & WINPE_LDFLAG_FWDCACHE) bindflag |= WINPE_BINDFLAG_FWDCACHE;
+    PWINPE_RTMIMP imps = (PWINPE_RTMIMP)((uint8_t*)rtm + hdr->impoffset);
+    DWORD lastdll = 0;
+    size_t dllbase = 0;
+    for(DWORD i=0; i < hdr->impnum; i++)
+    {
+        if(imps[i].dllnamerva != lastdll)
+        {
+            lastdll = imps[i].dllnamerva;
+            dllbase = (size_t)pfnLoadLibraryA((LPCSTR)(imagebase + lastdll));
+            if(!dllbase) // the same as winpe_membindiatex, not run the module with unbound iat
+            {
+                pfnVirtualFree(imagebase, 0, MEM_RELEASE);
+                return NULL;
+            }
+        }
+        PIMAGE_IMPORT_BY_NAME pImpByName = NULL;
+        LPCSTR funcname = NULL;
+        if(imps[i].namerva & WINPE_RTM_ORDINALFLAG) funcname = (LPCSTR)(size_t)(imps[i].namerva & 0xffff);
+        else
+        {
+            pImpByName = (PIMAGE_IMPORT_BY_NAME)(imagebase + imps[i].namerva);
+            funcname = pImpByName->Name;
+        }
+        size_t funcva = winpe_memfindimp(dllbase, funcname, pImpByName, 
+            pfnLoadLibraryA, pfnGetProcAddress, bindflag);
+        if(funcva) *(size_t*)(imagebase + imps[i].iatrva) = funcva;
+    }
+
+    winpe_membindtls(imagebase, DLL_PROCESS_ATTACH);
+    PFN_DllMain pfnDllMain = (PFN_DllMain)(imagebase + winpe_oepval(imagebase, 0));
+    pfnDllMain((HINSTANCE)imagebase, DLL_PROCESS_ATTACH, NULL);
+    return imagebase;
+}
+
+static int winpe_memsetfind(LPCSTR *names, size_t n, const char *dllname, size_t namelen)
+{
+    // match "b.dll" with "b.dll" or "b" (in forward name)
+    for(size_t i=0; i < n; i++)
+    {
+        size_t k = 0;
+        for(; k < namelen && names[i][k]; k++)
+        {
+            char c1 = dllname[k], c2 = names[i][k];
+            if(c1 >= 'A' && c1 <= 'Z') c1 += 0x20;
+            if(c2 >= 'A' && c2 <= 'Z') c2 += 0x20;
+            if(c1 != c2) break;
+        }
+        if(k < namelen) continue;
+        if(!names[i][k] || inl_stricmp(names[i] + k, ".dll")==0) return (int)i;
+    }
+    return -1;
+}
+
+static void winpe_memsetvisit(size_t i, void **hmods, LPCSTR *names, size_t n, 
+    DWORD *state, PWINPE_MODSET modset)
+{
+    // dfs post order, state 0 not visit, 1 visiting, 2 visited 
+    state[i] = 1;
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hmods[i];
+    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)hmods[i] + pDosHeader->e_lfanew);
+    PIMAGE_DATA_DIRECTORY pImpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)((uint8_t*)hmods[i] + pImpEntry->VirtualAddress);
+    for (; pImpEntry->VirtualAddress && pImpDescriptor->Name; pImpDescriptor++) 
+    {
+        LPCSTR pDllName = (LPCSTR)((uint8_t*)hmods[i] + pImpDescriptor->Name);
+        int j = winpe_memsetfind(names, n, pDllName, inl_strlen(pDllName));
+        if(j >= 0 && !state[j]) winpe_memsetvisit(j, hmods, names, n, state, modset); // cycle is ignored
+    }
+    state[i] = 2;
+    modset->hmods[modset->count++] = hmods[i];
+}
+
+static DWORD WINAPI winpe_memsetreloctask(LPVOID hmod)
+{
+    return winpe_memreloc(hmod, (size_t)hmod) == (size_t)-1 ? 1 : 0;
+}
+
+size_t STDCALL winpe_memLoadLibrarySet(void **mempes, LPCSTR *names, size_t n, 
+    void **hmods, DWORD flag, PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+{
+    if(!pfnLoadLibraryA) pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    if(!pfnGetProcAddress) pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    char name_kernel32[] = { 'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l' , '\0'};
+    char name_VirtualQuery[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'Q', 'u', 'e', 'r', 'y', '\0'};
+    char name_VirtualAlloc[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', '\0'};
+    char name_VirtualFree[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', '\0'};
+    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
+    PFN_VirtualQuery pfnVirtualQuery = (PFN_VirtualQuery)pfnGetProcAddress(hmod_kernel32, name_VirtualQuery);
+    PFN_VirtualAlloc pfnVirtualAlloc = (PFN_VirtualAlloc)pfnGetProcAddress(hmod_kernel32, name_VirtualAlloc);
+    PFN_VirtualFree pfnVirtualFree = (PFN_VirtualFree)pfnGetProcAddress(hmod_kernel32, name_VirtualFree);
+    if(!n || !pfnVirtualQuery || !pfnVirtualAlloc || !pfnVirtualFree) return 0;
+
+    // modset record | names | indexes | state
+    size_t modsetsize = sizeof(WINPE_MODSET) + (n - 1) * sizeof(void*);
+    size_t tmpsize = n * (sizeof(LPCSTR) + sizeof(void*) + sizeof(DWORD));
+    PWINPE_MODSET modset = (PWINPE_MODSET)pfnVirtualAlloc(NULL, modsetsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    uint8_t *tmpbuf = (uint8_t*)pfnVirtualAlloc(NULL, tmpsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    LPCSTR *setnames = (LPCSTR*)tmpbuf;
+    void **indexes = (void**)(tmpbuf + n * sizeof(LPCSTR));
+    DWORD *state = (DWORD*)(tmpbuf + n * (sizeof(LPCSTR) + sizeof(void*)));
+    size_t result = 0;
+    WINPE_VMMAP vmmap; // snapshot once for all modules
+    inl_memset(&vmmap, 0, sizeof(vmmap));
+    if(flag & WINPE_LDFLAG_MEMFIND) winpe_vmmap_snapshot(&vmmap, NULL);
+    for(size_t i=0; i < n; i++) hmods[i] = NULL;
+    if(!modset || !tmpbuf) goto winpe_memLoadLibrarySet_end;
+
+    // map all modules
+    for(size_t i=0; i < n; i++)
+    {
+        size_t imagesize = winpe_imagesizeval(mempes[i], 0);
+        size_t imagebase = 0;
+        if(flag & WINPE_LDFLAG_MEMFIND)
+        {
+            imagebase = winpe_imagebaseval(mempes[i], 0);
+            if(vmmap.count) imagebase = (size_t)winpe_vmmap_findspace(&vmmap, imagebase, imagesize, 0x10000);
+            else imagebase = (size_t)winpe_findspace(imagebase, imagesize, 0x10000, pfnVirtualQuery);
+        }
+        hmods[i] = pfnVirtualAlloc((void*)imagebase, imagesize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+        if(!hmods[i]) hmods[i] = pfnVirtualAlloc(NULL, imagesize, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+        if(!hmods[i]) goto winpe_memLoadLibrarySet_end;
+        if(vmmap.count) winpe_vmmap_update(&vmmap, (size_t)hmods[i], (imagesize + 0xffff) & ~(size_t)0xffff, MEM_COMMIT);
+        inl_memcpy(hmods[i], mempes[i], imagesize);
+        inl_memset(WINPE_MEMRECORD_OF(hmods[i]), 0, sizeof(WINPE_MEMRECORD));
+        
+        setnames[i] = names ? names[i] : NULL;
+        if(!setnames[i])
+        {
+            PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hmods[i];
+            PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)hmods[i] + pDosHeader->e_lfanew);
+            PIMAGE_DATA_DIRECTORY pExpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+            PIMAGE_EXPORT_DIRECTORY pExpDescriptor = (PIMAGE_EXPORT_DIRECTORY)((uint8_t*)hmods[i] + pExpEntry->VirtualAddress);
+            setnames[i] = pExpEntry->VirtualAddress ? (LPCSTR)((uint8_t*)hmods[i] + pExpDescriptor->Name) : "";
+        }
+    }
+
+    // reloc modules in parallel
+    for(size_t i=0; i < n; i += MAXIMUM_WAIT_OBJECTS)
+    {
+        HANDLE hthreads[MAXIMUM_WAIT_OBJECTS];
+        size_t nthread = n - i < MAXIMUM_WAIT_OBJECTS ? n - i : MAXIMUM_WAIT_OBJECTS;
+        DWORD failed = 0;
+        for(size_t k=0; k < nthread; k++)
+        {
+            hthreads[k] = CreateThread(NULL, 0, winpe_memsetreloctask, hmods[i+k], 0, NULL);
+            if(!hthreads[k]) failed |= winpe_memsetreloctask(hmods[i+k]);
+        }
+        for(size_t k=0; k < nthread; k++)
+        {
+            DWORD code = 1;
+            if(!hthreads[k]) continue;
+            WaitForSingleObject(hthreads[k], INFINITE);
+            GetExitCodeThread(hthreads[k], &code);
+            CloseHandle(hthreads[k]);
+            failed |= code;
+        }
+        if(failed) goto winpe_memLoadLibrarySet_end;
+    }
+
+    // build exp index for binding in set
+    for(size_t i=0; i < n; i++)
+    {
+        size_t indexsize = winpe_memexpindex(hmods[i], NULL, 0);
+        indexes[i] = pfnVirtualAlloc(NULL, indexsize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if(!indexes[i]) goto winpe_memLoadLibrarySet_end;
+        winpe_memexpindex(hmods[i], indexes[i], indexsize);
+    }
+
+    // bind iat, in set by index, others by pfnLoadLibraryA
+    DWORD bindflag = 0;
+    if(flag & WINPE_LDFLAG_EXPHINT) bindflag |= WINPE_BINDFLAG_EXPHINT;
+    if(flag & WINPE_LDFLAG_FWDCACHE) bindflag |= WINPE_BINDFLAG_FWDCACHE;
+    for(size_t i=0; i < n; i++)
+    {
+        PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)hmods[i];
+        PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)hmods[i] + pDosHeader->e_lfanew);
+        PIMAGE_DATA_DIRECTORY pImpEntry = &pNtHeader->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
+        PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)((uint8_t*)hmods[i] + pImpEntry->VirtualAddress);
+        for (; pImpEntry->VirtualAddress && pImpDescriptor->Name; pImpDescriptor++) 
+        {
+            LPCSTR pDllName = (LPCSTR)((uint8_t*)hmods[i] + pImpDescriptor->Name);
+            PIMAGE_THUNK_DATA pFtThunk = (PIMAGE_THUNK_DATA)((uint8_t*)hmods[i] + pImpDescriptor->FirstThunk);
+            PIMAGE_THUNK_DATA pOftThunk = (PIMAGE_THUNK_DATA)((uint8_t*)hmods[i] + pImpDescriptor->OriginalFirstThunk);
+            int j = winpe_memsetfind(setnames, n, pDllName, inl_strlen(pDllName));
+            size_t dllbase = 0;
+            if(j < 0)
+            {
+                dllbase = (size_t)pfnLoadLibraryA(pDllName);
+                if(!dllbase) goto winpe_memLoadLibrarySet_end;
+            }
+
+            for (int t=0; pFtThunk[t].u1.Function &&  pOftThunk[t].u1.Function; t++) 
+            {
+                size_t thunk = (size_t)pOftThunk[t].u1.AddressOfData;
+                PIMAGE_IMPORT_BY_NAME pImpByName = NULL;
+                LPCSTR funcname = NULL;
+                size_t funcva = 0;
+                if(thunk >> (sizeof(size_t)*8 - 1)) funcname = (LPCSTR)(thunk & 0xffff);
+                else
+                {
+                    pImpByName = (PIMAGE_IMPORT_BY_NAME)((uint8_t*)hmods[i] + thunk);
+                    funcname = pImpByName->Name;
+                }
+                if(j < 0)
+                {
+                    funcva = winpe_memfindimp(dllbase, funcname, pImpByName, 
+                        pfnLoadLibraryA, pfnGetProcAddress, bindflag);
+                }
+                else for(int hop=0, k=j; hop < WINPE_FWDMAXHOP; hop++) // forward in set
+                {
+                    void *expva = (size_t)funcname <= MAXWORD ? 
+                        winpe_memfindexp(hmods[k], funcname) : winpe_memfindexpindex(indexes[k], funcname);
+                    if(!expva) break;
+                    size_t exprva = (size_t)expva - (size_t)hmods[k];
+                    PIMAGE_NT_HEADERS pNtHeader2 = (PIMAGE_NT_HEADERS)((uint8_t*)hmods[k] 
+                        + ((PIMAGE_DOS_HEADER)hmods[k])->e_lfanew);
+                    PIMAGE_DATA_DIRECTORY pExpEntry = &pNtHeader2->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
+                    if(exprva < pExpEntry->VirtualAddress || exprva >= pExpEntry->VirtualAddress + pExpEntry->Size)
+                    {
+                        funcva = (size_t)expva;
+                        break;
+                    }
+                    LPCSTR fwdname = (LPCSTR)expva;
+                    size_t dotpos = 0;
+                    while(fwdname[dotpos] && fwdname[dotpos]!='.') dotpos++;
+                    int m = fwdname[dotpos] ? winpe_memsetfind(setnames, n, fwdname, dotpos) : -1;
+                    if(m < 0 || fwdname[dotpos+1]=='#')
+                    {
+                        PWINPE_FWDCACHE cache = (bindflag & WINPE_BINDFLAG_FWDCACHE) ? &s_winpe_fwdcache : NULL;
+                        funcva = (size_t)winpe_memforwardexpex(hmods[k], exprva, 
+                            pfnLoadLibraryA, pfnGetProcAddress, cache);
+                        break;
+                    }
+                    k = m;
+                    funcname = fwdname + dotpos + 1;
+                }
+                if(!funcva) continue;
+                pFtThunk[t].u1.Function = funcva;
+            }
+        }
+    }
+
+    // call tls and dll entry, dependency first
+    modset->refcount = (LONG)n;
+    modset->count = 0;
+    for(size_t i=0; i < n; i++) state[i] = 0;
+    for(size_t i=0; i < n; i++)
+    {
+        if(!state[i]) winpe_memsetvisit(i, hmods, setnames, n, state, modset);
+    }
+    for(size_t i=0; i < n; i++) WINPE_MEMRECORD_OF(hmods[i])->modset = modset;
+    for(DWORD i=0; i < modset->count; i++)
+    {
+        void *hmod = modset->hmods[i];
+        DWORD oeprva = winpe_oepval(hmod, 0);
+        winpe_membindtls(hmod, DLL_PROCESS_ATTACH);
+        if(oeprva) ((PFN_DllMain)((uint8_t*)hmod + oeprva))((HINSTANCE)hmod, DLL_PROCESS_ATTACH, NULL);
+    }
+    result = n;
+
+winpe_memLoadLibrarySet_end:
+    if(vmmap.count) winpe_vmmap_free(&vmmap);
+    if(tmpbuf)
+    {
+        for(size_t i=0; i < n; i++) 
+        {
+            if(indexes[i]) pfnVirtualFree(indexes[i], 0, MEM_RELEASE);
+        }
+        pfnVirtualFree(tmpbuf, 0, MEM_RELEASE);
+    }
+    if(!result)
+    {
+        for(size_t i=0; i < n; i++) 
+        {
+            if(hmods[i]) pfnVirtualFree(hmods[i], 0, MEM_RELEASE);
+            hmods[i] = NULL;
+        }
+        if(modset) pfnVirtualFree(modset, 0, MEM_RELEASE);
+    }
+    return result;
+}
+
+BOOL STDCALL winpe_memFreeLibrary(void *mempe)
+{
+    PFN_LoadLibraryA pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    PFN_GetProcAddress pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    return winpe_memFreeLibraryEx(mempe, pfnLoadLibraryA, pfnGetProcAddress);
+}
+
+BOOL STDCALL winpe_memFreeLibraryEx(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
+{
+    char name_kernel32[] = {'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '\0'};
+    char name_VirtualFree[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', '\0'};
+    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
+    PFN_VirtualFree pfnVirtualFree = (PFN_VirtualFree)pfnGetProcAddress(hmod_kernel32, name_VirtualFree);
+    PWINPE_MODSET modset = WINPE_MEMRECORD_OF(mempe)->modset;
+    if(modset) // unload all in reverse topological order
+    {
+        if(InterlockedDecrement(&modset->refcount) > 0) return TRUE;
+        for(DWORD i=modset->count; i > 0; i--)
+        {
+            void *hmod = modset->hmods[i-1];
+            DWORD oeprva = winpe_oepval(hmod, 0);
+            winpe_membindtls(hmod, DLL_PROCESS_DETACH);
+            if(oeprva) ((PFN_DllMain)((uint8_t*)hmod + oeprva))((HINSTANCE)hmod, DLL_PROCESS_DETACH, NULL);
+            if(WINPE_MEMRECORD_OF(hmod)->lazyctx) pfnVirtualFree(WINPE_MEMRECORD_OF(hmod)->lazyctx, 0, MEM_RELEASE);
+            winpe_memforwardexpflush(NULL, hmod);
+            pfnVirtualFree(hmod, 0, MEM_RELEASE);
+        }
+        return pfnVirtualFree(modset, 0, MEM_RELEASE);
+    }
+    
+    PFN_DllMain pfnDllMain = (PFN_DllMain)((uint8_t*)mempe + winpe_oepval(mempe, 0));
+    winpe_membindtls(mempe, DLL_PROCESS_DETACH);
+    pfnDllMain((HINSTANCE)mempe, DLL_PROCESS_DETACH, NULL);
+    PWINPE_LAZYCTX lazyctx = WINPE_MEMRECORD_OF(mempe)->lazyctx;
+    if(lazyctx) pfnVirtualFree(lazyctx, 0, MEM_RELEASE);
+    winpe_memforwardexpflush(NULL, mempe);
+    if(WINPE_MEMRECORD_OF(mempe)->flag & WINPE_MEMFLAG_SECTION)
+    {
+        char name_UnmapViewOfFile[] = {'U', 'n', 'm', 'a', 'p', 'V', 'i', 'e', 'w', 
+            'O', 'f', 'F', 'i', 'l', 'e', '\0'};
+        PFN_UnmapViewOfFile pfnUnmapViewOfFile = (PFN_UnmapViewOfFile)
+            pfnGetProcAddress(hmod_kernel32, name_UnmapViewOfFile);
+        return pfnUnmapViewOfFile(mempe);
+    }
+    return pfnVirtualFree(mempe, 0, MEM_FREE);
+}
+
+BOOL STDCALL winpe_memFreeLibraryAllocator(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, 
+    PWINPE_ALLOCATOR allocator)
+{
+    if(!pfnLoadLibraryA) pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    if(!pfnGetProcAddress) pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    char name_kernel32[] = {'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '\0'};
+    char name_VirtualFree[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'F', 'r', 'e', 'e', '\0'};
+    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
+    PFN_VirtualFree pfnVirtualFree = (PFN_VirtualFree)pfnGetProcAddress(hmod_kernel32, name_VirtualFree);
+    
+    PFN_DllMain pfnDllMain = (PFN_DllMain)((uint8_t*)mempe + winpe_oepval(mempe, 0));
+    winpe_membindtls(mempe, DLL_PROCESS_DETACH);
+    pfnDllMain((HINSTANCE)mempe, DLL_PROCESS_DETACH, NULL);
+    PWINPE_LAZYCTX lazyctx = WINPE_MEMRECORD_OF(mempe)->lazyctx;
+    if(lazyctx) pfnVirtualFree(lazyctx, 0, MEM_RELEASE);
+    winpe_memforwardexpflush(NULL, mempe);
+    return allocator->free(allocator->arg, mempe, winpe_imagesizeval(mempe, 0));
+}
+
+PROC STDCALL winpe_memGetProcAddress(void *mempe, const char *funcname)
+{
+    // this function might failed if inline and -Os, -O3, if in dll function, use printf might help
+    void* expva = winpe_memfindexp(mempe, funcname);
+    size_t exprva = (size_t)expva - (size_t)mempe;
+    // printf("[winpe_memGetProcAddress] expva=%p\n", expva);
+    
     // use pfnLoadLibraryA, pfnGetProcAddress to avoid infinity loop
     void *hmod_kernel32 = winpe_findkernel32();
     char name_GetProcAddress[] = {'G', 'e', 't', 'P', 'r', 'o', 'c', 'A', 'd', 'd', 'r', 'e', 's', 's', '\0'};
@@ -473,7 +2749,8 @@ PROC STDCALL winpe_memGetProcAddress(void *mempe, const char *funcname)
     }
     PFN_LoadLibraryA pfnLoadLibraryA =  (PFN_LoadLibraryA)func[0];
     PFN_GetProcAddress pfnGetProcAddress = (PFN_GetProcAddress)func[1];
-    return (PROC)winpe_memforwardexp(mempe, exprva, pfnLoadLibraryA, pfnGetProcAddress); 
+    return (PROC)winpe_memforwardexpex(mempe, exprva, 
+        pfnLoadLibraryA, pfnGetProcAddress, &s_winpe_fwdcache); 
 }
 
 // PE query functions
@@ -535,37 +2812,11 @@ void* winpe_findkernel32()
 
 void* STDCALL winpe_findmoduleaex(PPEB peb, const char *modulename)
 {
-    typedef struct _LDR_ENTRY  // has 3 kinds of pointer link list
-    {
-        LIST_ENTRY InLoadOrderLinks; // this has link pointer
-        LIST_ENTRY InMemoryOrderLinks; // order is program, ntdll, kernel32.dll
-        LIST_ENTRY InInitializationOrderLinks;//to next entry in same place
-        PVOID DllBase; // 0x18, 0x30
-        PVOID EntryPoint;
-        ULONG SizeOfImage;
-        UNICODE_STRING FullDllName;
-        UNICODE_STRING BaseDllName;
-        ULONG Flags;
-        USHORT LoadCount;
-        USHORT TlsIndex;
-        union
-        {
-            LIST_ENTRY HashLinks;
-            struct
-            {
-                PVOID SectionPointer;
-                ULONG CheckSum;
-            };
-        };
-        ULONG TimeDateStamp;
-    } LDR_ENTRY, *PLDR_ENTRY; // use this because of mingw bug
-    
-    PLDR_ENTRY ldrentry = NULL;
     PPEB_LDR_DATA ldr = NULL;
-
-
+    PINL_MODCACHE cache = NULL;
     if(!peb)
     {
+            cache = &s_winpe_modcache;
             PTEB teb = NtCurrentTeb(); 
 #ifdef _WIN64
             peb = *(PPEB*)((uint8_t*)teb + 0x60);
@@ -580,25 +2831,8 @@ void* STDCALL winpe_findmoduleaex(PPEB peb, const char *modulename)
     ldr = *(PPEB_LDR_DATA*)((uint8_t*)peb + 0xC);
 #endif 
 
-    // InMemoryOrderModuleList is the second entry
-    ldrentry = (PLDR_ENTRY)((size_t)ldr->InMemoryOrderModuleList.Flink - 2*sizeof(size_t));
-    if(!modulename)
-    {
-        return ldrentry->DllBase;
-    }
-    while(ldrentry->InMemoryOrderLinks.Flink != ldr->InMemoryOrderModuleList.Flink)
-    {
-        PUNICODE_STRING ustr = &ldrentry->FullDllName;
-        int i;
-        for(i=ustr->Length/2-1; i>0 && ustr->Buffer[i]!='\\';i--);
-        if(ustr->Buffer[i]=='\\') i++;
-        if(inl_stricmp2(modulename,  ustr->Buffer + i)==0)
-        {
-            return ldrentry->DllBase;
-        }
-        ldrentry = (PLDR_ENTRY)((size_t)ldrentry->InMemoryOrderLinks.Flink - 2*sizeof(size_t));
-    }
-    return NULL;
+    // InMemoryOrderModuleList order is program, ntdll, kernel32.dll
+    return inl_findmodule(&ldr->InMemoryOrderModuleList, modulename, cache);
 }
 
 PROC winpe_findloadlibrarya()
@@ -633,94 +2867,510 @@ void* STDCALL winpe_findspace(size_t imagebase,
     return NULL;
 }
 
+static bool_t winpe_vmmap_reserve(PWINPE_VMMAP vmmap, size_t count)
+{
+    if(count <= vmmap->capacity) return TRUE;
+    size_t capacity = vmmap->capacity ? vmmap->capacity : 0x100;
+    while(capacity < count) capacity <<= 1;
+    PWINPE_VMREGION regions = (PWINPE_VMREGION)realloc(vmmap->regions, capacity * sizeof(WINPE_VMREGION));
+    if(!regions) return FALSE;
+    vmmap->regions = regions;
+    vmmap->capacity = capacity;
+    return TRUE;
+}
+
+static bool_t winpe_vmmap_build(PWINPE_VMMAP vmmap)
+{
+    // merge the neighbor regions in the same state
+    size_t n = 0;
+    for(size_t i=0; i < vmmap->count; i++)
+    {
+        PWINPE_VMREGION region = &vmmap->regions[i];
+        if(!region->size) continue;
+        if(n && vmmap->regions[n-1].state == region->state
+            && vmmap->regions[n-1].base + vmmap->regions[n-1].size == region->base)
+        {
+            vmmap->regions[n-1].size += region->size;
+        }
+        else vmmap->regions[n++] = *region;
+    }
+    vmmap->count = n;
+
+    // rebuild the segment tree of max free size
+    size_t leafnum = 1;
+    while(leafnum < n) leafnum <<= 1;
+    if(leafnum != vmmap->leafnum)
+    {
+        size_t *tree = (size_t*)realloc(vmmap->tree, 2 * leafnum * sizeof(size_t));
+        if(!tree) return FALSE;
+        vmmap->tree = tree;
+        vmmap->leafnum = leafnum;
+    }
+    for(size_t i=0; i < leafnum; i++)
+    {
+        PWINPE_VMREGION region = &vmmap->regions[i];
+        vmmap->tree[leafnum + i] = i < n && region->state == MEM_FREE ? region->size : 0;
+    }
+    for(size_t i=leafnum - 1; i > 0; i--)
+    {
+        size_t l = vmmap->tree[2*i], r = vmmap->tree[2*i+1];
+        vmmap->tree[i] = l > r ? l : r;
+    }
+    return TRUE;
+}
+
+static size_t winpe_vmmap_lowerbound(PWINPE_VMMAP vmmap, size_t addr)
+{
+    // the last region with base <= addr
+    size_t l = 0, r = vmmap->count;
+    while(l + 1 < r)
+    {
+        size_t m = (l + r) / 2;
+        if(vmmap->regions[m].base <= addr) l = m;
+        else r = m;
+    }
+    return l;
+}
+
+static size_t winpe_vmmap_treefind(PWINPE_VMMAP vmmap, size_t start, size_t size)
+{
+    // the first leaf >= start with free size >= size, leafnum if not found
+    size_t node = vmmap->leafnum + start;
+    if(start >= vmmap->leafnum) return vmmap->leafnum;
+    if(vmmap->tree[node] >= size) return start;
+    while(node > 1) // go up until a right sibling has enough space
+    {
+        if(!(node & 1) && vmmap->tree[node + 1] >= size) 
+        {
+            node++;
+            break;
+        }
+        node >>= 1;
+    }
+    if(node == 1) return vmmap->leafnum;
+    while(node < vmmap->leafnum) // go down to the leftmost leaf
+    {
+        node = vmmap->tree[2*node] >= size ? 2*node : 2*node + 1;
+    }
+    return node - vmmap->leafnum;
+}
+
+bool_t STDCALL winpe_vmmap_snapshot(PWINPE_VMMAP vmmap, HANDLE hprocess)
+{
+    inl_memset(vmmap, 0, sizeof(WINPE_VMMAP));
+    vmmap->hprocess = hprocess;
+    size_t addr = 0;
+    MEMORY_BASIC_INFORMATION minfo;
+    while(TRUE)
+    {
+        SIZE_T ret = hprocess ? VirtualQueryEx(hprocess, (LPCVOID)addr, &minfo, sizeof(minfo)) : 
+                        VirtualQuery((LPCVOID)addr, &minfo, sizeof(minfo));
+        if(!ret || !minfo.RegionSize) break;
+        if(!winpe_vmmap_reserve(vmmap, vmmap->count + 1)) 
+        {
+            winpe_vmmap_free(vmmap);
+            return FALSE;
+        }
+        PWINPE_VMREGION region = &vmmap->regions[vmmap->count++];
+        region->base = (size_t)minfo.BaseAddress;
+        region->size = minfo.RegionSize;
+        region->state = minfo.State;
+        if(region->base + region->size <= addr) break; // overflow
+        addr = region->base + region->size;
+    }
+    if(!vmmap->count || !winpe_vmmap_build(vmmap))
+    {
+        winpe_vmmap_free(vmmap);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+bool_t STDCALL winpe_vmmap_update(PWINPE_VMMAP vmmap, size_t base, size_t size, DWORD state)
+{
+    if(!vmmap->count || !size) return FALSE;
+    size_t end = base + size;
+    PWINPE_VMREGION last = &vmmap->regions[vmmap->count - 1];
+    if(end < base || base < vmmap->regions[0].base || end > last->base + last->size) return FALSE;
+    if(!winpe_vmmap_reserve(vmmap, vmmap->count + 2)) return FALSE;
+
+    // split at base and end, then set the state inside
+    size_t split[2] = {base, end};
+    for(int k=0; k < 2; k++)
+    {
+        size_t i = winpe_vmmap_lowerbound(vmmap, split[k]);
+        PWINPE_VMREGION region = &vmmap->regions[i];
+        if(region->base == split[k] || split[k] >= region->base + region->size) continue;
+        for(size_t j=vmmap->count; j > i; j--) vmmap->regions[j] = vmmap->regions[j-1];
+        vmmap->count++;
+        region[1].base = split[k];
+        region[1].size = region->base + region->size - split[k];
+        region->size = split[k] - region->base;
+    }
+    for(size_t i = winpe_vmmap_lowerbound(vmmap, base); 
+        i < vmmap->count && vmmap->regions[i].base < end; i++)
+    {
+        vmmap->regions[i].state = state;
+    }
+    return winpe_vmmap_build(vmmap);
+}
+
+void* STDCALL winpe_vmmap_findspace(PWINPE_VMMAP vmmap, 
+    size_t addr, size_t size, size_t alignsize)
+{
+    if(!vmmap->count || !size) return NULL;
+    if(!alignsize) alignsize = 1;
+    size_t i = winpe_vmmap_lowerbound(vmmap, addr);
+    while(TRUE)
+    {
+        i = winpe_vmmap_treefind(vmmap, i, size);
+        if(i >= vmmap->count) return NULL;
+        PWINPE_VMREGION region = &vmmap->regions[i];
+        size_t start = region->base > addr ? region->base : addr;
+        size_t end = region->base + region->size;
+        if(start % alignsize) start += alignsize - start % alignsize;
+        if(start >= region->base && start < end && end - start >= size) return (void*)start;
+        i++;
+    }
+}
+
+void STDCALL winpe_vmmap_free(PWINPE_VMMAP vmmap)
+{
+    if(vmmap->regions) free(vmmap->regions);
+    if(vmmap->tree) free(vmmap->tree);
+    inl_memset(vmmap, 0, sizeof(WINPE_VMMAP));
+}
+
+#endif // _WIN32
+
 // PE load, adjust functions
 size_t STDCALL winpe_overlayoffset(const void *rawpe)
 {
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)rawpe;
-    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)rawpe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
-    PIMAGE_SECTION_HEADER pSectHeader = (PIMAGE_SECTION_HEADER)((uint8_t*)pOptHeader + pFileHeader->SizeOfOptionalHeader);
-    WORD sectNum = pFileHeader->NumberOfSections;
-    return pSectHeader[sectNum-1].PointerToRawData + pSectHeader[sectNum-1].SizeOfRawData;
+    return (size_t)winpe_overlayrange(rawpe, 0, NULL);
+}
+
+uint64_t STDCALL winpe_overlayrange(const void *rawpe, uint64_t filesize, uint64_t *poverlaysize)
+{
+    // rawpe might be only the headers, so the view is trusted
+    WINPE_VIEW view;
+    if(poverlaysize) *poverlaysize = 0;
+    if(!winpe_view_init(&view, rawpe, 0, 0)) return 0;
+
+    // sections might not be sorted by raw offset
+    uint64_t overlayoffset = view.headersize;
+    for(WORD i=0; i<view.sectnum; i++)
+    {
+        if(!view.secthdr[i].SizeOfRawData) continue;
+        uint64_t sectend = (uint64_t)view.secthdr[i].PointerToRawData + view.secthdr[i].SizeOfRawData;
+        if(sectend > overlayoffset) overlayoffset = sectend;
+    }
+
+    // the security dir VirtualAddress is a file offset, skip the certificate table 
+    uint64_t overlayend = filesize;
+    PIMAGE_DATA_DIRECTORY pSecurityEntry = &view.datadir[IMAGE_DIRECTORY_ENTRY_SECURITY];
+    if(view.dirnum > IMAGE_DIRECTORY_ENTRY_SECURITY && pSecurityEntry->VirtualAddress && pSecurityEntry->Size)
+    {
+        uint64_t certoffset = pSecurityEntry->VirtualAddress;
+        uint64_t certend = certoffset + ((pSecurityEntry->Size + 7) & ~7); // 8 bytes aligned
+        if(certoffset <= overlayoffset && certend > overlayoffset) overlayoffset = certend;
+        else if(certoffset > overlayoffset && certoffset < overlayend) overlayend = certoffset;
+    }
+    if(filesize && overlayoffset > filesize) overlayoffset = filesize;
+    if(poverlaysize) *poverlaysize = overlayend > overlayoffset ? overlayend - overlayoffset : 0;
+    return overlayoffset;
+}
+
+size_t STDCALL winpe_rtmcheck(const void *rtm, size_t rtmsize)
+{
+    PWINPE_RTMHDR hdr = (PWINPE_RTMHDR)rtm;
+    if(rtmsize < sizeof(WINPE_RTMHDR) || hdr->magic != WINPE_RTM_MAGIC) return 0;
+    if(hdr->hdrsize < sizeof(WINPE_RTMHDR) || hdr->ptrsize != sizeof(size_t)) return 0;
+    if((uint64_t)hdr->imageoffset + hdr->imagesize > rtmsize) return 0;
+    if((uint64_t)hdr->impoffset + (uint64_t)hdr->impnum * sizeof(WINPE_RTMIMP) 
+        + (uint64_t)hdr->reloc32num * sizeof(DWORD) > rtmsize) return 0;
+    if((uint64_t)hdr->pagemapoffset + hdr->pagemapsize > rtmsize) return 0;
+    if((uint64_t)hdr->relocmapoffset + hdr->relocmapsize > rtmsize) return 0;
+    if((uint64_t)hdr->pagemapsize * 8 * WINPE_RTM_PAGESIZE < hdr->imagesize) return 0;
+
+    // each page in pagemap has a bitmap
+    const uint8_t *pagemap = (const uint8_t*)rtm + hdr->pagemapoffset;
+    uint64_t pagenum = 0;
+    for(DWORD i=0; i < hdr->pagemapsize * 8; i++)
+    {
+        if(!(pagemap[i/8] & (1 << (i%8)))) continue;
+        if((uint64_t)(i + 1) * WINPE_RTM_PAGESIZE > hdr->imagesize) return 0;
+        pagenum++;
+    }
+    if(pagenum * WINPE_RTM_PAGESIZE / 8 != hdr->relocmapsize) return 0;
+
+    PWINPE_RTMIMP imps = (PWINPE_RTMIMP)((uint8_t*)rtm + hdr->impoffset);
+    for(DWORD i=0; i < hdr->impnum; i++)
+    {
+        if((uint64_t)imps[i].iatrva + sizeof(size_t) > hdr->imagesize) return 0;
+        if(imps[i].dllnamerva >= hdr->imagesize) return 0;
+        if(!(imps[i].namerva & WINPE_RTM_ORDINALFLAG) 
+            && (uint64_t)imps[i].namerva + sizeof(IMAGE_IMPORT_BY_NAME) > hdr->imagesize) return 0;
+    }
+    const DWORD *reloc32 = (const DWORD*)(imps + hdr->impnum);
+    for(DWORD i=0; i < hdr->reloc32num; i++)
+    {
+        if((uint64_t)reloc32[i] + sizeof(uint32_t) > hdr->imagesize) return 0;
+    }
+    return hdr->imagesize;
+}
+
+size_t STDCALL winpe_memload(const void *rawpe, size_t rawsize, 
+    void *mempe, size_t memsize, bool_t same_align)
+{
+    // load rawpe to memalign, rawsize 0 means no bounds check of the raw data
+    WINPE_VIEW view;
+    if(!winpe_view_init(&view, rawpe, rawsize, 0)) return 0;
+    size_t imagesize = view.imagesize;
+    if(!mempe) return imagesize;
+    else if(memsize!=0 && memsize<imagesize) return 0;
+
+    size_t headersize = view.headersize;
+    if(headersize > imagesize) return 0;
+    if(headersize > view.size) headersize = view.size;
+    inl_memset(mempe, 0, imagesize);
+    inl_memcpy(mempe, rawpe, headersize);
+    
+    for(WORD i=0;i<view.sectnum;i++)
+    {
+        size_t sectsize = view.secthdr[i].SizeOfRawData;
+        size_t rawoffset = view.secthdr[i].PointerToRawData;
+        size_t memoffset = view.secthdr[i].VirtualAddress;
+        if(rawoffset >= view.size) continue;
+        if(sectsize > view.size - rawoffset) sectsize = view.size - rawoffset;
+        if(memoffset >= imagesize) continue;
+        if(sectsize > imagesize - memoffset) sectsize = imagesize - memoffset;
+        inl_memcpy((uint8_t*)mempe + memoffset, (uint8_t*)rawpe + rawoffset, sectsize);
+    }
+
+    // adjust all to mem align
+    if(same_align && winpe_view_init(&view, mempe, imagesize, WINPE_VIEWFLAG_MEM))
+    {
+        if(view.magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+        {
+            PIMAGE_OPTIONAL_HEADER64 pOptHeader64 = (PIMAGE_OPTIONAL_HEADER64)view.opthdr;
+            pOptHeader64->FileAlignment = pOptHeader64->SectionAlignment;
+        }
+        else
+        {
+            PIMAGE_OPTIONAL_HEADER32 pOptHeader32 = (PIMAGE_OPTIONAL_HEADER32)view.opthdr;
+            pOptHeader32->FileAlignment = pOptHeader32->SectionAlignment;
+        }
+        for(WORD i=0;i<view.sectnum;i++)
+        {
+            view.secthdr[i].PointerToRawData = view.secthdr[i].VirtualAddress;
+        }
+    }
+    return imagesize;
+}
+
+// reloc the blocks from offset to end in reloc directory, zero SizeOfBlock ends the table
+static size_t winpe_memrelocrange(const WINPE_VIEW *view, DWORD offset, DWORD end, int64_t delta)
+{
+    size_t reloc_count = 0;
+    PIMAGE_BASE_RELOCATION pBaseReloc = NULL;
+    while(offset < end && (pBaseReloc = winpe_view_relocblock(view, &offset)))
+    {
+        size_t count = winpe_memrelocblock((void*)view->base, view->imagesize, pBaseReloc, delta);
+        if(count == (size_t)-1) return (size_t)-1;
+        reloc_count += count;
+    }
+    if(offset >= end) return reloc_count;
+
+    // the iteration stopped before end, only zero padding is valid here
+    DWORD relocsize = 0;
+    uint8_t *reloc = (uint8_t*)winpe_view_dir(view, IMAGE_DIRECTORY_ENTRY_BASERELOC, &relocsize);
+    if(reloc && relocsize - offset >= sizeof(IMAGE_BASE_RELOCATION) 
+        && ((PIMAGE_BASE_RELOCATION)(reloc + offset))->SizeOfBlock) return (size_t)-1;
+    return reloc_count;
+}
+
+size_t STDCALL winpe_memreloc(void *mempe, size_t newimagebase)
+{
+    // pe32 might be relocated by x64 program, so do not use native optional header
+    WINPE_VIEW view;
+    if(!winpe_view_init(&view, mempe, 0, WINPE_VIEWFLAG_MEM)) return (size_t)-1;
+    int64_t delta = (int64_t)((uint64_t)newimagebase - winpe_view_imagebase(&view));
+    DWORD relocsize = 0;
+    if(view.dirnum > IMAGE_DIRECTORY_ENTRY_BASERELOC 
+        && view.datadir[IMAGE_DIRECTORY_ENTRY_BASERELOC].Size 
+        && !winpe_view_dir(&view, IMAGE_DIRECTORY_ENTRY_BASERELOC, &relocsize)) return (size_t)-1;
+
+    // check all blocks first (delta 0 writes nothing), so an invalid table leaves the image unchanged
+    size_t reloc_count = winpe_memrelocrange(&view, 0, relocsize, 0);
+    if(reloc_count == (size_t)-1) return (size_t)-1;
+    if(delta && winpe_memrelocrange(&view, 0, relocsize, delta) != reloc_count) return (size_t)-1;
+
+    if(view.magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC) 
+    {
+        ((PIMAGE_OPTIONAL_HEADER64)view.opthdr)->ImageBase = newimagebase;
+    }
+    else ((PIMAGE_OPTIONAL_HEADER32)view.opthdr)->ImageBase = (DWORD)newimagebase;
+    return reloc_count;
+}
+
+#ifdef _WIN32
+typedef struct _WINPE_RELOCTASK
+{
+    const WINPE_VIEW *view;
+    DWORD start; // block offset range in reloc directory
+    DWORD end;
+    int64_t delta; // 0 for checking the blocks only
+    size_t count; // (size_t)-1 if invalid
+}WINPE_RELOCTASK, *PWINPE_RELOCTASK;
+
+static DWORD WINAPI winpe_memreloctask(LPVOID param)
+{
+    PWINPE_RELOCTASK task = (PWINPE_RELOCTASK)param;
+    task->count = winpe_memrelocrange(task->view, task->start, task->end, task->delta);
+    return task->count == (size_t)-1 ? 1 : 0;
+}
+
+static size_t winpe_memreloctasks(PWINPE_RELOCTASK tasks, DWORD ntask, int64_t delta)
+{
+    // the first task runs in current thread
+    HANDLE hthreads[MAXIMUM_WAIT_OBJECTS];
+    for(DWORD i=0; i < ntask; i++) tasks[i].delta = delta;
+    for(DWORD i=1; i < ntask; i++)
+    {
+        hthreads[i] = CreateThread(NULL, 0, winpe_memreloctask, &tasks[i], 0, NULL);
+        if(!hthreads[i]) winpe_memreloctask(&tasks[i]);
+    }
+    winpe_memreloctask(&tasks[0]);
+    size_t reloc_count = tasks[0].count;
+    for(DWORD i=1; i < ntask; i++)
+    {
+        if(hthreads[i])
+        {
+            WaitForSingleObject(hthreads[i], INFINITE);
+            CloseHandle(hthreads[i]);
+        }
+        if(tasks[i].count == (size_t)-1 || reloc_count == (size_t)-1) reloc_count = (size_t)-1;
+        else reloc_count += tasks[i].count;
+    }
+    return reloc_count;
 }
 
-size_t STDCALL winpe_memload(const void *rawpe, size_t rawsize, 
-    void *mempe, size_t memsize, bool_t same_align)
+size_t STDCALL winpe_memrelocex(void *mempe, size_t newimagebase, DWORD nthread)
 {
-    // load rawpe to memalign
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)rawpe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)rawpe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_SECTION_HEADER pSectHeader = (PIMAGE_SECTION_HEADER)((uint8_t*)pOptHeader + pFileHeader->SizeOfOptionalHeader);
-    WORD sectNum = pFileHeader->NumberOfSections;
-    size_t imagesize = pOptHeader->SizeOfImage;
-    if(!mempe) return imagesize;
-    else if(memsize!=0 && memsize<imagesize) return 0;
-
-    inl_memset(mempe, 0, imagesize);
-    inl_memcpy(mempe, rawpe, pOptHeader->SizeOfHeaders);
-    
-    for(WORD i=0;i<sectNum;i++)
+#define WINPE_RELOC_MINTHREADSIZE 0x10000 // small table is faster without threads
+    WINPE_VIEW view;
+    DWORD relocsize = 0;
+    if(!winpe_view_init(&view, mempe, 0, WINPE_VIEWFLAG_MEM)) return (size_t)-1;
+    winpe_view_dir(&view, IMAGE_DIRECTORY_ENTRY_BASERELOC, &relocsize);
+    if(!nthread)
+    {
+        SYSTEM_INFO sysinfo;
+        GetSystemInfo(&sysinfo);
+        nthread = sysinfo.dwNumberOfProcessors;
+    }
+    if(nthread > MAXIMUM_WAIT_OBJECTS) nthread = MAXIMUM_WAIT_OBJECTS;
+    if(nthread <= 1 || relocsize < WINPE_RELOC_MINTHREADSIZE)
     {
-        inl_memcpy((uint8_t*)mempe+pSectHeader[i].VirtualAddress, 
-            (uint8_t*)rawpe+pSectHeader[i].PointerToRawData, pSectHeader[i].SizeOfRawData);
+        return winpe_memreloc(mempe, newimagebase);
     }
+    int64_t delta = (int64_t)((uint64_t)newimagebase - winpe_view_imagebase(&view));
 
-    // adjust all to mem align
-    if(same_align)
-    {
-        pDosHeader = (PIMAGE_DOS_HEADER)mempe;
-        pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mempe + pDosHeader->e_lfanew);
-        pFileHeader = &pNtHeader->FileHeader;
-        pOptHeader = &pNtHeader->OptionalHeader;
-        pSectHeader = (PIMAGE_SECTION_HEADER)((uint8_t*)pOptHeader + pFileHeader->SizeOfOptionalHeader);
-        sectNum = pFileHeader->NumberOfSections;
-        pOptHeader->FileAlignment = pOptHeader->SectionAlignment;
-        for(WORD i=0;i<sectNum;i++)
+    // split blocks into tasks with similar size, the last task checks the rest of table
+    WINPE_RELOCTASK tasks[MAXIMUM_WAIT_OBJECTS];
+    DWORD ntask = 0;
+    DWORD tasksize = relocsize / nthread;
+    DWORD offset = 0, blockoffset = 0;
+    while(winpe_view_relocblock(&view, &offset))
+    {
+        if(!ntask || (blockoffset >= ntask * tasksize && ntask < nthread))
         {
-            pSectHeader[i].PointerToRawData = pSectHeader[i].VirtualAddress;
+            if(ntask) tasks[ntask-1].end = blockoffset;
+            tasks[ntask].view = &view;
+            tasks[ntask].start = blockoffset;
+            ntask++;
         }
+        blockoffset = offset;
     }
-    return imagesize;
+    if(!ntask) return winpe_memreloc(mempe, newimagebase);
+    tasks[ntask-1].end = relocsize;
+
+    // check all tasks with delta 0 first, then fix up, so an invalid table leaves the image unchanged
+    size_t reloc_count = winpe_memreloctasks(tasks, ntask, 0);
+    if(reloc_count == (size_t)-1) return (size_t)-1;
+    if(delta && winpe_memreloctasks(tasks, ntask, delta) != reloc_count) return (size_t)-1;
+
+    if(view.magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC) 
+    {
+        ((PIMAGE_OPTIONAL_HEADER64)view.opthdr)->ImageBase = newimagebase;
+    }
+    else ((PIMAGE_OPTIONAL_HEADER32)view.opthdr)->ImageBase = (DWORD)newimagebase;
+    return reloc_count;
 }
 
-size_t STDCALL winpe_memreloc(void *mempe, size_t newimagebase)
+#endif // _WIN32
+
+size_t STDCALL winpe_memrelocblock(void *mempe, size_t imagesize,
+    const void *basereloc, int64_t delta)
 {
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mempe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
-    PIMAGE_DATA_DIRECTORY pRelocEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_BASERELOC];
-	
-    DWORD reloc_count = 0;
-    DWORD reloc_offset = 0;
-    int64_t shift = (int64_t)newimagebase - (int64_t)pOptHeader->ImageBase;
-	while (reloc_offset < pRelocEntry->Size)
-	{
-		PIMAGE_BASE_RELOCATION pBaseReloc = (PIMAGE_BASE_RELOCATION)
-            ((uint8_t*)mempe + pRelocEntry->VirtualAddress + reloc_offset);
-        PRELOCOFFSET pRelocOffset = (PRELOCOFFSET)((uint8_t*)pBaseReloc + sizeof(IMAGE_BASE_RELOCATION));
-		DWORD item_num = (pBaseReloc->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(RELOCOFFSET);
-		for (size_t i = 0; i < item_num; i++)
-		{
-			if (!pRelocOffset[i].type && !pRelocOffset[i].offset) continue;
-			DWORD targetoffset = pBaseReloc->VirtualAddress + pRelocOffset[i].offset;
-            size_t *paddr = (size_t *)((uint8_t*)mempe + targetoffset);
-            size_t relocaddr = (size_t)((int64_t)*paddr + shift);
-            //printf("reloc 0x%08x->0x%08x\n", *paddr, relocaddr);
-            *paddr = relocaddr;
-		}
-		reloc_offset += sizeof(IMAGE_BASE_RELOCATION) + sizeof(RELOCOFFSET) * item_num;
-		reloc_count += item_num;
-	}
-    pOptHeader->ImageBase = newimagebase;
-	return reloc_count;
+    const IMAGE_BASE_RELOCATION *pBaseReloc = (const IMAGE_BASE_RELOCATION *)basereloc;
+    const WORD *pRelocItem = (const WORD*)((uint8_t*)pBaseReloc + sizeof(IMAGE_BASE_RELOCATION));
+    if(pBaseReloc->SizeOfBlock < sizeof(IMAGE_BASE_RELOCATION)) return (size_t)-1;
+    if(pBaseReloc->VirtualAddress >= imagesize) return (size_t)-1;
+    DWORD item_num = (pBaseReloc->SizeOfBlock - sizeof(IMAGE_BASE_RELOCATION)) / sizeof(WORD);
+    uint8_t *page = (uint8_t*)mempe + pBaseReloc->VirtualAddress;
+    size_t pagesize = imagesize - pBaseReloc->VirtualAddress; // bytes of image from this page
+    size_t reloc_count = 0;
+
+    // if the whole 4KB page (with 8 bytes tail) is in image, skip the bounds check of each item
+    bool_t checkbound = pagesize < 0x1000 + sizeof(uint64_t);
+    for (DWORD i = 0; i < item_num; i++)
+    {
+        WORD offset = pRelocItem[i] & 0xfff;
+        WORD type = pRelocItem[i] >> 12;
+        uint8_t *p = page + offset;
+        if(type == IMAGE_REL_BASED_ABSOLUTE) continue; // padding
+        if(checkbound)
+        {
+            size_t width = type == IMAGE_REL_BASED_DIR64 ? 8 : (type == IMAGE_REL_BASED_HIGHLOW ? 4 : 2);
+            if(offset + width > pagesize) return (size_t)-1;
+        }
+        if(delta) switch(type)
+        {
+        case IMAGE_REL_BASED_DIR64:
+            *(uint64_t*)p += (uint64_t)delta;
+            break;
+        case IMAGE_REL_BASED_HIGHLOW:
+            *(uint32_t*)p += (uint32_t)delta;
+            break;
+        case IMAGE_REL_BASED_HIGH:
+            *(uint16_t*)p = (uint16_t)((((uint32_t)*(uint16_t*)p << 16) + (uint32_t)delta) >> 16);
+            break;
+        case IMAGE_REL_BASED_LOW:
+            *(uint16_t*)p += (uint16_t)delta;
+            break;
+        case IMAGE_REL_BASED_HIGHADJ: // the next item is the low 16 bit
+        {
+            if(++i >= item_num) return (size_t)-1;
+            uint32_t v = ((uint32_t)*(uint16_t*)p << 16) + (uint32_t)(int32_t)(int16_t)pRelocItem[i];
+            v += (uint32_t)delta + 0x8000;
+            *(uint16_t*)p = (uint16_t)(v >> 16);
+            break;
+        }
+        default: // arm, mips, riscv types are not supported
+            return (size_t)-1;
+        }
+        else if(type == IMAGE_REL_BASED_HIGHADJ) 
+        {
+            if(++i >= item_num) return (size_t)-1; // the same check as fixup
+        }
+        else if(type != IMAGE_REL_BASED_DIR64 && type != IMAGE_REL_BASED_HIGHLOW
+            && type != IMAGE_REL_BASED_HIGH && type != IMAGE_REL_BASED_LOW) return (size_t)-1;
+        reloc_count++;
+    }
+    return reloc_count;
 }
- 
+
+#ifdef _WIN32
 size_t STDCALL winpe_membindiat(void *mempe, 
     PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
 {
@@ -792,185 +3442,698 @@ size_t STDCALL winpe_membindiat(void *mempe,
     return iat_count;
 }
 
-size_t STDCALL winpe_membindtls(void *mempe, DWORD reason)
+static INLINE size_t winpe_memfindimp(size_t dllbase, LPCSTR funcname, 
+    PIMAGE_IMPORT_BY_NAME pImpByName, PFN_LoadLibraryA pfnLoadLibraryA, 
+    PFN_GetProcAddress pfnGetProcAddress, DWORD flag)
 {
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
-    PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mempe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
-    PIMAGE_DATA_DIRECTORY pTlsDirectory = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_TLS];
-    if(!pTlsDirectory->VirtualAddress) return 0;
+    size_t funcva = 0;
+    if((flag & WINPE_BINDFLAG_EXPHINT) && pImpByName)
+    {
+        // hint is the index in AddressOfNames, usually matched if the dll not changed
+        void *expva = winpe_memfindexphint((void*)dllbase, funcname, pImpByName->Hint);
+        PWINPE_FWDCACHE cache = (flag & WINPE_BINDFLAG_FWDCACHE) ? &s_winpe_fwdcache : NULL;
+        if(expva) funcva = (size_t)winpe_memforwardexpex((void*)dllbase, 
+            (size_t)expva - dllbase, pfnLoadLibraryA, pfnGetProcAddress, cache);
+    }
+    if(!funcva) funcva = (size_t)pfnGetProcAddress((HMODULE)dllbase, funcname);
+    return funcva;
+}
 
-    size_t tls_count = 0;
-    PIMAGE_TLS_DIRECTORY pTlsEntry = (PIMAGE_TLS_DIRECTORY)((uint8_t*)mempe + pTlsDirectory->VirtualAddress);
-    PIMAGE_TLS_CALLBACK *tlscb= (PIMAGE_TLS_CALLBACK*)pTlsEntry->AddressOfCallBacks;
-    if(tlscb)
+static size_t winpe_membindiatlazy(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, DWORD flag)
+{
+#ifdef _WIN64
+    // save args and xmm0-3, call [resolver] with rax (entry), then jmp to func
+    uint8_t common_code[] = {0x51, 0x52, 0x41, 0x50, 0x41, 0x51, 0x48, 0x83, 0xEC, 0x68, 0x0F, 0x29, 0x44, 0x24, 0x20, 0x0F, 0x29, 0x4C, 0x24, 0x30, 0x0F, 0x29, 0x54, 0x24, 0x40, 0x0F, 0x29, 0x5C, 0x24, 0x50, 0x48, 0x89, 0xC1, 0xFF, 0x15, 0x20, 0x00, 0x00, 0x00, 0x0F, 0x28, 0x44, 0x24, 0x20, 0x0F, 0x28, 0x4C, 0x24, 0x30, 0x0F, 0x28, 0x54, 0x24, 0x40, 0x0F, 0x28, 0x5C, 0x24, 0x50, 0x48, 0x83, 0xC4, 0x68, 0x41, 0x59, 0x41, 0x58, 0x5A, 0x59, 0xFF, 0xE0, 0, 0, 0, 0, 0, 0, 0, 0};
+    size_t resolver_offset = 0x47;
+    uint8_t stub_code[] = {0x48, 0xB8, 0, 0, 0, 0, 0, 0, 0, 0, 0xE9, 0, 0, 0, 0}; // mov rax, entry; jmp common
+    size_t entry_offset = 2, jmp_offset = 11;
+#else
+    // save ecx, edx, call resolver with [esp] (entry), then jmp to func
+    uint8_t common_code[] = {0x51, 0x52, 0xFF, 0x74, 0x24, 0x08, 0xB8, 0, 0, 0, 0, 0xFF, 0xD0, 0x5A, 0x59, 0x83, 0xC4, 0x04, 0xFF, 0xE0};
+    size_t resolver_offset = 7;
+    uint8_t stub_code[] = {0x68, 0, 0, 0, 0, 0xE9, 0, 0, 0, 0}; // push entry; jmp common
+    size_t entry_offset = 1, jmp_offset = 6;
+#endif
+#define WINPE_LAZYSTUB_SIZE 0x10
+    WINPE_VIEW view;
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = NULL;
+    if(!winpe_view_init(&view, mempe, 0, WINPE_VIEWFLAG_MEM)) return 0;
+    if(view.ptrsize != sizeof(size_t)) return 0; // can not bind the other bitness
+
+    // count imports for the stubs size, bound-only imports (no OriginalFirstThunk) use FirstThunk
+    DWORD count = 0;
+    for (DWORD i=0; (pImpDescriptor = winpe_view_impdesc(&view, i)); i++) 
+    {
+        DWORD oft = pImpDescriptor->OriginalFirstThunk;
+        DWORD ft = pImpDescriptor->FirstThunk;
+        if(!winpe_view_str(&view, pImpDescriptor->Name)) return 0;
+        for (DWORD j=0; winpe_view_thunkt(&view, ft, j, sizeof(size_t)) 
+            && winpe_view_thunkt(&view, oft ? oft : ft, j, sizeof(size_t)); j++) count++;
+    }
+    if(!count) return 0;
+
+    char name_kernel32[] = {'k', 'e', 'r', 'n', 'e', 'l', '3', '2', '.', 'd', 'l', 'l', '\0'};
+    char name_VirtualAlloc[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'A', 'l', 'l', 'o', 'c', '\0'};
+    char name_VirtualProtect[] = {'V', 'i', 'r', 't', 'u', 'a', 'l', 'P', 'r', 'o', 't', 'e', 'c', 't', '\0'};
+    HMODULE hmod_kernel32 = pfnLoadLibraryA(name_kernel32);
+    PFN_VirtualAlloc pfnVirtualAlloc = (PFN_VirtualAlloc)pfnGetProcAddress(hmod_kernel32, name_VirtualAlloc);
+    PFN_VirtualProtect pfnVirtualProtect = (PFN_VirtualProtect)pfnGetProcAddress(hmod_kernel32, name_VirtualProtect);
+    if(!pfnVirtualAlloc || !pfnVirtualProtect) return 0;
+
+    // ctx | entries | common code | stubs, in one alloc
+    size_t common_rva = sizeof(WINPE_LAZYCTX) + count * sizeof(WINPE_LAZYENTRY);
+    common_rva = (common_rva + 0xf) & ~(size_t)0xf;
+    size_t stubs_rva = common_rva + ((sizeof(common_code) + 0xf) & ~(size_t)0xf);
+    size_t size = stubs_rva + count * WINPE_LAZYSTUB_SIZE;
+    PWINPE_LAZYCTX ctx = (PWINPE_LAZYCTX)pfnVirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if(!ctx) return 0;
+    ctx->pfnLoadLibraryA = pfnLoadLibraryA;
+    ctx->pfnGetProcAddress = pfnGetProcAddress;
+    ctx->flag = flag & ~WINPE_BINDFLAG_LAZY;
+    ctx->count = count;
+    ctx->size = size;
+    ctx->entries = (PWINPE_LAZYENTRY)((uint8_t*)ctx + sizeof(WINPE_LAZYCTX));
+    ctx->stubs = (uint8_t*)ctx + stubs_rva;
+    uint8_t *common = (uint8_t*)ctx + common_rva;
+    size_t resolver = (size_t)winpe_memlazybind;
+    inl_memcpy(common, common_code, sizeof(common_code));
+    inl_memcpy(common + resolver_offset, &resolver, sizeof(resolver));
+
+    DWORD iat_count = 0;
+    for (DWORD i=0; (pImpDescriptor = winpe_view_impdesc(&view, i)); i++) 
     {
-        while(*tlscb)
+        LPCSTR pDllName = winpe_view_str(&view, pImpDescriptor->Name);
+        DWORD oft = pImpDescriptor->OriginalFirstThunk;
+        DWORD ft = pImpDescriptor->FirstThunk;
+        for (DWORD j=0; winpe_view_thunkt(&view, ft, j, sizeof(size_t)); j++) 
         {
-            (*tlscb)(mempe, reason, NULL);
-            tlscb++;
-            tls_count++;
+            uint64_t thunk = winpe_view_thunkt(&view, oft ? oft : ft, j, sizeof(size_t));
+            if(!thunk) break;
+            PWINPE_LAZYENTRY entry = &ctx->entries[iat_count];
+            uint8_t *stub = ctx->stubs + iat_count * WINPE_LAZYSTUB_SIZE;
+            entry->ctx = ctx;
+            entry->iat = (PIMAGE_THUNK_DATA)winpe_view_ptr(&view, 
+                ft + (size_t)j * sizeof(size_t), sizeof(size_t));
+            entry->dllname = pDllName;
+            entry->impbyname = NULL;
+            if(thunk & IMAGE_ORDINAL_FLAG64) // by ordinal
+            {
+                entry->funcname = (LPCSTR)(size_t)(thunk & 0xffff);
+            }
+            else
+            {
+                // invalid name is kept in stub, and reported on the first call
+                entry->impbyname = (PIMAGE_IMPORT_BY_NAME)winpe_view_ptr(&view, 
+                    (size_t)thunk, sizeof(IMAGE_IMPORT_BY_NAME));
+                if(entry->impbyname && !winpe_view_str(&view, (size_t)thunk + sizeof(WORD)))
+                {
+                    entry->impbyname = NULL;
+                }
+                entry->funcname = entry->impbyname ? (LPCSTR)entry->impbyname->Name : NULL;
+            }
+
+            int32_t jmprel = (int32_t)((size_t)common - (size_t)(stub + sizeof(stub_code)));
+            inl_memcpy(stub, stub_code, sizeof(stub_code));
+            inl_memcpy(stub + entry_offset, &entry, sizeof(entry));
+            inl_memcpy(stub + jmp_offset, &jmprel, sizeof(jmprel));
+            entry->iat->u1.Function = (size_t)stub;
+            iat_count++;
         }
     }
-    return tls_count;
+
+    DWORD oldprotect;
+    pfnVirtualProtect(ctx, size, PAGE_EXECUTE_READ, &oldprotect);
+    WINPE_MEMRECORD_OF(mempe)->lazyctx = ctx;
+    return iat_count;
 }
 
-void* STDCALL winpe_memfindiat(void *mempe, LPCSTR dllname, LPCSTR funcname)
+void* STDCALL winpe_memlazybind(void *entry)
 {
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mempe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
-    PIMAGE_DATA_DIRECTORY pImpEntry =  &pDataDirectory[IMAGE_DIRECTORY_ENTRY_IMPORT];
-    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = (PIMAGE_IMPORT_DESCRIPTOR)((uint8_t*)mempe + pImpEntry->VirtualAddress);
+    PWINPE_LAZYENTRY pEntry = (PWINPE_LAZYENTRY)entry;
+    PWINPE_LAZYCTX ctx = pEntry->ctx;
+    ULONG_PTR param = (ULONG_PTR)entry;
+    size_t dllbase = (size_t)ctx->pfnLoadLibraryA(pEntry->dllname);
+    if(!dllbase) 
+    {
+        RaiseException(WINPE_LAZYSTATUS_DLLNOTFOUND, EXCEPTION_NONCONTINUABLE, 1, &param);
+        return NULL;
+    }
+    size_t funcva = 0;
+    if(pEntry->funcname) funcva = winpe_memfindimp(dllbase, pEntry->funcname, pEntry->impbyname, 
+        ctx->pfnLoadLibraryA, ctx->pfnGetProcAddress, ctx->flag);
+    if(!funcva) 
+    {
+        RaiseException(WINPE_LAZYSTATUS_FUNCNOTFOUND, EXCEPTION_NONCONTINUABLE, 1, &param);
+        return NULL;
+    }
+    InterlockedExchangePointer((PVOID volatile*)&pEntry->iat->u1.Function, (PVOID)funcva);
+    return (void*)funcva;
+}
+
+size_t STDCALL winpe_membindiatex(void *mempe, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, DWORD flag)
+{
+    WINPE_VIEW view;
+    PIMAGE_IMPORT_DESCRIPTOR pImpDescriptor = NULL;
     PIMAGE_THUNK_DATA pFtThunk = NULL;
-    PIMAGE_THUNK_DATA pOftThunk = NULL;
     LPCSTR pDllName = NULL;
     PIMAGE_IMPORT_BY_NAME pImpByName = NULL;
+    size_t funcva = 0;
+    LPCSTR funcname = NULL;
 
-    for (; pImpDescriptor->Name; pImpDescriptor++) 
+    if(!pfnLoadLibraryA) pfnLoadLibraryA = (PFN_LoadLibraryA)winpe_findloadlibrarya();
+    if(!pfnGetProcAddress) pfnGetProcAddress = (PFN_GetProcAddress)winpe_findgetprocaddress();
+    WINPE_MEMRECORD_OF(mempe)->lazyctx = NULL;
+    if(flag & WINPE_BINDFLAG_LAZY)
     {
-        pDllName = (LPCSTR)((uint8_t*)mempe + pImpDescriptor->Name);
-        if(dllname && inl_stricmp(pDllName, dllname)!=0) continue;
-        pFtThunk = (PIMAGE_THUNK_DATA)((uint8_t*)mempe + pImpDescriptor->FirstThunk);
-        pOftThunk = (PIMAGE_THUNK_DATA)((uint8_t*)mempe + pImpDescriptor->OriginalFirstThunk);
+        return winpe_membindiatlazy(mempe, pfnLoadLibraryA, pfnGetProcAddress, flag);
+    }
+    if(!winpe_view_init(&view, mempe, 0, WINPE_VIEWFLAG_MEM)) return 0;
+    if(view.ptrsize != sizeof(size_t)) return 0; // can not bind the other bitness
 
-        for (int j=0; pFtThunk[j].u1.Function &&  pOftThunk[j].u1.Function; j++) 
+    DWORD iat_count = 0;
+    for (DWORD i=0; (pImpDescriptor = winpe_view_impdesc(&view, i)); i++) 
+    {
+        pDllName = winpe_view_str(&view, pImpDescriptor->Name);
+        if(!pDllName) return 0;
+        size_t dllbase = (size_t)pfnLoadLibraryA(pDllName);
+        if(!dllbase) return 0;
+
+        DWORD oft = pImpDescriptor->OriginalFirstThunk;
+        DWORD ft = pImpDescriptor->FirstThunk;
+        for (DWORD j=0; winpe_view_thunkt(&view, ft, j, sizeof(size_t)); j++) 
         {
-            pImpByName=(PIMAGE_IMPORT_BY_NAME)((uint8_t*)mempe + pOftThunk[j].u1.AddressOfData);
-            if((size_t)funcname < MAXWORD) // ordinary
+            uint64_t thunk = winpe_view_thunkt(&view, oft ? oft : ft, j, sizeof(size_t));
+            if(!thunk) break;
+            pImpByName = NULL;
+            if(thunk & IMAGE_ORDINAL_FLAG64) // by ordinal
             {
-                WORD funcord = LOWORD(funcname);
-                if(pImpByName->Hint == funcord) return &pFtThunk[j];
+                funcname = (LPCSTR)(size_t)(thunk & 0xffff);
             }
             else
             {
-                if(inl_stricmp(pImpByName->Name, funcname)==0) return &pFtThunk[j];
+                pImpByName = (PIMAGE_IMPORT_BY_NAME)winpe_view_ptr(&view, 
+                    (size_t)thunk, sizeof(IMAGE_IMPORT_BY_NAME));
+                if(!pImpByName || !winpe_view_str(&view, (size_t)thunk + sizeof(WORD))) continue;
+                funcname = pImpByName->Name;
             }
+
+            funcva = winpe_memfindimp(dllbase, funcname, pImpByName, 
+                pfnLoadLibraryA, pfnGetProcAddress, flag);
+            if(!funcva) continue;
+            pFtThunk = (PIMAGE_THUNK_DATA)winpe_view_ptr(&view, 
+                ft + (size_t)j * sizeof(size_t), sizeof(size_t));
+            pFtThunk->u1.Function = funcva;
+#ifdef _DEBUG
+            assert(funcva == (size_t)GetProcAddress((HMODULE)dllbase, funcname));
+#endif
+            iat_count++;
         }
     }
-    return 0;
+    return iat_count;
 }
 
-void* STDCALL winpe_memfindexp(void *mempe, LPCSTR funcname)
+size_t STDCALL winpe_membindtls(void *mempe, DWORD reason)
 {
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mempe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
-    PIMAGE_DATA_DIRECTORY pExpEntry =  &pDataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
-    PIMAGE_EXPORT_DIRECTORY  pExpDescriptor =  (PIMAGE_EXPORT_DIRECTORY)((uint8_t*)mempe + pExpEntry->VirtualAddress);
+    WINPE_VIEW view;
+    if(!winpe_view_init(&view, mempe, 0, WINPE_VIEWFLAG_MEM)) return 0;
 
-    WORD *ordrva = (WORD*)((uint8_t*)mempe + pExpDescriptor->AddressOfNameOrdinals);
-    DWORD *namerva = (DWORD*)((uint8_t*)mempe + pExpDescriptor->AddressOfNames);
-    DWORD *funcrva = (DWORD*)((uint8_t*)mempe + pExpDescriptor->AddressOfFunctions);
-    if((size_t)funcname <= MAXWORD) // find by ordnial
+    size_t tls_count = 0;
+    uint64_t cbva = 0;
+    while((cbva = winpe_view_tlscallback(&view, (DWORD)tls_count)))
     {
-        WORD ordbase = LOWORD(pExpDescriptor->Base) - 1;
-        WORD funcord = LOWORD(funcname);
-        return (void*)((uint8_t*)mempe + funcrva[ordrva[funcord-ordbase]]);
+        ((PIMAGE_TLS_CALLBACK)(size_t)cbva)(mempe, reason, NULL);
+        tls_count++;
     }
-    else
+    return tls_count;
+}
+#endif // _WIN32
+
+size_t STDCALL winpe_memlz4decode(const void *src, size_t srcsize, void *dst, size_t dstsize)
+{
+    const uint8_t *ip = (const uint8_t*)src;
+    const uint8_t *iend = ip + srcsize;
+    uint8_t *op = (uint8_t*)dst;
+    uint8_t *oend = op + dstsize;
+    while(ip < iend)
     {
-        for(DWORD i=0;i<pExpDescriptor->NumberOfNames;i++)
+        // literals, length by token high 4 bits and 0xff extension
+        size_t token = *ip++;
+        size_t litlen = token >> 4;
+        if(litlen == 15)
+        {
+            size_t b = 0;
+            do 
+            {
+                if(ip >= iend) return 0;
+                b = *ip++;
+                litlen += b;
+            } while(b == 255);
+        }
+        if(litlen > (size_t)(iend - ip) || litlen > (size_t)(oend - op)) return 0;
+        while(litlen >= sizeof(size_t))
+        {
+            *(size_t*)op = *(const size_t*)ip; // unaligned is fine on x86
+            op += sizeof(size_t); ip += sizeof(size_t); litlen -= sizeof(size_t);
+        }
+        while(litlen--) *op++ = *ip++;
+        if(ip >= iend) break; // the last sequence only has literals
+
+        // match, offset in 2 bytes, length by token low 4 bits + 4
+        if(iend - ip < 2) return 0;
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(!offset || offset > (size_t)(op - (uint8_t*)dst)) return 0;
+        size_t matchlen = token & 15;
+        if(matchlen == 15)
+        {
+            size_t b = 0;
+            do 
+            {
+                if(ip >= iend) return 0;
+                b = *ip++;
+                matchlen += b;
+            } while(b == 255);
+        }
+        matchlen += 4;
+        if(matchlen > (size_t)(oend - op)) return 0;
+        const uint8_t *match = op - offset;
+        if(offset >= sizeof(size_t))
         {
-            LPCSTR curname = (LPCSTR)((uint8_t*)mempe+namerva[i]);
-            if(inl_stricmp(curname, funcname)==0)
+            while(matchlen >= sizeof(size_t))
             {
-                return (void*)((uint8_t*)mempe + funcrva[ordrva[i]]);
-            }       
+                *(size_t*)op = *(const size_t*)match;
+                op += sizeof(size_t); match += sizeof(size_t); matchlen -= sizeof(size_t);
+            }
         }
+        while(matchlen--) *op++ = *match++; // overlapped copy for repeating pattern
     }
-    return NULL;
+    return op - (uint8_t*)dst;
+}
+
+
+void* STDCALL winpe_memfindiat(void *mempe, LPCSTR dllname, LPCSTR funcname)
+{
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return NULL;
+    DWORD iatrva = winpe_ctx_findiat(&ctx, dllname, funcname);
+    return iatrva ? (void*)((uint8_t*)mempe + iatrva) : NULL;
+}
+
+void* STDCALL winpe_memfindexp(void *mempe, LPCSTR funcname)
+{
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return NULL;
+    DWORD exprva = winpe_ctx_findexp(&ctx, funcname);
+    return exprva ? (void*)((uint8_t*)mempe + exprva) : NULL;
 }
 
 void* STDCALL winpe_memfindexpcrc32(void* mempe, uint32_t crc32)
 {
-    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)mempe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)mempe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
-    PIMAGE_DATA_DIRECTORY pExpEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
-    PIMAGE_EXPORT_DIRECTORY  pExpDescriptor =(PIMAGE_EXPORT_DIRECTORY)((uint8_t*)mempe + pExpEntry->VirtualAddress);
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return NULL;
+    DWORD exprva = winpe_ctx_findexpcrc32t(&ctx, crc32, winpe_crc32tab());
+    return exprva ? (void*)((uint8_t*)mempe + exprva) : NULL;
+}
+
+size_t STDCALL winpe_memexpcrc32index(void *mempe, 
+    PWINPE_EXPCRC32 index, size_t indexnum, DWORD flag)
+{
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return 0;
+    DWORD namenum = ctx.expdir ? ctx.expdir->NumberOfNames : 0;
+    if(!index) return namenum;
+    if(indexnum < namenum) return 0;
+
+    const uint32_t *crc32tab = (flag & WINPE_HASHFLAG_CRC32C) ? NULL : winpe_crc32tab();
+    for (DWORD i = 0; i < namenum; i++)
+    {
+        LPCSTR curname = NULL;
+        index[i].exprva = winpe_ctx_expname(&ctx, i, &curname);
+        if(!curname) curname = "";
+        size_t namelen = inl_strlen(curname);
+        if(flag & WINPE_HASHFLAG_CRC32C) index[i].crc32 = inl_crc32c(curname, namelen);
+        else index[i].crc32 = inl_crc32t(curname, namelen, crc32tab);
+    }
+
+    // shell sort by crc32, no crt qsort for shellcode
+    for(size_t gap = namenum / 2; gap > 0; gap /= 2)
+    {
+        for(size_t i = gap; i < namenum; i++)
+        {
+            WINPE_EXPCRC32 t = index[i];
+            size_t j = i;
+            for(; j >= gap && index[j-gap].crc32 > t.crc32; j -= gap) index[j] = index[j-gap];
+            index[j] = t;
+        }
+    }
+    return namenum;
+}
+
+void* STDCALL winpe_memfindexpcrc32index(void *mempe, 
+    const WINPE_EXPCRC32 *index, size_t indexnum, uint32_t crc32)
+{
+    size_t l = 0, r = indexnum;
+    while(l < r)
+    {
+        size_t m = l + (r - l) / 2;
+        if(index[m].crc32 < crc32) l = m + 1;
+        else r = m;
+    }
+    if(l < indexnum && index[l].crc32 == crc32) 
+    {
+        return (void*)((uint8_t*)mempe + index[l].exprva);
+    }
+    return NULL;
+}
+
+void* STDCALL winpe_memfindexphint(void *mempe, LPCSTR funcname, WORD hint)
+{
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return NULL;
+    DWORD exprva = winpe_ctx_findexphint(&ctx, funcname, hint);
+    return exprva ? (void*)((uint8_t*)mempe + exprva) : NULL;
+}
+
+size_t STDCALL winpe_memexpindex(void *mempe, void *buf, size_t bufsize)
+{
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return 0;
+    DWORD namenum = ctx.expdir ? ctx.expdir->NumberOfNames : 0;
+
+    // open addressing, keep the load factor under 0.5
+    DWORD slotnum = 1;
+    while(slotnum < namenum * 2) slotnum <<= 1;
+    size_t indexsize = sizeof(WINPE_EXPINDEX) + (slotnum - 1) * sizeof(WINPE_EXPSLOT);
+    if(!buf) return indexsize;
+    if(bufsize < indexsize) return 0;
+
+    PWINPE_EXPINDEX index = (PWINPE_EXPINDEX)buf;
+    index->mempe = mempe;
+    index->slotnum = slotnum;
+    index->namenum = namenum;
+    inl_memset(index->slots, 0, slotnum * sizeof(WINPE_EXPSLOT));
+    for(DWORD i=0; i < namenum; i++)
+    {
+        LPCSTR curname = NULL;
+        winpe_ctx_expname(&ctx, i, &curname);
+        if(!curname) continue;
+        uint32_t hash = inl_fnv1a32(curname, inl_strlen(curname));
+        DWORD j = hash & (slotnum - 1);
+        while(index->slots[j].nameidx) j = (j + 1) & (slotnum - 1);
+        index->slots[j].hash = hash;
+        index->slots[j].nameidx = i + 1;
+    }
+    return indexsize;
+}
 
-    WORD* ordrva = (WORD*)((uint8_t*)mempe + pExpDescriptor->AddressOfNameOrdinals);
-    DWORD* namerva = (DWORD*)((uint8_t*)mempe + pExpDescriptor->AddressOfNames);
-    DWORD* funcrva = (DWORD*)((uint8_t*)mempe + pExpDescriptor->AddressOfFunctions);
-    for (DWORD i = 0; i < pExpDescriptor->NumberOfNames; i++)
+void* STDCALL winpe_memfindexpindex(const void *index, LPCSTR funcname)
+{
+    const WINPE_EXPINDEX *pIndex = (const WINPE_EXPINDEX *)index;
+    void *mempe = pIndex->mempe;
+    if((size_t)funcname <= MAXWORD) return winpe_memfindexp(mempe, funcname);
+    
+    WINPE_CTX ctx;
+    if(!winpe_ctx_init(&ctx, mempe, 0, WINPE_VIEWFLAG_MEM)) return NULL;
+
+    uint32_t hash = inl_fnv1a32(funcname, inl_strlen(funcname));
+    DWORD j = hash & (pIndex->slotnum - 1);
+    while(pIndex->slots[j].nameidx)
     {
-        LPCSTR curname = (LPCSTR)((uint8_t*)mempe + namerva[i]);
-        if (crc32==inl_crc32(curname, inl_strlen(curname)))
+        if(pIndex->slots[j].hash == hash)
         {
-            return (void*)((uint8_t*)mempe + funcrva[ordrva[i]]);
+            LPCSTR curname = NULL;
+            DWORD exprva = winpe_ctx_expname(&ctx, pIndex->slots[j].nameidx - 1, &curname);
+            if(exprva && curname && inl_strcmp(curname, funcname)==0)
+            {
+                return (void*)((uint8_t*)mempe + exprva);
+            }
         }
+        j = (j + 1) & (pIndex->slotnum - 1);
     }
     return NULL;
 }
 
+#ifdef _WIN32
 void* STDCALL winpe_memforwardexp(void *mempe, size_t exprva, 
     PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress)
 {
-    // this function might have infinite loop
-    // kerenl32.dll, GetProcessMitigationPolicy -> api-ms-win-core-processthreads-l1-1-1.dll -> kerenl32.dll, GetProcessMitigationPolicys
+    return winpe_memforwardexpex(mempe, exprva, pfnLoadLibraryA, pfnGetProcAddress, NULL);
+}
+
+// read the slot by seq, NULL if empty, writing or not matched
+static void* winpe_fwdcache_get(PWINPE_FWDSLOT slot, uint32_t hash, size_t dllbase, size_t exprva)
+{
+    int32_t seq = slot->seq;
+    inl_fence();
+    uint32_t curhash = slot->hash;
+    size_t curbase = slot->dllbase;
+    size_t currva = slot->exprva;
+    void *va = slot->va;
+    inl_fence();
+    if((seq & 1) || seq != slot->seq) return NULL;
+    if(!curhash || curhash != hash || curbase != dllbase || currva != exprva) return NULL;
+    return va;
+}
+
+static void winpe_fwdcache_put(PWINPE_FWDCACHE cache, 
+    uint32_t hash, size_t dllbase, size_t exprva, void *va)
+{
+    // use the empty or same key slot in probe range, or replace the first slot
+    PWINPE_FWDSLOT target = &cache->slots[hash & (WINPE_FWDCACHE_SLOTNUM - 1)];
+    for(DWORD k=0; k < WINPE_FWDCACHE_MAXPROBE; k++)
+    {
+        PWINPE_FWDSLOT slot = &cache->slots[(hash + k) & (WINPE_FWDCACHE_SLOTNUM - 1)];
+        if(!slot->hash || (slot->dllbase == dllbase && slot->exprva == exprva))
+        {
+            target = slot;
+            break;
+        }
+    }
+    int32_t seq = target->seq;
+    if((seq & 1) || inl_cas32(&target->seq, seq + 1, seq) != seq) return; // other thread writing
+    target->hash = hash;
+    target->dllbase = dllbase;
+    target->exprva = exprva;
+    target->va = va;
+    inl_cas32(&target->seq, seq + 2, seq + 1);
+}
+
+void STDCALL winpe_memforwardexpflush(PWINPE_FWDCACHE cache, void *mempe)
+{
+    if(!cache) cache = &s_winpe_fwdcache;
+    size_t start = (size_t)mempe;
+    size_t end = start + winpe_imagesizeval(mempe, 0);
+    for(DWORD k=0; k < WINPE_FWDCACHE_SLOTNUM; k++)
+    {
+        PWINPE_FWDSLOT slot = &cache->slots[k];
+        int32_t seq = slot->seq;
+        if(!slot->hash || (seq & 1)) continue;
+        size_t va = (size_t)slot->va;
+        if(slot->dllbase != start && !(va >= start && va < end)) continue;
+        if(inl_cas32(&slot->seq, seq + 1, seq) != seq) continue;
+        slot->hash = 0;
+        inl_cas32(&slot->seq, seq + 2, seq + 1);
+    }
+}
+
+void* STDCALL winpe_memforwardexpex(void *mempe, size_t exprva, 
+    PFN_LoadLibraryA pfnLoadLibraryA, PFN_GetProcAddress pfnGetProcAddress, 
+    PWINPE_FWDCACHE cache)
+{
+    // kerenl32.dll, GetProcessMitigationPolicy -> api-ms-win-core-processthreads-l1-1-1.dll 
+    // -> kerenl32.dll, GetProcessMitigationPolicy, if api set not resolved by importer
     size_t dllbase = (size_t)mempe;
-    while (1)
+    size_t visited[WINPE_FWDMAXHOP][2]; // (dllbase, exprva) of forward, for loop detect
+    uint32_t hash = 0;
+    for(int hop=0; hop < WINPE_FWDMAXHOP; hop++)
     {
         PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)dllbase;
         PIMAGE_NT_HEADERS pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)dllbase + pDosHeader->e_lfanew);
         PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
         PIMAGE_DATA_DIRECTORY pDataDirectory = pOptHeader->DataDirectory;
         PIMAGE_DATA_DIRECTORY pExpEntry = &pDataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
-        if(exprva >= pExpEntry->VirtualAddress && exprva < pExpEntry->VirtualAddress + pExpEntry->Size)
+        if(!(exprva >= pExpEntry->VirtualAddress && exprva < pExpEntry->VirtualAddress + pExpEntry->Size))
+        {
+            void *expva = (void*)(dllbase + exprva);
+            if(hash) winpe_fwdcache_put(cache, hash, visited[0][0], visited[0][1], expva);
+            return expva;
+        }
+        for(int k=0; k < hop; k++)
+        {
+            if(visited[k][0]==dllbase && visited[k][1]==exprva) return NULL;
+        }
+        visited[hop][0] = dllbase;
+        visited[hop][1] = exprva;
+        
+        // find the first forward exp in cache, the api set host depends on exp dir name
+        char *fwdname = (char*)(dllbase + exprva);
+        PIMAGE_EXPORT_DIRECTORY pExpDescriptor = (PIMAGE_EXPORT_DIRECTORY)
+            ((uint8_t*)dllbase + pExpEntry->VirtualAddress);
+        const char *importer = (const char*)(dllbase + pExpDescriptor->Name);
+        if(cache && hop==0)
+        {
+            hash = inl_fnv1a32(fwdname, inl_strlen(fwdname));
+            for(const char *p = importer; *p; p++) hash = (hash ^ (uint8_t)*p) * 0x01000193;
+            if(!hash) hash = 1;
+            for(DWORD k=0; k < WINPE_FWDCACHE_MAXPROBE; k++)
+            {
+                PWINPE_FWDSLOT slot = &cache->slots[(hash + k) & (WINPE_FWDCACHE_SLOTNUM - 1)];
+                void *va = winpe_fwdcache_get(slot, hash, dllbase, exprva);
+                if(va) return va;
+            }
+        }
+
+        // make dllname with .dll and funcname 
+        char namebuf[MAX_PATH];
+        char hostbuf[MAX_PATH];
+        char *dllname = namebuf;
+        char *funcname = NULL;
+        int i=0, j=0;
+        while(fwdname[i]!=0)
+        {
+            if(j >= MAX_PATH - 5) return NULL;
+            if(fwdname[i]=='.' && !funcname)
+            {
+                namebuf[j] = fwdname[i];
+                namebuf[++j] = 'd';
+                namebuf[++j] = 'l';
+                namebuf[++j] = 'l';
+                namebuf[++j] = '\0';
+                funcname = namebuf + j + 1;
+            }
+            else
+            {
+                namebuf[j] = fwdname[i];
+            }
+            i++;
+            j++;
+        }
+        namebuf[j] = '\0';
+        if(!funcname) return NULL;
+        //printf("[winpe_memforwardexp] dllname=%s funcname=%s\n", dllname, funcname);
+
+        // api set, api-ms-win-xxx or ext-ms-win-xxx
+        if((dllname[0]=='a' || dllname[0]=='A' || dllname[0]=='e' || dllname[0]=='E') 
+            && (dllname[3]=='-'))
+        {
+            if(winpe_findapiseta(dllname, importer, hostbuf, sizeof(hostbuf))) dllname = hostbuf;
+        }
+
+        dllbase = (size_t)pfnLoadLibraryA(dllname);
+        if(!dllbase) return NULL;
+        size_t expva = (size_t)pfnGetProcAddress((HMODULE)dllbase, funcname);
+        if(!expva) return NULL;
+        exprva = expva - dllbase;
+    }
+    return NULL;
+}
+
+size_t STDCALL winpe_findapiseta(const char *apisetname, const char *importer, 
+    char *hostname, size_t hostsize)
+{
+    typedef struct _API_SET_NAMESPACE
+    {
+        ULONG Version; // 6 for win10
+        ULONG Size;
+        ULONG Flags;
+        ULONG Count;
+        ULONG EntryOffset;
+        ULONG HashOffset;
+        ULONG HashFactor;
+    } API_SET_NAMESPACE, *PAPI_SET_NAMESPACE;
+
+    typedef struct _API_SET_NAMESPACE_ENTRY
+    {
+        ULONG Flags;
+        ULONG NameOffset;
+        ULONG NameLength;
+        ULONG HashedLength; // name length without the last -N
+        ULONG ValueOffset;
+        ULONG ValueCount;
+    } API_SET_NAMESPACE_ENTRY, *PAPI_SET_NAMESPACE_ENTRY;
+
+    typedef struct _API_SET_VALUE_ENTRY
+    {
+        ULONG Flags;
+        ULONG NameOffset; // importer name, empty for default
+        ULONG NameLength;
+        ULONG ValueOffset; // host name
+        ULONG ValueLength;
+    } API_SET_VALUE_ENTRY, *PAPI_SET_VALUE_ENTRY;
+
+    PTEB teb = NtCurrentTeb();
+#ifdef _WIN64
+    PPEB peb = *(PPEB*)((uint8_t*)teb + 0x60);
+    PAPI_SET_NAMESPACE apiset = *(PAPI_SET_NAMESPACE*)((uint8_t*)peb + 0x68);
+#else
+    PPEB peb = *(PPEB*)((uint8_t*)teb + 0x30);
+    PAPI_SET_NAMESPACE apiset = *(PAPI_SET_NAMESPACE*)((uint8_t*)peb + 0x38);
+#endif
+    if(!apiset || apiset->Version != 6) return 0;
+
+    // compare the name without the last -N and .dll
+    size_t namelen = inl_strlen(apisetname);
+    if(namelen > 4 && inl_stricmp(apisetname + namelen - 4, ".dll")==0) namelen -= 4;
+    size_t hashedlen = namelen;
+    while(hashedlen > 0 && apisetname[hashedlen-1]!='-') hashedlen--;
+    if(!hashedlen) return 0;
+    hashedlen--;
+
+    PAPI_SET_NAMESPACE_ENTRY pEntry = (PAPI_SET_NAMESPACE_ENTRY)((uint8_t*)apiset + apiset->EntryOffset);
+    for(ULONG i=0; i < apiset->Count; i++)
+    {
+        if(pEntry[i].HashedLength / sizeof(wchar_t) != hashedlen) continue;
+        const wchar_t *entryname = (const wchar_t*)((uint8_t*)apiset + pEntry[i].NameOffset);
+        size_t k = 0;
+        for(; k < hashedlen; k++)
+        {
+            wchar_t c = (wchar_t)(uint8_t)apisetname[k];
+            if(c >= L'A' && c <= L'Z') c += 0x20;
+            if(c != entryname[k]) break;
+        }
+        if(k < hashedlen) continue;
+        if(!pEntry[i].ValueCount) return 0;
+
+        // the first value is default, others are for specific importer
+        PAPI_SET_VALUE_ENTRY pValue = (PAPI_SET_VALUE_ENTRY)((uint8_t*)apiset + pEntry[i].ValueOffset);
+        PAPI_SET_VALUE_ENTRY pTarget = &pValue[0];
+        size_t importerlen = importer ? inl_strlen(importer) : 0;
+        for(ULONG v=1; v < pEntry[i].ValueCount && importerlen; v++)
         {
-            char namebuf[MAX_PATH];
-            char *dllname = (char*)(dllbase + exprva);
-            char *funcname = dllname;
-            //printf("[winpe_memforwardexp] dllname=%s funcname=%s\n", dllname, funcname);
-            int i=0, j=0;
-            while(dllname[i]!=0)
+            const wchar_t *valuename = (const wchar_t*)((uint8_t*)apiset + pValue[v].NameOffset);
+            if(pValue[v].NameLength / sizeof(wchar_t) != importerlen) continue;
+            for(k=0; k < importerlen; k++)
             {
-                if(dllname[i]=='.')
-                {
-                    namebuf[j] = dllname[i];
-                    namebuf[++j] = 'd';
-                    namebuf[++j] = 'l';
-                    namebuf[++j] = 'l';
-                    namebuf[++j] = '\0';
-                    funcname = namebuf + j + 1;
-                }
-                else
-                {
-                    namebuf[j] = dllname[i];
-                }
-                i++;
-                j++;
+                wchar_t c1 = (wchar_t)(uint8_t)importer[k], c2 = valuename[k];
+                if(c1 >= L'A' && c1 <= L'Z') c1 += 0x20;
+                if(c2 >= L'A' && c2 <= L'Z') c2 += 0x20;
+                if(c1 != c2) break;
             }
-            namebuf[j] = '\0';
-            dllname = namebuf;
-            dllbase = (size_t)pfnLoadLibraryA(dllname);
-            size_t expva = (size_t)pfnGetProcAddress((HMODULE)dllbase, funcname);
-            exprva = expva - dllbase;
+            if(k == importerlen) pTarget = &pValue[v];
         }
-        else
-        {
-            return (void*)(dllbase + exprva);
-        } 
+        
+        size_t hostlen = pTarget->ValueLength / sizeof(wchar_t);
+        const wchar_t *host = (const wchar_t*)((uint8_t*)apiset + pTarget->ValueOffset);
+        if(!hostlen || hostlen + 1 > hostsize) return 0;
+        for(k=0; k < hostlen; k++) hostname[k] = (char)host[k];
+        hostname[hostlen] = '\0';
+        return hostlen;
     }
-    return NULL;
+    return 0;
 }
 
+#endif // _WIN32
+
 // PE setting function
+// the fields except ImageBase, stack and heap sizes have the same offset in pe32 and pe32+,
+// so use PIMAGE_OPTIONAL_HEADER32 for both rather than the native one
 void STDCALL winpe_noaslr(void *pe)
 {
     PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)pe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)pe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
+    PIMAGE_NT_HEADERS32 pNtHeader = (PIMAGE_NT_HEADERS32)((uint8_t*)pe + pDosHeader->e_lfanew);
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = &pNtHeader->OptionalHeader;
     #ifndef IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE
     #define IMAGE_DLLCHARACTERISTICS_DYNAMIC_BASE 0x0040
     #endif
@@ -980,9 +4143,8 @@ void STDCALL winpe_noaslr(void *pe)
 DWORD STDCALL winpe_oepval(void *pe, DWORD newoeprva)
 {
     PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)pe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)pe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
+    PIMAGE_NT_HEADERS32 pNtHeader = (PIMAGE_NT_HEADERS32)((uint8_t*)pe + pDosHeader->e_lfanew);
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = &pNtHeader->OptionalHeader;
     DWORD orgoep = pOptHeader->AddressOfEntryPoint;
     if(newoeprva) pOptHeader->AddressOfEntryPoint = newoeprva;
     return orgoep;
@@ -991,20 +4153,27 @@ DWORD STDCALL winpe_oepval(void *pe, DWORD newoeprva)
 size_t STDCALL winpe_imagebaseval(void *pe, size_t newimagebase)
 {
     PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)pe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)pe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
-    size_t imagebase = pOptHeader->ImageBase;
-    if(newimagebase) pOptHeader->ImageBase = newimagebase;
+    PIMAGE_NT_HEADERS32 pNtHeader32 = (PIMAGE_NT_HEADERS32)((uint8_t*)pe + pDosHeader->e_lfanew);
+    PIMAGE_NT_HEADERS64 pNtHeader64 = (PIMAGE_NT_HEADERS64)pNtHeader32;
+    size_t imagebase = 0;
+    if(pNtHeader32->OptionalHeader.Magic == IMAGE_NT_OPTIONAL_HDR64_MAGIC)
+    {
+        imagebase = (size_t)pNtHeader64->OptionalHeader.ImageBase;
+        if(newimagebase) pNtHeader64->OptionalHeader.ImageBase = newimagebase;
+    }
+    else
+    {
+        imagebase = pNtHeader32->OptionalHeader.ImageBase;
+        if(newimagebase) pNtHeader32->OptionalHeader.ImageBase = (DWORD)newimagebase;
+    }
     return imagebase; 
 }
 
 size_t STDCALL winpe_imagesizeval(void *pe, size_t newimagesize)
 {
     PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)pe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)pe + pDosHeader->e_lfanew);
-    PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
+    PIMAGE_NT_HEADERS32 pNtHeader = (PIMAGE_NT_HEADERS32)((uint8_t*)pe + pDosHeader->e_lfanew);
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = &pNtHeader->OptionalHeader;
     size_t imagesize = pOptHeader->SizeOfImage;
     if(newimagesize) pOptHeader->SizeOfImage = (DWORD)newimagesize;
     return imagesize; 
@@ -1013,9 +4182,9 @@ size_t STDCALL winpe_imagesizeval(void *pe, size_t newimagesize)
 size_t STDCALL winpe_appendsecth(void *pe, PIMAGE_SECTION_HEADER psecth)
 {
     PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)pe;
-    PIMAGE_NT_HEADERS  pNtHeader = (PIMAGE_NT_HEADERS)((uint8_t*)pe + pDosHeader->e_lfanew);
+    PIMAGE_NT_HEADERS32 pNtHeader = (PIMAGE_NT_HEADERS32)((uint8_t*)pe + pDosHeader->e_lfanew);
     PIMAGE_FILE_HEADER pFileHeader = &pNtHeader->FileHeader;
-    PIMAGE_OPTIONAL_HEADER pOptHeader = &pNtHeader->OptionalHeader;
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = &pNtHeader->OptionalHeader;
     PIMAGE_SECTION_HEADER pSectHeader = (PIMAGE_SECTION_HEADER)((uint8_t*)pOptHeader + pFileHeader->SizeOfOptionalHeader);
     WORD sectNum = pFileHeader->NumberOfSections;
     PIMAGE_SECTION_HEADER pLastSectHeader = &pSectHeader[sectNum-1];
@@ -1046,6 +4215,825 @@ size_t STDCALL winpe_appendsecth(void *pe, PIMAGE_SECTION_HEADER psecth)
     return pOptHeader->SizeOfImage;
 }
 
+// PE checksum functions
+static INLINE uint32_t winpe_checksum_fold(uint64_t sum)
+{
+    while(sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+    return (uint32_t)sum;
+}
+
+static uint32_t winpe_checksum_sum(const void *data, size_t size, size_t offset)
+{
+    // 2^16 = 1 (mod 0xffff), so add 32 bit words in 64 bit, then fold to 16 bits
+    const uint8_t *p = (const uint8_t*)data;
+    uint64_t sum = 0;
+#ifdef WINPE_USE_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc1 = zero, acc2 = zero;
+    for(; size >= 32; size -= 32, p += 32)
+    {
+        __m128i v1 = _mm_loadu_si128((const __m128i*)p);
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(p + 16));
+        acc1 = _mm_add_epi64(acc1, _mm_unpacklo_epi32(v1, zero));
+        acc2 = _mm_add_epi64(acc2, _mm_unpackhi_epi32(v1, zero));
+        acc1 = _mm_add_epi64(acc1, _mm_unpacklo_epi32(v2, zero));
+        acc2 = _mm_add_epi64(acc2, _mm_unpackhi_epi32(v2, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, _mm_add_epi64(acc1, acc2));
+    sum = (uint64_t)winpe_checksum_fold(lanes[0]) + winpe_checksum_fold(lanes[1]);
+#endif
+    for(; size >= 4; size -= 4, p += 4) sum += *(const uint32_t*)p;
+    if(size >= 2)
+    {
+        sum += *(const uint16_t*)p;
+        size -= 2; p += 2;
+    }
+    if(size) sum += *p; // the last odd byte with zero padding
+    uint32_t sum16 = winpe_checksum_fold(sum);
+    if(offset & 1) sum16 = ((sum16 << 8) | (sum16 >> 8)) & 0xffff; // bytes are swapped at odd offset
+    return sum16;
+}
+
+static INLINE DWORD winpe_checksum_final(uint32_t sum16, DWORD headersum, size_t filesize)
+{
+    // subtract the CheckSum field, the same as CheckSumMappedFile
+    if(sum16 >= LOWORD(headersum)) sum16 -= LOWORD(headersum);
+    else sum16 = ((sum16 - LOWORD(headersum)) & 0xffff) - 1;
+    if(sum16 >= HIWORD(headersum)) sum16 -= HIWORD(headersum);
+    else sum16 = ((sum16 - HIWORD(headersum)) & 0xffff) - 1;
+    return (DWORD)(sum16 + filesize);
+}
+
+DWORD STDCALL winpe_checksumval(void *pe, DWORD newchecksum)
+{
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)pe;
+    PIMAGE_NT_HEADERS32 pNtHeader = (PIMAGE_NT_HEADERS32)((uint8_t*)pe + pDosHeader->e_lfanew);
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = &pNtHeader->OptionalHeader;
+    DWORD checksum = pOptHeader->CheckSum;
+    if(newchecksum) pOptHeader->CheckSum = newchecksum;
+    return checksum;
+}
+
+DWORD STDCALL winpe_checksum(const void *rawpe, size_t filesize)
+{
+    // only the CheckSum field is needed, the same offset in pe32 and pe32+
+    PIMAGE_DOS_HEADER pDosHeader = (PIMAGE_DOS_HEADER)rawpe;
+    size_t csoffset = (size_t)pDosHeader->e_lfanew + FIELD_OFFSET(IMAGE_NT_HEADERS32, OptionalHeader.CheckSum);
+    if(filesize < sizeof(IMAGE_DOS_HEADER) || pDosHeader->e_magic != IMAGE_DOS_SIGNATURE) return 0;
+    if(pDosHeader->e_lfanew <= 0 || csoffset + sizeof(DWORD) > filesize) return 0;
+    if(*(const DWORD*)((const uint8_t*)rawpe + pDosHeader->e_lfanew) != IMAGE_NT_SIGNATURE) return 0;
+    DWORD headersum = *(const DWORD*)((const uint8_t*)rawpe + csoffset);
+    return winpe_checksum_final(winpe_checksum_sum(rawpe, filesize, 0), headersum, filesize);
+}
+
+DWORD STDCALL winpe_checksum_update(DWORD checksum, size_t oldfilesize, size_t newfilesize,
+    size_t offset, const void *olddata, const void *newdata, size_t size)
+{
+    // restore the whole file sum with the CheckSum field, then replace the range
+    uint32_t sum16 = (uint32_t)(checksum - oldfilesize) & 0xffff;
+    sum16 = winpe_checksum_fold((uint64_t)sum16 + LOWORD(checksum) + HIWORD(checksum));
+    if(olddata) sum16 = winpe_checksum_fold((uint64_t)sum16 + 
+        (~winpe_checksum_sum(olddata, size, offset) & 0xffff));
+    if(newdata) sum16 = winpe_checksum_fold((uint64_t)sum16 + 
+        winpe_checksum_sum(newdata, size, offset));
+    return winpe_checksum_final(sum16, checksum, newfilesize);
+}
+
+// PE rewriting functions
+#define WINPE_REWRITE_ALIGN(x, align) (((uint64_t)(x) + (align) - 1) & ~((uint64_t)(align) - 1))
+
+typedef struct _WINPE_REWRITEOUT
+{
+    const WINPE_REWRITER *rw;
+    PFN_WINPE_WRITE pfnwrite; // NULL for summing the checksum
+    void *arg;
+    uint64_t offset;
+    DWORD patchidx;
+    uint32_t sum16;
+}WINPE_REWRITEOUT, *PWINPE_REWRITEOUT;
+
+static bool_t winpe_rewrite_emit(PWINPE_REWRITEOUT out, const uint8_t *data, size_t size)
+{
+    // data NULL for zeros
+    static const uint8_t zeros[0x1000] = {0};
+    if(!out->pfnwrite)
+    {
+        if(data) out->sum16 = winpe_checksum_fold((uint64_t)out->sum16 + 
+            winpe_checksum_sum(data, size, (size_t)out->offset));
+        out->offset += size;
+        return TRUE;
+    }
+    while(size)
+    {
+        size_t n = size > sizeof(zeros) && !data ? sizeof(zeros) : size;
+        if(out->pfnwrite(out->arg, data ? data : zeros, n) != n) return FALSE;
+        out->offset += n;
+        size -= n;
+        if(data) data += n;
+    }
+    return TRUE;
+}
+
+static bool_t winpe_rewrite_put(PWINPE_REWRITEOUT out, const void *data, size_t size)
+{
+    // split the range at patches, data NULL for zeros
+    const WINPE_REWRITER *rw = out->rw;
+    const uint8_t *p = (const uint8_t*)data;
+    while(size)
+    {
+        size_t n = size;
+        const uint8_t *src = p;
+        while(out->patchidx < rw->patchnum && 
+            (uint64_t)rw->patches[out->patchidx].offset + sizeof(DWORD) <= out->offset) out->patchidx++;
+        if(out->patchidx < rw->patchnum)
+        {
+            const WINPE_REWRITEPATCH *patch = &rw->patches[out->patchidx];
+            if(patch->offset > out->offset)
+            {
+                if(n > patch->offset - out->offset) n = (size_t)(patch->offset - out->offset);
+            }
+            else 
+            {
+                size_t k = (size_t)(out->offset - patch->offset);
+                if(n > sizeof(DWORD) - k) n = sizeof(DWORD) - k;
+                src = (const uint8_t*)&patch->value + k;
+                if(k + n == sizeof(DWORD)) out->patchidx++;
+            }
+        }
+        if(!winpe_rewrite_emit(out, src, n)) return FALSE;
+        size -= n;
+        if(p) p += n;
+    }
+    return TRUE;
+}
+
+static bool_t winpe_rewrite_pad(PWINPE_REWRITEOUT out, uint64_t offset)
+{
+    if(offset < out->offset) return FALSE;
+    return winpe_rewrite_put(out, NULL, (size_t)(offset - out->offset));
+}
+
+static size_t winpe_rewrite_stream(PWINPE_REWRITEOUT out)
+{
+    // headers | sections in raw order | overlay, the same walk for checksum and write
+    const WINPE_REWRITER *rw = out->rw;
+    const WINPE_VIEW *view = &rw->view;
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = (PIMAGE_OPTIONAL_HEADER32)(rw->header + 
+        ((const uint8_t*)view->opthdr - view->base));
+    if(!winpe_rewrite_put(out, rw->header, pOptHeader->SizeOfHeaders)) return 0;
+    for(WORD i=0; i<rw->rawnum; i++)
+    {
+        const WINPE_REWRITESECT *sect = &rw->sects[rw->raworder[i]];
+        const IMAGE_SECTION_HEADER *pSectHeader = &sect->secthdr;
+        if(!winpe_rewrite_pad(out, pSectHeader->PointerToRawData)) return 0;
+        const void *data = sect->data;
+        size_t size = sect->datasize;
+        if(!data)
+        {
+            // the source range might be truncated
+            data = view->base + sect->orgoffset;
+            size = sect->orgoffset < view->size ? view->size - sect->orgoffset : 0;
+            if(size > sect->orgsize) size = sect->orgsize;
+        }
+        if(size > pSectHeader->SizeOfRawData) size = pSectHeader->SizeOfRawData;
+        if(!winpe_rewrite_put(out, data, size)) return 0;
+        if(!winpe_rewrite_pad(out, (uint64_t)pSectHeader->PointerToRawData + pSectHeader->SizeOfRawData)) return 0;
+    }
+    if(rw->overlaysize)
+    {
+        if(!winpe_rewrite_pad(out, rw->newoverlayoffset)) return 0;
+        if(!winpe_rewrite_put(out, view->base + rw->overlayoffset, rw->overlaysize)) return 0;
+    }
+    if(!winpe_rewrite_pad(out, rw->filesize)) return 0;
+    return (size_t)out->offset;
+}
+
+static DWORD winpe_rewrite_mapoffset(const WINPE_REWRITER *rw, DWORD offset)
+{
+    // source file offset to output, 0 if in replaced sections
+    if(offset < rw->view.headersize) return offset;
+    for(WORD i=0; i<rw->view.sectnum; i++)
+    {
+        const WINPE_REWRITESECT *sect = &rw->sects[i];
+        if(sect->data || !sect->orgsize) continue;
+        if(offset >= sect->orgoffset && offset - sect->orgoffset < sect->orgsize)
+        {
+            return sect->secthdr.PointerToRawData + (offset - sect->orgoffset);
+        }
+    }
+    if(offset >= rw->overlayoffset) return rw->newoverlayoffset + (offset - rw->overlayoffset);
+    return 0;
+}
+
+bool_t STDCALL winpe_rewrite_init(PWINPE_REWRITER rw, const void *rawpe, size_t size)
+{
+    inl_memset(rw, 0, sizeof(WINPE_REWRITER));
+    if(!size || size > 0xffffffff || !winpe_view_init(&rw->view, rawpe, size, 0)) return FALSE;
+    const WINPE_VIEW *view = &rw->view;
+    if(view->sectnum > WINPE_REWRITE_MAXSECT || view->headersize > size) return FALSE;
+    
+    // the fields used here are at the same offset in pe32 and pe32+
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = (PIMAGE_OPTIONAL_HEADER32)view->opthdr;
+    DWORD filealign = pOptHeader->FileAlignment, sectalign = pOptHeader->SectionAlignment;
+    if(!filealign || (filealign & (filealign - 1))) return FALSE;
+    if(!sectalign || (sectalign & (sectalign - 1)) || sectalign < filealign) return FALSE;
+    rw->entry = pOptHeader->AddressOfEntryPoint;
+    rw->filechar = view->filehdr->Characteristics;
+    rw->dllchar = pOptHeader->DllCharacteristics;
+    rw->headersize = view->headersize;
+    rw->checksum = pOptHeader->CheckSum;
+    inl_memcpy(rw->datadir, view->datadir, view->dirnum * sizeof(IMAGE_DATA_DIRECTORY));
+
+    // the overlay is after all the raw sections
+    uint64_t overlayoffset = view->headersize;
+    rw->sectnum = view->sectnum;
+    for(WORD i=0; i<view->sectnum; i++)
+    {
+        PWINPE_REWRITESECT sect = &rw->sects[i];
+        inl_memcpy(&sect->secthdr, &view->secthdr[i], sizeof(IMAGE_SECTION_HEADER));
+        sect->orgsize = view->secthdr[i].SizeOfRawData;
+        sect->orgoffset = sect->orgsize ? view->secthdr[i].PointerToRawData : 0;
+        uint64_t sectend = (uint64_t)sect->orgoffset + sect->orgsize;
+        if(sectend > overlayoffset) overlayoffset = sectend;
+    }
+    if(overlayoffset < size)
+    {
+        rw->overlayoffset = (DWORD)overlayoffset;
+        rw->overlaysize = (DWORD)(size - overlayoffset);
+    }
+    else rw->overlayoffset = (DWORD)size;
+    return TRUE;
+}
+
+int STDCALL winpe_rewrite_addsect(PWINPE_REWRITER rw, LPCSTR name, 
+    const void *data, DWORD datasize, DWORD virtualsize, DWORD characteristics)
+{
+    if(rw->sectnum >= WINPE_REWRITE_MAXSECT) return -1;
+    PWINPE_REWRITESECT sect = &rw->sects[rw->sectnum];
+    inl_memset(sect, 0, sizeof(WINPE_REWRITESECT));
+    for(int i=0; name && name[i] && i<IMAGE_SIZEOF_SHORT_NAME; i++) sect->secthdr.Name[i] = (BYTE)name[i];
+    sect->secthdr.Misc.VirtualSize = virtualsize > datasize ? virtualsize : datasize;
+    sect->secthdr.Characteristics = characteristics;
+    sect->data = data;
+    sect->datasize = data ? datasize : 0;
+    return rw->sectnum++;
+}
+
+bool_t STDCALL winpe_rewrite_setsect(PWINPE_REWRITER rw, WORD index, const void *data, DWORD datasize)
+{
+    if(index >= rw->sectnum || !data) return FALSE;
+    PWINPE_REWRITESECT sect = &rw->sects[index];
+    sect->data = data;
+    sect->datasize = datasize;
+    if(sect->secthdr.Misc.VirtualSize < datasize) sect->secthdr.Misc.VirtualSize = datasize;
+    return TRUE;
+}
+
+size_t STDCALL winpe_rewrite_layout(PWINPE_REWRITER rw)
+{
+    const WINPE_VIEW *view = &rw->view;
+    const uint8_t *base = view->base;
+    PIMAGE_OPTIONAL_HEADER32 pOptHeader = (PIMAGE_OPTIONAL_HEADER32)view->opthdr;
+    DWORD filealign = pOptHeader->FileAlignment, sectalign = pOptHeader->SectionAlignment;
+    WORD orgnum = view->sectnum;
+    rw->filesize = 0;
+    rw->patchnum = 0;
+
+    // grow the headers for the section table, must be under the first section in memory
+    DWORD sectoffset = (DWORD)((const uint8_t*)view->secthdr - base);
+    uint64_t tableend = sectoffset + (uint64_t)rw->sectnum * sizeof(IMAGE_SECTION_HEADER);
+    uint64_t headersize = WINPE_REWRITE_ALIGN(rw->headersize > tableend ? rw->headersize : tableend, filealign);
+    if(headersize < view->headersize) headersize = view->headersize;
+    if(headersize > view->headersize)
+    {
+        uint64_t firstva = WINPE_REWRITE_ALIGN(view->imagesize, sectalign);
+        for(WORD i=0; i<orgnum; i++)
+        {
+            if(rw->sects[i].secthdr.VirtualAddress < firstva) firstva = rw->sects[i].secthdr.VirtualAddress;
+        }
+        if(WINPE_REWRITE_ALIGN(headersize, sectalign) > firstva) return 0;
+    }
+
+    // the replaced sections should not overlap the next in memory
+    uint64_t vaend = WINPE_REWRITE_ALIGN(headersize, sectalign);
+    for(WORD i=0; i<orgnum; i++)
+    {
+        const IMAGE_SECTION_HEADER *pSectHeader = &rw->sects[i].secthdr;
+        DWORD vsize = pSectHeader->Misc.VirtualSize ? pSectHeader->Misc.VirtualSize : pSectHeader->SizeOfRawData;
+        uint64_t sectend = (uint64_t)pSectHeader->VirtualAddress + vsize;
+        if(rw->sects[i].data)
+        {
+            for(WORD j=0; j<orgnum; j++)
+            {
+                DWORD va = rw->sects[j].secthdr.VirtualAddress;
+                if(va > pSectHeader->VirtualAddress && va < sectend) return 0;
+            }
+        }
+        if(sectend > vaend) vaend = sectend;
+    }
+
+    // the added sections are after the last in memory
+    for(WORD i=orgnum; i<rw->sectnum; i++)
+    {
+        PIMAGE_SECTION_HEADER pSectHeader = &rw->sects[i].secthdr;
+        vaend = WINPE_REWRITE_ALIGN(vaend, sectalign);
+        pSectHeader->VirtualAddress = (DWORD)vaend;
+        vaend += pSectHeader->Misc.VirtualSize ? pSectHeader->Misc.VirtualSize : 1;
+    }
+    uint64_t imagesize = WINPE_REWRITE_ALIGN(vaend, sectalign);
+    if(imagesize < view->imagesize) imagesize = view->imagesize; // some linkers reserve more
+    if(imagesize > 0xffffffff) return 0;
+
+    // sort the raw sections by source offset, added ones are the last
+    rw->rawnum = 0;
+    for(WORD i=0; i<rw->sectnum; i++)
+    {
+        const WINPE_REWRITESECT *sect = &rw->sects[i];
+        DWORD rawsize = sect->data ? sect->datasize : sect->orgsize;
+        if(!rawsize) 
+        {
+            rw->sects[i].secthdr.PointerToRawData = 0;
+            rw->sects[i].secthdr.SizeOfRawData = 0;
+            continue;
+        }
+        WORD j = rw->rawnum++;
+        uint64_t key = i < orgnum && !sect->data ? sect->orgoffset : (uint64_t)-1;
+        for(; j>0; j--)
+        {
+            const WINPE_REWRITESECT *prev = &rw->sects[rw->raworder[j-1]];
+            uint64_t prevkey = rw->raworder[j-1] < orgnum && !prev->data ? prev->orgoffset : (uint64_t)-1;
+            if(prevkey <= key) break;
+            rw->raworder[j] = rw->raworder[j-1];
+        }
+        rw->raworder[j] = i;
+    }
+
+    // keep the source offsets if possible, else shift by file alignment
+    uint64_t cursor = headersize;
+    for(WORD i=0; i<rw->rawnum; i++)
+    {
+        WORD idx = rw->raworder[i];
+        PWINPE_REWRITESECT sect = &rw->sects[idx];
+        uint64_t offset = WINPE_REWRITE_ALIGN(cursor, filealign);
+        uint64_t rawsize = sect->orgsize;
+        if(sect->data) rawsize = WINPE_REWRITE_ALIGN(sect->datasize, filealign);
+        else if(sect->orgoffset >= cursor) offset = sect->orgoffset;
+        else offset = sect->orgoffset + WINPE_REWRITE_ALIGN(cursor - sect->orgoffset, filealign);
+        sect->secthdr.PointerToRawData = (DWORD)offset;
+        sect->secthdr.SizeOfRawData = (DWORD)rawsize;
+        cursor = offset + rawsize;
+    }
+    uint64_t overlayoffset = cursor;
+    if(rw->overlaysize)
+    {
+        // keep the certificate table 8 bytes aligned
+        overlayoffset = rw->overlayoffset;
+        if(overlayoffset < cursor) overlayoffset += WINPE_REWRITE_ALIGN(cursor - overlayoffset, 8);
+    }
+    uint64_t filesize = overlayoffset + rw->overlaysize;
+    if(filesize > 0xffffffff) return 0;
+    rw->newoverlayoffset = (DWORD)overlayoffset;
+    rw->filesize = (DWORD)filesize;
+
+    // build the output headers from source
+    if(rw->header) free(rw->header);
+    rw->header = (uint8_t*)malloc((size_t)headersize);
+    if(!rw->header) 
+    {
+        rw->filesize = 0;
+        return 0;
+    }
+    size_t copysize = view->headersize < view->size ? view->headersize : view->size;
+    inl_memset(rw->header, 0, (size_t)headersize);
+    inl_memcpy(rw->header, base, copysize);
+    PIMAGE_FILE_HEADER pFileHeader = (PIMAGE_FILE_HEADER)(rw->header + ((const uint8_t*)view->filehdr - base));
+    PIMAGE_OPTIONAL_HEADER32 pNewOptHeader = (PIMAGE_OPTIONAL_HEADER32)(rw->header + ((const uint8_t*)view->opthdr - base));
+    PIMAGE_DATA_DIRECTORY pDataDir = (PIMAGE_DATA_DIRECTORY)(rw->header + ((const uint8_t*)view->datadir - base));
+    PIMAGE_SECTION_HEADER pSectHeader = (PIMAGE_SECTION_HEADER)(rw->header + sectoffset);
+    for(WORD i=0; i<rw->sectnum; i++)
+    {
+        inl_memcpy(&pSectHeader[i], &rw->sects[i].secthdr, sizeof(IMAGE_SECTION_HEADER));
+    }
+    pFileHeader->NumberOfSections = rw->sectnum;
+    pFileHeader->Characteristics = rw->filechar;
+    if(pFileHeader->PointerToSymbolTable) 
+    {
+        pFileHeader->PointerToSymbolTable = winpe_rewrite_mapoffset(rw, pFileHeader->PointerToSymbolTable);
+    }
+    pNewOptHeader->AddressOfEntryPoint = rw->entry;
+    pNewOptHeader->DllCharacteristics = rw->dllchar;
+    pNewOptHeader->SizeOfHeaders = (DWORD)headersize;
+    pNewOptHeader->SizeOfImage = (DWORD)imagesize;
+    pNewOptHeader->CheckSum = 0;
+    inl_memcpy(pDataDir, rw->datadir, view->dirnum * sizeof(IMAGE_DATA_DIRECTORY));
+
+    // the bound imports in header slack are overwritten by the section table
+    PIMAGE_DATA_DIRECTORY pBoundEntry = &pDataDir[IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT];
+    if(view->dirnum > IMAGE_DIRECTORY_ENTRY_BOUND_IMPORT && pBoundEntry->VirtualAddress 
+        && pBoundEntry->VirtualAddress < tableend)
+    {
+        pBoundEntry->VirtualAddress = 0;
+        pBoundEntry->Size = 0;
+    }
+
+    // the security dir VirtualAddress is a file offset
+    PIMAGE_DATA_DIRECTORY pSecurityEntry = &pDataDir[IMAGE_DIRECTORY_ENTRY_SECURITY];
+    if(view->dirnum > IMAGE_DIRECTORY_ENTRY_SECURITY && pSecurityEntry->VirtualAddress)
+    {
+        pSecurityEntry->VirtualAddress = winpe_rewrite_mapoffset(rw, pSecurityEntry->VirtualAddress);
+        if(!pSecurityEntry->VirtualAddress) pSecurityEntry->Size = 0;
+    }
+
+    // the debug entries PointerToRawData are file offsets inside the copied sections
+    DWORD debugsize = 0;
+    PIMAGE_DEBUG_DIRECTORY pDebugDir = (PIMAGE_DEBUG_DIRECTORY)winpe_view_dir(view, IMAGE_DIRECTORY_ENTRY_DEBUG, &debugsize);
+    for(DWORD i=0; pDebugDir && i < debugsize / sizeof(IMAGE_DEBUG_DIRECTORY); i++)
+    {
+        DWORD ptr = pDebugDir[i].PointerToRawData;
+        DWORD newptr = ptr ? winpe_rewrite_mapoffset(rw, ptr) : 0;
+        DWORD offset = winpe_rewrite_mapoffset(rw, (DWORD)((const uint8_t*)&pDebugDir[i].PointerToRawData - base));
+        if(newptr == ptr || !offset) continue;
+        if(offset + sizeof(DWORD) <= headersize) *(DWORD*)(rw->header + offset) = newptr;
+        else if(rw->patchnum < WINPE_REWRITE_MAXPATCH)
+        {
+            // keep ascending without overlapping
+            DWORD j = rw->patchnum;
+            while(j>0 && rw->patches[j-1].offset >= offset) j--;
+            if(j>0 && rw->patches[j-1].offset + sizeof(DWORD) > offset) continue;
+            if(j<rw->patchnum && offset + sizeof(DWORD) > rw->patches[j].offset) continue;
+            for(DWORD k=rw->patchnum; k>j; k--) rw->patches[k] = rw->patches[k-1];
+            rw->patches[j].offset = offset;
+            rw->patches[j].value = newptr;
+            rw->patchnum++;
+        }
+    }
+
+    // sum the output once before writing, as the CheckSum is in headers
+    if(rw->checksum)
+    {
+        WINPE_REWRITEOUT out;
+        inl_memset(&out, 0, sizeof(out));
+        out.rw = rw;
+        winpe_rewrite_stream(&out);
+        rw->checksum = winpe_checksum_final(out.sum16, 0, rw->filesize);
+        pNewOptHeader->CheckSum = rw->checksum;
+    }
+    return rw->filesize;
+}
+
+size_t STDCALL winpe_rewrite_write(PWINPE_REWRITER rw, PFN_WINPE_WRITE pfnwrite, void *arg)
+{
+    if(!pfnwrite) return 0;
+    if(!rw->header && !winpe_rewrite_layout(rw)) return 0;
+    WINPE_REWRITEOUT out;
+    inl_memset(&out, 0, sizeof(out));
+    out.rw = rw;
+    out.pfnwrite = pfnwrite;
+    out.arg = arg;
+    return winpe_rewrite_stream(&out);
+}
+
+static size_t STDCALL winpe_rewrite_fwrite(void *arg, const void *buf, size_t size)
+{
+    return fwrite(buf, 1, size, (FILE*)arg);
+}
+
+size_t STDCALL winpe_rewrite_file(PWINPE_REWRITER rw, const char *path)
+{
+    if(!rw->header && !winpe_rewrite_layout(rw)) return 0;
+    FILE *fp = fopen(path, "wb");
+    if(!fp) return 0;
+    setvbuf(fp, NULL, _IOFBF, 0x100000);
+    size_t size = winpe_rewrite_write(rw, winpe_rewrite_fwrite, fp);
+    if(fclose(fp) != 0) size = 0;
+    return size;
+}
+
+void STDCALL winpe_rewrite_free(PWINPE_REWRITER rw)
+{
+    if(rw->header) free(rw->header);
+    rw->header = NULL;
+}
+
+// PE resource functions
+static INLINE WORD winpe_res_upper(WORD c)
+{
+    return c >= 'a' && c <= 'z' ? c - 0x20 : c;
+}
+
+static int winpe_res_cmpkey(const WINPE_RESINDEX *index, DWORD key1, DWORD key2)
+{
+    // strings are before ids as the resource dir, strings ignore ascii case
+    if(!(key1 & WINPE_RES_STRINGFLAG) || !(key2 & WINPE_RES_STRINGFLAG))
+    {
+        if(key1 & WINPE_RES_STRINGFLAG) return -1;
+        if(key2 & WINPE_RES_STRINGFLAG) return 1;
+        return key1 < key2 ? -1 : key1 > key2;
+    }
+    WORD len1 = 0, len2 = 0;
+    const WORD *str1 = winpe_resname(index, key1, &len1);
+    const WORD *str2 = winpe_resname(index, key2, &len2);
+    for(WORD i=0; i<len1 && i<len2; i++)
+    {
+        WORD c1 = winpe_res_upper(str1[i]), c2 = winpe_res_upper(str2[i]);
+        if(c1 != c2) return c1 < c2 ? -1 : 1;
+    }
+    return len1 < len2 ? -1 : len1 > len2;
+}
+
+static int winpe_res_cmpentry(const WINPE_RESINDEX *index, const WINPE_RESENTRY *entry1, const WINPE_RESENTRY *entry2)
+{
+    int cmp = winpe_res_cmpkey(index, entry1->type, entry2->type);
+    if(!cmp) cmp = winpe_res_cmpkey(index, entry1->name, entry2->name);
+    if(!cmp) cmp = winpe_res_cmpkey(index, entry1->lang, entry2->lang);
+    return cmp;
+}
+
+static int winpe_res_cmpquery(const WINPE_RESINDEX *index, const WORD *query, DWORD key)
+{
+    if((size_t)query <= MAXWORD)
+    {
+        if(key & WINPE_RES_STRINGFLAG) return 1;
+        return (DWORD)(size_t)query < key ? -1 : (DWORD)(size_t)query > key;
+    }
+    if(!(key & WINPE_RES_STRINGFLAG)) return -1;
+    WORD len = 0, i = 0;
+    const WORD *str = winpe_resname(index, key, &len);
+    for(; query[i] && i<len; i++)
+    {
+        WORD c1 = winpe_res_upper(query[i]), c2 = winpe_res_upper(str[i]);
+        if(c1 != c2) return c1 < c2 ? -1 : 1;
+    }
+    if(query[i]) return 1;
+    return i < len ? -1 : 0;
+}
+
+static PIMAGE_RESOURCE_DIRECTORY_ENTRY winpe_res_dirent(const WINPE_VIEW *view, DWORD rsrcrva, 
+    DWORD offset, DWORD *pnum)
+{
+    // the entries of the dir at offset, all in bounds
+    *pnum = 0;
+    size_t dirrva = (size_t)rsrcrva + offset;
+    PIMAGE_RESOURCE_DIRECTORY pDir = (PIMAGE_RESOURCE_DIRECTORY)winpe_view_ptr(view, 
+        dirrva, sizeof(IMAGE_RESOURCE_DIRECTORY));
+    if(!pDir) return NULL;
+    DWORD num = (DWORD)pDir->NumberOfNamedEntries + pDir->NumberOfIdEntries;
+    PIMAGE_RESOURCE_DIRECTORY_ENTRY pEntry = (PIMAGE_RESOURCE_DIRECTORY_ENTRY)winpe_view_ptr(view, 
+        dirrva + sizeof(IMAGE_RESOURCE_DIRECTORY), num * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY));
+    if(pEntry) *pnum = num;
+    return pEntry;
+}
+
+static DWORD winpe_res_walk(const WINPE_VIEW *view, DWORD rsrcrva, PWINPE_RESENTRY entries)
+{
+    // type | name | lang dirs to the data entries, entries NULL for counting
+    DWORD count = 0, typenum = 0, namenum = 0, langnum = 0;
+    PIMAGE_RESOURCE_DIRECTORY_ENTRY pTypeEntry = winpe_res_dirent(view, rsrcrva, 0, &typenum);
+    for(DWORD i=0; i<typenum; i++)
+    {
+        if(!(pTypeEntry[i].OffsetToData & WINPE_RES_STRINGFLAG)) continue;
+        PIMAGE_RESOURCE_DIRECTORY_ENTRY pNameEntry = winpe_res_dirent(view, rsrcrva, 
+            pTypeEntry[i].OffsetToData & ~WINPE_RES_STRINGFLAG, &namenum);
+        for(DWORD j=0; j<namenum; j++)
+        {
+            if(!(pNameEntry[j].OffsetToData & WINPE_RES_STRINGFLAG)) continue;
+            PIMAGE_RESOURCE_DIRECTORY_ENTRY pLangEntry = winpe_res_dirent(view, rsrcrva, 
+                pNameEntry[j].OffsetToData & ~WINPE_RES_STRINGFLAG, &langnum);
+            for(DWORD k=0; k<langnum; k++)
+            {
+                if(pLangEntry[k].OffsetToData & WINPE_RES_STRINGFLAG) continue;
+                PIMAGE_RESOURCE_DATA_ENTRY pDataEntry = (PIMAGE_RESOURCE_DATA_ENTRY)winpe_view_ptr(view, 
+                    (size_t)rsrcrva + pLangEntry[k].OffsetToData, sizeof(IMAGE_RESOURCE_DATA_ENTRY));
+                if(!pDataEntry) continue;
+                if(count >= WINPE_RES_MAXENTRY) return count;
+                if(entries)
+                {
+                    PWINPE_RESENTRY entry = &entries[count];
+                    entry->type = pTypeEntry[i].Name;
+                    entry->name = pNameEntry[j].Name;
+                    entry->lang = pLangEntry[k].Name;
+                    entry->rva = pDataEntry->OffsetToData;
+                    entry->size = pDataEntry->Size;
+                    entry->codepage = pDataEntry->CodePage;
+                    entry->data = NULL;
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+size_t STDCALL winpe_resindex(const WINPE_VIEW *view, void *buf, size_t bufsize)
+{
+    DWORD rsrcrva = 0;
+    if(view->dirnum > IMAGE_DIRECTORY_ENTRY_RESOURCE)
+    {
+        rsrcrva = view->datadir[IMAGE_DIRECTORY_ENTRY_RESOURCE].VirtualAddress;
+    }
+    DWORD count = rsrcrva ? winpe_res_walk(view, rsrcrva, NULL) : 0;
+    size_t indexsize = sizeof(WINPE_RESINDEX) + (count ? count - 1 : 0) * sizeof(WINPE_RESENTRY);
+    if(!buf) return indexsize;
+    if(bufsize < indexsize) return 0;
+
+    PWINPE_RESINDEX index = (PWINPE_RESINDEX)buf;
+    inl_memcpy(&index->view, view, sizeof(WINPE_VIEW));
+    index->rsrcrva = rsrcrva;
+    index->count = count ? winpe_res_walk(view, rsrcrva, index->entries) : 0;
+
+    // the dir is usually sorted, else shell sort for the binary search
+    DWORD i = 1;
+    while(i < count && winpe_res_cmpentry(index, &index->entries[i-1], &index->entries[i]) <= 0) i++;
+    if(i < count)
+    {
+        DWORD gap = 1;
+        while(gap < count / 3) gap = gap * 3 + 1;
+        for(; gap; gap /= 3)
+        {
+            for(i=gap; i<count; i++)
+            {
+                WINPE_RESENTRY entry = index->entries[i];
+                DWORD j = i;
+                for(; j>=gap && winpe_res_cmpentry(index, &index->entries[j-gap], &entry) > 0; j -= gap)
+                {
+                    index->entries[j] = index->entries[j-gap];
+                }
+                index->entries[j] = entry;
+            }
+        }
+    }
+    return indexsize;
+}
+
+PWINPE_RESENTRY STDCALL winpe_resfind(const void *index, const WORD *type, const WORD *name, WORD lang)
+{
+    // the lower bound of type, name, lang
+    PWINPE_RESINDEX pIndex = (PWINPE_RESINDEX)index;
+    DWORD lo = 0, hi = pIndex->count;
+    while(lo < hi)
+    {
+        DWORD mid = lo + (hi - lo) / 2;
+        const WINPE_RESENTRY *entry = &pIndex->entries[mid];
+        int cmp = winpe_res_cmpquery(pIndex, type, entry->type);
+        if(!cmp) cmp = winpe_res_cmpquery(pIndex, name, entry->name);
+        if(!cmp && lang) cmp = winpe_res_cmpquery(pIndex, (const WORD*)(size_t)lang, entry->lang);
+        if(cmp > 0) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo >= pIndex->count) return NULL;
+    PWINPE_RESENTRY entry = &pIndex->entries[lo];
+    if(winpe_res_cmpquery(pIndex, type, entry->type)) return NULL;
+    if(winpe_res_cmpquery(pIndex, name, entry->name)) return NULL;
+    if(lang && winpe_res_cmpquery(pIndex, (const WORD*)(size_t)lang, entry->lang)) return NULL;
+    return entry;
+}
+
+const void* STDCALL winpe_resdata(const void *index, const WINPE_RESENTRY *entry)
+{
+    const WINPE_RESINDEX *pIndex = (const WINPE_RESINDEX *)index;
+    if(entry->data) return entry->data;
+    return winpe_view_ptr(&pIndex->view, entry->rva, entry->size);
+}
+
+const WORD* STDCALL winpe_resname(const void *index, DWORD key, WORD *plen)
+{
+    const WINPE_RESINDEX *pIndex = (const WINPE_RESINDEX *)index;
+    if(plen) *plen = 0;
+    if(!(key & WINPE_RES_STRINGFLAG)) return NULL;
+    size_t rva = (size_t)pIndex->rsrcrva + (key & ~WINPE_RES_STRINGFLAG);
+    const WORD *pLength = (const WORD*)winpe_view_ptr(&pIndex->view, rva, sizeof(WORD));
+    if(!pLength) return NULL;
+    const WORD *str = (const WORD*)winpe_view_ptr(&pIndex->view, rva + sizeof(WORD), *pLength * sizeof(WORD));
+    if(str && plen) *plen = *pLength;
+    return str;
+}
+
+static DWORD winpe_res_putkey(const WINPE_RESINDEX *index, DWORD key, uint8_t *buf, DWORD *pstroffset)
+{
+    // copy the string as IMAGE_RESOURCE_DIR_STRING_U
+    if(!(key & WINPE_RES_STRINGFLAG)) return key;
+    WORD len = 0;
+    const WORD *str = winpe_resname(index, key, &len);
+    DWORD offset = *pstroffset;
+    *(WORD*)(buf + offset) = len;
+    if(str) inl_memcpy(buf + offset + sizeof(WORD), str, len * sizeof(WORD));
+    *pstroffset += sizeof(WORD) + len * sizeof(WORD);
+    return WINPE_RES_STRINGFLAG | offset;
+}
+
+static void winpe_res_putdir(uint8_t *buf, DWORD offset, DWORD namednum, DWORD idnum)
+{
+    PIMAGE_RESOURCE_DIRECTORY pDir = (PIMAGE_RESOURCE_DIRECTORY)(buf + offset);
+    pDir->NumberOfNamedEntries = (WORD)namednum;
+    pDir->NumberOfIdEntries = (WORD)idnum;
+}
+
+size_t STDCALL winpe_resbuild(const void *index, DWORD rva, void *buf, size_t bufsize)
+{
+    const WINPE_RESINDEX *pIndex = (const WINPE_RESINDEX *)index;
+    const WINPE_RESENTRY *entries = pIndex->entries;
+    DWORD count = pIndex->count;
+    WORD len = 0;
+
+    // count the dirs and strings, as the entries are sorted
+    DWORD typenum = 0, namenum = 0;
+    uint64_t strsize = 0, datasize = 0;
+    for(DWORD i=0; i<count; i++)
+    {
+        const WINPE_RESENTRY *entry = &entries[i];
+        bool_t newtype = !i || winpe_res_cmpkey(pIndex, entries[i-1].type, entry->type);
+        bool_t newname = newtype || winpe_res_cmpkey(pIndex, entries[i-1].name, entry->name);
+        if(newtype && winpe_resname(pIndex, entry->type, &len)) strsize += sizeof(WORD) * (1 + len);
+        if(newname && winpe_resname(pIndex, entry->name, &len)) strsize += sizeof(WORD) * (1 + len);
+        if(winpe_resname(pIndex, entry->lang, &len)) strsize += sizeof(WORD) * (1 + len);
+        typenum += newtype;
+        namenum += newname;
+        datasize = ((datasize + 7) & ~7ULL) + entry->size;
+    }
+    DWORD dirsize = (1 + typenum + namenum) * sizeof(IMAGE_RESOURCE_DIRECTORY) + 
+        (typenum + namenum + count) * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+    uint64_t stroffset = dirsize + (uint64_t)count * sizeof(IMAGE_RESOURCE_DATA_ENTRY);
+    uint64_t dataoffset = (stroffset + strsize + 7) & ~7ULL;
+    uint64_t rsrcsize = dataoffset + datasize;
+    if(rsrcsize > 0x7fffffff) return 0;
+    if(!buf) return (size_t)rsrcsize;
+    if(bufsize < rsrcsize) return 0;
+
+    // root | type dirs | name dirs | data entries | strings | data
+    uint8_t *p = (uint8_t*)buf;
+    inl_memset(p, 0, (size_t)rsrcsize);
+    DWORD rootent = sizeof(IMAGE_RESOURCE_DIRECTORY);
+    DWORD typedir = rootent + typenum * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+    DWORD namedir = typedir + typenum * sizeof(IMAGE_RESOURCE_DIRECTORY) + namenum * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+    DWORD dataent = namedir + namenum * sizeof(IMAGE_RESOURCE_DIRECTORY) + count * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+    DWORD strcur = (DWORD)stroffset, datacur = (DWORD)dataoffset;
+    DWORD typeent = 0, nameent = 0, typenamed = 0;
+    for(DWORD i=0; i<count; i++)
+    {
+        const WINPE_RESENTRY *entry = &entries[i];
+        const void *data = winpe_resdata(pIndex, entry);
+        if(!data && entry->size) return 0;
+        PIMAGE_RESOURCE_DIRECTORY_ENTRY pEntry;
+        bool_t newtype = !i || winpe_res_cmpkey(pIndex, entries[i-1].type, entry->type);
+        bool_t newname = newtype || winpe_res_cmpkey(pIndex, entries[i-1].name, entry->name);
+        if(newtype)
+        {
+            // count the names of this type, then the type dir
+            DWORD n = 0, named = 0;
+            for(DWORD j=i; j<count && !winpe_res_cmpkey(pIndex, entries[j].type, entry->type); j++)
+            {
+                if(j==i || winpe_res_cmpkey(pIndex, entries[j-1].name, entries[j].name)) 
+                {
+                    n++;
+                    named += (entries[j].name & WINPE_RES_STRINGFLAG) != 0;
+                }
+            }
+            pEntry = (PIMAGE_RESOURCE_DIRECTORY_ENTRY)(p + rootent);
+            pEntry->Name = winpe_res_putkey(pIndex, entry->type, p, &strcur);
+            pEntry->OffsetToData = WINPE_RES_STRINGFLAG | typedir;
+            rootent += sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+            typenamed += (entry->type & WINPE_RES_STRINGFLAG) != 0;
+            winpe_res_putdir(p, typedir, named, n - named);
+            typeent = typedir + sizeof(IMAGE_RESOURCE_DIRECTORY);
+            typedir = typeent + n * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+        }
+        if(newname)
+        {
+            // count the langs of this name, then the name dir
+            DWORD n = 0, named = 0;
+            for(DWORD j=i; j<count && !winpe_res_cmpkey(pIndex, entries[j].type, entry->type) 
+                && !winpe_res_cmpkey(pIndex, entries[j].name, entry->name); j++)
+            {
+                n++;
+                named += (entries[j].lang & WINPE_RES_STRINGFLAG) != 0;
+            }
+            pEntry = (PIMAGE_RESOURCE_DIRECTORY_ENTRY)(p + typeent);
+            pEntry->Name = winpe_res_putkey(pIndex, entry->name, p, &strcur);
+            pEntry->OffsetToData = WINPE_RES_STRINGFLAG | namedir;
+            typeent += sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+            winpe_res_putdir(p, namedir, named, n - named);
+            nameent = namedir + sizeof(IMAGE_RESOURCE_DIRECTORY);
+            namedir = nameent + n * sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+        }
+
+        // lang entry | data entry | data
+        pEntry = (PIMAGE_RESOURCE_DIRECTORY_ENTRY)(p + nameent);
+        pEntry->Name = winpe_res_putkey(pIndex, entry->lang, p, &strcur);
+        pEntry->OffsetToData = dataent;
+        nameent += sizeof(IMAGE_RESOURCE_DIRECTORY_ENTRY);
+        PIMAGE_RESOURCE_DATA_ENTRY pDataEntry = (PIMAGE_RESOURCE_DATA_ENTRY)(p + dataent);
+        pDataEntry->OffsetToData = rva + datacur;
+        pDataEntry->Size = entry->size;
+        pDataEntry->CodePage = entry->codepage;
+        dataent += sizeof(IMAGE_RESOURCE_DATA_ENTRY);
+        if(entry->size) inl_memcpy(p + datacur, data, entry->size);
+        datacur = (datacur + entry->size + 7) & ~7;
+    }
+    winpe_res_putdir(p, 0, typenamed, typenum - typenamed);
+    return (size_t)rsrcsize;
+}
+
 #endif // WINPE_IMPLEMENTATION
 #endif // _WINPE_H
 
@@ -1064,4 +5052,33 @@ size_t STDCALL winpe_appendsecth(void *pe, PIMAGE_SECTION_HEADER psecth)
  * v0.3.5, add winpe_memfindexpcrc32
  * v0.3.6, add AT&T format asm for gcc, improve macro style and comment
  * v0.3.7, seperate some macro to commdef
+ * v0.3.8, winpe_memreloc dispatch reloc type with bounds check, add winpe_memrelocex for threads
+ * v0.3.9, winpe_memfindexp by binary search, add winpe_memfindexphint, winpe_memexpindex, winpe_membindiatex
+ * v0.3.10, table driven crc32 in winpe_memfindexpcrc32, add winpe_memexpcrc32index
+ * v0.3.11, winpe_memforwardexp with loop detect and api set, add winpe_memforwardexpex with cache
+ * v0.3.12, add WINPE_BINDFLAG_LAZY for lazy binding iat by stubs, winpe_memlazybind
+ * v0.3.13, add winpe_memLoadLibrarySet to load modules depending on each other in memory
+ * v0.3.14, add winpe_mapfile, winpe_unmapfile, winpe_memload_file by the mapped view
+ * v0.3.15, add WINPE_ALLOCATOR, winpe_memload_fileex, winpe_overlayload_fileex, winpe_memLoadLibraryAllocator
+ * v0.3.16, add winpe_overlayrange with certificate table, winpe_overlayopen_file by headers only
+ * v0.3.17, add winpe_vmmap_snapshot, winpe_vmmap_findspace for searching space in O(log n)
+ * v0.3.18, add winpe_memsection_create, winpe_memLoadLibrarySection for sharing pages by section
+ * v0.3.19, add winpe_rtmcheck, winpe_memLoadLibraryRtm for ready-to-map image by winrtm.py
+ * v0.3.20, add winpe_memlz4decode for compressed module in windllin
+ * v0.3.21, add winpe_view for portable bounds-checked parsing, build without windows.h on posix
+ * v0.3.22, dispatch pe32 and pe32+ by magic once, thunk loops specialized by bitness
+ * v0.3.23, add winpe_ctx to parse headers once for lookups, winpe_memfind* by ctx
+ * v0.3.24, add winpe_checksum the same as CheckSumMappedFile by sse2, winpe_checksum_update for changed ranges
+ * v0.3.25, add winpe_rewrite functions to collect pe edits, layout once and stream the output
+ * v0.3.26, add winpe_resindex for resource lookup by binary search, winpe_resbuild to rebuild resource dir
+ * v0.3.27, winpe_findmoduleaex of current process by module cache, invalidated when ldr list changed
+ * v0.3.28, winpe_memreloc returns (size_t)-1 if invalid and checks all blocks before fixups, 0 for no reloc
+ * v0.3.29, lazy bind walks thunks by view with FirstThunk fallback, raise exception if an import can not be resolved
+ * v0.3.30, winpe_memLoadLibraryRtm fails if an import dll not loaded, rebase rtm reloc32 list by 4 bytes
+ * v0.3.31, winpe_memrelocex splits and checks the reloc blocks by view, the same as winpe_memreloc
+ * v0.3.32, winpe_findmoduleaex by shared inl_findmodule, cached entries checked on ldr list
+ * v0.3.33, winpe_memrelocblock checks highadj bound without delta, winpe_memreloc fails if fixup pass fails
+ * v0.3.34, forward cache keyed by (dllbase, exprva) with name hash and bounded probe, add winpe_memforwardexpflush
+ * v0.3.35, module cache dropped by ldr list stamp, cached links read only after found on list
+ * v0.3.36, winpe_memfindexpcrc32 and winpe_memexpcrc32index use a process crc32 table built once
 */
\ No newline at end of file
@@ -0,0 +1,288 @@
+# -*- coding: utf-8 -*-
+__version__ = "0.1.1"
+__description__ = f"""
+convert windows pe to ready-to-map (rtm) image for winpe_memLoadLibraryRtm,
+the image is laid out by section alignment with relocs applied for a base,
+and a reloc bitmap for rebasing, a flat import list for binding
+    v{__version__}, developed by devseed
+"""
+
+import os
+import struct
+import argparse
+from typing import List, Tuple
+
+RTM_MAGIC = 0x304D5452 # "RTM0"
+RTM_PAGESIZE = 0x1000
+RTM_IMAGEALIGN = 0x1000
+RTM_ORDINALFLAG = 0x80000000
+
+class rtm_hdr_t(struct.Struct):
+    """
+    the same as WINPE_RTMHDR in winpe.h
+    """
+    def __init__(self, data=None):
+        super().__init__('<2IQ10I')
+        self.magic = RTM_MAGIC
+        self.hdrsize = self.size
+        self.imagebase = 0
+        self.imagesize = 0
+        self.ptrsize = 0
+        self.imageoffset = 0
+        self.pagemapoffset = 0
+        self.pagemapsize = 0
+        self.relocmapoffset = 0
+        self.relocmapsize = 0
+        self.impoffset = 0
+        self.impnum = 0
+        self.reloc32num = 0
+        if data is not None:
+            self.frombytes(data)
+
+    def frombytes(self, data):
+        (self.magic, self.hdrsize, self.imagebase,
+        self.imagesize, self.ptrsize, self.imageoffset,
+        self.pagemapoffset, self.pagemapsize,
+        self.relocmapoffset, self.relocmapsize,
+        self.impoffset, self.impnum, self.reloc32num) = self.unpack_from(data)
+
+    def tobytes(self):
+        return self.pack(self.magic, self.hdrsize, self.imagebase,
+            self.imagesize, self.ptrsize, self.imageoffset,
+            self.pagemapoffset, self.pagemapsize,
+            self.relocmapoffset, self.relocmapsize,
+            self.impoffset, self.impnum, self.reloc32num)
+
+class Pe:
+    """
+    minimal pe parser for pe32 and pe32+, no lief needed
+    """
+    def __init__(self, data=None):
+        if data is not None:
+            self.parse(data)
+
+    def parse(self, data):
+        self.content = data
+        if data[:2] != b'MZ':
+            raise ValueError("invalid dos signature")
+        self.e_lfanew = struct.unpack_from('<I', data, 0x3c)[0]
+        if data[self.e_lfanew: self.e_lfanew+4] != b'PE\0\0':
+            raise ValueError("invalid nt signature")
+        filehdr = self.e_lfanew + 4
+        (self.machine, self.nsect, _, _, _,
+            self.sizeof_opthdr, _) = struct.unpack_from('<2H3I2H', data, filehdr)
+        self.opthdr = filehdr + 20
+        self.magic = struct.unpack_from('<H', data, self.opthdr)[0]
+        if self.magic == 0x20b:
+            self.ptrsize = 8
+            self.imagebase_offset = self.opthdr + 24
+            self.imagebase = struct.unpack_from('<Q', data, self.imagebase_offset)[0]
+            datadir = self.opthdr + 112
+        elif self.magic == 0x10b:
+            self.ptrsize = 4
+            self.imagebase_offset = self.opthdr + 28
+            self.imagebase = struct.unpack_from('<I', data, self.imagebase_offset)[0]
+            datadir = self.opthdr + 96
+        else: raise ValueError(f"invalid optional header magic {self.magic:x}")
+        (self.entry,) = struct.unpack_from('<I', data, self.opthdr + 16)
+        (self.sizeof_image, self.sizeof_headers) = struct.unpack_from('<2I', data, self.opthdr + 56)
+        ndir = struct.unpack_from('<I', data, datadir - 4)[0]
+        self.datadirs = [struct.unpack_from('<2I', data, datadir + 8*i)
+            if i < ndir else (0, 0) for i in range(16)]
+        self.sections = []
+        offset = self.opthdr + self.sizeof_opthdr
+        for i in range(self.nsect):
+            (name, vsize, va, rawsize, rawoffset) = struct.unpack_from('<8s4I', data, offset)
+            self.sections.append((name, vsize, va, rawsize, rawoffset))
+            offset += 40
+
+    def memlayout(self) -> bytearray:
+        """
+        layout the pe by section alignment, the same as winpe_memload
+        """
+        data = self.content
+        image = bytearray(self.sizeof_image)
+        headersize = min(self.sizeof_headers, len(data), self.sizeof_image)
+        image[:headersize] = data[:headersize]
+        for (name, vsize, va, rawsize, rawoffset) in self.sections:
+            if rawoffset >= len(data) or va >= self.sizeof_image: continue
+            size = min(rawsize, len(data) - rawoffset, self.sizeof_image - va)
+            image[va: va+size] = data[rawoffset: rawoffset+size]
+        return image
+
+    def relocs(self, image) -> List[Tuple[int, int]]:
+        """
+        :return: [(rva, width)] of HIGHLOW (4 bytes) or DIR64 (8 bytes) relocs
+        """
+        rvas = []
+        relocrva, relocsize = self.datadirs[5]
+        offset = 0
+        while offset + 8 <= relocsize:
+            pagerva, blocksize = struct.unpack_from('<2I', image, relocrva + offset)
+            if blocksize == 0: break
+            for i in range((blocksize - 8)//2):
+                item = struct.unpack_from('<H', image, relocrva + offset + 8 + 2*i)[0]
+                reloctype, rva = item >> 12, pagerva + (item & 0xfff)
+                if reloctype == 0: continue # ABSOLUTE padding
+                elif reloctype == 3: rvas.append((rva, 4)) # HIGHLOW
+                elif reloctype == 10 and self.ptrsize == 8: rvas.append((rva, 8)) # DIR64
+                else: raise NotImplementedError(f"reloc type {reloctype} at {rva:x}")
+            offset += blocksize
+        return rvas
+
+    def imports(self, image) -> List[Tuple[int, int, int]]:
+        """
+        :return: [(iatrva, dllnamerva, hintnamerva|RTM_ORDINALFLAG + ordinal)]
+        """
+        imps = []
+        imprva, impsize = self.datadirs[1]
+        if imprva == 0: return imps
+        ordflag = 1 << (self.ptrsize * 8 - 1)
+        fmt = '<Q' if self.ptrsize == 8 else '<I'
+        offset = imprva
+        while True:
+            (oft, _, _, namerva, ft) = struct.unpack_from('<5I', image, offset)
+            if namerva == 0: break
+            thunkrva = oft if oft else ft
+            i = 0
+            while True:
+                thunk = struct.unpack_from(fmt, image, thunkrva + i*self.ptrsize)[0]
+                if thunk == 0: break
+                if thunk & ordflag: name = RTM_ORDINALFLAG | (thunk & 0xffff)
+                else: name = thunk & 0x7fffffff
+                imps.append((ft + i*self.ptrsize, namerva, name))
+                i += 1
+            offset += 20
+        return imps
+
+def convert_rtm(data, imagebase=None) -> bytes:
+    """
+    convert pe to rtm image
+    :param imagebase: the base relocs applied for, None for the origin imagebase
+    :return: rtm data
+    """
+    pe = Pe(data)
+    image = pe.memlayout()
+    if imagebase is None: imagebase = pe.imagebase
+    delta = imagebase - pe.imagebase
+
+    # apply relocs and make bitmap, one bit for each ptrsize reloc address,
+    # HIGHLOW in pe32+ is 4 bytes, so it is in the reloc32 list instead
+    pagenum = (pe.sizeof_image + RTM_PAGESIZE - 1) // RTM_PAGESIZE
+    pagemap = bytearray((pagenum + 7) // 8)
+    pagebitmaps = dict()
+    reloc32 = []
+    for (rva, width) in pe.relocs(image):
+        if rva + width > pe.sizeof_image:
+            raise ValueError(f"reloc out of image at {rva:x}")
+        fmt = '<Q' if width == 8 else '<I'
+        value = struct.unpack_from(fmt, image, rva)[0]
+        struct.pack_into(fmt, image, rva, (value + delta) & ((1 << (width * 8)) - 1))
+        if width != pe.ptrsize:
+            reloc32.append(rva)
+            continue
+        page = rva // RTM_PAGESIZE
+        pagemap[page//8] |= 1 << (page%8)
+        if page not in pagebitmaps:
+            pagebitmaps[page] = bytearray(RTM_PAGESIZE // 8)
+        bit = rva % RTM_PAGESIZE
+        pagebitmaps[page][bit//8] |= 1 << (bit%8)
+    relocmap = b''.join(pagebitmaps[page] for page in sorted(pagebitmaps))
+    struct.pack_into('<Q' if pe.ptrsize == 8 else '<I', image, pe.imagebase_offset, imagebase)
+
+    # flat import list, in dll order for binding, then reloc32 list
+    imps = pe.imports(image)
+    impdata = b''.join(struct.pack('<3I', *imp) for imp in imps)
+    impdata += b''.join(struct.pack('<I', rva) for rva in reloc32)
+
+    hdr = rtm_hdr_t()
+    hdr.imagebase = imagebase
+    hdr.imagesize = pe.sizeof_image
+    hdr.ptrsize = pe.ptrsize
+    hdr.pagemapoffset = hdr.size
+    hdr.pagemapsize = len(pagemap)
+    hdr.relocmapoffset = hdr.pagemapoffset + hdr.pagemapsize
+    hdr.relocmapsize = len(relocmap)
+    hdr.impoffset = (hdr.relocmapoffset + hdr.relocmapsize + 3) & ~3
+    hdr.impnum = len(imps)
+    hdr.reloc32num = len(reloc32)
+    imageoffset = hdr.impoffset + len(impdata)
+    hdr.imageoffset = (imageoffset + RTM_IMAGEALIGN - 1) & ~(RTM_IMAGEALIGN - 1)
+    rtm = bytearray(hdr.tobytes())
+    rtm += pagemap + relocmap
+    rtm += bytes(hdr.impoffset - len(rtm)) + impdata
+    rtm += bytes(hdr.imageoffset - len(rtm)) + image
+    return bytes(rtm)
+
+def rebase_rtm(rtm, imagebase) -> bytearray:
+    """
+    rebase the image in rtm by the reloc bitmap, the same as winpe_memLoadLibraryRtm
+    :return: image
+    """
+    hdr = rtm_hdr_t(rtm)
+    image = bytearray(rtm[hdr.imageoffset: hdr.imageoffset + hdr.imagesize])
+    delta = imagebase - hdr.imagebase
+    fmt = '<Q' if hdr.ptrsize == 8 else '<I'
+    mask = (1 << (hdr.ptrsize * 8)) - 1
+    relocmap = hdr.relocmapoffset
+    for page in range(hdr.pagemapsize * 8):
+        if not rtm[hdr.pagemapoffset + page//8] & (1 << (page%8)): continue
+        for i in range(RTM_PAGESIZE):
+            if rtm[relocmap + i//8] & (1 << (i%8)):
+                rva = page * RTM_PAGESIZE + i
+                value = struct.unpack_from(fmt, image, rva)[0]
+                struct.pack_into(fmt, image, rva, (value + delta) & mask)
+        relocmap += RTM_PAGESIZE // 8
+    reloc32offset = hdr.impoffset + 12 * hdr.impnum
+    for i in range(hdr.reloc32num):
+        rva = struct.unpack_from('<I', rtm, reloc32offset + 4*i)[0]
+        value = struct.unpack_from('<I', image, rva)[0]
+        struct.pack_into('<I', image, rva, (value + delta) & 0xffffffff)
+    struct.pack_into(fmt, image, Pe(image).imagebase_offset, imagebase)
+    return image
+
+def verify_rtm(data, rtm, imagebase=None) -> bool:
+    """
+    verify rebasing rtm is the same as applying relocs from the origin pe
+    """
+    pe = Pe(data)
+    hdr = rtm_hdr_t(rtm)
+    if hdr.magic != RTM_MAGIC: return False
+    if imagebase is None: imagebase = hdr.imagebase + 0x10000000
+    image1 = rebase_rtm(rtm, imagebase)
+    image2 = convert_rtm(data, imagebase)[hdr.imageoffset: hdr.imageoffset + hdr.imagesize]
+    if image1 != image2: return False
+    imps = [struct.unpack_from('<3I', rtm, hdr.impoffset + 12*i) for i in range(hdr.impnum)]
+    return imps == pe.imports(pe.memlayout())
+
+def main():
+    parser = argparse.ArgumentParser(description=__description__)
+    parser.add_argument('inpath', type=str)
+    parser.add_argument('--outpath', '-o', default=None)
+    parser.add_argument('--imagebase', '-b', type=lambda x: int(x, 0), default=None)
+    parser.add_argument('--verify', action="store_true")
+    args = parser.parse_args()
+    outpath = args.outpath
+    if outpath is None: outpath = os.path.splitext(args.inpath)[0] + ".rtm"
+
+    with open(args.inpath, 'rb') as fp:
+        data = fp.read()
+    rtm = convert_rtm(data, args.imagebase)
+    hdr = rtm_hdr_t(rtm)
+    print(f"convert {args.inpath} -> {outpath}, imagebase=0x{hdr.imagebase:x} "
+        f"imagesize=0x{hdr.imagesize:x} relocpages={hdr.relocmapsize//(RTM_PAGESIZE//8)} "
+        f"imports={hdr.impnum}")
+    if args.verify:
+        if not verify_rtm(data, rtm): raise ValueError("verify rtm failed")
+        print("verify rtm ok")
+    with open(outpath, 'wb') as fp:
+        fp.write(rtm)
+
+if __name__ == "__main__":
+    main()
+
+"""
+history:
+v0.1, inital version convert pe to ready-to-map image
+v0.1.1, HIGHLOW in pe32+ is rebased by 4 bytes in reloc32 list
+"""